@@ -63,6 +63,12 @@ void VG_(post_clo_init_configure_caches)(cache_t* I1c,
                                          cache_t* clo_D1c,
                                          cache_t* clo_LLc);
 
+// Parses a cache option value of the form "<size>,<assoc>,<line_size>",
+// as given to option opt, into *cache.  Exits with an error message if the
+// value is not valid.
+void VG_(parse_cache_opt)(cache_t* cache, const HChar* opt,
+                          const HChar* optval);
+
 void VG_(print_cache_clo_opts)(void);
 
 #endif   // __CG_ARCH_H
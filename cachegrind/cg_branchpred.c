@@ -34,6 +34,23 @@
    - a taken/not-taken predictor for conditional branches
    - a branch target address predictor for indirect branches
 
+   Each comes in several models, selected with --branch-predictor and
+   --indirect-predictor:
+
+   - simple (the default): 2-bit counters indexed by the branch address
+     and a few bits of global history, as found in processors of around
+     2004
+   - gshare: 2-bit counters indexed by the branch address xor'ed with a
+     longer global history
+   - tage: a base predictor plus tagged tables of counters, indexed with
+     geometrically increasing lengths of global history (a simplified
+     TAGE, after Seznec and Michaud, "A case for (partially) TAgged
+     GEometric history length branch prediction", JILP 2006)
+
+   - btac (the default): the last target of the branch
+   - ittage: tagged tables of targets, indexed as for tage (ITTAGE,
+     Seznec, "A 64-Kbytes ITTAGE indirect branch predictor", JWAC 2011)
+
    Function return-address prediction is not modelled, on the basis
    that return stack predictors almost always predict correctly, and
    also that it is difficult for Valgrind to robustly identify
@@ -69,9 +86,7 @@
    makes the predictor able to correlate this branch's behaviour with
    that of other branches. 
 
-   TODO: use predictor written by someone who understands this stuff.
-   Perhaps it would be better to move to a standard GShare predictor
-   and/or tournament predictor.
+   This is the "simple" model.
 */
 /* The index is composed of N_HIST bits at the top and N_IADD bits at
    the bottom.  These numbers chosen somewhat arbitrarily, but note
@@ -88,7 +103,7 @@ static UWord shift_register = 0;   /* Contains global history */
 static UChar counters[N_COUNTERS]; /* Counter array; presumably auto-zeroed */
 
 
-static ULong do_cond_branch_predict ( Addr instr_addr, Word takenW )
+static ULong simple_cond_predict ( Addr instr_addr, Word takenW )
 {
    UWord indx;
    Bool  predicted_taken, actually_taken, mispredict;
@@ -137,7 +152,7 @@ static ULong do_cond_branch_predict ( Addr instr_addr, Word takenW )
 #define N_BTAC      (1 << N_BTAC_BITS)
 static Addr btac[N_BTAC]; /* BTAC; presumably auto-zeroed */
 
-static ULong do_ind_branch_predict ( Addr instr_addr, Addr actual )
+static ULong btac_ind_predict ( Addr instr_addr, Addr actual )
 {
    Bool mispredict;
    const UWord mask = (1 << N_BTAC_BITS) - 1;
@@ -150,6 +165,390 @@ static ULong do_ind_branch_predict ( Addr instr_addr, Addr actual )
 }
 
 
+/* Predictor models */
+typedef enum {
+   BP_Simple,
+   BP_GShare,
+   BP_TAGE
+} bp_cond_t;
+
+typedef enum {
+   BP_BTAC,
+   BP_ITTAGE
+} bp_ind_t;
+
+/* Longest global history (in branches) usable by the models */
+#define BP_MAX_HIST 512
+
+static bp_cond_t bp_cond = BP_Simple;
+static bp_ind_t  bp_ind  = BP_BTAC;
+static Int       bp_hist = 64;
+static Bool      bp_tagged = False;  /* tage or ittage in use? */
+
+static HChar     bp_desc_line[80];
+
+/* Global history of the models other than "simple".  It has the
+   outcomes of conditional branches, and two bits of the target of
+   each indirect branch.  ghist[ghist_pos] is the most recent bit. */
+#define GHIST_SIZE 1024
+static UChar ghist[GHIST_SIZE];
+static UInt  ghist_pos = 0;
+static ULong ghist_word = 0;  /* the most recent 64 bits, for gshare */
+
+/* The tagged tables of tage and ittage.  Both use the same history
+   lengths and table sizes, and so the same folded histories. */
+#define TAGE_TABLES     4
+#define TAGE_LOG_SIZE   10
+#define TAGE_TAG_BITS   9
+#define TAGE_MIN_HIST   4
+#define TAGE_BASE_BITS  13
+#define TAGE_AGE_PERIOD (1 << 18)   /* branches between aging u bits */
+
+/* The history of a tagged table, folded (xor'ed) down to the width of
+   the index and the tag together, and maintained incrementally as bits
+   are shifted in.  The low bits go into the index, the high bits into
+   the tag. */
+#define TAGE_FOLD_BITS  (TAGE_LOG_SIZE + TAGE_TAG_BITS)
+
+typedef struct {
+   Int  len;        /* history length */
+   Int  outpoint;   /* len % TAGE_FOLD_BITS */
+   UInt fold;
+} tage_hist;
+
+static tage_hist tage_h[TAGE_TABLES];
+
+static __inline__ void ghist_push ( UInt bit )
+{
+   UInt pos = (ghist_pos - 1) & (GHIST_SIZE - 1), out, f;
+   Int  i;
+
+   ghist_pos = pos;
+   ghist[pos] = bit;
+   ghist_word = (ghist_word << 1) | bit;
+   if (!bp_tagged)
+      return;
+   for (i = 0; i < TAGE_TABLES; i++) {
+      out = ghist[(pos + tage_h[i].len) & (GHIST_SIZE - 1)];
+      f = (tage_h[i].fold << 1) | bit;
+      f ^= out << tage_h[i].outpoint;
+      f ^= f >> TAGE_FOLD_BITS;
+      tage_h[i].fold = f & ((1 << TAGE_FOLD_BITS) - 1);
+   }
+}
+
+static __inline__ UWord tage_index ( UWord pc, Int i )
+{
+   return (pc ^ (pc >> (TAGE_LOG_SIZE - i)) ^ tage_h[i].fold)
+          & ((1 << TAGE_LOG_SIZE) - 1);
+}
+
+static __inline__ UShort tage_tag_of ( UWord pc, Int i )
+{
+   return (pc ^ (pc >> TAGE_TAG_BITS) ^ (tage_h[i].fold >> TAGE_LOG_SIZE))
+          & ((1 << TAGE_TAG_BITS) - 1);
+}
+
+
+/* gshare: 64k 2-bit counters, indexed by the branch address xor'ed
+   with the last min(bp_hist, 64) outcomes folded to 16 bits. */
+#define GSHARE_BITS 16
+static UChar gshare[1 << GSHARE_BITS];
+
+static ULong gshare_cond_predict ( Addr instr_addr, Word takenW )
+{
+   ULong h = bp_hist < 64 ? ghist_word & ((1ULL << bp_hist) - 1)
+                          : ghist_word;
+   UWord indx = ((instr_addr >> N_IADDR_LO_ZERO_BITS)
+                 ^ h ^ (h >> 16) ^ (h >> 32) ^ (h >> 48))
+                & ((1 << GSHARE_BITS) - 1);
+   Bool  predicted_taken = gshare[indx] >= 2;
+   Bool  actually_taken  = takenW > 0;
+
+   if (actually_taken) {
+      if (gshare[indx] < 3)
+         gshare[indx]++;
+   } else {
+      if (gshare[indx] > 0)
+         gshare[indx]--;
+   }
+   ghist_push(actually_taken ? 1 : 0);
+   return predicted_taken != actually_taken ? 1 : 0;
+}
+
+
+/* tage: a base table of 2-bit counters indexed by the branch address,
+   and TAGE_TABLES tagged tables of 3-bit counters.  The prediction
+   comes from the matching entry with the longest history (the
+   provider), unless that entry was only just allocated, in which case
+   the next match may be used instead.  On a mispredict, an entry is
+   allocated in a table with a longer history.  The fields of the
+   entries are in separate arrays, so that a lookup touches just the
+   tags. */
+static UShort tage_tag[TAGE_TABLES][1 << TAGE_LOG_SIZE];
+static Char   tage_ctr[TAGE_TABLES][1 << TAGE_LOG_SIZE]; /* -4..3, taken
+                                                             if >= 0 */
+static UChar  tage_u[TAGE_TABLES][1 << TAGE_LOG_SIZE];   /* 0..3, use-
+                                                             fulness */
+static UChar  tage_base[1 << TAGE_BASE_BITS];
+static Int    tage_use_alt = 0;  /* -8..7: use the alternate prediction
+                                    for new entries? */
+static UInt   tage_ticks = 0;
+
+static ULong tage_cond_predict ( Addr instr_addr, Word takenW )
+{
+   UWord  pc = instr_addr >> N_IADDR_LO_ZERO_BITS;
+   UWord  bindx = pc & ((1 << TAGE_BASE_BITS) - 1);
+   UWord  indx[TAGE_TABLES];
+   UShort tag[TAGE_TABLES];
+   UInt   hits = 0;
+   Int    i, j, provider = -1, alt = -1, p = 0;
+   Bool   taken = takenW > 0, pred, alt_pred, provider_pred = False;
+
+   for (i = 0; i < TAGE_TABLES; i++) {
+      indx[i] = tage_index(pc, i);
+      tag[i]  = tage_tag_of(pc, i);
+      hits |= (UInt)(tage_tag[i][indx[i]] == tag[i]) << i;
+   }
+   if (hits) {
+      provider = 31 - __builtin_clz(hits);
+      p = indx[provider];
+      hits &= ~(1U << provider);
+      if (hits)
+         alt = 31 - __builtin_clz(hits);
+   }
+
+   alt_pred = alt >= 0 ? tage_ctr[alt][indx[alt]] >= 0
+                       : tage_base[bindx] >= 2;
+   pred = alt_pred;
+   if (provider >= 0) {
+      Char ctr = tage_ctr[provider][p];
+      Bool fresh = (ctr == 0 || ctr == -1) && tage_u[provider][p] == 0;
+      provider_pred = ctr >= 0;
+      pred = fresh && tage_use_alt >= 0 ? alt_pred : provider_pred;
+      if (fresh && provider_pred != alt_pred) {
+         if (alt_pred == taken) {
+            if (tage_use_alt < 7) tage_use_alt++;
+         } else {
+            if (tage_use_alt > -8) tage_use_alt--;
+         }
+      }
+   }
+
+   /* On a mispredict, allocate an entry with a longer history. */
+   if (pred != taken && provider < TAGE_TABLES - 1) {
+      for (i = provider + 1; i < TAGE_TABLES; i++) {
+         if (tage_u[i][indx[i]] == 0)
+            break;
+      }
+      if (i < TAGE_TABLES) {
+         tage_tag[i][indx[i]] = tag[i];
+         tage_ctr[i][indx[i]] = taken ? 0 : -1;
+      } else {
+         for (i = provider + 1; i < TAGE_TABLES; i++)
+            tage_u[i][indx[i]]--;
+      }
+   }
+
+   if (provider >= 0) {
+      Char* ctr = &tage_ctr[provider][p];
+      UChar* u  = &tage_u[provider][p];
+      if (taken) {
+         if (*ctr < 3) (*ctr)++;
+      } else {
+         if (*ctr > -4) (*ctr)--;
+      }
+      if (provider_pred != alt_pred) {
+         if (provider_pred == taken) {
+            if (*u < 3) (*u)++;
+         } else {
+            if (*u > 0) (*u)--;
+         }
+      }
+   } else {
+      if (taken) {
+         if (tage_base[bindx] < 3) tage_base[bindx]++;
+      } else {
+         if (tage_base[bindx] > 0) tage_base[bindx]--;
+      }
+   }
+
+   /* Let entries which are no longer useful be replaced, eventually. */
+   if (++tage_ticks == TAGE_AGE_PERIOD) {
+      tage_ticks = 0;
+      for (i = 0; i < TAGE_TABLES; i++)
+         for (j = 0; j < (1 << TAGE_LOG_SIZE); j++)
+            tage_u[i][j] >>= 1;
+   }
+
+   ghist_push(taken ? 1 : 0);
+   return pred != taken ? 1 : 0;
+}
+
+
+/* ittage: the btac as base predictor, and tagged tables of targets
+   with 2-bit confidence counters, used like the tables of tage. */
+typedef struct {
+   Addr   target;
+   UShort tag;
+   UChar  ctr;   /* 0..3, confidence */
+   UChar  u;     /* 0..3, usefulness */
+} ittage_entry;
+
+static ittage_entry ittage[TAGE_TABLES][1 << TAGE_LOG_SIZE];
+static UInt         ittage_ticks = 0;
+
+static ULong ittage_ind_predict ( Addr instr_addr, Addr actual )
+{
+   UWord  pc = instr_addr >> N_IADDR_LO_ZERO_BITS;
+   UWord  bindx = pc & ((1 << N_BTAC_BITS) - 1);
+   UWord  indx[TAGE_TABLES], h;
+   UShort tag[TAGE_TABLES];
+   UInt   hits = 0;
+   Int    i, j, provider = -1, alt = -1;
+   Addr   pred, alt_pred;
+   ittage_entry* e = NULL;
+
+   for (i = 0; i < TAGE_TABLES; i++) {
+      indx[i] = tage_index(pc, i);
+      tag[i]  = tage_tag_of(pc, i);
+   }
+   for (i = 0; i < TAGE_TABLES; i++)
+      hits |= (UInt)(ittage[i][indx[i]].tag == tag[i]) << i;
+   if (hits) {
+      provider = 31 - __builtin_clz(hits);
+      hits &= ~(1U << provider);
+      if (hits)
+         alt = 31 - __builtin_clz(hits);
+   }
+
+   alt_pred = alt >= 0 ? ittage[alt][indx[alt]].target : btac[bindx];
+   pred = alt_pred;
+   if (provider >= 0) {
+      e = &ittage[provider][indx[provider]];
+      if (e->ctr > 0 || e->u > 0)
+         pred = e->target;
+   }
+
+   if (pred != actual && provider < TAGE_TABLES - 1) {
+      for (i = provider + 1; i < TAGE_TABLES; i++) {
+         if (ittage[i][indx[i]].u == 0)
+            break;
+      }
+      if (i < TAGE_TABLES) {
+         ittage[i][indx[i]].tag    = tag[i];
+         ittage[i][indx[i]].target = actual;
+         ittage[i][indx[i]].ctr    = 0;
+         ittage[i][indx[i]].u      = 0;
+      } else {
+         for (i = provider + 1; i < TAGE_TABLES; i++)
+            ittage[i][indx[i]].u--;
+      }
+   }
+
+   if (e) {
+      if (e->target == actual) {
+         if (e->ctr < 3) e->ctr++;
+         if (alt_pred != actual && e->u < 3) e->u++;
+      } else {
+         if (e->ctr > 0)
+            e->ctr--;
+         else
+            e->target = actual;
+         if (alt_pred == actual && e->u > 0) e->u--;
+      }
+   }
+   btac[bindx] = actual;
+
+   if (++ittage_ticks == TAGE_AGE_PERIOD) {
+      ittage_ticks = 0;
+      for (i = 0; i < TAGE_TABLES; i++)
+         for (j = 0; j < (1 << TAGE_LOG_SIZE); j++)
+            ittage[i][j].u >>= 1;
+   }
+
+   h = actual >> N_IADDR_LO_ZERO_BITS;
+   h ^= h >> 4;
+   ghist_push(h & 1);
+   ghist_push((h >> 1) & 1);
+   return pred != actual ? 1 : 0;
+}
+
+
+static ULong do_cond_branch_predict ( Addr instr_addr, Word takenW )
+{
+   switch (bp_cond) {
+      case BP_GShare: return gshare_cond_predict(instr_addr, takenW);
+      case BP_TAGE:   return tage_cond_predict(instr_addr, takenW);
+      default:        return simple_cond_predict(instr_addr, takenW);
+   }
+}
+
+static ULong do_ind_branch_predict ( Addr instr_addr, Addr actual )
+{
+   ULong mispredict;
+   UWord h;
+
+   if (bp_ind == BP_ITTAGE)
+      return ittage_ind_predict(instr_addr, actual);
+
+   mispredict = btac_ind_predict(instr_addr, actual);
+   if (bp_cond != BP_Simple) {
+      // as for ittage, so that the conditional models see the same
+      // history with either indirect model
+      h = actual >> N_IADDR_LO_ZERO_BITS;
+      h ^= h >> 4;
+      ghist_push(h & 1);
+      ghist_push((h >> 1) & 1);
+   }
+   return mispredict;
+}
+
+/* hist is the longest history, in bits, used by gshare and the tagged
+   tables; the lengths of the tagged tables are a geometric series
+   from TAGE_MIN_HIST to hist. */
+static void branchpred_init ( bp_cond_t cond, bp_ind_t ind, Int hist )
+{
+   double ratio, lo, hi, len, p;
+   Int    i, n;
+
+   tl_assert(hist > TAGE_MIN_HIST && hist <= BP_MAX_HIST);
+   bp_cond   = cond;
+   bp_ind    = ind;
+   bp_hist   = hist;
+   bp_tagged = cond == BP_TAGE || ind == BP_ITTAGE;
+
+   /* ratio^(TAGE_TABLES-1) == hist/TAGE_MIN_HIST, by bisection, as
+      there is no libm */
+   lo = 1.0;
+   hi = (double)hist / TAGE_MIN_HIST;
+   for (n = 0; n < 50; n++) {
+      ratio = (lo + hi) / 2;
+      for (p = 1.0, i = 0; i < TAGE_TABLES - 1; i++)
+         p *= ratio;
+      if (p * TAGE_MIN_HIST < hist)
+         lo = ratio;
+      else
+         hi = ratio;
+   }
+   for (len = TAGE_MIN_HIST, i = 0; i < TAGE_TABLES; i++, len *= ratio) {
+      tage_hist* h = &tage_h[i];
+      h->len = i == TAGE_TABLES - 1 ? hist : (Int)(len + 0.5);
+      if (i > 0 && h->len <= tage_h[i-1].len)
+         h->len = tage_h[i-1].len + 1;
+      h->outpoint = h->len % TAGE_FOLD_BITS;
+      h->fold = 0;
+   }
+
+   VG_(sprintf)(bp_desc_line, "%s, %s",
+                cond == BP_Simple ? "simple" :
+                cond == BP_GShare ? "gshare" : "tage",
+                ind == BP_BTAC ? "btac" : "ittage");
+   if (cond != BP_Simple || ind != BP_BTAC)
+      VG_(sprintf)(bp_desc_line + VG_(strlen)(bp_desc_line),
+                   " (history %d)", hist);
+}
+
 /*--------------------------------------------------------------------*/
 /*--- end                                          cg_branchpred.c ---*/
 /*--------------------------------------------------------------------*/
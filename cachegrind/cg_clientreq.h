@@ -0,0 +1,49 @@
+
+/*--------------------------------------------------------------------*/
+/*--- Cachegrind-internal client requests.        cg_clientreq.h ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Cachegrind, a Valgrind tool for cache
+   profiling programs.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#ifndef __CG_CLIENTREQ_H
+#define __CG_CLIENTREQ_H
+
+#include "valgrind.h"
+
+/* These requests are not a public interface: they are only made by the
+   heap wrappers in cg_intercepts.c, to tell Cachegrind about heap blocks
+   when --data-profile=yes. */
+typedef
+   enum {
+      /* Returns 1 if heap blocks should be reported, 0 otherwise. */
+      VG_USERREQ__CG_DATA_PROFILE = VG_USERREQ_TOOL_BASE('C','G'),
+      /* args: address, size.  A block was allocated. */
+      VG_USERREQ__CG_MALLOC,
+      /* args: address.  A block is about to be freed. */
+      VG_USERREQ__CG_FREE
+   }
+   CG_ClientRequest;
+
+#endif   /* __CG_CLIENTREQ_H */
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
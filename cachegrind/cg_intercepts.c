@@ -0,0 +1,224 @@
+
+/*--------------------------------------------------------------------*/
+/*--- Heap wrappers for --data-profile.           cg_intercepts.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Cachegrind, a Valgrind tool for cache
+   profiling programs.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+/* RUNS ON SIMULATED CPU
+   These wrap (rather than replace) the allocator, so that the program's
+   own malloc is still simulated.  Cachegrind only preloads this file
+   with --data-profile=yes, and does not instrument the code in it.  The wrappers tell Cachegrind where each heap block is, so
+   that data cache misses can be attributed to the code that allocated
+   the block. */
+
+#include "pub_tool_basics.h"
+#include "pub_tool_redir.h"
+#include "pub_tool_clreq.h"
+#include "cg_clientreq.h"
+
+
+/* -1 until the tool has been asked whether --data-profile is in effect.
+   Racy, but every thread computes the same value. */
+static int cg_data_profile = -1;
+
+static __inline__ int data_profile(void)
+{
+   if (cg_data_profile < 0)
+      cg_data_profile
+         = VALGRIND_DO_CLIENT_REQUEST_EXPR(0, VG_USERREQ__CG_DATA_PROFILE,
+                                           0, 0, 0, 0, 0);
+   return cg_data_profile;
+}
+
+static __inline__ void report_alloc(void* p, SizeT n)
+{
+   if (p != NULL && data_profile())
+      VALGRIND_DO_CLIENT_REQUEST_STMT(VG_USERREQ__CG_MALLOC, p, n, 0, 0, 0);
+}
+
+static __inline__ void report_free(void* p)
+{
+   if (p != NULL && data_profile())
+      VALGRIND_DO_CLIENT_REQUEST_STMT(VG_USERREQ__CG_FREE, p, 0, 0, 0, 0);
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Wrapper templates                                    ---*/
+/*------------------------------------------------------------*/
+
+#define ALLOC_WRAPPER(soname, fnname) \
+   void* I_WRAP_SONAME_FNNAME_ZU(soname, fnname)(SizeT n); \
+   void* I_WRAP_SONAME_FNNAME_ZU(soname, fnname)(SizeT n) \
+   { \
+      OrigFn fn; \
+      void*  p; \
+      VALGRIND_GET_ORIG_FN(fn); \
+      CALL_FN_W_W(p, fn, n); \
+      report_alloc(p, n); \
+      return p; \
+   }
+
+/* The nothrow variants of operator new. */
+#define ALLOC2_WRAPPER(soname, fnname) \
+   void* I_WRAP_SONAME_FNNAME_ZU(soname, fnname)(SizeT n, void* nt); \
+   void* I_WRAP_SONAME_FNNAME_ZU(soname, fnname)(SizeT n, void* nt) \
+   { \
+      OrigFn fn; \
+      void*  p; \
+      VALGRIND_GET_ORIG_FN(fn); \
+      CALL_FN_W_WW(p, fn, n, nt); \
+      report_alloc(p, n); \
+      return p; \
+   }
+
+#define FREE_WRAPPER(soname, fnname) \
+   void I_WRAP_SONAME_FNNAME_ZU(soname, fnname)(void* p); \
+   void I_WRAP_SONAME_FNNAME_ZU(soname, fnname)(void* p) \
+   { \
+      OrigFn fn; \
+      VALGRIND_GET_ORIG_FN(fn); \
+      report_free(p); \
+      CALL_FN_v_W(fn, p); \
+   }
+
+/* Sized operator delete. */
+#define FREE2_WRAPPER(soname, fnname) \
+   void I_WRAP_SONAME_FNNAME_ZU(soname, fnname)(void* p, SizeT n); \
+   void I_WRAP_SONAME_FNNAME_ZU(soname, fnname)(void* p, SizeT n) \
+   { \
+      OrigFn fn; \
+      VALGRIND_GET_ORIG_FN(fn); \
+      report_free(p); \
+      CALL_FN_v_WW(fn, p, n); \
+   }
+
+
+/*------------------------------------------------------------*/
+/*--- C allocator                                          ---*/
+/*------------------------------------------------------------*/
+
+ALLOC_WRAPPER(VG_Z_LIBC_SONAME, malloc)
+ALLOC_WRAPPER(VG_Z_LIBC_SONAME, valloc)
+FREE_WRAPPER(VG_Z_LIBC_SONAME, free)
+
+void* I_WRAP_SONAME_FNNAME_ZU(VG_Z_LIBC_SONAME, calloc)(SizeT nmemb,
+                                                       SizeT size);
+void* I_WRAP_SONAME_FNNAME_ZU(VG_Z_LIBC_SONAME, calloc)(SizeT nmemb,
+                                                       SizeT size)
+{
+   OrigFn fn;
+   void*  p;
+   VALGRIND_GET_ORIG_FN(fn);
+   CALL_FN_W_WW(p, fn, nmemb, size);
+   report_alloc(p, nmemb * size);
+   return p;
+}
+
+void* I_WRAP_SONAME_FNNAME_ZU(VG_Z_LIBC_SONAME, realloc)(void* old, SizeT n);
+void* I_WRAP_SONAME_FNNAME_ZU(VG_Z_LIBC_SONAME, realloc)(void* old, SizeT n)
+{
+   OrigFn fn;
+   void*  p;
+   VALGRIND_GET_ORIG_FN(fn);
+   CALL_FN_W_WW(p, fn, old, n);
+   /* realloc(old, 0) may free old and return NULL; if it fails for a
+      non-zero size, old is untouched. */
+   if (p != NULL || n == 0) {
+      report_free(old);
+      report_alloc(p, n);
+   }
+   return p;
+}
+
+void* I_WRAP_SONAME_FNNAME_ZU(VG_Z_LIBC_SONAME, memalign)(SizeT align,
+                                                         SizeT n);
+void* I_WRAP_SONAME_FNNAME_ZU(VG_Z_LIBC_SONAME, memalign)(SizeT align,
+                                                         SizeT n)
+{
+   OrigFn fn;
+   void*  p;
+   VALGRIND_GET_ORIG_FN(fn);
+   CALL_FN_W_WW(p, fn, align, n);
+   report_alloc(p, n);
+   return p;
+}
+
+void* I_WRAP_SONAME_FNNAME_ZU(VG_Z_LIBC_SONAME, aligned_alloc)(SizeT align,
+                                                              SizeT n);
+void* I_WRAP_SONAME_FNNAME_ZU(VG_Z_LIBC_SONAME, aligned_alloc)(SizeT align,
+                                                              SizeT n)
+{
+   OrigFn fn;
+   void*  p;
+   VALGRIND_GET_ORIG_FN(fn);
+   CALL_FN_W_WW(p, fn, align, n);
+   report_alloc(p, n);
+   return p;
+}
+
+int I_WRAP_SONAME_FNNAME_ZU(VG_Z_LIBC_SONAME, posix_memalign)(void** memptr,
+                                                             SizeT align,
+                                                             SizeT n);
+int I_WRAP_SONAME_FNNAME_ZU(VG_Z_LIBC_SONAME, posix_memalign)(void** memptr,
+                                                             SizeT align,
+                                                             SizeT n)
+{
+   OrigFn fn;
+   Word   res;
+   VALGRIND_GET_ORIG_FN(fn);
+   CALL_FN_W_WWW(res, fn, memptr, align, n);
+   if (res == 0)
+      report_alloc(*memptr, n);
+   return (int)res;
+}
+
+
+/*------------------------------------------------------------*/
+/*--- C++ allocator                                        ---*/
+/*------------------------------------------------------------*/
+
+/* operator new usually calls malloc, so such blocks are reported twice.
+   The outer report comes last and wins, which attributes the block to
+   the caller of new rather than to new itself. */
+
+#if VG_WORDSIZE == 4
+ALLOC_WRAPPER(VG_Z_LIBSTDCXX_SONAME, _Znwj)
+ALLOC_WRAPPER(VG_Z_LIBSTDCXX_SONAME, _Znaj)
+ALLOC2_WRAPPER(VG_Z_LIBSTDCXX_SONAME, _ZnwjRKSt9nothrow_t)
+ALLOC2_WRAPPER(VG_Z_LIBSTDCXX_SONAME, _ZnajRKSt9nothrow_t)
+FREE2_WRAPPER(VG_Z_LIBSTDCXX_SONAME, _ZdlPvj)
+FREE2_WRAPPER(VG_Z_LIBSTDCXX_SONAME, _ZdaPvj)
+#else
+ALLOC_WRAPPER(VG_Z_LIBSTDCXX_SONAME, _Znwm)
+ALLOC_WRAPPER(VG_Z_LIBSTDCXX_SONAME, _Znam)
+ALLOC2_WRAPPER(VG_Z_LIBSTDCXX_SONAME, _ZnwmRKSt9nothrow_t)
+ALLOC2_WRAPPER(VG_Z_LIBSTDCXX_SONAME, _ZnamRKSt9nothrow_t)
+FREE2_WRAPPER(VG_Z_LIBSTDCXX_SONAME, _ZdlPvm)
+FREE2_WRAPPER(VG_Z_LIBSTDCXX_SONAME, _ZdaPvm)
+#endif
+FREE_WRAPPER(VG_Z_LIBSTDCXX_SONAME, _ZdlPv)
+FREE_WRAPPER(VG_Z_LIBSTDCXX_SONAME, _ZdaPv)
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
@@ -29,6 +29,7 @@
 
 #include "pub_tool_basics.h"
 #include "pub_tool_debuginfo.h"
+#include "pub_tool_hashtable.h"
 #include "pub_tool_libcbase.h"
 #include "pub_tool_libcassert.h"
 #include "pub_tool_libcfile.h"
@@ -37,12 +38,14 @@
 #include "pub_tool_mallocfree.h"
 #include "pub_tool_options.h"
 #include "pub_tool_oset.h"
+#include "pub_tool_stacktrace.h"
 #include "pub_tool_tooliface.h"
 #include "pub_tool_xarray.h"
 #include "pub_tool_clientstate.h"
 #include "pub_tool_machine.h"      // VG_(fnptr_to_fnentry)
 
 #include "cg_arch.h"
+#include "cg_clientreq.h"
 #include "cg_sim.c"
 #include "cg_branchpred.c"
 
@@ -59,7 +62,12 @@
 
 static Bool  clo_cache_sim  = True;  /* do cache simulation? */
 static Bool  clo_branch_sim = False; /* do branch simulation? */
+static bp_cond_t clo_branch_pred = BP_Simple; /* conditional branch model */
+static bp_ind_t  clo_ind_pred = BP_BTAC;      /* indirect branch model */
+static Int   clo_branch_hist = 64;   /* longest global history */
+static Bool  clo_data_profile = False; /* charge misses to data objects? */
 static const HChar* clo_cachegrind_out_file = "cachegrind.out.%p";
+static const HChar* clo_data_out_file = "cachegrind.data.%p";
 
 /*------------------------------------------------------------*/
 /*--- Cachesim configuration                               ---*/
@@ -75,10 +83,34 @@ typedef
    struct {
       ULong a;  /* total # memory accesses of this kind */
       ULong m1; /* misses in the first level cache */
-      ULong mL; /* misses in the second level cache */
+      ULong mM; /* misses in the mid-level cache, if any */
+      ULong mL; /* misses in the last level cache */
    }
    CacheCC;
 
+typedef
+   struct {
+      ULong i1; /* insn fetches missing the first level ITLB */
+      ULong iL; /* insn fetches missing both TLB levels */
+      ULong d1; /* data accesses missing the first level DTLB */
+      ULong dL; /* data accesses missing both TLB levels */
+   }
+   TlbCC;
+
+typedef
+   struct {
+      ULong issued; /* # prefetches issued */
+      ULong useful; /* # prefetched lines hit by a later access */
+   }
+   PrefetchCC;
+
+typedef
+   struct {
+      ULong inv; /* copies in other cores invalidated by writes */
+      ULong fs;  /* ... of which because of false sharing */
+   }
+   CoherenceCC;
+
 typedef
    struct {
       ULong b;  /* total # branches of this kind */
@@ -105,6 +137,9 @@ typedef struct {
    CacheCC  Ir;  /* Insn read counts */
    CacheCC  Dr;  /* Data read counts */
    CacheCC  Dw;  /* Data write/modify counts */
+   TlbCC    Tlb; /* TLB miss counts */
+   PrefetchCC Pf; /* Data prefetch counts */
+   CoherenceCC Coh; /* Coherence counts, with --cores */
    BranchCC Bc;  /* Conditional branch counts */
    BranchCC Bi;  /* Indirect branch counts */
 } LineCC;
@@ -267,13 +302,24 @@ static LineCC* get_lineCC(Addr origAddr)
       lineCC->loc.line = loc.line;
       lineCC->Ir.a     = 0;
       lineCC->Ir.m1    = 0;
+      lineCC->Ir.mM    = 0;
       lineCC->Ir.mL    = 0;
       lineCC->Dr.a     = 0;
       lineCC->Dr.m1    = 0;
+      lineCC->Dr.mM    = 0;
       lineCC->Dr.mL    = 0;
       lineCC->Dw.a     = 0;
       lineCC->Dw.m1    = 0;
+      lineCC->Dw.mM    = 0;
       lineCC->Dw.mL    = 0;
+      lineCC->Tlb.i1   = 0;
+      lineCC->Tlb.iL   = 0;
+      lineCC->Tlb.d1   = 0;
+      lineCC->Tlb.dL   = 0;
+      lineCC->Pf.issued = 0;
+      lineCC->Pf.useful = 0;
+      lineCC->Coh.inv  = 0;
+      lineCC->Coh.fs   = 0;
       lineCC->Bc.b     = 0;
       lineCC->Bc.mp    = 0;
       lineCC->Bi.b     = 0;
@@ -411,6 +457,357 @@ void log_1IrNoX_1Dw_cache_access(InstrInfo* n, Addr data_addr, Word data_size)
    n->parent->Dw.a++;
 }
 
+/* Coherence counts of a data cache line, with --cores. */
+typedef
+   struct _DataLineCC {
+      struct _DataLineCC* next;
+      UWord               block; /* address >> line size bits */
+      CoherenceCC         Coh;
+   }
+   DataLineCC;
+
+static VgHashTable* data_line_table = NULL;
+
+/* Data modifies are counted as reads, but are writes as far as coherence
+   is concerned, hence is_write. */
+static void coherence_D(InstrInfo* n, Addr data_addr, Word data_size,
+                        Bool is_write)
+{
+   UInt        inv = 0, fs = 0;
+   UWord       block;
+   DataLineCC* dl;
+
+   cachesim_coherence_ref(data_addr, data_size, is_write, &inv, &fs);
+   if (inv == 0)
+      return;
+
+   n->parent->Coh.inv += inv;
+   n->parent->Coh.fs  += fs;
+
+   block = data_addr >> D1.line_size_bits;
+   dl = VG_(HT_lookup)(data_line_table, block);
+   if (!dl) {
+      dl = VG_(malloc)("cg.coherence_D.1", sizeof(DataLineCC));
+      dl->block   = block;
+      dl->Coh.inv = 0;
+      dl->Coh.fs  = 0;
+      VG_(HT_add_node)(data_line_table, dl);
+   }
+   dl->Coh.inv += inv;
+   dl->Coh.fs  += fs;
+}
+
+/*------------------------------------------------------------*/
+/*--- Data-centric profiling                               ---*/
+/*------------------------------------------------------------*/
+
+// With --data-profile=yes, D1 and LL data misses are also charged to the
+// data object that was accessed: a heap block (charged to the code that
+// allocated it), a global variable, a thread stack, or an unknown object.
+
+typedef
+   struct {
+      ULong m1r; /* D1 read misses */
+      ULong mLr; /* LL read misses */
+      ULong m1w; /* D1 write misses */
+      ULong mLw; /* LL write misses */
+   }
+   DataMissCC;
+
+typedef
+   struct _DataObjCC {
+      struct _DataObjCC* next;
+      UWord              key;  /* allocation site, or symbol address */
+      const HChar*       name; /* symbol name; NULL for allocation sites */
+      DataMissCC         M;
+   }
+   DataObjCC;
+
+// A live heap block, as reported by the wrappers in cg_intercepts.c.
+typedef
+   struct {
+      Addr       payload;
+      SizeT      szB;  /* never zero */
+      DataObjCC* site;
+   }
+   HeapBlock;
+
+static OSet*        heap_blocks     = NULL; /* HeapBlock, by payload */
+static VgHashTable* data_site_table = NULL; /* DataObjCC, by site */
+static VgHashTable* data_sym_table  = NULL; /* DataObjCC, by symbol */
+static DataObjCC    data_stack_obj;
+static DataObjCC    data_unknown_obj;
+static HeapBlock*   last_heap_block = NULL;
+
+// Heap blocks don't overlap, so any overlap with a one-byte key counts as
+// a match.  The key is the first field of HeapBlock.
+static Word cmp_Addr_HeapBlock(const void* vkey, const void* vhb)
+{
+   const HeapBlock* key = vkey;
+   const HeapBlock* hb  = vhb;
+
+   if (key->payload + key->szB <= hb->payload) return -1;
+   if (hb->payload + hb->szB <= key->payload)  return  1;
+   return 0;
+}
+
+// Symbol lookups are slow, so remember which object recent non-heap,
+// non-stack addresses belong to.  Each entry covers [lo, hi]: everything
+// from the start of a symbol up to the highest address seen in it, or a
+// single address that is not in any symbol (obj is NULL).  Entries are
+// indexed by cache line, but a hit needs the address to be in the range,
+// so a line holding two globals is attributed correctly.  The cache is
+// emptied when debug info is loaded or unloaded.
+#define DATA_SYM_CACHE_SIZE  1024
+static struct {
+   Addr       lo;
+   Addr       hi;
+   DataObjCC* obj;
+} data_sym_cache[DATA_SYM_CACHE_SIZE];
+static UInt data_sym_cache_generation;
+
+static void data_sym_cache_clear(void)
+{
+   UInt i;
+
+   for (i = 0; i < DATA_SYM_CACHE_SIZE; i++) {
+      data_sym_cache[i].lo = 1;
+      data_sym_cache[i].hi = 0;
+   }
+   data_sym_cache_generation = VG_(debuginfo_generation)();
+}
+
+static DataObjCC* get_DataObjCC(VgHashTable* table, UWord key,
+                                const HChar* name)
+{
+   DataObjCC* obj = VG_(HT_lookup)(table, key);
+   if (!obj) {
+      obj = VG_(calloc)("cg.get_DataObjCC.1", 1, sizeof(DataObjCC));
+      obj->key  = key;
+      obj->name = name;
+      VG_(HT_add_node)(table, obj);
+   }
+   return obj;
+}
+
+static DataObjCC* find_data_obj(Addr a)
+{
+   HeapBlock    key;
+   HeapBlock*   hb;
+   ThreadId     tid;
+   Addr         stack_min, stack_max;
+   UWord        i;
+   const HChar* name;
+   PtrdiffT     offset;
+   DataObjCC*   obj = NULL;
+
+   if (last_heap_block && last_heap_block->payload <= a
+       && a - last_heap_block->payload < last_heap_block->szB)
+      return last_heap_block->site;
+   key.payload = a;
+   key.szB     = 1;
+   hb = VG_(OSetGen_Lookup)(heap_blocks, &key);
+   if (hb) {
+      last_heap_block = hb;
+      return hb->site;
+   }
+
+   VG_(thread_stack_reset_iter)(&tid);
+   while (VG_(thread_stack_next)(&tid, &stack_min, &stack_max)) {
+      if (stack_min - VG_STACK_REDZONE_SZB <= a && a <= stack_max)
+         return &data_stack_obj;
+   }
+
+   if (data_sym_cache_generation != VG_(debuginfo_generation)())
+      data_sym_cache_clear();
+   i = (a >> D1.line_size_bits) % DATA_SYM_CACHE_SIZE;
+   if (data_sym_cache[i].lo <= a && a <= data_sym_cache[i].hi)
+      return data_sym_cache[i].obj;
+   if (VG_(get_datasym_and_offset)(VG_(current_DiEpoch)(), a,
+                                   &name, &offset)) {
+      obj = get_DataObjCC(data_sym_table, a - offset, get_perm_string(name));
+      // If the entry was for this symbol already, this extends it.
+      data_sym_cache[i].lo = a - offset;
+   } else {
+      data_sym_cache[i].lo = a;
+   }
+   data_sym_cache[i].hi  = a;
+   data_sym_cache[i].obj = obj;
+   return obj;
+}
+
+static void data_miss(Addr data_addr, Bool is_write, ULong m1, ULong mL)
+{
+   DataObjCC* obj = find_data_obj(data_addr);
+
+   if (!obj)
+      obj = &data_unknown_obj;
+   if (is_write) {
+      obj->M.m1w += m1;
+      obj->M.mLw += mL;
+   } else {
+      obj->M.m1r += m1;
+      obj->M.mLr += mL;
+   }
+}
+
+static void data_free_block(Addr p)
+{
+   HeapBlock  key;
+   HeapBlock* hb;
+
+   key.payload = p;
+   key.szB     = 1;
+   hb = VG_(OSetGen_Lookup)(heap_blocks, &key);
+   // Ignore frees of blocks we never saw allocated.
+   if (!hb || hb->payload != p)
+      return;
+   VG_(OSetGen_Remove)(heap_blocks, &key);
+   VG_(OSetGen_FreeNode)(heap_blocks, hb);
+   last_heap_block = NULL;
+}
+
+static void data_new_block(ThreadId tid, Addr p, SizeT szB)
+{
+   Addr       ips[2];
+   HeapBlock  key;
+   HeapBlock* hb;
+
+   // The allocation site is the caller of the wrapper in cg_intercepts.c.
+   if (VG_(get_StackTrace)(tid, ips, 2, NULL, NULL, 0) < 2)
+      ips[1] = 0;
+
+   // Zero-sized blocks can still be accessed one-past-the-start, and
+   // an overlapping stale block means we missed a free.
+   key.payload = p;
+   key.szB     = szB > 0 ? szB : 1;
+   while ((hb = VG_(OSetGen_Remove)(heap_blocks, &key)))
+      VG_(OSetGen_FreeNode)(heap_blocks, hb);
+   last_heap_block = NULL;
+
+   hb = VG_(OSetGen_AllocNode)(heap_blocks, sizeof(HeapBlock));
+   hb->payload = key.payload;
+   hb->szB     = key.szB;
+   hb->site    = get_DataObjCC(data_site_table, ips[1], NULL);
+   VG_(OSetGen_Insert)(heap_blocks, hb);
+}
+
+/* The handlers below are used instead of the ones above if a non-default
+   cache hierarchy is simulated. */
+__attribute__((always_inline))
+static __inline__
+void hier_Ir(InstrInfo* n)
+{
+   cachesim_hier_doref(&I1, n->instr_addr, n->instr_len,
+                       &n->parent->Ir.m1, &n->parent->Ir.mM,
+                       &n->parent->Ir.mL);
+   n->parent->Ir.a++;
+
+   if (cachesim_tlb) {
+      switch (cachesim_tlb_ref(&ITLB, n->instr_addr)) {
+      case 2: n->parent->Tlb.iL++; /* fallthrough */
+      case 1: n->parent->Tlb.i1++;
+      }
+   }
+}
+
+__attribute__((always_inline))
+static __inline__
+void hier_D(InstrInfo* n, CacheCC* cc, Addr data_addr, Word data_size,
+            Bool is_write)
+{
+   ULong m1 = cc->m1, mL = cc->mL;
+
+   if (cachesim_pf != PF_None)
+      cachesim_D_doref_pf(n->instr_addr, data_addr, data_size,
+                          &cc->m1, &cc->mM, &cc->mL,
+                          &n->parent->Pf.issued, &n->parent->Pf.useful);
+   else
+      cachesim_hier_doref(&D1, data_addr, data_size,
+                          &cc->m1, &cc->mM, &cc->mL);
+   cc->a++;
+
+   // Charged like the main counts, ie. modifies as reads.
+   if (clo_data_profile && cc->m1 != m1)
+      data_miss(data_addr, cc == &n->parent->Dw, cc->m1 - m1, cc->mL - mL);
+
+   if (cachesim_n_cores > 1)
+      coherence_D(n, data_addr, data_size, is_write);
+
+   if (cachesim_tlb) {
+      switch (cachesim_tlb_ref(&DTLB, data_addr)) {
+      case 2: n->parent->Tlb.dL++; /* fallthrough */
+      case 1: n->parent->Tlb.d1++;
+      }
+   }
+}
+
+static VG_REGPARM(1)
+void log_1Ir_0D_hier_cache_access(InstrInfo* n)
+{
+   hier_Ir(n);
+}
+
+static VG_REGPARM(2)
+void log_2Ir_0D_hier_cache_access(InstrInfo* n, InstrInfo* n2)
+{
+   hier_Ir(n);
+   hier_Ir(n2);
+}
+
+static VG_REGPARM(3)
+void log_3Ir_0D_hier_cache_access(InstrInfo* n, InstrInfo* n2, InstrInfo* n3)
+{
+   hier_Ir(n);
+   hier_Ir(n2);
+   hier_Ir(n3);
+}
+
+static VG_REGPARM(3)
+void log_1Ir_1Dr_hier_cache_access(InstrInfo* n, Addr data_addr,
+                                   Word data_size)
+{
+   hier_Ir(n);
+   hier_D(n, &n->parent->Dr, data_addr, data_size, False);
+}
+
+static VG_REGPARM(3)
+void log_1Ir_1Dm_hier_cache_access(InstrInfo* n, Addr data_addr,
+                                   Word data_size)
+{
+   hier_Ir(n);
+   hier_D(n, &n->parent->Dr, data_addr, data_size, True);
+}
+
+static VG_REGPARM(3)
+void log_1Ir_1Dw_hier_cache_access(InstrInfo* n, Addr data_addr,
+                                   Word data_size)
+{
+   hier_Ir(n);
+   hier_D(n, &n->parent->Dw, data_addr, data_size, True);
+}
+
+static VG_REGPARM(3)
+void log_0Ir_1Dr_hier_cache_access(InstrInfo* n, Addr data_addr,
+                                   Word data_size)
+{
+   hier_D(n, &n->parent->Dr, data_addr, data_size, False);
+}
+
+static VG_REGPARM(3)
+void log_0Ir_1Dm_hier_cache_access(InstrInfo* n, Addr data_addr,
+                                   Word data_size)
+{
+   hier_D(n, &n->parent->Dr, data_addr, data_size, True);
+}
+
+static VG_REGPARM(3)
+void log_0Ir_1Dw_hier_cache_access(InstrInfo* n, Addr data_addr,
+                                   Word data_size)
+{
+   hier_D(n, &n->parent->Dw, data_addr, data_size, True);
+}
+
 /* Note that addEvent_D_guarded assumes that log_0Ir_1Dr_cache_access
    and log_0Ir_1Dw_cache_access have exactly the same prototype.  If
    you change them, you must change addEvent_D_guarded too. */
@@ -740,8 +1137,16 @@ static void flushEvents ( CgState* cgs )
                   immediately preceding Ir.  Same applies to analogous
                   assertions in the subsequent cases. */
                tl_assert(ev2->inode == ev->inode);
-               helperName = "log_1IrNoX_1Dr_cache_access";
-               helperAddr = &log_1IrNoX_1Dr_cache_access;
+               if (cachesim_hier && ev2->tag == Ev_Dm) {
+                  helperName = "log_1Ir_1Dm_hier_cache_access";
+                  helperAddr = &log_1Ir_1Dm_hier_cache_access;
+               } else if (cachesim_hier) {
+                  helperName = "log_1Ir_1Dr_hier_cache_access";
+                  helperAddr = &log_1Ir_1Dr_hier_cache_access;
+               } else {
+                  helperName = "log_1IrNoX_1Dr_cache_access";
+                  helperAddr = &log_1IrNoX_1Dr_cache_access;
+               }
                argv = mkIRExprVec_3( i_node_expr,
                                      get_Event_dea(ev2),
                                      mkIRExpr_HWord( get_Event_dszB(ev2) ) );
@@ -752,8 +1157,13 @@ static void flushEvents ( CgState* cgs )
             else
             if (ev2 && ev2->tag == Ev_Dw) {
                tl_assert(ev2->inode == ev->inode);
-               helperName = "log_1IrNoX_1Dw_cache_access";
-               helperAddr = &log_1IrNoX_1Dw_cache_access;
+               if (cachesim_hier) {
+                  helperName = "log_1Ir_1Dw_hier_cache_access";
+                  helperAddr = &log_1Ir_1Dw_hier_cache_access;
+               } else {
+                  helperName = "log_1IrNoX_1Dw_cache_access";
+                  helperAddr = &log_1IrNoX_1Dw_cache_access;
+               }
                argv = mkIRExprVec_3( i_node_expr,
                                      get_Event_dea(ev2),
                                      mkIRExpr_HWord( get_Event_dszB(ev2) ) );
@@ -764,7 +1174,10 @@ static void flushEvents ( CgState* cgs )
             else
             if (ev2 && ev3 && ev2->tag == Ev_IrNoX && ev3->tag == Ev_IrNoX)
             {
-               if (clo_cache_sim) {
+               if (clo_cache_sim && cachesim_hier) {
+                  helperName = "log_3Ir_0D_hier_cache_access";
+                  helperAddr = &log_3Ir_0D_hier_cache_access;
+               } else if (clo_cache_sim) {
                   helperName = "log_3IrNoX_0D_cache_access";
                   helperAddr = &log_3IrNoX_0D_cache_access;
                } else {
@@ -780,7 +1193,10 @@ static void flushEvents ( CgState* cgs )
             /* Merge an IrNoX with one following IrNoX. */
             else
             if (ev2 && ev2->tag == Ev_IrNoX) {
-               if (clo_cache_sim) {
+               if (clo_cache_sim && cachesim_hier) {
+                  helperName = "log_2Ir_0D_hier_cache_access";
+                  helperAddr = &log_2Ir_0D_hier_cache_access;
+               } else if (clo_cache_sim) {
                   helperName = "log_2IrNoX_0D_cache_access";
                   helperAddr = &log_2IrNoX_0D_cache_access;
                } else {
@@ -794,7 +1210,10 @@ static void flushEvents ( CgState* cgs )
             }
             /* No merging possible; emit as-is. */
             else {
-               if (clo_cache_sim) {
+               if (clo_cache_sim && cachesim_hier) {
+                  helperName = "log_1Ir_0D_hier_cache_access";
+                  helperAddr = &log_1Ir_0D_hier_cache_access;
+               } else if (clo_cache_sim) {
                   helperName = "log_1IrNoX_0D_cache_access";
                   helperAddr = &log_1IrNoX_0D_cache_access;
                } else {
@@ -807,7 +1226,10 @@ static void flushEvents ( CgState* cgs )
             }
             break;
          case Ev_IrGen:
-            if (clo_cache_sim) {
+            if (clo_cache_sim && cachesim_hier) {
+               helperName = "log_1Ir_0D_hier_cache_access";
+               helperAddr = &log_1Ir_0D_hier_cache_access;
+            } else if (clo_cache_sim) {
 	       helperName = "log_1IrGen_0D_cache_access";
 	       helperAddr = &log_1IrGen_0D_cache_access;
 	    } else {
@@ -821,8 +1243,16 @@ static void flushEvents ( CgState* cgs )
          case Ev_Dr:
          case Ev_Dm:
             /* Data read or modify */
-            helperName = "log_0Ir_1Dr_cache_access";
-            helperAddr = &log_0Ir_1Dr_cache_access;
+            if (cachesim_hier && ev->tag == Ev_Dm) {
+               helperName = "log_0Ir_1Dm_hier_cache_access";
+               helperAddr = &log_0Ir_1Dm_hier_cache_access;
+            } else if (cachesim_hier) {
+               helperName = "log_0Ir_1Dr_hier_cache_access";
+               helperAddr = &log_0Ir_1Dr_hier_cache_access;
+            } else {
+               helperName = "log_0Ir_1Dr_cache_access";
+               helperAddr = &log_0Ir_1Dr_cache_access;
+            }
             argv = mkIRExprVec_3( i_node_expr, 
                                   get_Event_dea(ev), 
                                   mkIRExpr_HWord( get_Event_dszB(ev) ) );
@@ -831,8 +1261,13 @@ static void flushEvents ( CgState* cgs )
             break;
          case Ev_Dw:
             /* Data write */
-            helperName = "log_0Ir_1Dw_cache_access";
-            helperAddr = &log_0Ir_1Dw_cache_access;
+            if (cachesim_hier) {
+               helperName = "log_0Ir_1Dw_hier_cache_access";
+               helperAddr = &log_0Ir_1Dw_hier_cache_access;
+            } else {
+               helperName = "log_0Ir_1Dw_cache_access";
+               helperAddr = &log_0Ir_1Dw_cache_access;
+            }
             argv = mkIRExprVec_3( i_node_expr,
                                   get_Event_dea(ev), 
                                   mkIRExpr_HWord( get_Event_dszB(ev) ) );
@@ -978,10 +1413,17 @@ void addEvent_D_guarded ( CgState* cgs, InstrInfo* inode,
    Int          regparms;
    IRDirty*     di;
    i_node_expr = mkIRExpr_HWord( (HWord)inode );
-   helperName  = isWrite ? "log_0Ir_1Dw_cache_access"
-                         : "log_0Ir_1Dr_cache_access";
-   helperAddr  = isWrite ? &log_0Ir_1Dw_cache_access
-                         : &log_0Ir_1Dr_cache_access;
+   if (cachesim_hier) {
+      helperName = isWrite ? "log_0Ir_1Dw_hier_cache_access"
+                           : "log_0Ir_1Dr_hier_cache_access";
+      helperAddr = isWrite ? &log_0Ir_1Dw_hier_cache_access
+                           : &log_0Ir_1Dr_hier_cache_access;
+   } else {
+      helperName = isWrite ? "log_0Ir_1Dw_cache_access"
+                           : "log_0Ir_1Dr_cache_access";
+      helperAddr = isWrite ? &log_0Ir_1Dw_cache_access
+                           : &log_0Ir_1Dr_cache_access;
+   }
    argv        = mkIRExprVec_3( i_node_expr,
                                 ea, mkIRExpr_HWord( datasize ) );
    regparms    = 3;
@@ -1037,6 +1479,43 @@ void addEvent_Bi ( CgState* cgs, InstrInfo* inode, IRAtom* whereTo )
 ////////////////////////////////////////////////////////////
 
 
+// The heap wrappers in vgpreload_cachegrind are not part of the program
+// being profiled, so their code is not instrumented.  Returns True if a is
+// in their text section.
+static Addr preload_text_lo = 0;
+static Addr preload_text_hi = 0;
+static Bool preload_searched = False;
+static UInt preload_search_generation;
+
+static Bool is_preload_code(Addr a)
+{
+   const DebugInfo* di;
+
+   // Without --data-profile the preload is not loaded at all.
+   if (!clo_data_profile)
+      return False;
+
+   // Until the preload is found, only search again after debug info
+   // has been loaded.
+   if (preload_text_hi == 0
+       && (!preload_searched
+           || preload_search_generation != VG_(debuginfo_generation)())) {
+      preload_searched = True;
+      preload_search_generation = VG_(debuginfo_generation)();
+      for (di = VG_(next_DebugInfo)(NULL); di; di = VG_(next_DebugInfo)(di)) {
+         if (VG_(strstr)(VG_(DebugInfo_get_filename)(di),
+                         "/vgpreload_cachegrind-")
+             && VG_(DebugInfo_get_text_size)(di) > 0) {
+            preload_text_lo = VG_(DebugInfo_get_text_avma)(di);
+            preload_text_hi = preload_text_lo
+                              + VG_(DebugInfo_get_text_size)(di);
+            break;
+         }
+      }
+   }
+   return preload_text_lo <= a && a < preload_text_hi;
+}
+
 static
 IRSB* cg_instrument ( VgCallbackClosure* closure,
                       IRSB* sbIn, 
@@ -1058,6 +1537,9 @@ IRSB* cg_instrument ( VgCallbackClosure* closure,
       VG_(tool_panic)("host/guest word size mismatch");
    }
 
+   if (is_preload_code(vge->base[0]))
+      return sbIn;
+
    // Set up new SB
    cgs.sbOut = deepCopyIRSBExceptStmts(sbIn);
 
@@ -1357,6 +1839,41 @@ IRSB* cg_instrument ( VgCallbackClosure* closure,
 static cache_t clo_I1_cache = UNDEFINED_CACHE;
 static cache_t clo_D1_cache = UNDEFINED_CACHE;
 static cache_t clo_LL_cache = UNDEFINED_CACHE;
+static cache_t clo_ML_cache = UNDEFINED_CACHE;
+
+static cache_repl_t clo_L1_repl = Repl_LRU;
+static cache_repl_t clo_ML_repl = Repl_LRU;
+static cache_repl_t clo_LL_repl = Repl_LRU;
+static cache_incl_t clo_LL_incl = Incl_NINE;
+
+static Bool clo_tlb_sim   = False;
+static Int  clo_page_size = 4096;
+static Int  clo_ITLB_entries = 128, clo_ITLB_assoc = 8;
+static Int  clo_DTLB_entries = 64,  clo_DTLB_assoc = 4;
+static Int  clo_STLB_entries = 1536, clo_STLB_assoc = 12;
+static cache_pf_t clo_prefetch = PF_None;
+static Int  clo_cores = 1;
+
+// Parses a TLB option value of the form "<entries>,<assoc>".
+static void parse_tlb_opt(Int* entries, Int* assoc, const HChar* opt,
+                          const HChar* optval)
+{
+   Long   i1, i2;
+   HChar* endptr;
+
+   i1 = VG_(strtoll10)(optval,   &endptr); if (*endptr != ',')  goto bad;
+   i2 = VG_(strtoll10)(endptr+1, &endptr); if (*endptr != '\0') goto bad;
+   if (i1 <= 0 || i2 <= 0 || i1 > 1 << 20 || i2 > i1 || i1 % i2 != 0
+       || VG_(log2)(i1 / i2) == -1)
+      goto bad;
+   *entries = i1;
+   *assoc   = i2;
+   return;
+
+  bad:
+   VG_(fmsg_bad_option)(opt, "The number of sets (entries / associativity) "
+                        "must be a power of two.\n");
+}
 
 /*------------------------------------------------------------*/
 /*--- cg_fini() and related function                       ---*/
@@ -1367,12 +1884,123 @@ static cache_t clo_LL_cache = UNDEFINED_CACHE;
 static CacheCC  Ir_total;
 static CacheCC  Dr_total;
 static CacheCC  Dw_total;
+static TlbCC    Tlb_total;
+static PrefetchCC Pf_total;
+static CoherenceCC Coh_total;
 static BranchCC Bc_total;
 static BranchCC Bi_total;
 
+static void fprint_CacheCC(VgFile* fp, const CacheCC* cc)
+{
+   if (cachesim_ML_used)
+      VG_(fprintf)(fp, " %llu %llu %llu %llu", cc->a, cc->m1, cc->mM, cc->mL);
+   else
+      VG_(fprintf)(fp, " %llu %llu %llu", cc->a, cc->m1, cc->mL);
+}
+
+// Prints the counts of one line, in the order of the "events:" line.
+static void fprint_counts(VgFile* fp, const CacheCC* Ir, const CacheCC* Dr,
+                          const CacheCC* Dw, const TlbCC* Tlb,
+                          const PrefetchCC* Pf, const CoherenceCC* Coh,
+                          const BranchCC* Bc, const BranchCC* Bi)
+{
+   if (clo_cache_sim) {
+      fprint_CacheCC(fp, Ir);
+      fprint_CacheCC(fp, Dr);
+      fprint_CacheCC(fp, Dw);
+      if (cachesim_tlb)
+         VG_(fprintf)(fp, " %llu %llu %llu %llu",
+                      Tlb->i1, Tlb->iL, Tlb->d1, Tlb->dL);
+      if (cachesim_pf != PF_None)
+         VG_(fprintf)(fp, " %llu %llu", Pf->issued, Pf->useful);
+      if (cachesim_n_cores > 1)
+         VG_(fprintf)(fp, " %llu %llu", Coh->inv, Coh->fs);
+   } else {
+      VG_(fprintf)(fp, " %llu", Ir->a);
+   }
+   if (clo_branch_sim)
+      VG_(fprintf)(fp, " %llu %llu %llu %llu", Bc->b, Bc->mp, Bi->b, Bi->mp);
+   VG_(fprintf)(fp, "\n");
+}
+
+static Int cmp_DataLineCC_by_fs(const void* v1, const void* v2)
+{
+   const DataLineCC* dl1 = *(const DataLineCC* const*)v1;
+   const DataLineCC* dl2 = *(const DataLineCC* const*)v2;
+
+   if (dl1->Coh.fs != dl2->Coh.fs)
+      return dl1->Coh.fs > dl2->Coh.fs ? -1 : 1;
+   if (dl1->Coh.inv != dl2->Coh.inv)
+      return dl1->Coh.inv > dl2->Coh.inv ? -1 : 1;
+   if (dl1->block != dl2->block)
+      return dl1->block < dl2->block ? -1 : 1;
+   return 0;
+}
+
+// Prints the coherence counts of the data cache lines as comment lines,
+// which cg_annotate, cg_diff and cg_merge skip.  Lines with the most false
+// sharing come first.
+static void fprint_data_lines(VgFile* fp)
+{
+   DataLineCC** dls;
+   UInt         i, n_dls;
+   Addr         a;
+   const HChar* name;
+   PtrdiffT     offset;
+
+   dls = (DataLineCC**)VG_(HT_to_array)(data_line_table, &n_dls);
+   VG_(ssort)(dls, n_dls, sizeof(DataLineCC*), cmp_DataLineCC_by_fs);
+
+   VG_(fprintf)(fp, "# data lines: address Dinv Dfs [symbol+offset]\n");
+   for (i = 0; i < n_dls; i++) {
+      a = dls[i]->block << D1.line_size_bits;
+      VG_(fprintf)(fp, "# 0x%lx %llu %llu", a, dls[i]->Coh.inv,
+                   dls[i]->Coh.fs);
+      if (VG_(get_datasym_and_offset)(VG_(current_DiEpoch)(), a,
+                                      &name, &offset))
+         VG_(fprintf)(fp, " %s+%ld", name, (long)offset);
+      VG_(fprintf)(fp, "\n");
+   }
+   VG_(free)(dls);
+}
+
+// Prints the "desc:" and "cmd:" lines, without the final newline.
+static void fprint_desc_and_cmd(VgFile* fp)
+{
+   Int i;
+
+   // "desc:" lines (giving I1/D1/LL cache configuration).  The spaces after
+   // the 2nd colon makes cg_annotate's output look nicer.
+   VG_(fprintf)(fp,  "desc: I1 cache:         %s\n"
+                     "desc: D1 cache:         %s\n",
+                     I1.desc_line, D1.desc_line);
+   if (cachesim_ML_used)
+      VG_(fprintf)(fp, "desc: ML cache:         %s\n", ML.desc_line);
+   VG_(fprintf)(fp,  "desc: LL cache:         %s\n", LL.desc_line);
+   if (cachesim_tlb)
+      VG_(fprintf)(fp, "desc: ITLB:             %s\n"
+                       "desc: DTLB:             %s\n"
+                       "desc: STLB:             %s\n",
+                       ITLB.desc_line, DTLB.desc_line, STLB.desc_line);
+   if (cachesim_pf != PF_None)
+      VG_(fprintf)(fp, "desc: D1 prefetcher:    %s\n",
+                       cachesim_pf == PF_NextLine ? "next-line" : "stride");
+   if (cachesim_n_cores > 1)
+      VG_(fprintf)(fp, "desc: Cores:            %d, with private caches "
+                       "above LL\n", cachesim_n_cores);
+   if (clo_branch_sim && (bp_cond != BP_Simple || bp_ind != BP_BTAC))
+      VG_(fprintf)(fp, "desc: Branch predictor: %s\n", bp_desc_line);
+
+   // "cmd:" line
+   VG_(fprintf)(fp, "cmd: %s", VG_(args_the_exename));
+   for (i = 0; i < VG_(sizeXA)( VG_(args_for_client) ); i++) {
+      HChar* arg = * (HChar**) VG_(indexXA)( VG_(args_for_client), i );
+      VG_(fprintf)(fp, " %s", arg);
+   }
+}
+
 static void fprint_CC_table_and_calc_totals(void)
 {
-   Int     i;
    VgFile  *fp;
    HChar   *currFile = NULL;
    const HChar *currFn = NULL;
@@ -1400,34 +2028,25 @@ static void fprint_CC_table_and_calc_totals(void)
       VG_(free)(cachegrind_out_file);
    }
 
-   // "desc:" lines (giving I1/D1/LL cache configuration).  The spaces after
-   // the 2nd colon makes cg_annotate's output look nicer.
-   VG_(fprintf)(fp,  "desc: I1 cache:         %s\n"
-                     "desc: D1 cache:         %s\n"
-                     "desc: LL cache:         %s\n",
-                     I1.desc_line, D1.desc_line, LL.desc_line);
+   fprint_desc_and_cmd(fp);
 
-   // "cmd:" line
-   VG_(fprintf)(fp, "cmd: %s", VG_(args_the_exename));
-   for (i = 0; i < VG_(sizeXA)( VG_(args_for_client) ); i++) {
-      HChar* arg = * (HChar**) VG_(indexXA)( VG_(args_for_client), i );
-      VG_(fprintf)(fp, " %s", arg);
-   }
    // "events:" line
-   if (clo_cache_sim && clo_branch_sim) {
-      VG_(fprintf)(fp, "\nevents: Ir I1mr ILmr Dr D1mr DLmr Dw D1mw DLmw "
-                                  "Bc Bcm Bi Bim\n");
-   }
-   else if (clo_cache_sim && !clo_branch_sim) {
-      VG_(fprintf)(fp, "\nevents: Ir I1mr ILmr Dr D1mr DLmr Dw D1mw DLmw "
-                                  "\n");
-   }
-   else if (!clo_cache_sim && clo_branch_sim) {
-      VG_(fprintf)(fp, "\nevents: Ir Bc Bcm Bi Bim\n");
-   }
-   else {
-      VG_(fprintf)(fp, "\nevents: Ir\n");
-   }
+   VG_(fprintf)(fp, "\nevents: Ir");
+   if (clo_cache_sim && cachesim_ML_used)
+      VG_(fprintf)(fp, " I1mr IMmr ILmr Dr D1mr DMmr DLmr Dw D1mw DMmw DLmw");
+   else if (clo_cache_sim)
+      VG_(fprintf)(fp, " I1mr ILmr Dr D1mr DLmr Dw D1mw DLmw");
+   if (clo_cache_sim && cachesim_tlb)
+      VG_(fprintf)(fp, " ITLB1m ITLBm DTLB1m DTLBm");
+   if (clo_cache_sim && cachesim_pf != PF_None)
+      VG_(fprintf)(fp, " PFissued PFuseful");
+   if (clo_cache_sim && cachesim_n_cores > 1)
+      VG_(fprintf)(fp, " Dinv Dfs");
+   if (clo_branch_sim)
+      VG_(fprintf)(fp, " Bc Bcm Bi Bim");
+   else if (clo_cache_sim)
+      VG_(fprintf)(fp, " ");   // The historical format has a trailing space.
+   VG_(fprintf)(fp, "\n");
 
    // Traverse every lineCC
    VG_(OSetGen_ResetIter)(CC_table);
@@ -1455,51 +2074,32 @@ static void fprint_CC_table_and_calc_totals(void)
       }
 
       // Print the LineCC
-      if (clo_cache_sim && clo_branch_sim) {
-         VG_(fprintf)(fp,  "%d %llu %llu %llu"
-                             " %llu %llu %llu"
-                             " %llu %llu %llu"
-                             " %llu %llu %llu %llu\n",
-                            lineCC->loc.line,
-                            lineCC->Ir.a, lineCC->Ir.m1, lineCC->Ir.mL, 
-                            lineCC->Dr.a, lineCC->Dr.m1, lineCC->Dr.mL,
-                            lineCC->Dw.a, lineCC->Dw.m1, lineCC->Dw.mL,
-                            lineCC->Bc.b, lineCC->Bc.mp, 
-                            lineCC->Bi.b, lineCC->Bi.mp);
-      }
-      else if (clo_cache_sim && !clo_branch_sim) {
-         VG_(fprintf)(fp,  "%d %llu %llu %llu"
-                             " %llu %llu %llu"
-                             " %llu %llu %llu\n",
-                            lineCC->loc.line,
-                            lineCC->Ir.a, lineCC->Ir.m1, lineCC->Ir.mL, 
-                            lineCC->Dr.a, lineCC->Dr.m1, lineCC->Dr.mL,
-                            lineCC->Dw.a, lineCC->Dw.m1, lineCC->Dw.mL);
-      }
-      else if (!clo_cache_sim && clo_branch_sim) {
-         VG_(fprintf)(fp,  "%d %llu"
-                             " %llu %llu %llu %llu\n",
-                            lineCC->loc.line,
-                            lineCC->Ir.a, 
-                            lineCC->Bc.b, lineCC->Bc.mp, 
-                            lineCC->Bi.b, lineCC->Bi.mp);
-      }
-      else {
-         VG_(fprintf)(fp,  "%d %llu\n",
-                            lineCC->loc.line,
-                            lineCC->Ir.a);
-      }
+      VG_(fprintf)(fp, "%d", lineCC->loc.line);
+      fprint_counts(fp, &lineCC->Ir, &lineCC->Dr, &lineCC->Dw,
+                    &lineCC->Tlb, &lineCC->Pf, &lineCC->Coh,
+                    &lineCC->Bc, &lineCC->Bi);
 
       // Update summary stats
       Ir_total.a  += lineCC->Ir.a;
       Ir_total.m1 += lineCC->Ir.m1;
+      Ir_total.mM += lineCC->Ir.mM;
       Ir_total.mL += lineCC->Ir.mL;
       Dr_total.a  += lineCC->Dr.a;
       Dr_total.m1 += lineCC->Dr.m1;
+      Dr_total.mM += lineCC->Dr.mM;
       Dr_total.mL += lineCC->Dr.mL;
       Dw_total.a  += lineCC->Dw.a;
       Dw_total.m1 += lineCC->Dw.m1;
+      Dw_total.mM += lineCC->Dw.mM;
       Dw_total.mL += lineCC->Dw.mL;
+      Tlb_total.i1 += lineCC->Tlb.i1;
+      Tlb_total.iL += lineCC->Tlb.iL;
+      Tlb_total.d1 += lineCC->Tlb.d1;
+      Tlb_total.dL += lineCC->Tlb.dL;
+      Pf_total.issued += lineCC->Pf.issued;
+      Pf_total.useful += lineCC->Pf.useful;
+      Coh_total.inv += lineCC->Coh.inv;
+      Coh_total.fs  += lineCC->Coh.fs;
       Bc_total.b  += lineCC->Bc.b;
       Bc_total.mp += lineCC->Bc.mp;
       Bi_total.b  += lineCC->Bi.b;
@@ -1508,44 +2108,150 @@ static void fprint_CC_table_and_calc_totals(void)
       distinct_lines++;
    }
 
+   if (cachesim_n_cores > 1)
+      fprint_data_lines(fp);
+
    // Summary stats must come after rest of table, since we calculate them
    // during traversal.  */
-   if (clo_cache_sim && clo_branch_sim) {
-      VG_(fprintf)(fp,  "summary:"
-                        " %llu %llu %llu"
-                        " %llu %llu %llu"
-                        " %llu %llu %llu"
-                        " %llu %llu %llu %llu\n", 
-                        Ir_total.a, Ir_total.m1, Ir_total.mL,
-                        Dr_total.a, Dr_total.m1, Dr_total.mL,
-                        Dw_total.a, Dw_total.m1, Dw_total.mL,
-                        Bc_total.b, Bc_total.mp, 
-                        Bi_total.b, Bi_total.mp);
-   }
-   else if (clo_cache_sim && !clo_branch_sim) {
-      VG_(fprintf)(fp,  "summary:"
-                        " %llu %llu %llu"
-                        " %llu %llu %llu"
-                        " %llu %llu %llu\n",
-                        Ir_total.a, Ir_total.m1, Ir_total.mL,
-                        Dr_total.a, Dr_total.m1, Dr_total.mL,
-                        Dw_total.a, Dw_total.m1, Dw_total.mL);
-   }
-   else if (!clo_cache_sim && clo_branch_sim) {
-      VG_(fprintf)(fp,  "summary:"
-                        " %llu"
-                        " %llu %llu %llu %llu\n", 
-                        Ir_total.a,
-                        Bc_total.b, Bc_total.mp, 
-                        Bi_total.b, Bi_total.mp);
-   }
-   else {
-      VG_(fprintf)(fp, "summary:"
-                        " %llu\n", 
-                        Ir_total.a);
+   VG_(fprintf)(fp, "summary:");
+   fprint_counts(fp, &Ir_total, &Dr_total, &Dw_total, &Tlb_total, &Pf_total,
+                 &Coh_total, &Bc_total, &Bi_total);
+
+   VG_(fclose)(fp);
+}
+
+// The data profile is written in the same format as the main output file,
+// so cg_annotate, cg_diff and cg_merge work on it.  Heap blocks are listed
+// under the file, function and line that allocated them; other objects
+// under file "???".
+typedef struct {
+   CodeLoc    loc;
+   DataMissCC M;
+} DataLocCC;
+
+static Word cmp_CodeLoc_DataLocCC(const void *vloc, const void *vcc)
+{
+   Word res;
+   const CodeLoc* a = (const CodeLoc*)vloc;
+   const CodeLoc* b = &(((const DataLocCC*)vcc)->loc);
+
+   res = VG_(strcmp)(a->file, b->file);
+   if (0 != res)
+      return res;
+
+   res = VG_(strcmp)(a->fn, b->fn);
+   if (0 != res)
+      return res;
+
+   return a->line - b->line;
+}
+
+static void add_DataLocCC(OSet* table, HChar* file, const HChar* fn,
+                          Int line, const DataMissCC* M)
+{
+   CodeLoc    loc;
+   DataLocCC* dl;
+
+   if (M->m1r == 0 && M->m1w == 0)
+      return;
+   loc.file = file;
+   loc.fn   = fn;
+   loc.line = line;
+   dl = VG_(OSetGen_Lookup)(table, &loc);
+   if (!dl) {
+      dl = VG_(OSetGen_AllocNode)(table, sizeof(DataLocCC));
+      dl->loc.file = get_perm_string(file);
+      dl->loc.fn   = get_perm_string(fn);
+      dl->loc.line = line;
+      dl->M.m1r = dl->M.mLr = dl->M.m1w = dl->M.mLw = 0;
+      VG_(OSetGen_Insert)(table, dl);
    }
+   dl->M.m1r += M->m1r;
+   dl->M.mLr += M->mLr;
+   dl->M.m1w += M->m1w;
+   dl->M.mLw += M->mLw;
+}
 
+static void fprint_data_profile(void)
+{
+   VgFile*      fp;
+   OSet*        table;
+   DataObjCC*   obj;
+   DataLocCC*   dl;
+   DataMissCC   total = { 0, 0, 0, 0 };
+   HChar*       currFile = NULL;
+   HChar*       unknown;
+   const HChar* currFn = NULL;
+   const HChar  *fn, *file, *dir;
+   UInt         line;
+
+   HChar* data_out_file =
+      VG_(expand_file_name)("--data-out-file", clo_data_out_file);
+
+   fp = VG_(fopen)(data_out_file, VKI_O_CREAT|VKI_O_TRUNC|VKI_O_WRONLY,
+                                  VKI_S_IRUSR|VKI_S_IWUSR);
+   if (fp == NULL) {
+      VG_(umsg)("error: can't open data profile output file '%s'\n",
+                data_out_file );
+      VG_(umsg)("       ... so the data profile will be missing.\n");
+      VG_(free)(data_out_file);
+      return;
+   }
+   VG_(free)(data_out_file);
+
+   table = VG_(OSetGen_Create)(offsetof(DataLocCC, loc),
+                               cmp_CodeLoc_DataLocCC,
+                               VG_(malloc), "cg.fprint_data_profile.1",
+                               VG_(free));
+
+   VG_(HT_ResetIter)(data_site_table);
+   while ((obj = VG_(HT_Next)(data_site_table))) {
+      get_debug_info(obj->key, &dir, &file, &fn, &line);
+
+      // Form an absolute pathname if a directory is available
+      HChar absfile[VG_(strlen)(dir) + 1 + VG_(strlen)(file) + 1];
+
+      if (dir[0]) {
+         VG_(sprintf)(absfile, "%s/%s", dir, file);
+      } else {
+         VG_(sprintf)(absfile, "%s", file);
+      }
+      add_DataLocCC(table, absfile, fn, line, &obj->M);
+   }
+   unknown = get_perm_string("???");
+   VG_(HT_ResetIter)(data_sym_table);
+   while ((obj = VG_(HT_Next)(data_sym_table)))
+      add_DataLocCC(table, unknown, obj->name, 0, &obj->M);
+   add_DataLocCC(table, unknown, "(stack)", 0, &data_stack_obj.M);
+   add_DataLocCC(table, unknown, "(unknown)", 0, &data_unknown_obj.M);
+
+   fprint_desc_and_cmd(fp);
+   VG_(fprintf)(fp, "\nevents: D1mr DLmr D1mw DLmw\n");
+
+   VG_(OSetGen_ResetIter)(table);
+   while ( (dl = VG_(OSetGen_Next)(table)) ) {
+      Bool just_hit_a_new_file = False;
+      if ( dl->loc.file != currFile ) {
+         currFile = dl->loc.file;
+         VG_(fprintf)(fp, "fl=%s\n", currFile);
+         just_hit_a_new_file = True;
+      }
+      if ( just_hit_a_new_file || dl->loc.fn != currFn ) {
+         currFn = dl->loc.fn;
+         VG_(fprintf)(fp, "fn=%s\n", currFn);
+      }
+      VG_(fprintf)(fp, "%d %llu %llu %llu %llu\n", dl->loc.line,
+                   dl->M.m1r, dl->M.mLr, dl->M.m1w, dl->M.mLw);
+      total.m1r += dl->M.m1r;
+      total.mLr += dl->M.mLr;
+      total.m1w += dl->M.m1w;
+      total.mLw += dl->M.mLw;
+   }
+
+   VG_(fprintf)(fp, "summary: %llu %llu %llu %llu\n",
+                total.m1r, total.mLr, total.m1w, total.mLw);
    VG_(fclose)(fp);
+   VG_(OSetGen_Destroy)(table);
 }
 
 static UInt ULong_width(ULong n)
@@ -1570,6 +2276,8 @@ static void cg_fini(Int exitcode)
    Int l1, l2, l3;
 
    fprint_CC_table_and_calc_totals();
+   if (clo_data_profile)
+      fprint_data_profile();
 
    if (VG_(clo_verbosity) == 0) 
       return;
@@ -1593,11 +2301,16 @@ static void cg_fini(Int exitcode)
       miss numbers */
    if (clo_cache_sim) {
       VG_(umsg)(fmt, "I1  misses:   ", Ir_total.m1);
+      if (cachesim_ML_used)
+         VG_(umsg)(fmt, "MLi misses:   ", Ir_total.mM);
       VG_(umsg)(fmt, "LLi misses:   ", Ir_total.mL);
 
       if (0 == Ir_total.a) Ir_total.a = 1;
       VG_(umsg)("I1  miss rate: %*.2f%%\n", l1,
                 Ir_total.m1 * 100.0 / Ir_total.a);
+      if (cachesim_ML_used)
+         VG_(umsg)("MLi miss rate: %*.2f%%\n", l1,
+                   Ir_total.mM * 100.0 / Ir_total.a);
       VG_(umsg)("LLi miss rate: %*.2f%%\n", l1,
                 Ir_total.mL * 100.0 / Ir_total.a);
       VG_(umsg)("\n");
@@ -1606,6 +2319,7 @@ static void cg_fini(Int exitcode)
        * determine the width of columns 2 & 3. */
       D_total.a  = Dr_total.a  + Dw_total.a;
       D_total.m1 = Dr_total.m1 + Dw_total.m1;
+      D_total.mM = Dr_total.mM + Dw_total.mM;
       D_total.mL = Dr_total.mL + Dw_total.mL;
 
       /* Make format string, getting width right for numbers */
@@ -1616,6 +2330,9 @@ static void cg_fini(Int exitcode)
                      D_total.a, Dr_total.a, Dw_total.a);
       VG_(umsg)(fmt, "D1  misses:   ",
                      D_total.m1, Dr_total.m1, Dw_total.m1);
+      if (cachesim_ML_used)
+         VG_(umsg)(fmt, "MLd misses:   ",
+                        D_total.mM, Dr_total.mM, Dw_total.mM);
       VG_(umsg)(fmt, "LLd misses:   ",
                      D_total.mL, Dr_total.mL, Dw_total.mL);
 
@@ -1626,6 +2343,11 @@ static void cg_fini(Int exitcode)
                 l1, D_total.m1  * 100.0 / D_total.a,
                 l2, Dr_total.m1 * 100.0 / Dr_total.a,
                 l3, Dw_total.m1 * 100.0 / Dw_total.a);
+      if (cachesim_ML_used)
+         VG_(umsg)("MLd miss rate: %*.1f%% (%*.1f%%     + %*.1f%%  )\n",
+                   l1, D_total.mM  * 100.0 / D_total.a,
+                   l2, Dr_total.mM * 100.0 / Dr_total.a,
+                   l3, Dw_total.mM * 100.0 / Dw_total.a);
       VG_(umsg)("LLd miss rate: %*.1f%% (%*.1f%%     + %*.1f%%  )\n",
                 l1, D_total.mL  * 100.0 / D_total.a,
                 l2, Dr_total.mL * 100.0 / Dr_total.a,
@@ -1650,6 +2372,31 @@ static void cg_fini(Int exitcode)
                 l1, LL_total_m  * 100.0 / (Ir_total.a + D_total.a),
                 l2, LL_total_mr * 100.0 / (Ir_total.a + Dr_total.a),
                 l3, LL_total_mw * 100.0 / Dw_total.a);
+
+      /* TLB results: first level misses and page walks. */
+      if (cachesim_tlb) {
+         VG_(sprintf)(fmt, "%%s %%,%dllu  (%%,%dllu ins  + %%,%dllu data)\n",
+                           l1, l2, l3);
+         VG_(umsg)("\n");
+         VG_(umsg)(fmt, "TLB1 misses:  ", Tlb_total.i1 + Tlb_total.d1,
+                        Tlb_total.i1, Tlb_total.d1);
+         VG_(umsg)(fmt, "TLB  misses:  ", Tlb_total.iL + Tlb_total.dL,
+                        Tlb_total.iL, Tlb_total.dL);
+      }
+
+      if (cachesim_pf != PF_None) {
+         VG_(sprintf)(fmt, "%%s %%,%dllu\n", l1);
+         VG_(umsg)("\n");
+         VG_(umsg)(fmt, "PF issued:    ", Pf_total.issued);
+         VG_(umsg)(fmt, "PF useful:    ", Pf_total.useful);
+      }
+
+      if (cachesim_n_cores > 1) {
+         VG_(sprintf)(fmt, "%%s %%,%dllu\n", l1);
+         VG_(umsg)("\n");
+         VG_(umsg)(fmt, "Invalidations:", Coh_total.inv);
+         VG_(umsg)(fmt, "False sharing:", Coh_total.fs);
+      }
    }
 
    /* If branch profiling is enabled, show branch overall results. */
@@ -1730,24 +2477,119 @@ void cg_discard_superblock_info ( Addr orig_addr64, VexGuestExtents vge )
    // Get BB info, remove from table, free BB info.  Simple!  Note that we
    // use orig_addr, not the first instruction address in vge.
    sbInfo = VG_(OSetGen_Remove)(instrInfoTable, &orig_addr);
+   if (NULL == sbInfo && is_preload_code(orig_addr))
+      return;
    tl_assert(NULL != sbInfo);
    VG_(OSetGen_FreeNode)(instrInfoTable, sbInfo);
 }
 
+/*--------------------------------------------------------------------*/
+/*--- Client requests                                              ---*/
+/*--------------------------------------------------------------------*/
+
+// Only the wrappers in cg_intercepts.c make these.
+static Bool cg_handle_client_request(ThreadId tid, UWord* args, UWord* ret)
+{
+   if (!VG_IS_TOOL_USERREQ('C','G',args[0]))
+      return False;
+
+   switch (args[0]) {
+   case VG_USERREQ__CG_DATA_PROFILE:
+      *ret = clo_data_profile;
+      return True;
+   case VG_USERREQ__CG_MALLOC:
+   case VG_USERREQ__CG_FREE:
+      if (!clo_data_profile)
+         break;
+      if (args[0] == VG_USERREQ__CG_MALLOC)
+         data_new_block(tid, args[1], args[2]);
+      else
+         data_free_block(args[1]);
+      break;
+   default:
+      return False;
+   }
+   *ret = 0;
+   return True;
+}
+
 /*--------------------------------------------------------------------*/
 /*--- Command line processing                                      ---*/
 /*--------------------------------------------------------------------*/
 
 static Bool cg_process_cmd_line_option(const HChar* arg)
 {
+   const HChar* tmp_str;
+
    if (VG_(str_clo_cache_opt)(arg,
                               &clo_I1_cache,
                               &clo_D1_cache,
                               &clo_LL_cache)) {}
 
+   else if VG_STR_CLO(arg, "--ML", tmp_str) {
+      VG_(parse_cache_opt)(&clo_ML_cache, arg, tmp_str);
+   }
+   else if VG_XACT_CLO(arg, "--L1-replacement=lru",    clo_L1_repl, Repl_LRU) {}
+   else if VG_XACT_CLO(arg, "--L1-replacement=plru",   clo_L1_repl, Repl_PLRU) {}
+   else if VG_XACT_CLO(arg, "--L1-replacement=rrip",   clo_L1_repl, Repl_RRIP) {}
+   else if VG_XACT_CLO(arg, "--L1-replacement=random", clo_L1_repl,
+                       Repl_Random) {}
+   else if VG_XACT_CLO(arg, "--ML-replacement=lru",    clo_ML_repl, Repl_LRU) {}
+   else if VG_XACT_CLO(arg, "--ML-replacement=plru",   clo_ML_repl, Repl_PLRU) {}
+   else if VG_XACT_CLO(arg, "--ML-replacement=rrip",   clo_ML_repl, Repl_RRIP) {}
+   else if VG_XACT_CLO(arg, "--ML-replacement=random", clo_ML_repl,
+                       Repl_Random) {}
+   else if VG_XACT_CLO(arg, "--LL-replacement=lru",    clo_LL_repl, Repl_LRU) {}
+   else if VG_XACT_CLO(arg, "--LL-replacement=plru",   clo_LL_repl, Repl_PLRU) {}
+   else if VG_XACT_CLO(arg, "--LL-replacement=rrip",   clo_LL_repl, Repl_RRIP) {}
+   else if VG_XACT_CLO(arg, "--LL-replacement=random", clo_LL_repl,
+                       Repl_Random) {}
+   else if VG_XACT_CLO(arg, "--LL-inclusion=nine",      clo_LL_incl,
+                       Incl_NINE) {}
+   else if VG_XACT_CLO(arg, "--LL-inclusion=inclusive", clo_LL_incl,
+                       Incl_Inclusive) {}
+   else if VG_XACT_CLO(arg, "--LL-inclusion=exclusive", clo_LL_incl,
+                       Incl_Exclusive) {}
+
+   else if VG_BOOL_CLO(arg, "--tlb-sim", clo_tlb_sim) {}
+   else if VG_INT_CLO (arg, "--page-size", clo_page_size) {
+      if (clo_page_size < 4096 || clo_page_size > (1 << 30)
+          || VG_(log2)(clo_page_size) == -1)
+         VG_(fmsg_bad_option)(arg, "The page size must be a power of two "
+                              "between 4096 and 1073741824.\n");
+   }
+   else if VG_STR_CLO(arg, "--ITLB", tmp_str) {
+      parse_tlb_opt(&clo_ITLB_entries, &clo_ITLB_assoc, arg, tmp_str);
+   }
+   else if VG_STR_CLO(arg, "--DTLB", tmp_str) {
+      parse_tlb_opt(&clo_DTLB_entries, &clo_DTLB_assoc, arg, tmp_str);
+   }
+   else if VG_STR_CLO(arg, "--STLB", tmp_str) {
+      parse_tlb_opt(&clo_STLB_entries, &clo_STLB_assoc, arg, tmp_str);
+   }
+   else if VG_XACT_CLO(arg, "--prefetch=none",      clo_prefetch, PF_None) {}
+   else if VG_XACT_CLO(arg, "--prefetch=next-line", clo_prefetch,
+                       PF_NextLine) {}
+   else if VG_XACT_CLO(arg, "--prefetch=stride",    clo_prefetch, PF_Stride) {}
+   else if VG_BINT_CLO(arg, "--cores", clo_cores, 1, CACHESIM_MAX_CORES) {}
+
    else if VG_STR_CLO( arg, "--cachegrind-out-file", clo_cachegrind_out_file) {}
    else if VG_BOOL_CLO(arg, "--cache-sim",  clo_cache_sim)  {}
    else if VG_BOOL_CLO(arg, "--branch-sim", clo_branch_sim) {}
+   else if VG_XACT_CLO(arg, "--branch-predictor=simple", clo_branch_pred,
+                       BP_Simple) {}
+   else if VG_XACT_CLO(arg, "--branch-predictor=gshare", clo_branch_pred,
+                       BP_GShare) {}
+   else if VG_XACT_CLO(arg, "--branch-predictor=tage",   clo_branch_pred,
+                       BP_TAGE) {}
+   else if VG_XACT_CLO(arg, "--indirect-predictor=btac", clo_ind_pred,
+                       BP_BTAC) {}
+   else if VG_XACT_CLO(arg, "--indirect-predictor=ittage", clo_ind_pred,
+                       BP_ITTAGE) {}
+   else if VG_BINT_CLO(arg, "--branch-history", clo_branch_hist,
+                       8, BP_MAX_HIST) {}
+   else if VG_BOOL_CLO(arg, "--data-profile", clo_data_profile) {}
+   else if VG_STR_CLO( arg, "--data-out-file", clo_data_out_file) {}
    else
       return False;
 
@@ -1758,9 +2600,35 @@ static void cg_print_usage(void)
 {
    VG_(print_cache_clo_opts)();
    VG_(printf)(
+"    --ML=<size>,<assoc>,<line_size>  simulate a mid-level cache between\n"
+"                                     I1/D1 and LL [none]\n"
+"    --L1-replacement=lru|plru|rrip|random  I1/D1 replacement policy [lru]\n"
+"    --ML-replacement=lru|plru|rrip|random  ML replacement policy [lru]\n"
+"    --LL-replacement=lru|plru|rrip|random  LL replacement policy [lru]\n"
+"    --LL-inclusion=nine|inclusive|exclusive\n"
+"                                     LL contents w.r.t. upper levels [nine]\n"
+"    --prefetch=none|next-line|stride D1 prefetcher model [none]\n"
+"    --tlb-sim=yes|no                 collect TLB miss stats? [no]\n"
+"    --ITLB=<entries>,<assoc>         first level instruction TLB [128,8]\n"
+"    --DTLB=<entries>,<assoc>         first level data TLB [64,4]\n"
+"    --STLB=<entries>,<assoc>         shared second level TLB [1536,12]\n"
+"    --page-size=<number>             page size in bytes, e.g. 2097152 for\n"
+"                                     huge pages [4096]\n"
+"    --cores=<number>                 simulate this many cores with private\n"
+"                                     I1/D1/ML caches and count coherence\n"
+"                                     invalidations [1]\n"
 "    --cache-sim=yes|no               collect cache stats? [yes]\n"
 "    --branch-sim=yes|no              collect branch prediction stats? [no]\n"
+"    --branch-predictor=simple|gshare|tage\n"
+"                                     conditional branch predictor [simple]\n"
+"    --indirect-predictor=btac|ittage indirect branch predictor [btac]\n"
+"    --branch-history=<number>        longest global history used by gshare,\n"
+"                                     tage and ittage, in branches [64]\n"
+"    --data-profile=yes|no            charge data cache misses to heap\n"
+"                                     allocation sites and variables? [no]\n"
 "    --cachegrind-out-file=<file>     output file name [cachegrind.out.%%p]\n"
+"    --data-out-file=<file>           data profile output file name\n"
+"                                     [cachegrind.data.%%p]\n"
    );
 }
 
@@ -1796,11 +2664,22 @@ static void cg_pre_clo_init(void)
                                    cg_fini);
 
    VG_(needs_superblock_discards)(cg_discard_superblock_info);
+   VG_(needs_client_requests)(cg_handle_client_request);
    VG_(needs_command_line_options)(cg_process_cmd_line_option,
                                    cg_print_usage,
                                    cg_print_debug_usage);
 }
 
+// With --cores, thread N runs on core (N-1) % cores.
+static void cg_start_client_code(ThreadId tid, ULong blocks_done)
+{
+   Int core = (tid - 1) % cachesim_n_cores;
+
+   if (core == cachesim_core)
+      return;
+   cachesim_switch_core(core);
+}
+
 static void cg_post_clo_init(void)
 {
    cache_t I1c, D1c, LLc; 
@@ -1846,7 +2725,87 @@ static void cg_post_clo_init(void)
       VG_(exit)(1);
    }
 
-   cachesim_initcaches(I1c, D1c, LLc);
+   if (clo_ML_cache.size != -1 || clo_L1_repl != Repl_LRU
+       || clo_ML_repl != Repl_LRU || clo_LL_repl != Repl_LRU
+       || clo_LL_incl != Incl_NINE || clo_prefetch != PF_None
+       || clo_tlb_sim || clo_cores > 1 || clo_data_profile) {
+      /* Blocks are looked up in all levels with the same tag. */
+      if (I1c.line_size != D1c.line_size || I1c.line_size != LLc.line_size
+          || (clo_ML_cache.size != -1
+              && clo_ML_cache.line_size != LLc.line_size)) {
+         VG_(umsg)("Cachegrind: cannot continue: a mid-level cache, a "
+                   "replacement policy\n");
+         VG_(umsg)("  other than LRU, an inclusive or exclusive LL cache, "
+                   "prefetching, TLB\n");
+         VG_(umsg)("  simulation, multiple cores and --data-profile=yes "
+                   "require all caches\n");
+         VG_(umsg)("  to have the same line size.  Exiting now.\n");
+         VG_(exit)(1);
+      }
+   }
+
+   cachesim_initcaches(I1c, D1c, clo_ML_cache, LLc,
+                       clo_L1_repl, clo_ML_repl, clo_LL_repl, clo_LL_incl);
+   cachesim_initprefetch(clo_prefetch);
+   branchpred_init(clo_branch_pred, clo_ind_pred, clo_branch_hist);
+   if (!clo_cache_sim)
+      clo_data_profile = False;
+
+   // The heap wrappers in vgpreload_cachegrind-$PLATFORM.so are only needed
+   // for --data-profile=yes.  Otherwise remove it from LD_PRELOAD (or
+   // platform-equivalent), as Massif does for --pages-as-heap=yes, so that
+   // the wrappers neither run nor add to the counts.  This is a bit of a
+   // hack, but LD_PRELOAD is setup well before tool initialisation.
+   if (!clo_data_profile) {
+      HChar* LD_PRELOAD_val = VG_(getenv)( VG_(LD_PRELOAD_var_name) );
+      HChar* s1;
+      HChar* s2;
+
+      tl_assert(LD_PRELOAD_val);
+
+      // Make sure the vgpreload_core-$PLATFORM entry is there, for sanity.
+      s1 = VG_(strstr)(LD_PRELOAD_val, "vgpreload_core");
+      tl_assert(s1);
+
+      // Now find the vgpreload_cachegrind-$PLATFORM entry.
+      s1 = VG_(strstr)(LD_PRELOAD_val, "vgpreload_cachegrind");
+      tl_assert(s1);
+      s2 = s1;
+
+      // Position s1 on the previous ':', which must be there because
+      // of the preceding vgpreload_core-$PLATFORM entry.
+      for (; *s1 != ':'; s1--)
+         ;
+
+      // Position s2 on the next ':' or \0
+      for (; *s2 != ':' && *s2 != '\0'; s2++)
+         ;
+
+      // Move all characters from s2 to s1
+      while ((*s1++ = *s2++))
+         ;
+   }
+   if (clo_tlb_sim)
+      cachesim_inittlbs(clo_ITLB_entries, clo_ITLB_assoc,
+                        clo_DTLB_entries, clo_DTLB_assoc,
+                        clo_STLB_entries, clo_STLB_assoc, clo_page_size);
+   if (clo_cache_sim && clo_cores > 1) {
+      cachesim_initcores(clo_cores);
+      data_line_table = VG_(HT_construct)("cg.data_line_table");
+      VG_(track_start_client_code)(cg_start_client_code);
+   }
+   if (clo_data_profile) {
+      // Misses are only seen one at a time in the hierarchy simulation.
+      cachesim_hier = True;
+      heap_blocks =
+         VG_(OSetGen_Create)(offsetof(HeapBlock, payload),
+                             cmp_Addr_HeapBlock,
+                             VG_(malloc), "cg.main.cpci.4",
+                             VG_(free));
+      data_site_table = VG_(HT_construct)("cg.data_site_table");
+      data_sym_table  = VG_(HT_construct)("cg.data_sym_table");
+      data_sym_cache_clear();
+   }
 }
 
 VG_DETERMINE_INTERFACE_VERSION(cg_pre_clo_init)
@@ -1,6 +1,6 @@
 
 /*--------------------------------------------------------------------*/
-/*--- A program that merges multiple cachegrind output files.      ---*/
+/*--- A program that merges cachegrind or callgrind output files.  ---*/
 /*---                                                   cg_merge.c ---*/
 /*--------------------------------------------------------------------*/
 
@@ -37,6 +37,13 @@
 #include <assert.h>
 #include <string.h>
 #include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
 
 typedef  signed long   Word;
 typedef  unsigned long UWord;
@@ -47,6 +54,7 @@ typedef  signed int    Int;
 typedef  unsigned int  UInt;
 typedef  unsigned long long int ULong;
 typedef  signed char   Char;
+typedef  unsigned char UChar;
 typedef  size_t        SizeT;
 
 
@@ -112,12 +120,15 @@ WordFM* dopyFM ( WordFM* fm, Word(*dopyK)(Word), Word(*dopyV)(Word) );
 static const char* argv0 = "cg_merge";
 
 /* Keep track of source filename/line no so as to be able to
-   print decent error messages. */
+   print decent error messages.  Also holds the line buffer, so that
+   several files can be read at once, by several threads. */
 typedef
    struct {
-      FILE* fp;
-      UInt  lno;
-      char* filename;
+      FILE*  fp;
+      UInt   lno;
+      const char* filename;
+      char*  line;
+      size_t linesiz;
    }
    SOURCE;
 
@@ -151,42 +162,25 @@ static void barf ( SOURCE* s, const char* msg )
 }
 
 // Read a line. Return the line read, or NULL if at EOF.
-// The line is allocated dynamically but will be overwritten with
+// The line is held in a buffer of s, which is overwritten with
 // every invocation. Caller must not free it.
 static const char *readline ( SOURCE* s )
 {
-   static char  *line = NULL;
-   static size_t linesiz = 0;
+   ssize_t n = getline(&s->line, &s->linesiz, s->fp);
 
-   int ch, i = 0;
-
-   while (1) {
-      ch = getc(s->fp);
-      if (ch != EOF) {
-          if (i + 1 >= linesiz) {
-             linesiz += 500;
-             line = realloc(line, linesiz * sizeof *line);
-             if (line == NULL)
-                mallocFail(s, "readline:");
-          }
-          line[i++] = ch;
-          line[i] = 0;
-          if (ch == '\n') {
-             line[i-1] = 0;
-             s->lno++;
-             break;
-          }
-      } else {
-         if (ferror(s->fp)) {
-            perror(argv0);
-            barf(s, "I/O error while reading input file");
-         } else {
-            // hit EOF
-            break;
-         }
+   if (n < 0) {
+      if (ferror(s->fp)) {
+         perror(argv0);
+         barf(s, "I/O error while reading input file");
       }
+      // hit EOF
+      return NULL;
    }
-   return i == 0 ? NULL : line;
+   if (n > 0 && s->line[n-1] == '\n') {
+      s->line[n-1] = 0;
+      s->lno++;
+   }
+   return s->line;
 }
 
 static Bool streqn ( const char* s1, const char* s2, size_t n )
@@ -242,16 +236,6 @@ typedef
    }
    CacheProfFile;
 
-static FileFn* new_FileFn ( char* file_name, char* fn_name )
-{
-   FileFn* ffn = malloc(sizeof(FileFn));
-   if (ffn == NULL)
-      return NULL;
-   ffn->fi_name = file_name;
-   ffn->fn_name = fn_name;
-   return ffn;
-}
-
 static void ddel_FileFn ( FileFn* ffn )
 {
    if (ffn->fi_name)
@@ -262,19 +246,6 @@ static void ddel_FileFn ( FileFn* ffn )
    free(ffn);
 }
 
-static FileFn* dopy_FileFn ( FileFn* ff )
-{
-   char *fi2, *fn2;
-   fi2 = strdup(ff->fi_name);
-   if (fi2 == NULL) return NULL;
-   fn2 = strdup(ff->fn_name);
-   if (fn2 == NULL) {
-      free(fi2);
-      return NULL;
-   }
-   return new_FileFn( fi2, fn2 );
-}
-
 static Counts* new_Counts ( Int n_counts, /*COPIED*/ULong* counts )
 {
    Int i;
@@ -331,11 +302,6 @@ static void ddel_Counts ( Counts* cts )
    free(cts);
 }
 
-static Counts* dopy_Counts ( Counts* cts )
-{
-   return new_Counts( cts->n_counts, cts->counts );
-}
-
 static
 CacheProfFile* new_CacheProfFile ( char**  desc_lines,
                                    char*   cmd_line,
@@ -358,12 +324,6 @@ CacheProfFile* new_CacheProfFile ( char**  desc_lines,
    return cpf;
 }
 
-static WordFM* dopy_InnerMap ( WordFM* innerMap )
-{
-   return dopyFM ( innerMap, NULL,
-                             (Word(*)(Word))dopy_Counts );
-}
-
 static void ddel_InnerMap ( WordFM* innerMap )
 {
    deleteFM( innerMap, NULL, (void(*)(Word))ddel_Counts );
@@ -701,6 +661,11 @@ static CacheProfFile* parse_CacheProfFile ( SOURCE* s )
          continue;
       }
       else
+      if (line[0] == '#') {
+         // comment, e.g. the per data line counts of --cores
+         continue;
+      }
+      else
       if (streqn(line, "fn=", 3)) {
          free(curr_fn);
          curr_fn = strdup(line+3);
@@ -763,202 +728,1918 @@ static CacheProfFile* parse_CacheProfFile ( SOURCE* s )
 }
 
 
-static void merge_CacheProfInfo ( SOURCE* s,
-                                  /*MOD*/CacheProfFile* dst,
-                                  CacheProfFile* src )
+//------------------------------------------------------------------//
+//---                      Input/output files                    ---//
+//------------------------------------------------------------------//
+
+/* Input files whose names end in ".gz" (as written by Callgrind with
+   --dump-gzip=yes) are read through "gzip -dc".  Pipes are created
+   with the lock held and are close-on-exec, so that a gzip started by
+   one thread does not hold the write end of another thread's pipe
+   open. */
+static pthread_mutex_t fork_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static FILE* open_input ( SOURCE* s, /*OUT*/pid_t* pid )
 {
-   /* For each (filefn, innerMap) in src
-      if filefn not in dst
-         add binding dopy(filefn)->dopy(innerMap) in src
-      else
-         // merge src->innerMap with dst->innerMap
-         for each (lineno, counts) in src->innerMap
-         if lineno not in dst->innerMap
-            add binding lineno->dopy(counts) to dst->innerMap
-         else
-            add counts into dst->innerMap[lineno]
-   */
-   /* Outer iterator:  FileFn* -> WordFM* (inner iterator)
-      Inner iterator:  UWord   -> Counts*
-   */
-   FileFn* soKey;
-   WordFM* soVal;
-   WordFM* doVal;
-   UWord   siKey;
-   Counts* siVal;
-   Counts* diVal;
-
-   /* First check mundane things: that the events: lines are
-      identical. */
-   if (!streq( dst->events_line, src->events_line ))
-     barf(s, "\"events:\" line of most recent file does "
-             "not match those previously processed");
-
-   initIterFM( src->outerMap );
-
-   // for (filefn, innerMap) in src
-   while (nextIterFM( src->outerMap, (Word*)&soKey, (Word*)&soVal )) {
-
-      // is filefn in dst?   
-      if (! lookupFM( dst->outerMap, (Word*)&doVal, (Word)soKey )) {
-
-         // no .. add dopy(filefn) -> dopy(innerMap) to src
-         FileFn* c_soKey = dopy_FileFn(soKey);
-         WordFM* c_soVal = dopy_InnerMap(soVal);
-         if ((!c_soKey) || (!c_soVal)) goto oom;
-         addToFM( dst->outerMap, (Word)c_soKey, (Word)c_soVal );
+   size_t len = strlen(s->filename);
+   FILE*  fp;
+   int    fds[2];
+
+   s->lno  = 1;
+   *pid    = 0;
+   if (len < 3 || !streq(s->filename + len - 3, ".gz")) {
+      s->fp = fopen(s->filename, "r");
+      return s->fp;
+   }
 
-      } else {
+   pthread_mutex_lock(&fork_lock);
+   if (pipe(fds) != 0) {
+      pthread_mutex_unlock(&fork_lock);
+      return NULL;
+   }
+   fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+   fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+   *pid = fork();
+   if (*pid == 0) {
+      dup2(fds[1], 1);
+      execlp("gzip", "gzip", "-dc", "--", s->filename, (char*)NULL);
+      _exit(127);
+   }
+   close(fds[1]);
+   pthread_mutex_unlock(&fork_lock);
+   if (*pid < 0) {
+      close(fds[0]);
+      return NULL;
+   }
+   fp = fdopen(fds[0], "r");
+   s->fp = fp;
+   return fp;
+}
 
-         // yes .. merge the two innermaps
-         initIterFM( soVal );
+/* If complete is False, the input was not read to the end, and gzip
+   may have been killed by SIGPIPE. */
+static void close_input ( SOURCE* s, pid_t pid, Bool complete )
+{
+   int status;
+
+   fclose(s->fp);
+   s->fp = NULL;
+   if (pid > 0) {
+      if (waitpid(pid, &status, 0) != pid)
+         barf(s, "cannot wait for gzip");
+      if (complete && !(WIFEXITED(status) && WEXITSTATUS(status) == 0))
+         barf(s, "gzip failed to decompress input file");
+   }
+}
 
-         // for (lno, counts) in soVal (source inner map)
-         while (nextIterFM( soVal, (Word*)&siKey, (Word*)&siVal )) {
+/* Temporary files are unlinked right away, so they disappear on
+   exit. */
+static FILE* open_tmp ( void )
+{
+   const char* dir = getenv("TMPDIR");
+   char*       name;
+   FILE*       fp;
+   int         fd;
+
+   if (!dir || !dir[0])
+      dir = "/tmp";
+   name = malloc(strlen(dir) + 20);
+   if (!name) {
+      fprintf(stderr, "%s: out of memory\n", argv0);
+      exit(2);
+   }
+   sprintf(name, "%s/cg_merge.XXXXXX", dir);
+   fd = mkstemp(name);
+   if (fd < 0 || !(fp = fdopen(fd, "w+"))) {
+      fprintf(stderr, "%s: cannot create temporary file in %s\n",
+                      argv0, dir);
+      perror(argv0);
+      exit(1);
+   }
+   unlink(name);
+   free(name);
+   return fp;
+}
 
-            // is lno in the corresponding dst inner map?
-            if (! lookupFM( doVal, (Word*)&diVal, siKey )) {
+/* The intermediate files of a merge are named, so that they can be
+   closed until they are read.  They are created in a private directory,
+   which is removed on exit. */
+static pthread_mutex_t tmp_lock = PTHREAD_MUTEX_INITIALIZER;
+static char*           tmp_dir;
+static UInt            tmp_count;
 
-               // no .. add lineno->dopy(counts) to dst inner map
-               Counts* c_siVal = dopy_Counts( siVal );
-               if (!c_siVal) goto oom;
-               addToFM( doVal, siKey, (Word)c_siVal );
+static void remove_tmp_dir ( void )
+{
+   DIR*           d = opendir(tmp_dir);
+   struct dirent* e;
+   char*          name;
+
+   if (d) {
+      while ((e = readdir(d))) {
+         if (streq(e->d_name, ".") || streq(e->d_name, ".."))
+            continue;
+         name = malloc(strlen(tmp_dir) + strlen(e->d_name) + 2);
+         if (!name)
+            break;
+         sprintf(name, "%s/%s", tmp_dir, e->d_name);
+         unlink(name);
+         free(name);
+      }
+      closedir(d);
+   }
+   rmdir(tmp_dir);
+}
 
-            } else {
+/* Create a new intermediate file for writing, and return its name in
+   *name. */
+static FILE* create_tmp ( /*OUT*/char** name )
+{
+   const char* dir;
+   FILE*       fp;
+   UInt        n;
+
+   pthread_mutex_lock(&tmp_lock);
+   if (!tmp_dir) {
+      dir = getenv("TMPDIR");
+      if (!dir || !dir[0])
+         dir = "/tmp";
+      tmp_dir = malloc(strlen(dir) + 20);
+      if (!tmp_dir) {
+         fprintf(stderr, "%s: out of memory\n", argv0);
+         exit(2);
+      }
+      sprintf(tmp_dir, "%s/cg_merge.XXXXXX", dir);
+      if (!mkdtemp(tmp_dir)) {
+         fprintf(stderr, "%s: cannot create temporary directory in %s\n",
+                         argv0, dir);
+         perror(argv0);
+         exit(1);
+      }
+      atexit(remove_tmp_dir);
+   }
+   n = tmp_count++;
+   pthread_mutex_unlock(&tmp_lock);
+
+   *name = malloc(strlen(tmp_dir) + 12);
+   if (!*name) {
+      fprintf(stderr, "%s: out of memory\n", argv0);
+      exit(2);
+   }
+   sprintf(*name, "%s/%u", tmp_dir, n);
+   fp = fopen(*name, "w");
+   if (!fp) {
+      fprintf(stderr, "%s: cannot create temporary file %s\n",
+                      argv0, *name);
+      perror(argv0);
+      exit(1);
+   }
+   return fp;
+}
+
+static void check_written ( FILE* f, const char* name )
+{
+   if (fflush(f) != 0 || ferror(f)) {
+      fprintf(stderr, "%s: error writing %s\n", argv0, name);
+      perror(argv0);
+      exit(1);
+   }
+}
+
+static void* xmalloc ( SOURCE* s, SizeT n )
+{
+   void* p = malloc(n);
+   if (p == NULL)
+      mallocFail(s, "xmalloc");
+   return p;
+}
+
+static void* xrealloc ( SOURCE* s, void* p, SizeT n )
+{
+   p = realloc(p, n);
+   if (p == NULL)
+      mallocFail(s, "xrealloc");
+   return p;
+}
+
+static char* xstrdup ( SOURCE* s, const char* str )
+{
+   char* p = strdup(str);
+   if (p == NULL)
+      mallocFail(s, "xstrdup");
+   return p;
+}
+
+/* Run fn(arg) on 'jobs' threads, including the calling one. */
+static void run_jobs ( Int jobs, void* (*fn)(void*), void* arg )
+{
+   pthread_t* th = malloc(jobs * sizeof(pthread_t));
+   Int        i;
+
+   assert(th);
+   for (i = 1; i < jobs; i++) {
+      if (pthread_create(&th[i], NULL, fn, arg) != 0) {
+         fprintf(stderr, "%s: cannot create thread\n", argv0);
+         exit(1);
+      }
+   }
+   fn(arg);
+   for (i = 1; i < jobs; i++)
+      pthread_join(th[i], NULL);
+   free(th);
+}
+
+
+//------------------------------------------------------------------//
+//---                     Top-N function summary                 ---//
+//------------------------------------------------------------------//
+
+typedef
+   struct {
+      char* fl;
+      char* fn;
+      ULong cost;
+   }
+   TopFn;
+
+typedef
+   struct {
+      TopFn* fns;
+      Int    n_fns;
+      Int    size;
+   }
+   TopList;
+
+static void add_TopFn ( TopList* t, const char* fl, const char* fn,
+                        ULong cost )
+{
+   if (t->n_fns == t->size) {
+      t->size = t->size ? 2 * t->size : 1024;
+      t->fns  = xrealloc(NULL, t->fns, t->size * sizeof(TopFn));
+   }
+   t->fns[t->n_fns].fl   = xstrdup(NULL, fl);
+   t->fns[t->n_fns].fn   = xstrdup(NULL, fn);
+   t->fns[t->n_fns].cost = cost;
+   t->n_fns++;
+}
+
+static int cmp_TopFn ( const void* v1, const void* v2 )
+{
+   const TopFn* t1 = v1;
+   const TopFn* t2 = v2;
+   if (t1->cost > t2->cost) return -1;
+   if (t1->cost < t2->cost) return 1;
+   return 0;
+}
+
+/* Print the n most expensive functions for the first event of
+   events_line. */
+static void show_TopList ( TopList* t, Int n, const char* events_line,
+                           ULong total )
+{
+   const char* ev = events_line + 7;
+   Int         i, len;
+
+   while (isspace(*ev)) ev++;
+   for (len = 0; ev[len] && !isspace(ev[len]); len++) ;
+
+   qsort(t->fns, t->n_fns, sizeof(TopFn), cmp_TopFn);
+   if (n > t->n_fns)
+      n = t->n_fns;
+   fprintf(stderr, "%s: top %d of %d functions by %.*s:\n",
+                   argv0, n, t->n_fns, len, ev);
+   for (i = 0; i < n; i++)
+      fprintf(stderr, "%s: %20llu %6.2f%%  %s:%s\n", argv0,
+                      t->fns[i].cost,
+                      total ? 100.0 * t->fns[i].cost / total : 0.0,
+                      t->fns[i].fl, t->fns[i].fn);
+}
+
+
+//------------------------------------------------------------------//
+//---          Cachegrind format: k-way merge of sorted files    ---//
+//------------------------------------------------------------------//
+
+/* Cachegrind writes its output sorted by file name, function name and
+   line number.  Such files are merged with a k-way merge which holds
+   just one function's worth of data per input in memory.  At most
+   max_open files are merged at a time; with more inputs, groups of
+   files are merged into intermediate files first, and these are then
+   merged in turn.  The groups of a level are merged in parallel with
+   -j.  An input found not to be sorted after all is parsed and sorted
+   in memory with the code above, and its group is merged again.
+   Intermediate files are closed once written, so that only the inputs
+   and outputs of the groups being merged are open. */
+
+typedef
+   struct {
+      const char* name;     // file name, for messages
+      char*       tmp;      // if non-NULL, read this intermediate file
+   }
+   Input;
+
+typedef
+   struct {
+      SOURCE  src;
+      pid_t   pid;
+      char**  desc_lines;   // null-terminated
+      char*   cmd_line;
+      char*   events_line;
+      Int     n_events;
+      char*   curr_fl;      // as set by the last fl=/fn= lines
+      char*   curr_fn;
+      char*   blk_fl;       // key of the next block of count lines
+      char*   blk_fn;
+      Bool    done;         // read up to the summary line
+      Bool    unsorted;
+      ULong*  summary;      // computed summary
+   }
+   CgReader;
+
+/* The count lines of one function, from all inputs */
+typedef
+   struct {
+      UWord lnno;
+      SizeT off;            // counts are at vals[off]
+   }
+   CgLine;
+
+typedef
+   struct {
+      CgLine* lines;
+      Int     n_lines, lines_size;
+      ULong*  vals;
+      SizeT   n_vals, vals_size;
+   }
+   CgBlock;
+
+static Word cmp_key ( const char* fl1, const char* fn1,
+                      const char* fl2, const char* fn2 )
+{
+   Word r = strcmp(fl1, fl2);
+   if (r == 0)
+      r = strcmp(fn1, fn2);
+   return r;
+}
+
+/* line is the first line after the last count line read.  Skip to the
+   next block of count lines, or to the summary line. */
+static void cg_advance ( CgReader* r, const char* line )
+{
+   ULong* summaryRead;
+   Int    i;
 
-               // yes .. merge counts into dst inner map val
-               addCounts( s, diVal, siVal );
+   while (1) {
+      if (!line)
+         parseError(&r->src, "eof before SUMMARY line");
 
+      if (isdigit(line[0])) {
+         if (r->blk_fl) {
+            Word c = cmp_key(r->curr_fl, r->curr_fn, r->blk_fl, r->blk_fn);
+            if (c < 0) {
+               r->unsorted = True;
+               return;
             }
+            if (c == 0)
+               return;
+            free(r->blk_fl);
+            free(r->blk_fn);
          }
-
+         r->blk_fl = xstrdup(&r->src, r->curr_fl);
+         r->blk_fn = xstrdup(&r->src, r->curr_fn);
+         return;
+      }
+      else
+      if (line[0] == '#') {
+         // comment, e.g. the per data line counts of --cores
+      }
+      else
+      if (streqn(line, "fn=", 3)) {
+         free(r->curr_fn);
+         r->curr_fn = xstrdup(&r->src, line+3);
+      }
+      else
+      if (streqn(line, "fl=", 3)) {
+         free(r->curr_fl);
+         r->curr_fl = xstrdup(&r->src, line+3);
+      }
+      else
+      if (streqn(line, "summary: ", 9)) {
+         summaryRead = xmalloc(&r->src, r->n_events * sizeof(ULong));
+         line += 8;
+         for (i = 0; i < r->n_events; i++) {
+            if (!parse_ULong(&summaryRead[i], &line))
+               parseError(&r->src, "wrong # counts in SUMMARY line");
+         }
+         while (isspace(*line)) line++;
+         if (*line != 0)
+            parseError(&r->src, "wrong # counts in SUMMARY line");
+         for (i = 0; i < r->n_events; i++) {
+            if (summaryRead[i] != r->summary[i])
+               parseError(&r->src, "computed vs stated SUMMARY counts "
+                                   "mismatch");
+         }
+         free(summaryRead);
+         if (readline(&r->src))
+            parseError(&r->src, "extraneous content after SUMMARY line");
+         r->done = True;
+         return;
       }
+      else
+         parseError(&r->src, "unexpected line in main data");
 
+      line = readline(&r->src);
    }
+}
 
-   // add the summaries too
-   addCounts(s, dst->summary, src->summary );
+/* Open the input and read up to the first block of count lines. */
+static void cg_open ( CgReader* r, Input* in )
+{
+   char**      desc = NULL;
+   Int         n_desc = 0;
+   const char* line;
+   char*       p;
+
+   memset(r, 0, sizeof(CgReader));
+   r->src.filename = in->tmp ? in->tmp : in->name;
+   if (!open_input(&r->src, &r->pid)) {
+      perror(argv0);
+      barf(&r->src, "Cannot open input file");
+   }
 
-   return;
+   // "desc:" lines
+   while (1) {
+      line = readline(&r->src);
+      if (!line || !streqn(line, "desc: ", 6))
+         break;
+      desc = xrealloc(&r->src, desc, (n_desc + 2) * sizeof(char*));
+      desc[n_desc++] = xstrdup(&r->src, line);
+   }
+   if (n_desc == 0)
+      parseError(&r->src, "no DESC lines present");
+   desc[n_desc] = NULL;
+   r->desc_lines = desc;
+
+   // "cmd:" line
+   if (!line || !streqn(line, "cmd: ", 5))
+      parseError(&r->src, "no CMD line present");
+   r->cmd_line = xstrdup(&r->src, line);
+
+   // "events:" line, counting the space-alphanum transitions
+   line = readline(&r->src);
+   if (!line)
+      parseError(&r->src, "eof before EVENTS line");
+   if (!streqn(line, "events: ", 8))
+      parseError(&r->src, "no EVENTS line present");
+   r->events_line = xstrdup(&r->src, line);
+   for (p = &r->events_line[6]; *p; p++) {
+      if (p[0] == ' ' && isalpha(p[1]))
+         r->n_events++;
+   }
+   r->summary = xmalloc(&r->src, r->n_events * sizeof(ULong));
+   memset(r->summary, 0, r->n_events * sizeof(ULong));
 
-  oom:
-   mallocFail(s, "merge_CacheProfInfo");
+   r->curr_fl = xstrdup(&r->src, "???");
+   r->curr_fn = xstrdup(&r->src, "???");
+   cg_advance(r, readline(&r->src));
 }
 
-static void usage ( void )
+static void cg_close ( CgReader* r, Input* in, Bool complete )
 {
-   fprintf(stderr, "%s: Merges multiple cachegrind output files into one\n", 
-                   argv0);
-   fprintf(stderr, "%s: usage: %s [-o outfile] [files-to-merge]\n", 
-                   argv0, argv0);
-   exit(1);
+   char** d;
+
+   close_input(&r->src, r->pid, complete);
+   for (d = r->desc_lines; d && *d; d++)
+      free(*d);
+   free(r->desc_lines);
+   free(r->cmd_line);
+   free(r->events_line);
+   free(r->curr_fl);
+   free(r->curr_fn);
+   free(r->blk_fl);
+   free(r->blk_fn);
+   free(r->summary);
+   free(r->src.line);
 }
 
-int main ( int argc, char** argv )
+/* Append the block of count lines starting at the current line to b,
+   and move on to the next block. */
+static void cg_read_block ( CgReader* r, CgBlock* b )
 {
-   Int            i;
-   SOURCE         src;
-   CacheProfFile  *cpf, *cpfTmp;
+   const char* line = r->src.line;
+   ULong*      counts;
+   Int         i;
 
-   FILE*          outfile = NULL;
-   char*          outfilename = NULL;
-   Int            outfileix = 0;
+   while (1) {
+      if (b->n_lines == b->lines_size) {
+         b->lines_size = b->lines_size ? 2 * b->lines_size : 256;
+         b->lines = xrealloc(&r->src, b->lines,
+                             b->lines_size * sizeof(CgLine));
+      }
+      if (b->n_vals + r->n_events > b->vals_size) {
+         b->vals_size = 2 * b->vals_size + r->n_events;
+         b->vals = xrealloc(&r->src, b->vals, b->vals_size * sizeof(ULong));
+      }
+      counts = &b->vals[b->n_vals];
+      if (!parse_ULong(&counts[0], &line))
+         parseError(&r->src, "garbage in counts line");
+      b->lines[b->n_lines].lnno = (UWord)counts[0];
+      b->lines[b->n_lines].off  = b->n_vals;
+      for (i = 0; i < r->n_events; i++) {
+         if (!parse_ULong(&counts[i], &line))
+            parseError(&r->src, "# counts doesn't match # events");
+         r->summary[i] += counts[i];
+      }
+      while (isspace(*line)) line++;
+      if (*line != 0)
+         parseError(&r->src, "# counts doesn't match # events");
+      b->n_lines++;
+      b->n_vals += r->n_events;
+
+      line = readline(&r->src);
+      if (!line || !isdigit(line[0]))
+         break;
+   }
+   cg_advance(r, line);
+}
 
-   if (argv[0])
-      argv0 = argv[0];
+static int cmp_CgLine ( const void* v1, const void* v2 )
+{
+   const CgLine* l1 = v1;
+   const CgLine* l2 = v2;
+   if (l1->lnno != l2->lnno)
+      return l1->lnno < l2->lnno ? -1 : 1;
+   return l1->off < l2->off ? -1 : 1;
+}
 
-   if (argc < 2)
-      usage();
+/* Min-heap of readers, ordered by the key of their next block */
+static Bool cg_less ( CgReader* r1, CgReader* r2 )
+{
+   return cmp_key(r1->blk_fl, r1->blk_fn, r2->blk_fl, r2->blk_fn) < 0;
+}
 
-   for (i = 1; i < argc; i++) {
-      if (streq(argv[i], "-h") || streq(argv[i], "--help"))
-         usage();
+static void heap_push ( CgReader** heap, Int* n, CgReader* r )
+{
+   Int i = (*n)++;
+   while (i > 0 && cg_less(r, heap[(i-1)/2])) {
+      heap[i] = heap[(i-1)/2];
+      i = (i-1)/2;
    }
+   heap[i] = r;
+}
 
-   /* Scan args, looking for '-o outfilename'. */
-   for (i = 1; i < argc; i++) {
-      if (streq(argv[i], "-o")) {
-         if (i+1 < argc) {
-            outfilename = argv[i+1];
-            outfileix   = i;
+static CgReader* heap_pop ( CgReader** heap, Int* n )
+{
+   CgReader* top = heap[0];
+   CgReader* r   = heap[--(*n)];
+   Int       i   = 0, c;
+
+   while ((c = 2*i + 1) < *n) {
+      if (c+1 < *n && cg_less(heap[c+1], heap[c]))
+         c++;
+      if (!cg_less(heap[c], r))
+         break;
+      heap[i] = heap[c];
+      i = c;
+   }
+   heap[i] = r;
+   return top;
+}
+
+typedef
+   struct {
+      Input*   inputs;
+      Int      n_inputs;
+      FILE*    out;         // the merged file, if final
+      char*    out_name;    // the merged file, if not final
+      Bool     final;
+      TopList* top;         // if non-NULL, collect the function totals
+   }
+   CgGroup;
+
+/* Merge the inputs of g into a new file: a temporary file, left open,
+   for the final merge, and an intermediate file otherwise.  Returns the
+   index of an input which is not sorted, or -1 when done. */
+static Int cg_merge_group ( CgGroup* g )
+{
+   CgReader*  rs   = xmalloc(NULL, g->n_inputs * sizeof(CgReader));
+   CgReader** heap = xmalloc(NULL, g->n_inputs * sizeof(CgReader*));
+   CgReader*  r;
+   CgBlock    b;
+   Int        i, j, k, n_heap = 0, bad = -1, n_events;
+   char       *fl = NULL, *fn = NULL, *out_fl = NULL;
+   char**     d;
+   ULong*     total;
+   ULong      cost;
+   FILE*      out;
+
+   memset(&b, 0, sizeof(b));
+   for (i = 0; i < g->n_inputs; i++) {
+      cg_open(&rs[i], &g->inputs[i]);
+      if (!streq(rs[i].events_line, rs[0].events_line))
+         barf(&rs[i].src, "\"events:\" line of most recent file does "
+                          "not match those previously processed");
+      if (rs[i].unsorted)
+         bad = i;
+      else if (!rs[i].done)
+         heap_push(heap, &n_heap, &rs[i]);
+   }
+   n_events = rs[0].n_events;
+   total = xmalloc(NULL, n_events * sizeof(ULong));
+   memset(total, 0, n_events * sizeof(ULong));
+
+   if (g->final)
+      out = open_tmp();
+   else
+      out = create_tmp(&g->out_name);
+   for (d = rs[0].desc_lines; *d; d++)
+      fprintf(out, "%s\n", *d);
+   fprintf(out, "%s\n%s\n", rs[0].cmd_line, rs[0].events_line);
+
+   while (bad < 0 && n_heap > 0) {
+      free(fl);
+      free(fn);
+      fl = xstrdup(NULL, heap[0]->blk_fl);
+      fn = xstrdup(NULL, heap[0]->blk_fn);
+
+      // Collect the lines of function (fl, fn) from all inputs
+      b.n_lines = 0;
+      b.n_vals  = 0;
+      while (n_heap > 0 && cmp_key(heap[0]->blk_fl, heap[0]->blk_fn,
+                                   fl, fn) == 0) {
+         r = heap_pop(heap, &n_heap);
+         cg_read_block(r, &b);
+         if (r->unsorted) {
+            bad = r - rs;
             break;
-         } else {
-            usage();
          }
+         if (!r->done)
+            heap_push(heap, &n_heap, r);
+      }
+      if (bad >= 0)
+         break;
+
+      // Sum up lines with the same line number and write them out
+      qsort(b.lines, b.n_lines, sizeof(CgLine), cmp_CgLine);
+      if (!out_fl || !streq(out_fl, fl)) {
+         free(out_fl);
+         out_fl = xstrdup(NULL, fl);
+         fprintf(out, "fl=%s\n", fl);
+      }
+      fprintf(out, "fn=%s\n", fn);
+      cost = 0;
+      for (i = 0; i < b.n_lines; i = j) {
+         ULong* sum = &b.vals[b.lines[i].off];
+         for (j = i+1; j < b.n_lines && b.lines[j].lnno == b.lines[i].lnno;
+              j++) {
+            for (k = 0; k < n_events; k++)
+               sum[k] += b.vals[b.lines[j].off + k];
+         }
+         fprintf(out, "%lu", b.lines[i].lnno);
+         for (k = 0; k < n_events; k++) {
+            fprintf(out, " %llu", sum[k]);
+            total[k] += sum[k];
+         }
+         fprintf(out, "\n");
+         if (n_events > 0)
+            cost += sum[0];
       }
+      if (g->top)
+         add_TopFn(g->top, fl, fn, cost);
    }
 
-   cpf = NULL;
+   if (bad < 0) {
+      fprintf(out, "summary:");
+      for (k = 0; k < n_events; k++)
+         fprintf(out, " %llu", total[k]);
+      fprintf(out, "\n");
+      check_written(out, "temporary file");
+      if (g->final)
+         g->out = out;
+      else
+         fclose(out);
+   }
+   else {
+      fclose(out);
+      if (!g->final) {
+         unlink(g->out_name);
+         free(g->out_name);
+         g->out_name = NULL;
+      }
+   }
 
-   for (i = 1; i < argc; i++) {
+   for (i = 0; i < g->n_inputs; i++)
+      cg_close(&rs[i], &g->inputs[i], bad < 0);
+   free(fl);
+   free(fn);
+   free(out_fl);
+   free(total);
+   free(b.lines);
+   free(b.vals);
+   free(heap);
+   free(rs);
+   return bad;
+}
 
-      if (i == outfileix) {
-         /* Skip '-o' and whatever follows it */
-         i += 1;
+/* Sort an input that Cachegrind did not write, by reading it into
+   memory.  Returns the name of the sorted intermediate file. */
+static char* cg_sort_input ( Input* in )
+{
+   SOURCE         src;
+   pid_t          pid;
+   CacheProfFile* cpf;
+   FILE*          out;
+   char*          name;
+
+   memset(&src, 0, sizeof(src));
+   src.filename = in->name;
+   if (!open_input(&src, &pid)) {
+      perror(argv0);
+      barf(&src, "Cannot open input file");
+   }
+   cpf = parse_CacheProfFile(&src);
+   close_input(&src, pid, True);
+   free(src.line);
+
+   out = create_tmp(&name);
+   show_CacheProfFile(out, cpf);
+   check_written(out, "temporary file");
+   fclose(out);
+   ddel_CacheProfFile(cpf);
+   return name;
+}
+
+typedef
+   struct {
+      CgGroup*        groups;
+      Int             n_groups;
+      Int             next;       // next group to merge
+      pthread_mutex_t lock;
+   }
+   CgLevel;
+
+static void* cg_merge_groups ( void* v )
+{
+   CgLevel* l = v;
+   CgGroup* g;
+   Int      i, bad;
+
+   while (1) {
+      pthread_mutex_lock(&l->lock);
+      i = l->next++;
+      pthread_mutex_unlock(&l->lock);
+      if (i >= l->n_groups)
+         return NULL;
+      g = &l->groups[i];
+      while ((bad = cg_merge_group(g)) >= 0) {
+         assert(!g->inputs[bad].tmp);
+         g->inputs[bad].tmp = cg_sort_input(&g->inputs[bad]);
+         if (g->top)
+            g->top->n_fns = 0;
+      }
+   }
+}
+
+/* Merge the inputs level by level.  Returns the merged file, and the
+   function totals in *top. */
+static FILE* cg_merge_files ( Input* inputs, Int n, Int jobs,
+                              Int max_open, TopList* top )
+{
+   CgLevel l;
+   Int     i, level, size;
+   Bool    final;
+   Input*  outputs;
+   FILE*   res;
+
+   for (level = 0; ; level++) {
+      final = n <= max_open && (jobs == 1 || level > 0);
+      if (final)
+         size = n;
+      else if (level == 0)
+         size = (n + jobs - 1) / jobs;
+      else
+         size = max_open;
+      if (size > max_open)
+         size = max_open;
+      if (size < 2 && !final)
+         size = 2;
+
+      memset(&l, 0, sizeof(l));
+      l.n_groups = (n + size - 1) / size;
+      l.groups = xmalloc(NULL, l.n_groups * sizeof(CgGroup));
+      for (i = 0; i < l.n_groups; i++) {
+         l.groups[i].inputs   = &inputs[i * size];
+         l.groups[i].n_inputs = i < l.n_groups - 1 ? size : n - i * size;
+         l.groups[i].out      = NULL;
+         l.groups[i].out_name = NULL;
+         l.groups[i].final    = final;
+         l.groups[i].top      = final ? top : NULL;
+      }
+      pthread_mutex_init(&l.lock, NULL);
+      run_jobs(jobs < l.n_groups ? jobs : l.n_groups, cg_merge_groups, &l);
+      pthread_mutex_destroy(&l.lock);
+
+      // The inputs of the next level are the outputs of this one
+      for (i = 0; i < n; i++) {
+         if (inputs[i].tmp) {
+            unlink(inputs[i].tmp);
+            free(inputs[i].tmp);
+         }
+      }
+      if (level > 0)
+         free(inputs);
+      if (final) {
+         res = l.groups[0].out;
+         free(l.groups);
+         return res;
+      }
+      outputs = xmalloc(NULL, l.n_groups * sizeof(Input));
+      for (i = 0; i < l.n_groups; i++) {
+         outputs[i].name = "(temporary file)";
+         outputs[i].tmp  = l.groups[i].out_name;
+      }
+      free(l.groups);
+      inputs = outputs;
+      n = l.n_groups;
+   }
+}
+
+
+//------------------------------------------------------------------//
+//---          Callgrind format: summing up in hash tables       ---//
+//------------------------------------------------------------------//
+
+/* Callgrind output is not sorted, so callgrind files are summed up in
+   hash tables keyed by context and position.  Memory use grows with
+   the size of the merged profile, not with the total size of the
+   inputs.  With -j, each job sums up a share of the files in a table
+   of its own, and the tables are added up at the end.  Names are
+   interned in a table shared by all jobs, and compared as pointers.
+
+   All the parts and threads of a file are summed up.  Positions are
+   written uncompressed; names are compressed. */
+
+#define CL_MAX_POS  3
+
+typedef
+   struct _Name {
+      struct _Name* next;
+      UInt          hash;
+      UInt          out_id[3];     // id in the output, per name space
+      char          str[];
+   }
+   Name;
+
+// name spaces for compression
+#define OB_SPACE  0
+#define FL_SPACE  1
+#define FN_SPACE  2
+
+static Name**          names = NULL;
+static UInt            names_size = 0, n_names = 0;
+static pthread_mutex_t names_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static UInt hash_str ( const char* s )
+{
+   UInt h = 2166136261u;
+   for (; *s; s++)
+      h = (h ^ (UChar)*s) * 16777619u;
+   return h;
+}
+
+static Name* intern ( SOURCE* src, const char* s )
+{
+   UInt  h = hash_str(s), i;
+   Name *n, *next;
+   Name** t;
+
+   pthread_mutex_lock(&names_lock);
+   if (names_size > 0) {
+      for (n = names[h & (names_size-1)]; n; n = n->next) {
+         if (n->hash == h && streq(n->str, s)) {
+            pthread_mutex_unlock(&names_lock);
+            return n;
+         }
+      }
+   }
+   if (n_names >= names_size) {
+      UInt size = names_size ? 2 * names_size : 4096;
+      t = xmalloc(src, size * sizeof(Name*));
+      memset(t, 0, size * sizeof(Name*));
+      for (i = 0; i < names_size; i++) {
+         for (n = names[i]; n; n = next) {
+            next = n->next;
+            n->next = t[n->hash & (size-1)];
+            t[n->hash & (size-1)] = n;
+         }
+      }
+      free(names);
+      names = t;
+      names_size = size;
+   }
+   n = xmalloc(src, sizeof(Name) + strlen(s) + 1);
+   strcpy(n->str, s);
+   n->hash = h;
+   n->out_id[0] = n->out_id[1] = n->out_id[2] = 0;
+   n->next = names[h & (names_size-1)];
+   names[h & (names_size-1)] = n;
+   n_names++;
+   pthread_mutex_unlock(&names_lock);
+   return n;
+}
+
+// kinds of records
+#define CL_COST  0   // values: costs
+#define CL_CALL  1   // values: call count, inclusive costs
+#define CL_JUMP  2   // values: jump count
+#define CL_JCND  3   // values: jumps followed, executions
+
+typedef
+   struct _ClCxt {
+      struct _ClCxt*  next;        // hash chain
+      struct _ClCxt*  next_all;    // in order of creation
+      Name            *ob, *fl, *fn;
+      struct _ClRec   *first, *last;
+      UInt            hash;
+   }
+   ClCxt;
+
+typedef
+   struct _ClRec {
+      struct _ClRec*  next;        // hash chain
+      struct _ClRec*  next_in_cxt; // in order of creation
+      ClCxt*          cxt;
+      Name*           fi;          // file of the (source) position
+      Name            *tob, *tfi, *tfn; // target of calls and jumps
+      ULong           pos[CL_MAX_POS];
+      ULong           tpos[CL_MAX_POS];
+      UInt            hash;
+      UChar           kind;
+      ULong           val[];
+   }
+   ClRec;
+
+typedef
+   struct {
+      char*   events_line;    // from the first file summed up
+      char*   positions_line;
+      Int     n_events;
+      Int     n_pos;
+      Bool    pos_hex[CL_MAX_POS];
+      ClCxt** cxts;
+      UInt    cxts_size, n_cxts;
+      ClCxt   *first_cxt, *last_cxt;
+      ClRec** recs;
+      UInt    recs_size, n_recs;
+      ULong*  summary;
+      UChar*  arena;          // records are carved out of chunks
+      SizeT   arena_left;
+   }
+   ClTable;
+
+/* The headers of the first input, which are copied to the output. */
+static char*  cl_creator = NULL;
+static char*  cl_cmd = NULL;
+static char** cl_desc_lines = NULL;
+static Int    cl_n_desc = 0;
+static char** cl_event_lines = NULL;
+static Int    cl_n_event = 0;
+
+static Int cl_n_vals ( ClTable* t, UChar kind )
+{
+   switch (kind) {
+      case CL_COST: return t->n_events;
+      case CL_CALL: return 1 + t->n_events;
+      case CL_JUMP: return 1;
+      default:      return 2;
+   }
+}
+
+static void* cl_alloc ( ClTable* t, SizeT n )
+{
+   void* p;
+
+   n = (n + 7) & ~(SizeT)7;
+   if (n > t->arena_left) {
+      t->arena_left = n > (1 << 20) ? n : (1 << 20);
+      t->arena = xmalloc(NULL, t->arena_left);
+   }
+   p = t->arena;
+   t->arena += n;
+   t->arena_left -= n;
+   return p;
+}
+
+static UInt mix ( UInt h, UWord w )
+{
+   h ^= (UInt)w ^ (UInt)((ULong)w >> 32);
+   h *= 0x9e3779b1u;
+   return h ^ (h >> 15);
+}
+
+static ClCxt* cl_get_cxt ( ClTable* t, Name* ob, Name* fl, Name* fn )
+{
+   UInt    h = mix(mix(mix(0, (UWord)ob), (UWord)fl), (UWord)fn), i;
+   ClCxt   *c, *next;
+   ClCxt** tab;
+
+   if (t->cxts_size > 0) {
+      for (c = t->cxts[h & (t->cxts_size-1)]; c; c = c->next) {
+         if (c->ob == ob && c->fl == fl && c->fn == fn)
+            return c;
+      }
+   }
+   if (t->n_cxts >= t->cxts_size) {
+      UInt size = t->cxts_size ? 2 * t->cxts_size : 1024;
+      tab = xmalloc(NULL, size * sizeof(ClCxt*));
+      memset(tab, 0, size * sizeof(ClCxt*));
+      for (i = 0; i < t->cxts_size; i++) {
+         for (c = t->cxts[i]; c; c = next) {
+            next = c->next;
+            c->next = tab[c->hash & (size-1)];
+            tab[c->hash & (size-1)] = c;
+         }
+      }
+      free(t->cxts);
+      t->cxts = tab;
+      t->cxts_size = size;
+   }
+   c = cl_alloc(t, sizeof(ClCxt));
+   c->ob = ob;
+   c->fl = fl;
+   c->fn = fn;
+   c->hash = h;
+   c->first = c->last = NULL;
+   c->next_all = NULL;
+   c->next = t->cxts[h & (t->cxts_size-1)];
+   t->cxts[h & (t->cxts_size-1)] = c;
+   if (t->last_cxt)
+      t->last_cxt->next_all = c;
+   else
+      t->first_cxt = c;
+   t->last_cxt = c;
+   t->n_cxts++;
+   return c;
+}
+
+/* Find the record with the key fields of k (the values of k are not
+   used), creating it with zero values if needed. */
+static ClRec* cl_get_rec ( ClTable* t, ClRec* k )
+{
+   UInt    h = 0, i;
+   Int     nv;
+   ClRec   *r, *next;
+   ClRec** tab;
+
+   h = mix(h, (UWord)k->cxt);
+   h = mix(h, (UWord)k->fi + k->kind);
+   h = mix(h, (UWord)k->tob);
+   h = mix(h, (UWord)k->tfi);
+   h = mix(h, (UWord)k->tfn);
+   for (i = 0; i < t->n_pos; i++)
+      h = mix(mix(h, (UWord)k->pos[i]), (UWord)k->tpos[i]);
+
+   if (t->recs_size > 0) {
+      for (r = t->recs[h & (t->recs_size-1)]; r; r = r->next) {
+         if (r->hash == h && r->cxt == k->cxt && r->kind == k->kind
+             && r->fi == k->fi && r->tob == k->tob && r->tfi == k->tfi
+             && r->tfn == k->tfn
+             && memcmp(r->pos, k->pos, t->n_pos * sizeof(ULong)) == 0
+             && memcmp(r->tpos, k->tpos, t->n_pos * sizeof(ULong)) == 0)
+            return r;
+      }
+   }
+   if (t->n_recs >= t->recs_size) {
+      UInt size = t->recs_size ? 2 * t->recs_size : 65536;
+      tab = xmalloc(NULL, size * sizeof(ClRec*));
+      memset(tab, 0, size * sizeof(ClRec*));
+      for (i = 0; i < t->recs_size; i++) {
+         for (r = t->recs[i]; r; r = next) {
+            next = r->next;
+            r->next = tab[r->hash & (size-1)];
+            tab[r->hash & (size-1)] = r;
+         }
+      }
+      free(t->recs);
+      t->recs = tab;
+      t->recs_size = size;
+   }
+   nv = cl_n_vals(t, k->kind);
+   r = cl_alloc(t, sizeof(ClRec) + nv * sizeof(ULong));
+   *r = *k;
+   memset(r->val, 0, nv * sizeof(ULong));
+   r->hash = h;
+   r->next = t->recs[h & (t->recs_size-1)];
+   t->recs[h & (t->recs_size-1)] = r;
+   r->next_in_cxt = NULL;
+   if (k->cxt->last)
+      k->cxt->last->next_in_cxt = r;
+   else
+      k->cxt->first = r;
+   k->cxt->last = r;
+   t->n_recs++;
+   return r;
+}
+
+/* Per-input parsing state */
+typedef
+   struct {
+      SOURCE   src;
+      pid_t    pid;
+      ClTable* t;
+      Bool     first_file;    // copy the headers to the output
+      Bool     in_body;
+      Name**   map[3];        // name compression: id -> name
+      UInt     map_size[3];
+      Name     *ob, *fl, *fn, *fi;
+      Name     *cob, *cfi, *cfn, *jfi, *jfn;
+      ClCxt*   cxt;           // for ob, fl, fn; NULL if not looked up yet
+      ULong    last[CL_MAX_POS]; // base of relative positions
+      UChar    pending;       // kind of a calls=/jump=/jcnd= line read
+      ULong    pending_val[2];
+      ULong    pending_tpos[CL_MAX_POS];
+      ULong*   costs;         // scratch
+      ULong*   part_self;     // costs of the current part
+      ULong*   part_stated;   // its summary:/totals: line
+      Int      part_state;    // 0: none, 1: summary: read, 2: totals: read
+   }
+   ClReader;
+
+static Bool parse_number ( /*OUT*/ULong* res, /*INOUT*/const char** pptr )
+{
+   const char* p = *pptr;
+   ULong       u = 0;
+
+   if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X') && isxdigit(p[2])) {
+      for (p += 2; isxdigit(*p); p++)
+         u = u * 16 + (isdigit(*p) ? *p - '0' : (tolower(*p) - 'a' + 10));
+   }
+   else if (isdigit(*p)) {
+      for (; isdigit(*p); p++)
+         u = u * 10 + (*p - '0');
+   }
+   else
+      return False;
+   *res = u;
+   *pptr = p;
+   return True;
+}
+
+/* Parse a list of n subpositions, relative to last. */
+static void cl_parse_pos ( ClReader* r, const char** pptr, Int n,
+                           const ULong* last, /*OUT*/ULong* pos )
+{
+   const char* p = *pptr;
+   ULong       u;
+   Int         i;
+
+   for (i = 0; i < n; i++) {
+      while (*p == ' ' || *p == '\t') p++;
+      if (*p == '*') {
+         pos[i] = last[i];
+         p++;
+      }
+      else if (*p == '+' || *p == '-') {
+         Bool plus = *p++ == '+';
+         if (!parse_number(&u, &p))
+            parseError(&r->src, "malformed position");
+         pos[i] = plus ? last[i] + u : last[i] - u;
+      }
+      else if (!parse_number(&pos[i], &p))
+         parseError(&r->src, "malformed position");
+      if (*p != ' ' && *p != '\t' && *p != 0)
+         parseError(&r->src, "malformed position");
+   }
+   for (; i < CL_MAX_POS; i++)
+      pos[i] = 0;
+   *pptr = p;
+}
+
+/* Parse up to n_events costs; missing ones are zero. */
+static void cl_parse_costs ( ClReader* r, const char* p, ULong* costs )
+{
+   Int i;
+
+   for (i = 0; i < r->t->n_events; i++) {
+      while (*p == ' ' || *p == '\t') p++;
+      if (*p == 0)
+         break;
+      if (!parse_number(&costs[i], &p))
+         parseError(&r->src, "garbage in cost line");
+   }
+   for (; i < r->t->n_events; i++)
+      costs[i] = 0;
+   while (*p == ' ' || *p == '\t') p++;
+   if (*p != 0)
+      parseError(&r->src, "more costs than events in cost line");
+}
+
+/* Name in a position spec: "(id) name", "(id)" or "name". */
+static Name* cl_name ( ClReader* r, Int space, const char* p )
+{
+   ULong id;
+   Name* n;
+
+   while (*p == ' ' || *p == '\t') p++;
+   if (*p != '(')
+      return intern(&r->src, p);
+
+   p++;
+   if (!parse_number(&id, &p) || *p != ')' || id > 0x7fffffff)
+      parseError(&r->src, "malformed name compression");
+   p++;
+   while (*p == ' ' || *p == '\t') p++;
+   if (*p == 0) {
+      if (id >= r->map_size[space] || !r->map[space][id])
+         parseError(&r->src, "undefined name compression id");
+      return r->map[space][id];
+   }
+   n = intern(&r->src, p);
+   if (id >= r->map_size[space]) {
+      UInt size = 2 * id + 16;
+      r->map[space] = xrealloc(&r->src, r->map[space], size * sizeof(Name*));
+      memset(r->map[space] + r->map_size[space], 0,
+             (size - r->map_size[space]) * sizeof(Name*));
+      r->map_size[space] = size;
+   }
+   r->map[space][id] = n;
+   return n;
+}
+
+static void cl_flush_part ( ClReader* r )
+{
+   ClTable* t = r->t;
+   Int      i;
+
+   if (!t->summary)
+      return;
+   for (i = 0; i < t->n_events; i++) {
+      t->summary[i] += r->part_state ? r->part_stated[i] : r->part_self[i];
+      r->part_self[i] = 0;
+   }
+   r->part_state = 0;
+}
+
+static void cl_set_events ( ClReader* r, const char* line )
+{
+   ClTable* t = r->t;
+   const char* p;
+   Int      n = 0;
+
+   for (p = line + 7; *p; p++) {
+      if (!isspace(p[0]) && (p == line + 7 || isspace(p[-1])))
+         n++;
+   }
+   if (t->events_line) {
+      if (!streq(t->events_line, line))
+         barf(&r->src, "\"events:\" line of most recent file does "
+                       "not match those previously processed");
+      return;
+   }
+   t->events_line = xstrdup(&r->src, line);
+   t->n_events    = n;
+   t->summary     = xmalloc(&r->src, n * sizeof(ULong));
+   memset(t->summary, 0, n * sizeof(ULong));
+}
+
+static void cl_set_positions ( ClReader* r, const char* line )
+{
+   ClTable*    t = r->t;
+   const char* p;
+   Int         n = 0;
+
+   if (t->positions_line) {
+      if (!streq(t->positions_line, line))
+         barf(&r->src, "\"positions:\" line of most recent file does "
+                       "not match those previously processed");
+      return;
+   }
+   for (p = line + 10; *p; ) {
+      while (isspace(*p)) p++;
+      if (*p == 0)
+         break;
+      if (n == CL_MAX_POS)
+         parseError(&r->src, "too many positions");
+      t->pos_hex[n] = streqn(p, "instr", 5) || streqn(p, "bb", 2)
+                      || streqn(p, "addr", 4);
+      n++;
+      while (*p && !isspace(*p)) p++;
+   }
+   if (n == 0)
+      parseError(&r->src, "empty \"positions:\" line");
+   t->positions_line = xstrdup(&r->src, line);
+   t->n_pos = n;
+}
+
+/* Called at the first body line: the "events:" and "positions:"
+   lines, if any, have been seen. */
+static void cl_start_body ( ClReader* r )
+{
+   ClTable* t = r->t;
+   Int      n;
+
+   if (!t->events_line)
+      parseError(&r->src, "no \"events:\" line before the profile data");
+   if (!t->positions_line)
+      cl_set_positions(r, "positions: line");
+   n = t->n_events + 1;
+   if (!r->costs) {
+      r->costs       = xmalloc(&r->src, n * sizeof(ULong));
+      r->part_self   = xmalloc(&r->src, n * sizeof(ULong));
+      r->part_stated = xmalloc(&r->src, n * sizeof(ULong));
+      memset(r->part_self, 0, n * sizeof(ULong));
+   }
+   r->in_body = True;
+}
+
+static void cl_summary_line ( ClReader* r, const char* p, Int state )
+{
+   // summary: after totals: starts a new part
+   if (r->part_state == 2)
+      cl_flush_part(r);
+   cl_parse_costs(r, p, r->part_stated);
+   r->part_state = state;
+}
+
+/* A line with a position: a cost line, or the source of a call or
+   jump. */
+static void cl_cost_line ( ClReader* r, const char* p )
+{
+   ClTable* t = r->t;
+   ClRec    k, *rec;
+   Int      i;
+
+   if (!r->cxt)
+      r->cxt = cl_get_cxt(t, r->ob, r->fl, r->fn);
+
+   memset(&k, 0, sizeof(k));
+   k.cxt  = r->cxt;
+   k.fi   = r->fi;
+   k.kind = r->pending;
+   cl_parse_pos(r, &p, t->n_pos, r->last, k.pos);
+
+   switch (r->pending) {
+   case CL_COST:
+      cl_parse_costs(r, p, r->costs);
+      rec = cl_get_rec(t, &k);
+      for (i = 0; i < t->n_events; i++) {
+         rec->val[i] += r->costs[i];
+         r->part_self[i] += r->costs[i];
+      }
+      memcpy(r->last, k.pos, sizeof(r->last));
+      break;
+   case CL_CALL:
+      if (!r->cfn)
+         parseError(&r->src, "calls= line without cfn= line");
+      cl_parse_costs(r, p, r->costs);
+      k.tob = r->cob ? r->cob : r->ob;
+      k.tfi = r->cfi ? r->cfi : r->fi;
+      k.tfn = r->cfn;
+      memcpy(k.tpos, r->pending_tpos, sizeof(k.tpos));
+      rec = cl_get_rec(t, &k);
+      rec->val[0] += r->pending_val[0];
+      for (i = 0; i < t->n_events; i++)
+         rec->val[i+1] += r->costs[i];
+      r->cob = r->cfi = r->cfn = NULL;
+      break;
+   default:
+      while (*p == ' ' || *p == '\t') p++;
+      if (*p != 0)
+         parseError(&r->src, "costs in the source line of a jump");
+      k.tfi = r->jfi ? r->jfi : r->fi;
+      k.tfn = r->jfn ? r->jfn : r->fn;
+      memcpy(k.tpos, r->pending_tpos, sizeof(k.tpos));
+      rec = cl_get_rec(t, &k);
+      rec->val[0] += r->pending_val[0];
+      if (r->pending == CL_JCND)
+         rec->val[1] += r->pending_val[1];
+      r->jfi = r->jfn = NULL;
+      break;
+   }
+   r->pending = CL_COST;
+}
+
+/* "calls=", "jump=" or "jcnd=" line */
+static void cl_call_line ( ClReader* r, UChar kind, const char* p )
+{
+   while (*p == ' ' || *p == '\t') p++;
+   if (!parse_number(&r->pending_val[0], &p))
+      parseError(&r->src, "malformed call or jump line");
+   if (kind == CL_JCND) {
+      // jcnd=<followed>/<executions>, or separated by a space
+      if (*p == '/')
+         p++;
+      while (*p == ' ' || *p == '\t') p++;
+      if (!parse_number(&r->pending_val[1], &p))
+         parseError(&r->src, "malformed jcnd= line");
+   }
+   cl_parse_pos(r, &p, r->t->n_pos, r->last, r->pending_tpos);
+   r->pending = kind;
+}
+
+static void cl_add_header ( char*** lines, Int* n, const char* line )
+{
+   *lines = xrealloc(NULL, *lines, (*n + 1) * sizeof(char*));
+   (*lines)[(*n)++] = xstrdup(NULL, line);
+}
+
+/* Sum up one callgrind file into r->t. */
+static void cl_read_file ( ClTable* t, const char* name, Bool first_file )
+{
+   ClReader    r;
+   const char* line;
+   Int         i;
+
+   memset(&r, 0, sizeof(r));
+   r.t = t;
+   r.first_file = first_file;
+   r.src.filename = name;
+   if (!open_input(&r.src, &r.pid)) {
+      perror(argv0);
+      barf(&r.src, "Cannot open input file");
+   }
+   r.fl = r.fi = intern(&r.src, "???");
+   r.fn = intern(&r.src, "???");
+   r.pending = CL_COST;
+
+   while ((line = readline(&r.src))) {
+      if (line[0] == 0 || line[0] == '#')
+         continue;
+
+      if (r.pending != CL_COST) {
+         cl_cost_line(&r, line);
          continue;
       }
 
-      fprintf(stderr, "%s: parsing %s\n", argv0, argv[i]);
-      src.lno      = 1;
-      src.filename = argv[i];
-      src.fp       = fopen(src.filename, "r");
-      if (!src.fp) {
-         perror(argv0);
-         barf(&src, "Cannot open input file");
+      if (isdigit(line[0]) || line[0] == '+' || line[0] == '-'
+          || line[0] == '*') {
+         if (!r.in_body)
+            cl_start_body(&r);
+         cl_cost_line(&r, line);
+      }
+      else if (streqn(line, "fn=", 3)) {
+         r.fn  = cl_name(&r, FN_SPACE, line+3);
+         r.cxt = NULL;
       }
-      assert(src.fp);
-      cpfTmp = parse_CacheProfFile( &src );
-      fclose(src.fp);
+      else if (streqn(line, "fl=", 3)) {
+         r.fl  = r.fi = cl_name(&r, FL_SPACE, line+3);
+         r.cxt = NULL;
+      }
+      else if (streqn(line, "fi=", 3) || streqn(line, "fe=", 3))
+         r.fi  = cl_name(&r, FL_SPACE, line+3);
+      else if (streqn(line, "ob=", 3)) {
+         r.ob  = cl_name(&r, OB_SPACE, line+3);
+         r.cxt = NULL;
+      }
+      else if (streqn(line, "cfn=", 4))
+         r.cfn = cl_name(&r, FN_SPACE, line+4);
+      else if (streqn(line, "cfi=", 4) || streqn(line, "cfl=", 4))
+         r.cfi = cl_name(&r, FL_SPACE, line+4);
+      else if (streqn(line, "cob=", 4))
+         r.cob = cl_name(&r, OB_SPACE, line+4);
+      else if (streqn(line, "jfn=", 4))
+         r.jfn = cl_name(&r, FN_SPACE, line+4);
+      else if (streqn(line, "jfi=", 4))
+         r.jfi = cl_name(&r, FL_SPACE, line+4);
+      else if (streqn(line, "calls=", 6) || streqn(line, "jump=", 5)
+               || streqn(line, "jcnd=", 5)) {
+         if (!r.in_body)
+            cl_start_body(&r);
+         cl_call_line(&r, line[0] == 'c' ? CL_CALL :
+                          line[1] == 'u' ? CL_JUMP : CL_JCND,
+                      strchr(line, '=') + 1);
+      }
+      else if (streqn(line, "events:", 7)) {
+         if (r.in_body)
+            cl_flush_part(&r);
+         cl_set_events(&r, line);
+         r.in_body = False;
+      }
+      else if (streqn(line, "positions:", 10))
+         cl_set_positions(&r, line);
+      else if (streqn(line, "summary:", 8) || streqn(line, "totals:", 7)) {
+         if (!r.in_body)
+            cl_start_body(&r);
+         cl_summary_line(&r, strchr(line, ':') + 1, line[0] == 's' ? 1 : 2);
+      }
+      else if (streqn(line, "part:", 5)) {
+         if (r.in_body)
+            cl_flush_part(&r);
+      }
+      else if (streqn(line, "desc:", 5)) {
+         if (first_file && !r.in_body && t->summary == NULL)
+            cl_add_header(&cl_desc_lines, &cl_n_desc, line);
+      }
+      else if (streqn(line, "event:", 6)) {
+         if (first_file && t->summary == NULL)
+            cl_add_header(&cl_event_lines, &cl_n_event, line);
+      }
+      else if (streqn(line, "cmd:", 4)) {
+         if (first_file && !cl_cmd)
+            cl_cmd = xstrdup(&r.src, line);
+      }
+      else if (streqn(line, "creator:", 8)) {
+         if (first_file && !cl_creator)
+            cl_creator = xstrdup(&r.src, line);
+      }
+      else if (streqn(line, "version:", 8) || streqn(line, "pid:", 4)
+               || streqn(line, "thread:", 7))
+         ;
+      else
+         parseError(&r.src, "unexpected line");
+   }
+   if (r.pending != CL_COST)
+      parseError(&r.src, "eof after call or jump line");
+   if (r.in_body)
+      cl_flush_part(&r);
+   close_input(&r.src, r.pid, True);
+
+   for (i = 0; i < 3; i++)
+      free(r.map[i]);
+   free(r.costs);
+   free(r.part_self);
+   free(r.part_stated);
+   free(r.src.line);
+}
 
-      /* If this isn't the first file, merge */
-      if (cpf == NULL) {
-         /* this is the first file */
-         cpf = cpfTmp;
-      } else {
-         /* not the first file; merge */
-         fprintf(stderr, "%s: merging %s\n", argv0, argv[i]);
-         merge_CacheProfInfo( &src, cpf, cpfTmp );
-         ddel_CacheProfFile( cpfTmp );
+/* dst += src */
+static void cl_add_table ( ClTable* dst, ClTable* src )
+{
+   ClCxt *c, *dc;
+   ClRec *r, *dr, k;
+   Int   i, nv;
+
+   if (!src->events_line)
+      return;
+   if (!dst->events_line) {
+      dst->events_line    = src->events_line;
+      dst->positions_line = src->positions_line;
+      dst->n_events       = src->n_events;
+      dst->n_pos          = src->n_pos;
+      memcpy(dst->pos_hex, src->pos_hex, sizeof(dst->pos_hex));
+      dst->summary        = xmalloc(NULL, dst->n_events * sizeof(ULong));
+      memset(dst->summary, 0, dst->n_events * sizeof(ULong));
+   }
+   if (!streq(dst->events_line, src->events_line)
+       || !streq(dst->positions_line, src->positions_line)) {
+      fprintf(stderr, "%s: \"events:\" or \"positions:\" lines of the "
+                      "input files do not match\n", argv0);
+      exit(1);
+   }
+
+   for (c = src->first_cxt; c; c = c->next_all) {
+      dc = cl_get_cxt(dst, c->ob, c->fl, c->fn);
+      for (r = c->first; r; r = r->next_in_cxt) {
+         k = *r;
+         k.cxt = dc;
+         dr = cl_get_rec(dst, &k);
+         nv = cl_n_vals(dst, r->kind);
+         for (i = 0; i < nv; i++)
+            dr->val[i] += r->val[i];
       }
+   }
+   for (i = 0; i < dst->n_events; i++)
+      dst->summary[i] += src->summary[i];
+}
 
+typedef
+   struct {
+      char**          files;
+      Int             n_files;
+      Int             n_jobs;
+      ClTable*        tables;     // one per job
+      Int             next;       // next job to start
+      pthread_mutex_t lock;
    }
+   ClJobs;
 
-   /* Now create the output file. */
+static void* cl_sum_files ( void* v )
+{
+   ClJobs* j = v;
+   Int     job, i, from, to;
+
+   pthread_mutex_lock(&j->lock);
+   job = j->next++;
+   pthread_mutex_unlock(&j->lock);
+
+   // Each job takes a contiguous share, so that the output does not
+   // depend on the number of jobs.
+   from = (Word)job * j->n_files / j->n_jobs;
+   to   = (Word)(job + 1) * j->n_files / j->n_jobs;
+   for (i = from; i < to; i++)
+      cl_read_file(&j->tables[job], j->files[i], i == 0);
+   return NULL;
+}
 
-   if (cpf) {
+static void cl_put_name ( FILE* f, const char* tag, Int space, Name* n )
+{
+   static UInt n_ids[3] = { 0, 0, 0 };
 
-      fprintf(stderr, "%s: writing %s\n", 
-                       argv0, outfilename ? outfilename : "(stdout)" );
+   if (n->out_id[space]) {
+      fprintf(f, "%s=(%u)\n", tag, n->out_id[space]);
+   } else {
+      n->out_id[space] = ++n_ids[space];
+      fprintf(f, "%s=(%u) %s\n", tag, n->out_id[space], n->str);
+   }
+}
 
-      /* Write the output. */
-      if (outfilename) {
-         outfile = fopen(outfilename, "w");
-         if (!outfile) {
-            fprintf(stderr, "%s: can't create output file %s\n", 
-                            argv0, outfilename);
-            perror(argv0);
-            exit(1);
+static void cl_put_pos ( FILE* f, ClTable* t, const ULong* pos )
+{
+   Int i;
+   for (i = 0; i < t->n_pos; i++)
+      fprintf(f, t->pos_hex[i] ? "%s%#llx" : "%s%llu", i ? " " : "",
+                 pos[i]);
+}
+
+static void cl_put_costs ( FILE* f, const ULong* costs, Int n )
+{
+   Int i;
+   while (n > 0 && costs[n-1] == 0)
+      n--;
+   for (i = 0; i < n; i++)
+      fprintf(f, " %llu", costs[i]);
+   fprintf(f, "\n");
+}
+
+static void cl_write ( FILE* f, ClTable* t, TopList* top )
+{
+   ClCxt* c;
+   ClRec* r;
+   Name   *ob = NULL, *fl = NULL, *fi = NULL;
+   ULong  self;
+   Int    i;
+
+   fprintf(f, "# callgrind format\nversion: 1\n");
+   fprintf(f, "%s\n", cl_creator ? cl_creator : "creator: cg_merge");
+   if (cl_cmd)
+      fprintf(f, "%s\n", cl_cmd);
+   fprintf(f, "\n");
+   for (i = 0; i < cl_n_desc; i++)
+      fprintf(f, "%s\n", cl_desc_lines[i]);
+   fprintf(f, "\n%s\n", t->positions_line);
+   for (i = 0; i < cl_n_event; i++)
+      fprintf(f, "%s\n", cl_event_lines[i]);
+   fprintf(f, "%s\nsummary:", t->events_line);
+   cl_put_costs(f, t->summary, t->n_events);
+   fprintf(f, "\n");
+
+   for (c = t->first_cxt; c; c = c->next_all) {
+      fprintf(f, "\n");
+      if (c->ob && c->ob != ob)
+         cl_put_name(f, "ob", OB_SPACE, c->ob);
+      ob = c->ob;
+      if (c->fl != fl) {
+         cl_put_name(f, "fl", FL_SPACE, c->fl);
+         fl = fi = c->fl;
+      }
+      cl_put_name(f, "fn", FN_SPACE, c->fn);
+
+      self = 0;
+      for (r = c->first; r; r = r->next_in_cxt) {
+         if (r->fi != fi) {
+            cl_put_name(f, r->fi == c->fl ? "fe" : "fi", FL_SPACE, r->fi);
+            fi = r->fi;
+         }
+         switch (r->kind) {
+         case CL_COST:
+            cl_put_pos(f, t, r->pos);
+            cl_put_costs(f, r->val, t->n_events);
+            if (t->n_events > 0)
+               self += r->val[0];
+            break;
+         case CL_CALL:
+            if (r->tob != c->ob)
+               cl_put_name(f, "cob", OB_SPACE, r->tob);
+            if (r->tfi != fi)
+               cl_put_name(f, "cfi", FL_SPACE, r->tfi);
+            cl_put_name(f, "cfn", FN_SPACE, r->tfn);
+            fprintf(f, "calls=%llu ", r->val[0]);
+            cl_put_pos(f, t, r->tpos);
+            fprintf(f, "\n");
+            cl_put_pos(f, t, r->pos);
+            cl_put_costs(f, r->val + 1, t->n_events);
+            break;
+         default:
+            if (r->tfi != fi)
+               cl_put_name(f, "jfi", FL_SPACE, r->tfi);
+            if (r->tfn != c->fn)
+               cl_put_name(f, "jfn", FN_SPACE, r->tfn);
+            if (r->kind == CL_JUMP)
+               fprintf(f, "jump=%llu ", r->val[0]);
+            else
+               fprintf(f, "jcnd=%llu/%llu ", r->val[0], r->val[1]);
+            cl_put_pos(f, t, r->tpos);
+            fprintf(f, "\n");
+            cl_put_pos(f, t, r->pos);
+            fprintf(f, "\n");
+            break;
          }
-      } else {
-         outfile = stdout;
       }
+      if (top)
+         add_TopFn(top, c->fl->str, c->fn->str, self);
+   }
 
-      show_CacheProfFile( outfile, cpf );
-      if (ferror(outfile)) {
-         fprintf(stderr, "%s: error writing output file %s\n", 
-                         argv0, outfilename ? outfilename : "(stdout)" );
-         perror(argv0);
-         if (outfile != stdout)
-            fclose(outfile);
+   fprintf(f, "\ntotals:");
+   cl_put_costs(f, t->summary, t->n_events);
+}
+
+
+//------------------------------------------------------------------//
+//---                              main                          ---//
+//------------------------------------------------------------------//
+
+static void usage ( void )
+{
+   fprintf(stderr, "%s: Merges multiple cachegrind or callgrind output "
+                   "files into one\n", argv0);
+   fprintf(stderr, "%s: usage: %s [-o outfile] [-j jobs] [--top=N] "
+                   "[files-to-merge]\n", argv0, argv0);
+   exit(1);
+}
+
+/* Cachegrind files start with "desc:" lines, callgrind files with a
+   format, version or creator line. */
+static Bool is_callgrind_file ( const char* name )
+{
+   SOURCE      src;
+   pid_t       pid;
+   const char* line;
+   Bool        res;
+
+   memset(&src, 0, sizeof(src));
+   src.filename = name;
+   if (!open_input(&src, &pid)) {
+      perror(argv0);
+      barf(&src, "Cannot open input file");
+   }
+   line = readline(&src);
+   res = line && !streqn(line, "desc:", 5);
+   close_input(&src, pid, False);
+   free(src.line);
+   return res;
+}
+
+int main ( int argc, char** argv )
+{
+   Int            i, jobs = 1, top_n = 0, max_open, n_files = 0;
+   char**         files;
+   char*          outfilename = NULL;
+   FILE*          outfile;
+   FILE*          merged;
+   TopList        top;
+   struct rlimit  rl;
+
+   if (argv[0])
+      argv0 = argv[0];
+
+   if (argc < 2)
+      usage();
+
+   files = malloc(argc * sizeof(char*));
+   assert(files);
+   for (i = 1; i < argc; i++) {
+      if (streq(argv[i], "-h") || streq(argv[i], "--help"))
+         usage();
+      else if (streq(argv[i], "-o")) {
+         if (i+1 >= argc)
+            usage();
+         outfilename = argv[++i];
+      }
+      else if (streqn(argv[i], "-j", 2)) {
+         const char* n = argv[i][2] ? argv[i] + 2 : (i+1 < argc ? argv[++i] : "");
+         jobs = atoi(n);
+         if (jobs < 1 || jobs > 1024)
+            usage();
+      }
+      else if (streqn(argv[i], "--top=", 6)) {
+         top_n = atoi(argv[i] + 6);
+         if (top_n < 1)
+            usage();
+      }
+      else
+         files[n_files++] = argv[i];
+   }
+   if (n_files == 0)
+      usage();
+   if (jobs > n_files)
+      jobs = n_files;
+
+   /* Merge at most max_open files at a time.  Each job has max_open
+      inputs and one output open; leave some file descriptors for stdio,
+      the gzip pipe being created and the final output.  With too few
+      descriptors for two inputs per job, run fewer jobs. */
+   max_open = 512;
+   if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY) {
+      Word avail = (Word)rl.rlim_cur - 8;
+      if (jobs > 1 && (Word)jobs * 3 > avail)
+         jobs = avail / 3 > 1 ? avail / 3 : 1;
+      if (avail / jobs - 1 < max_open)
+         max_open = avail / jobs - 1 > 2 ? avail / jobs - 1 : 2;
+   }
+
+   /* The files are read by the jobs below, in no particular order, but
+      report them as the one-file-at-a-time merge always did. */
+   for (i = 0; i < n_files; i++) {
+      fprintf(stderr, "%s: parsing %s\n", argv0, files[i]);
+      if (i > 0)
+         fprintf(stderr, "%s: merging %s\n", argv0, files[i]);
+   }
+   memset(&top, 0, sizeof(top));
+
+   if (is_callgrind_file(files[0])) {
+      ClJobs  j;
+
+      memset(&j, 0, sizeof(j));
+      j.files   = files;
+      j.n_files = n_files;
+      j.n_jobs  = jobs;
+      j.tables  = malloc(jobs * sizeof(ClTable));
+      assert(j.tables);
+      memset(j.tables, 0, jobs * sizeof(ClTable));
+      pthread_mutex_init(&j.lock, NULL);
+      run_jobs(jobs, cl_sum_files, &j);
+      pthread_mutex_destroy(&j.lock);
+      for (i = 1; i < jobs; i++)
+         cl_add_table(&j.tables[0], &j.tables[i]);
+      if (!j.tables[0].events_line) {
+         fprintf(stderr, "%s: no \"events:\" line in the input files\n",
+                         argv0);
          exit(1);
       }
 
-      fflush(outfile);
-      if (outfile != stdout)
-         fclose( outfile );
+      merged = open_tmp();
+      cl_write(merged, &j.tables[0], top_n ? &top : NULL);
+      check_written(merged, "temporary file");
+      if (top_n)
+         show_TopList(&top, top_n, j.tables[0].events_line,
+                      j.tables[0].n_events ? j.tables[0].summary[0] : 0);
+   }
+   else {
+      Input*  inputs = malloc(n_files * sizeof(Input));
+      SOURCE  src;
+      char*   events;
+      ULong   total = 0;
+      const char* line;
+
+      assert(inputs);
+      for (i = 0; i < n_files; i++) {
+         inputs[i].name = files[i];
+         inputs[i].tmp  = NULL;
+      }
+      merged = cg_merge_files(inputs, n_files, jobs, max_open,
+                              top_n ? &top : NULL);
+      free(inputs);
+
+      if (top_n) {
+         // The events and summary lines of the merged file
+         memset(&src, 0, sizeof(src));
+         src.filename = "(merged)";
+         src.fp = merged;
+         rewind(merged);
+         events = NULL;
+         while ((line = readline(&src))) {
+            if (streqn(line, "events: ", 8)) {
+               events = xstrdup(&src, line);
+            }
+            else if (streqn(line, "summary:", 8)) {
+               line += 8;
+               parse_ULong(&total, &line);
+            }
+         }
+         free(src.line);
+         show_TopList(&top, top_n, events, total);
+         free(events);
+      }
+   }
 
-      ddel_CacheProfFile( cpf );
+   /* Now copy the merged file to the output. */
+   fprintf(stderr, "%s: writing %s\n",
+                   argv0, outfilename ? outfilename : "(stdout)" );
+   if (outfilename) {
+      outfile = fopen(outfilename, "w");
+      if (!outfile) {
+         fprintf(stderr, "%s: can't create output file %s\n",
+                         argv0, outfilename);
+         perror(argv0);
+         exit(1);
+      }
+   } else {
+      outfile = stdout;
+   }
+
+   rewind(merged);
+   {
+      char   buf[65536];
+      size_t n;
+      while ((n = fread(buf, 1, sizeof(buf), merged)) > 0) {
+         if (fwrite(buf, 1, n, outfile) != n)
+            break;
+      }
    }
+   check_written(outfile, outfilename ? outfilename : "(stdout)");
+   if (outfile != stdout)
+      fclose(outfile);
+   fclose(merged);
+   free(files);
 
    return 0;
 }
@@ -34,8 +34,32 @@
       - both blocks hit                  --> one hit
       - one block hits, the other misses --> one miss
       - both blocks miss                 --> one miss (not two)
+  - the default configuration (I1/D1 + LL, LRU, LL neither inclusive nor
+    exclusive) is handled by the cachesim_*_doref functions below.  Any
+    other configuration -- a mid-level cache, another replacement policy
+    or an inclusive/exclusive LL -- is handled by cachesim_hier_doref(),
+    which is only called when such a configuration has been requested, so
+    the default configuration does not pay for it.
 */
 
+/* Replacement policies. */
+typedef enum {
+   Repl_LRU,      /* Least recently used. */
+   Repl_PLRU,     /* Bit pseudo-LRU: one "recently used" bit per line. */
+   Repl_RRIP,     /* Static re-reference interval prediction, 2 bits. */
+   Repl_Random    /* Pseudo-random victim. */
+} cache_repl_t;
+
+/* Relation between the LL cache and the levels above it. */
+typedef enum {
+   Incl_NINE,      /* Neither inclusive nor exclusive. */
+   Incl_Inclusive, /* LL evictions invalidate the line in upper levels. */
+   Incl_Exclusive  /* LL only holds lines evicted from the level above. */
+} cache_incl_t;
+
+/* Largest re-reference prediction value of a 2-bit RRIP cache. */
+#define RRIP_MAX 3
+
 typedef struct {
    Int          size;                   /* bytes */
    Int          assoc;
@@ -46,10 +70,25 @@ typedef struct {
    Int          tag_shift;
    HChar        desc_line[128];         /* large enough */
    UWord*       tags;
+   cache_repl_t repl;
+   UChar*       state;                  /* per-line PLRU/RRIP state */
+   UInt*        last_way;               /* per-set way of the last hit */
+   UInt         seed;                   /* for Repl_Random */
 } cache_t2;
 
+static const HChar* cachesim_repl_name(cache_repl_t repl)
+{
+   switch (repl) {
+   case Repl_LRU:    return "LRU";
+   case Repl_PLRU:   return "PLRU";
+   case Repl_RRIP:   return "RRIP";
+   case Repl_Random: return "random";
+   }
+   tl_assert(0);
+}
+
 /* By this point, the size/assoc/line_size has been checked. */
-static void cachesim_initcache(cache_t config, cache_t2* c)
+static void cachesim_initcache(cache_t config, cache_t2* c, cache_repl_t repl)
 {
    Int i;
 
@@ -75,6 +114,21 @@ static void cachesim_initcache(cache_t config, cache_t2* c)
 
    for (i = 0; i < c->sets * c->assoc; i++)
       c->tags[i] = 0;
+
+   c->repl  = repl;
+   c->state = NULL;
+   c->last_way = NULL;
+   c->seed  = 0x9e3779b9;
+   if (repl != Repl_LRU) {
+      VG_(sprintf)(c->desc_line + VG_(strlen)(c->desc_line), ", %s",
+                   cachesim_repl_name(repl));
+      c->state = VG_(malloc)("cg.sim.ci.2", c->sets * c->assoc);
+      for (i = 0; i < c->sets * c->assoc; i++)
+         c->state[i] = repl == Repl_RRIP ? RRIP_MAX : 0;
+      c->last_way = VG_(malloc)("cg.sim.ci.3", c->sets * sizeof(UInt));
+      for (i = 0; i < c->sets; i++)
+         c->last_way[i] = 0;
+   }
 }
 
 /* This attribute forces GCC to inline the function, getting rid of a
@@ -164,12 +218,56 @@ Bool cachesim_ref_is_miss(cache_t2* c, Addr a, UChar size)
 static cache_t2 LL;
 static cache_t2 I1;
 static cache_t2 D1;
+static cache_t2 ML;
+
+/* Bytes of a block that a core has accessed since it last lost the block
+ * to a write of another core.  One bit covers 1/64 of a line. */
+typedef struct {
+   UWord block;
+   ULong mask;
+} cache_acc_t;
 
-static void cachesim_initcaches(cache_t I1c, cache_t D1c, cache_t LLc)
+/* The private caches and TLBs of a simulated core, see
+ * cachesim_switch_core(). */
+typedef struct {
+   cache_t2     I1, D1, ML, ITLB, DTLB, STLB;
+   cache_acc_t* acc;
+} cache_core_t;
+
+#define CACHESIM_MAX_CORES 64
+
+static Int           cachesim_n_cores = 1;
+static Int           cachesim_core    = 0;  /* core running right now */
+static cache_core_t* cachesim_cores   = NULL;
+
+/* Is there a mid-level cache between I1/D1 and LL? */
+static Bool cachesim_ML_used = False;
+/* Is a configuration other than the default one simulated? */
+static Bool cachesim_hier = False;
+static cache_incl_t cachesim_LL_incl = Incl_NINE;
+
+/* MLc.size is -1 if there is no mid-level cache.  Non-default
+ * configurations require all line sizes to be equal. */
+static void cachesim_initcaches(cache_t I1c, cache_t D1c, cache_t MLc,
+                                cache_t LLc, cache_repl_t L1_repl,
+                                cache_repl_t ML_repl, cache_repl_t LL_repl,
+                                cache_incl_t LL_incl)
 {
-   cachesim_initcache(I1c, &I1);
-   cachesim_initcache(D1c, &D1);
-   cachesim_initcache(LLc, &LL);
+   cachesim_ML_used = MLc.size != -1;
+   cachesim_LL_incl = LL_incl;
+   cachesim_hier    = cachesim_ML_used || L1_repl != Repl_LRU
+                      || LL_repl != Repl_LRU || LL_incl != Incl_NINE;
+
+   cachesim_initcache(I1c, &I1, L1_repl);
+   cachesim_initcache(D1c, &D1, L1_repl);
+   cachesim_initcache(LLc, &LL, LL_repl);
+   if (cachesim_ML_used)
+      cachesim_initcache(MLc, &ML, ML_repl);
+
+   if (LL_incl == Incl_Inclusive)
+      VG_(strcat)(LL.desc_line, ", inclusive");
+   else if (LL_incl == Incl_Exclusive)
+      VG_(strcat)(LL.desc_line, ", exclusive");
 }
 
 __attribute__((always_inline))
@@ -231,6 +329,607 @@ static Bool cachesim_is_IrNoX(Addr a, UChar size)
    return True;
 }
 
+/*--------------------------------------------------------------------*/
+/*--- Non-default cache hierarchies                                ---*/
+/*--------------------------------------------------------------------*/
+
+/* Marks a way as used.  'hit' tells whether the line was found or has
+ * just been installed. */
+__attribute__((always_inline))
+static __inline__
+void cachesim_repl_touch(cache_t2* c, UChar* st, Int way, Bool hit)
+{
+   Int i;
+
+   switch (c->repl) {
+   case Repl_PLRU:
+      /* Once all ways are marked, start over with only this way marked. */
+      if (st[way])
+         return;
+      st[way] = 1;
+      for (i = 0; i < c->assoc; i++)
+         if (st[i] == 0)
+            return;
+      for (i = 0; i < c->assoc; i++)
+         st[i] = 0;
+      st[way] = 1;
+      break;
+   case Repl_RRIP:
+      /* Hits predict a near re-reference, new lines a distant one. */
+      st[way] = hit ? 0 : RRIP_MAX - 1;
+      break;
+   default:
+      break;
+   }
+}
+
+/* Chooses the way to replace in a full set.  Empty ways are used first. */
+static Int cachesim_repl_victim(cache_t2* c, const UWord* set, UChar* st)
+{
+   Int i;
+
+   for (i = 0; i < c->assoc; i++)
+      if (set[i] == 0)
+         return i;
+
+   switch (c->repl) {
+   case Repl_PLRU:
+      for (i = 0; i < c->assoc; i++)
+         if (st[i] == 0)
+            return i;
+      return 0;
+   case Repl_RRIP:
+      for (;;) {
+         for (i = 0; i < c->assoc; i++)
+            if (st[i] == RRIP_MAX)
+               return i;
+         for (i = 0; i < c->assoc; i++)
+            st[i]++;
+      }
+   case Repl_Random:
+      c->seed ^= c->seed << 13;
+      c->seed ^= c->seed >> 17;
+      c->seed ^= c->seed << 5;
+      return c->seed % c->assoc;
+   default:
+      tl_assert(0);
+   }
+}
+
+/* Like cachesim_setref_is_miss(), but for any replacement policy.  On a
+ * miss, the tag of the replaced line -- 0 if an empty line was used -- is
+ * stored in *victim. */
+__attribute__((always_inline))
+static __inline__
+Bool cachesim_setref_is_miss_repl(cache_t2* c, UInt set_no, UWord tag,
+                                  UWord* victim)
+{
+   UWord* set = &(c->tags[set_no * c->assoc]);
+   UChar* st;
+   Int    i, j;
+
+   if (c->repl == Repl_LRU) {
+      if (tag == set[0])
+         return False;
+      for (i = 1; i < c->assoc; i++) {
+         if (tag == set[i]) {
+            for (j = i; j > 0; j--)
+               set[j] = set[j - 1];
+            set[0] = tag;
+            return False;
+         }
+      }
+      *victim = set[c->assoc - 1];
+      for (j = c->assoc - 1; j > 0; j--)
+         set[j] = set[j - 1];
+      set[0] = tag;
+      return True;
+   }
+
+   /* Without LRU ordering, look at the way that hit last time first. */
+   st = &(c->state[set_no * c->assoc]);
+   i = c->last_way[set_no];
+   if (tag == set[i]) {
+      cachesim_repl_touch(c, st, i, True);
+      return False;
+   }
+   for (i = 0; i < c->assoc; i++) {
+      if (tag == set[i]) {
+         c->last_way[set_no] = i;
+         cachesim_repl_touch(c, st, i, True);
+         return False;
+      }
+   }
+   i = cachesim_repl_victim(c, set, st);
+   *victim = set[i];
+   set[i] = tag;
+   c->last_way[set_no] = i;
+   cachesim_repl_touch(c, st, i, False);
+   return True;
+}
+
+/* Removes a block from a cache.  Returns whether it was present. */
+static Bool cachesim_invalidate(cache_t2* c, UWord block)
+{
+   UWord* set = &(c->tags[(block & c->sets_min_1) * c->assoc]);
+   Int    i, j;
+
+   for (i = 0; i < c->assoc; i++) {
+      if (set[i] == block) {
+         if (c->repl == Repl_LRU) {
+            /* The freed line becomes the least recently used one. */
+            for (j = i; j < c->assoc - 1; j++)
+               set[j] = set[j + 1];
+            set[c->assoc - 1] = 0;
+         } else {
+            set[i] = 0;
+         }
+         return True;
+      }
+   }
+   return False;
+}
+
+/* Removes a block evicted from an inclusive LL from the levels above, in
+ * all cores. */
+static void cachesim_back_invalidate(UWord block)
+{
+   cache_core_t* c;
+   Int           i;
+
+   cachesim_invalidate(&I1, block);
+   cachesim_invalidate(&D1, block);
+   if (cachesim_ML_used)
+      cachesim_invalidate(&ML, block);
+   for (i = 0; i < cachesim_n_cores; i++) {
+      if (i == cachesim_core)
+         continue;
+      c = &cachesim_cores[i];
+      cachesim_invalidate(&c->I1, block);
+      cachesim_invalidate(&c->D1, block);
+      if (cachesim_ML_used)
+         cachesim_invalidate(&c->ML, block);
+   }
+}
+
+/* Handles a block that missed L1 and replaced upper_victim there.
+ * Returns 1 if the block hit the next level, 2 if it missed the mid-level
+ * cache but hit LL and 3 if it missed all levels. */
+static UInt cachesim_hier_L1_miss(UWord block, UWord upper_victim)
+{
+   UWord victim = 0;
+   UInt  level  = 1;
+
+   if (cachesim_ML_used) {
+      upper_victim = 0;
+      if (!cachesim_setref_is_miss_repl(&ML, block & ML.sets_min_1, block,
+                                        &upper_victim))
+         return 1;
+      level = 2;
+   }
+
+   switch (cachesim_LL_incl) {
+   case Incl_NINE:
+      if (!cachesim_setref_is_miss_repl(&LL, block & LL.sets_min_1, block,
+                                        &victim))
+         return level;
+      return 3;
+
+   case Incl_Inclusive:
+      if (!cachesim_setref_is_miss_repl(&LL, block & LL.sets_min_1, block,
+                                        &victim))
+         return level;
+      if (victim)
+         cachesim_back_invalidate(victim);
+      return 3;
+
+   case Incl_Exclusive:
+      /* A hit moves the block up; the line evicted from the level above
+         moves down. */
+      level = cachesim_invalidate(&LL, block) ? level : 3;
+      if (upper_victim)
+         cachesim_setref_is_miss_repl(&LL, upper_victim & LL.sets_min_1,
+                                      upper_victim, &victim);
+      return level;
+   }
+   tl_assert(0);
+}
+
+/* References one block, which is first looked up in L1 (I1 or D1).
+ * Returns 0 for an L1 hit and otherwise the result of
+ * cachesim_hier_L1_miss(). */
+__attribute__((always_inline))
+static __inline__
+UInt cachesim_hier_block(cache_t2* L1, UWord block)
+{
+   UWord upper_victim = 0;
+
+   if (!cachesim_setref_is_miss_repl(L1, block & L1->sets_min_1, block,
+                                     &upper_victim))
+      return 0;
+   return cachesim_hier_L1_miss(block, upper_victim);
+}
+
+/* Simulates a reference in a non-default hierarchy.  All levels have the
+ * same line size.  Misses are counted at most once per level.  Returns the
+ * deepest level missed, as cachesim_hier_block() does. */
+__attribute__((always_inline))
+static __inline__
+UInt cachesim_hier_doref(cache_t2* L1, Addr a, UChar size,
+                         ULong* m1, ULong* mM, ULong* mL)
+{
+   UWord block1 =  a         >> L1->line_size_bits;
+   UWord block2 = (a+size-1) >> L1->line_size_bits;
+   UInt  missed, missed2;
+
+   missed = cachesim_hier_block(L1, block1);
+   if (block1 != block2) {
+      tl_assert(block1 + 1 == block2);
+      missed2 = cachesim_hier_block(L1, block2);
+      if (missed2 > missed)
+         missed = missed2;
+   }
+   if (missed >= 1) (*m1)++;
+   if (missed >= 2) (*mM)++;
+   if (missed >= 3) (*mL)++;
+   return missed;
+}
+
+/*--------------------------------------------------------------------*/
+/*--- TLBs                                                         ---*/
+/*--------------------------------------------------------------------*/
+
+/* A TLB is simulated as an LRU cache whose lines are pages.  The second
+ * level TLB is shared by instructions and data. */
+static Bool     cachesim_tlb = False;
+static cache_t2 ITLB;
+static cache_t2 DTLB;
+static cache_t2 STLB;
+
+/* By this point entries/assoc is a power of two. */
+static void cachesim_inittlb(Int entries, Int assoc, Int page_size,
+                             cache_t2* t)
+{
+   Int i;
+
+   t->size           = entries;
+   t->assoc          = assoc;
+   t->line_size      = page_size;
+   t->sets           = entries / assoc;
+   t->sets_min_1     = t->sets - 1;
+   t->line_size_bits = VG_(log2)(page_size);
+   t->tag_shift      = t->line_size_bits + VG_(log2)(t->sets);
+   t->repl           = Repl_LRU;
+   t->state          = NULL;
+   t->last_way       = NULL;
+   VG_(sprintf)(t->desc_line, "%d entries, %d-way, %d B pages",
+                entries, assoc, page_size);
+
+   t->tags = VG_(malloc)("cg.sim.it.1", sizeof(UWord) * entries);
+   for (i = 0; i < entries; i++)
+      t->tags[i] = 0;
+}
+
+static void cachesim_inittlbs(Int I_entries, Int I_assoc,
+                              Int D_entries, Int D_assoc,
+                              Int S_entries, Int S_assoc, Int page_size)
+{
+   cachesim_tlb  = True;
+   cachesim_hier = True;
+   cachesim_inittlb(I_entries, I_assoc, page_size, &ITLB);
+   cachesim_inittlb(D_entries, D_assoc, page_size, &DTLB);
+   cachesim_inittlb(S_entries, S_assoc, page_size, &STLB);
+}
+
+/* Translates the page of address a.  Returns 0 for a hit in the first
+ * level TLB, 1 for a hit in the second level TLB and 2 if the page table
+ * has to be walked.  Only the page of the first byte is looked up. */
+__attribute__((always_inline))
+static __inline__
+UInt cachesim_tlb_ref(cache_t2* tlb, Addr a)
+{
+   UWord page = a >> tlb->line_size_bits;
+
+   if (!cachesim_setref_is_miss(tlb, page & tlb->sets_min_1, page))
+      return 0;
+   if (!cachesim_setref_is_miss(&STLB, page & STLB.sets_min_1, page))
+      return 1;
+   return 2;
+}
+
+/*--------------------------------------------------------------------*/
+/*--- Data prefetching                                             ---*/
+/*--------------------------------------------------------------------*/
+
+typedef enum {
+   PF_None,
+   PF_NextLine,   /* Fetch the next line after a D1 miss. */
+   PF_Stride      /* Fetch ahead for loads/stores with a constant stride. */
+} cache_pf_t;
+
+static cache_pf_t cachesim_pf = PF_None;
+
+/* Blocks recently brought into D1 by a prefetch, to find out whether the
+ * prefetch was useful, i.e. whether a demand access hit that block. */
+#define PF_BLOCKS_SIZE 4096
+static UWord pf_blocks[PF_BLOCKS_SIZE];
+
+/* Reference prediction table of the stride prefetcher, indexed by
+ * instruction address. */
+#define RPT_SIZE 256
+typedef struct {
+   Addr pc;
+   Addr last;
+   Word stride;
+   UInt conf;
+} rpt_entry;
+static rpt_entry rpt[RPT_SIZE];
+
+/* Stride confirmations needed before prefetching. */
+#define RPT_CONF_THRESHOLD 2
+#define RPT_CONF_MAX       3
+
+static void cachesim_initprefetch(cache_pf_t pf)
+{
+   cachesim_pf = pf;
+   if (pf != PF_None)
+      cachesim_hier = True;
+}
+
+static Bool cachesim_contains(cache_t2* c, UWord block)
+{
+   UWord* set = &(c->tags[(block & c->sets_min_1) * c->assoc]);
+   Int    i;
+
+   for (i = 0; i < c->assoc; i++)
+      if (set[i] == block)
+         return True;
+   return False;
+}
+
+/* Brings a block into D1 unless it is there already.  Returns whether a
+ * prefetch was issued. */
+static Bool cachesim_prefetch(UWord block)
+{
+   if (cachesim_contains(&D1, block))
+      return False;
+   cachesim_hier_block(&D1, block);
+   pf_blocks[block & (PF_BLOCKS_SIZE - 1)] = block;
+   return True;
+}
+
+/* Simulates a data reference of the instruction at pc, including the
+ * prefetches it triggers. */
+static void cachesim_D_doref_pf(Addr pc, Addr a, UChar size,
+                                ULong* m1, ULong* mM, ULong* mL,
+                                ULong* issued, ULong* useful)
+{
+   UWord      block = a >> D1.line_size_bits;
+   UWord*     pf    = &pf_blocks[block & (PF_BLOCKS_SIZE - 1)];
+   Bool       was_prefetched = *pf == block;
+   UInt       missed;
+   rpt_entry* e;
+   Word       stride;
+   UWord      next;
+
+   missed = cachesim_hier_doref(&D1, a, size, m1, mM, mL);
+   if (was_prefetched) {
+      *pf = 0;
+      if (missed == 0)
+         (*useful)++;
+   }
+
+   switch (cachesim_pf) {
+   case PF_NextLine:
+      if (missed)
+         *issued += cachesim_prefetch(block + 1);
+      break;
+
+   case PF_Stride:
+      e = &rpt[(pc ^ (pc >> 8)) & (RPT_SIZE - 1)];
+      if (e->pc != pc) {
+         e->pc     = pc;
+         e->last   = a;
+         e->stride = 0;
+         e->conf   = 0;
+         break;
+      }
+      stride = a - e->last;
+      if (stride != 0 && stride == e->stride) {
+         if (e->conf < RPT_CONF_MAX)
+            e->conf++;
+      } else {
+         e->stride = stride;
+         e->conf   = 0;
+      }
+      e->last = a;
+      if (e->conf >= RPT_CONF_THRESHOLD) {
+         next = (a + stride) >> D1.line_size_bits;
+         if (next != block)
+            *issued += cachesim_prefetch(next);
+      }
+      break;
+
+   default:
+      break;
+   }
+}
+
+/*--------------------------------------------------------------------*/
+/*--- Multiple cores                                               ---*/
+/*--------------------------------------------------------------------*/
+
+/* Each simulated core has its own I1, D1, ML and TLBs; LL is shared.  The
+ * caches of the running core are the ones in I1, D1, etc., so that the
+ * simulation code does not depend on the number of cores; those of the
+ * other cores are kept in cachesim_cores[].
+ *
+ * The private caches are kept coherent with a MESI-style invalidation
+ * protocol: a write removes the block from the private caches of all other
+ * cores.  A block that no other core holds is owned exclusively and is
+ * written without any coherence traffic. */
+
+/* Number of slots, a power of two, in the access table of each core. */
+static UWord cachesim_acc_mask;
+/* log2 of the number of bytes covered by one bit of cache_acc_t.mask. */
+static Int   cachesim_granule_bits;
+
+/* Gives copy the same configuration as c, with all lines empty. */
+static void cachesim_clonecache(const cache_t2* c, cache_t2* copy)
+{
+   Int n = c->sets * c->assoc;
+   Int i;
+
+   *copy = *c;
+   copy->tags = VG_(malloc)("cg.sim.cc.1", sizeof(UWord) * n);
+   for (i = 0; i < n; i++)
+      copy->tags[i] = 0;
+   if (c->state) {
+      copy->state = VG_(malloc)("cg.sim.cc.2", n);
+      for (i = 0; i < n; i++)
+         copy->state[i] = c->repl == Repl_RRIP ? RRIP_MAX : 0;
+      copy->last_way = VG_(malloc)("cg.sim.cc.3", c->sets * sizeof(UInt));
+      for (i = 0; i < c->sets; i++)
+         copy->last_way[i] = 0;
+   }
+}
+
+/* Must be called after the caches and TLBs have been initialised; their
+ * configuration is used for all cores. */
+static void cachesim_initcores(Int n_cores)
+{
+   UWord lines, n_acc;
+   Int   i;
+
+   cachesim_n_cores = n_cores;
+   cachesim_hier    = True;
+
+   /* Enough slots for all blocks that can be in a core's D1 and ML. */
+   lines = D1.sets * D1.assoc;
+   if (cachesim_ML_used)
+      lines += ML.sets * ML.assoc;
+   for (n_acc = 1; n_acc < 2 * lines; n_acc <<= 1)
+      ;
+   cachesim_acc_mask = n_acc - 1;
+   cachesim_granule_bits = D1.line_size_bits > 6 ? D1.line_size_bits - 6 : 0;
+
+   cachesim_cores = VG_(calloc)("cg.sim.ico.1", n_cores,
+                                sizeof(cache_core_t));
+   for (i = 0; i < n_cores; i++) {
+      cachesim_cores[i].acc = VG_(calloc)("cg.sim.ico.2", n_acc,
+                                          sizeof(cache_acc_t));
+      /* Core 0 runs first and uses the caches set up already. */
+      if (i == 0)
+         continue;
+      cachesim_clonecache(&I1, &cachesim_cores[i].I1);
+      cachesim_clonecache(&D1, &cachesim_cores[i].D1);
+      if (cachesim_ML_used)
+         cachesim_clonecache(&ML, &cachesim_cores[i].ML);
+      if (cachesim_tlb) {
+         cachesim_clonecache(&ITLB, &cachesim_cores[i].ITLB);
+         cachesim_clonecache(&DTLB, &cachesim_cores[i].DTLB);
+         cachesim_clonecache(&STLB, &cachesim_cores[i].STLB);
+      }
+   }
+}
+
+/* Makes the private caches of another core the current ones. */
+static void cachesim_switch_core(Int core)
+{
+   cache_core_t* c;
+
+   if (core == cachesim_core)
+      return;
+
+   c = &cachesim_cores[cachesim_core];
+   c->I1   = I1;
+   c->D1   = D1;
+   c->ML   = ML;
+   c->ITLB = ITLB;
+   c->DTLB = DTLB;
+   c->STLB = STLB;
+
+   c = &cachesim_cores[core];
+   I1   = c->I1;
+   D1   = c->D1;
+   ML   = c->ML;
+   ITLB = c->ITLB;
+   DTLB = c->DTLB;
+   STLB = c->STLB;
+
+   cachesim_core = core;
+}
+
+/* Handles the part [lo, hi] of a data reference that falls into block. */
+static void cachesim_coherence_block(UWord block, UWord lo, UWord hi,
+                                     Bool is_write, UInt* inv, UInt* fs)
+{
+   UWord         slot = block & cachesim_acc_mask;
+   ULong         mask;
+   cache_acc_t*  e;
+   cache_core_t* c;
+   Bool          had;
+   Int           i;
+
+   lo >>= cachesim_granule_bits;
+   hi >>= cachesim_granule_bits;
+   mask = (~0ULL >> (63 - hi)) & (~0ULL << lo);
+
+   e = &cachesim_cores[cachesim_core].acc[slot];
+   if (e->block != block) {
+      e->block = block;
+      e->mask  = 0;
+   }
+   e->mask |= mask;
+
+   if (!is_write)
+      return;
+
+   for (i = 0; i < cachesim_n_cores; i++) {
+      if (i == cachesim_core)
+         continue;
+      c   = &cachesim_cores[i];
+      had = cachesim_invalidate(&c->D1, block);
+      if (cachesim_ML_used)
+         had |= cachesim_invalidate(&c->ML, block);
+      if (!had)
+         continue;
+      (*inv)++;
+      /* If the other core's accesses are not known any more, count the
+         invalidation as true sharing. */
+      e = &c->acc[slot];
+      if (e->block == block) {
+         if ((e->mask & mask) == 0)
+            (*fs)++;
+         e->block = 0;
+         e->mask  = 0;
+      }
+   }
+}
+
+/* Updates the coherence state for a data reference of the running core.
+ * Returns in *inv how many copies of the block(s) in other cores a write
+ * invalidated, and in *fs how many of these invalidations were caused by
+ * false sharing: the other core had not accessed any of the bytes written
+ * since it got its copy. */
+static void cachesim_coherence_ref(Addr a, UChar size, Bool is_write,
+                                   UInt* inv, UInt* fs)
+{
+   UWord offset_mask = D1.line_size - 1;
+   UWord block1 =  a         >> D1.line_size_bits;
+   UWord block2 = (a+size-1) >> D1.line_size_bits;
+
+   if (block1 == block2) {
+      cachesim_coherence_block(block1, a & offset_mask,
+                               (a+size-1) & offset_mask, is_write, inv, fs);
+   } else {
+      cachesim_coherence_block(block1, a & offset_mask, offset_mask,
+                               is_write, inv, fs);
+      cachesim_coherence_block(block2, 0, (a+size-1) & offset_mask,
+                               is_write, inv, fs);
+   }
+}
+
 /*--------------------------------------------------------------------*/
 /*--- end                                                 cg_sim.c ---*/
 /*--------------------------------------------------------------------*/
@@ -0,0 +1,34 @@
+/* A conditional branch with a repeating pattern, and an indirect call
+   cycling through three targets.  Both are mispredicted most of the
+   time by the simple models, but not by tage and ittage. */
+
+#include <stdio.h>
+
+#define N 200000
+
+static volatile int count;
+
+static const char pattern[] = { 1, 1, 0, 1, 0, 0, 0, 1, 1, 0, 1, 0 };
+
+__attribute__((noinline)) static void f0(void) { count += 1; }
+__attribute__((noinline)) static void f1(void) { count += 2; }
+__attribute__((noinline)) static void f2(void) { count += 3; }
+
+static void (* volatile fns[3])(void) = { f0, f1, f2 };
+
+int main(void)
+{
+   int i, j = 0, k = 0;
+
+   for (i = 0; i < N; i++) {
+      if (pattern[j])
+         count++;
+      if (++j == sizeof(pattern))
+         j = 0;
+      fns[k]();
+      if (++k == 3)
+         k = 0;
+   }
+   printf("%d\n", count);
+   return 0;
+}
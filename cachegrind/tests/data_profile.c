@@ -0,0 +1,25 @@
+/* Walks a heap block and a global array that are both much bigger than
+   the D1 cache, so that most data misses are charged to them. */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define N (1 << 18)
+
+static int table[N];
+
+int main(void)
+{
+   int* heap = malloc(N * sizeof(int));
+   long sum = 0;
+   int  i, r;
+
+   for (r = 0; r < 2; r++)
+      for (i = 0; i < N; i += 16) {
+         heap[i] = i;
+         sum += table[i];
+      }
+   printf("%ld\n", sum + heap[16]);
+   free(heap);
+   return 0;
+}
@@ -0,0 +1,40 @@
+/* Two globals that share one cache line.  Misses on each of them must be
+   charged to the right one, not to whichever was looked up first. */
+
+#include <stdlib.h>
+
+/* Defined in assembly, so that both are sure to be in the same line. */
+__asm__(
+   ".data\n"
+   ".balign 64\n"
+   ".globl pair_a\n"
+   ".type pair_a, @object\n"
+   ".size pair_a, 32\n"
+   "pair_a: .zero 32\n"
+   ".globl pair_b\n"
+   ".type pair_b, @object\n"
+   ".size pair_b, 32\n"
+   "pair_b: .zero 32\n"
+   ".text\n"
+);
+extern volatile char pair_a[32], pair_b[32];
+
+#define EVICT_SIZE (256 * 1024)
+
+int main(void)
+{
+   volatile char* evict = malloc(EVICT_SIZE);
+   int i, j;
+
+   for (i = 0; i < 200; i++) {
+      /* Alternate, and evict the line from D1 before each access. */
+      if (i & 1)
+         pair_b[0]++;
+      else
+         pair_a[0]++;
+      for (j = 0; j < EVICT_SIZE; j += 64)
+         evict[j]++;
+   }
+   free((void*)evict);
+   return 0;
+}
@@ -0,0 +1,50 @@
+/* Two threads increment counters that share a cache line, and two other
+   counters that are on lines of their own. */
+
+#include <pthread.h>
+#include <stdio.h>
+
+#define N 2000000
+
+static struct {
+   volatile int a;
+   volatile int b;
+} shared __attribute__((aligned(64)));
+
+static struct {
+   volatile int a;
+   char pad[124];
+   volatile int b;
+} padded __attribute__((aligned(64)));
+
+static void* inc_a(void* arg)
+{
+   int i;
+   for (i = 0; i < N; i++) {
+      shared.a++;
+      padded.a++;
+   }
+   return NULL;
+}
+
+static void* inc_b(void* arg)
+{
+   int i;
+   for (i = 0; i < N; i++) {
+      shared.b++;
+      padded.b++;
+   }
+   return NULL;
+}
+
+int main(void)
+{
+   pthread_t t1, t2;
+
+   pthread_create(&t1, NULL, inc_a, NULL);
+   pthread_create(&t2, NULL, inc_b, NULL);
+   pthread_join(t1, NULL);
+   pthread_join(t2, NULL);
+   printf("%d %d %d %d\n", shared.a, shared.b, padded.a, padded.b);
+   return 0;
+}
@@ -0,0 +1,78 @@
+/* Access patterns whose miss counts tell the cache replacement and LL
+   inclusion policies apart.  All accessed lines are 4096 bytes apart, so
+   they map to set 0 of every cache used by the policy_*.vgtest tests.
+   Build with -O2, so that the loops do not touch memory themselves. */
+
+#include <stdlib.h>
+
+#define STRIDE 4096
+#define ROUNDS 2000
+/* Lines used once per round are taken from a pool this big, which is far
+   more than any of the caches can hold in one set. */
+#define POOL   64
+
+static volatile char* buf;
+
+#define line(i) buf[(i) * STRIDE]
+
+/* Five lines in turn in a 4-way set: LRU misses on every access, the
+   other policies keep some of the lines. */
+static __attribute__((noinline)) int cyclic(void)
+{
+   int i, j, sum = 0;
+
+   for (i = 0; i < ROUNDS; i++)
+      for (j = 0; j < 5; j++)
+         sum += line(j);
+   return sum;
+}
+
+/* Two hot lines, used twice, followed by three lines from the pool.
+   LRU evicts the hot lines every round, RRIP keeps them. */
+static __attribute__((noinline)) int scan(void)
+{
+   int i, j, sum = 0;
+
+   for (i = 0; i < ROUNDS; i++) {
+      sum += line(0) + line(1) + line(0) + line(1);
+      for (j = 0; j < 3; j++)
+         sum += line(2 + (3 * i + j) % POOL);
+   }
+   return sum;
+}
+
+/* One line that always hits L1, used twice and mixed with lines from the
+   pool.  An inclusive LL evicts the hot line and removes it from L1
+   as well. */
+static __attribute__((noinline)) int hot(void)
+{
+   int i, sum = 0;
+
+   for (i = 0; i < ROUNDS; i++)
+      sum += line(0) + line(0) + line(1 + i % POOL);
+   return sum;
+}
+
+/* Six lines in turn: too many for a 4-way LL set, but not for the 4-way
+   D1 set and LL set together, as an exclusive LL holds only lines evicted
+   from L1. */
+static __attribute__((noinline)) int cyclic6(void)
+{
+   int i, j, sum = 0;
+
+   for (i = 0; i < ROUNDS; i++)
+      for (j = 0; j < 6; j++)
+         sum += line(j);
+   return sum;
+}
+
+int main(void)
+{
+   int sum;
+
+   buf = calloc(2 + POOL + 1, STRIDE);
+   /* Align to STRIDE, i.e. to set 0. */
+   buf = (volatile char*)(((unsigned long)buf + STRIDE - 1) & ~(STRIDE - 1UL));
+   sum = cyclic() + scan() + hot() + cyclic6();
+   return sum;
+}
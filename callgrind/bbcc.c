@@ -33,7 +33,7 @@
 /*--- BBCC operations                                      ---*/
 /*------------------------------------------------------------*/
 
-#define N_BBCC_INITIAL_ENTRIES  10437
+#define N_BBCC_INITIAL_ENTRIES  16384  /* must be a power of 2 */
 
 /* BBCC table (key is BB/Context), per thread, resizable */
 bbcc_hash current_bbccs;
@@ -46,10 +46,14 @@ void CLG_(init_bbcc_hash)(bbcc_hash* bbccs)
 
    bbccs->size    = N_BBCC_INITIAL_ENTRIES;
    bbccs->entries = 0;
-   bbccs->table = (BBCC**) CLG_MALLOC("cl.bbcc.ibh.1",
-                                      bbccs->size * sizeof(BBCC*));
+   bbccs->table = (bbcc_slot*) CLG_MALLOC("cl.bbcc.ibh.1",
+                                          bbccs->size * sizeof(bbcc_slot));
 
-   for (i = 0; i < bbccs->size; i++) bbccs->table[i] = NULL;
+   for (i = 0; i < bbccs->size; i++) {
+      bbccs->table[i].bb   = NULL;
+      bbccs->table[i].cxt  = NULL;
+      bbccs->table[i].bbcc = NULL;
+   }
 }
 
 void CLG_(copy_current_bbcc_hash)(bbcc_hash* dst)
@@ -115,17 +119,15 @@ void CLG_(forall_bbccs)(void (*func)(BBCC*))
   int i, j;
 	
   for (i = 0; i < current_bbccs.size; i++) {
-    if ((bbcc=current_bbccs.table[i]) == NULL) continue;
-    while (bbcc) {
-      /* every bbcc should have a rec_array */
-      CLG_ASSERT(bbcc->rec_array != 0);
+    if ((bbcc=current_bbccs.table[i].bbcc) == NULL) continue;
 
-      for(j=0;j<bbcc->cxt->fn[0]->separate_recursions;j++) {
-	if ((bbcc2 = bbcc->rec_array[j]) == 0) continue;
+    /* every bbcc should have a rec_array */
+    CLG_ASSERT(bbcc->rec_array != 0);
 
-	(*func)(bbcc2);
-      }
-      bbcc = bbcc->next;
+    for(j=0;j<bbcc->cxt->fn[0]->separate_recursions;j++) {
+      if ((bbcc2 = bbcc->rec_array[j]) == 0) continue;
+
+      (*func)(bbcc2);
     }
   }
 }
@@ -144,10 +146,21 @@ void CLG_(forall_bbccs)(void (*func)(BBCC*))
 static __inline__
 UInt bbcc_hash_idx(BB* bb, Context* cxt, UInt size)
 {
+   UWord h;
+
    CLG_ASSERT(bb != 0);
    CLG_ASSERT(cxt != 0);
 
-   return ((Addr)bb + (Addr)cxt) % size;
+   /* BB and Context structs are aligned heap blocks, so the low bits
+    * of their addresses carry no information; mix before masking to
+    * keep the linear probe sequences short. */
+   h = (UWord)bb * 31 + (UWord)cxt;
+   h ^= h >> 16;
+   h *= 0x85ebca6bU;
+   h ^= h >> 13;
+   h *= 0xc2b2ae35U;
+   h ^= h >> 16;
+   return h & (size - 1);
 }
  
 
@@ -158,6 +171,7 @@ BBCC* lookup_bbcc(BB* bb, Context* cxt)
 {
    BBCC* bbcc = bb->last_bbcc;
    UInt  idx;
+   Int   probes;
 
    /* check LRU */
    if (bbcc->cxt == cxt) {
@@ -171,12 +185,19 @@ BBCC* lookup_bbcc(BB* bb, Context* cxt)
    CLG_(stat).bbcc_lru_misses++;
 
    idx = bbcc_hash_idx(bb, cxt, current_bbccs.size);
-   bbcc = current_bbccs.table[idx];
-   while (bbcc &&
-	  (bb      != bbcc->bb ||
-	   cxt     != bbcc->cxt)) {
-       bbcc = bbcc->next;
+   probes = 1;
+   while (current_bbccs.table[idx].bb &&
+	  (bb  != current_bbccs.table[idx].bb ||
+	   cxt != current_bbccs.table[idx].cxt)) {
+       idx = (idx + 1) & (current_bbccs.size - 1);
+       probes++;
    }
+   bbcc = current_bbccs.table[idx].bbcc;
+
+   CLG_(stat).bbcc_hash_lookups++;
+   CLG_(stat).bbcc_hash_probes += probes;
+   if (probes > CLG_(stat).bbcc_hash_probes_max)
+       CLG_(stat).bbcc_hash_probes_max = probes;
    
    CLG_DEBUG(2,"  lookup_bbcc(BB %#lx, Cxt %u, fn '%s'): %p (tid %u)\n",
 	    bb_addr(bb), cxt->base_number, cxt->fn[0]->name, 
@@ -192,47 +213,43 @@ BBCC* lookup_bbcc(BB* bb, Context* cxt)
 /* double size of hash table 1 (addr->BBCC) */
 static void resize_bbcc_hash(void)
 {
-    Int i, new_size, conflicts1 = 0, conflicts2 = 0;
-    BBCC** new_table;
+    Int i, new_size, probes, max_probes = 0;
+    bbcc_slot* new_table;
     UInt new_idx;
-    BBCC *curr_BBCC, *next_BBCC;
+    BBCC *curr_BBCC;
 
-    new_size = 2*current_bbccs.size+3;
-    new_table = (BBCC**) CLG_MALLOC("cl.bbcc.rbh.1",
-                                    new_size * sizeof(BBCC*));
+    new_size = 2*current_bbccs.size;
+    new_table = (bbcc_slot*) CLG_MALLOC("cl.bbcc.rbh.1",
+                                        new_size * sizeof(bbcc_slot));
  
-    for (i = 0; i < new_size; i++)
-      new_table[i] = NULL;
+    for (i = 0; i < new_size; i++) {
+      new_table[i].bb   = NULL;
+      new_table[i].cxt  = NULL;
+      new_table[i].bbcc = NULL;
+    }
  
     for (i = 0; i < current_bbccs.size; i++) {
-	if (current_bbccs.table[i] == NULL) continue;
+	if (current_bbccs.table[i].bb == NULL) continue;
  
-	curr_BBCC = current_bbccs.table[i];
-	while (NULL != curr_BBCC) {
-	    next_BBCC = curr_BBCC->next;
-
-	    new_idx = bbcc_hash_idx(curr_BBCC->bb,
-				    curr_BBCC->cxt,
-				    new_size);
-
-	    curr_BBCC->next = new_table[new_idx];
-	    new_table[new_idx] = curr_BBCC;
-	    if (curr_BBCC->next) {
-		conflicts1++;
-		if (curr_BBCC->next->next)
-		    conflicts2++;
-	    }
-
-	    curr_BBCC = next_BBCC;
+	curr_BBCC = current_bbccs.table[i].bbcc;
+	new_idx = bbcc_hash_idx(curr_BBCC->bb,
+				curr_BBCC->cxt,
+				new_size);
+	probes = 1;
+	while (new_table[new_idx].bb) {
+	    new_idx = (new_idx + 1) & (new_size - 1);
+	    probes++;
 	}
+	new_table[new_idx] = current_bbccs.table[i];
+	if (probes > max_probes) max_probes = probes;
     }
 
     VG_(free)(current_bbccs.table);
 
 
-    CLG_DEBUG(0,"Resize BBCC Hash: %u => %d (entries %u, conflicts %d/%d)\n",
+    CLG_DEBUG(0,"Resize BBCC Hash: %u => %d (entries %u, max probes %d)\n",
 	     current_bbccs.size, new_size,
-	     current_bbccs.entries, conflicts1, conflicts2);
+	     current_bbccs.entries, max_probes);
 
     current_bbccs.size = new_size;
     current_bbccs.table = new_table;
@@ -256,6 +273,38 @@ BBCC** new_recursion(int size)
 }
   
 
+/* BBCCs are never freed. They are carved out of big chunks, each
+ * together with its cost array, so that the cost counters updated
+ * when executing a BB are next to the BBCC header, and BBCCs created
+ * one after the other (usually executed one after the other) share
+ * cache lines and pages. This also saves the per-block overhead of
+ * the Valgrind allocator.
+ */
+#define BBCC_CHUNK_SIZE  (256 * 1024)
+
+static UChar* bbcc_chunk_free = 0;
+static SizeT  bbcc_chunk_left = 0;
+
+static void* alloc_bbcc_space(SizeT size)
+{
+   void* p;
+
+   size = VG_ROUNDUP(size, sizeof(ULong));
+
+   /* fall back for (very unlikely) huge BBCCs */
+   if (size > BBCC_CHUNK_SIZE / 16)
+      return CLG_MALLOC("cl.bbcc.abs.1", size);
+
+   if (size > bbcc_chunk_left) {
+      bbcc_chunk_free = CLG_MALLOC("cl.bbcc.abs.2", BBCC_CHUNK_SIZE);
+      bbcc_chunk_left = BBCC_CHUNK_SIZE;
+   }
+   p = bbcc_chunk_free;
+   bbcc_chunk_free += size;
+   bbcc_chunk_left -= size;
+   return p;
+}
+
 /*
  * Allocate a new BBCC
  *
@@ -266,20 +315,25 @@ static __inline__
 BBCC* new_bbcc(BB* bb)
 {
    BBCC* bbcc;
+   SizeT cost_offset;
    Int i;
 
    /* We need cjmp_count+1 JmpData structs:
-    * the last is for the unconditional jump/call/ret at end of BB
+    * the last is for the unconditional jump/call/ret at end of BB.
+    * The cost array follows.
     */
-   bbcc = (BBCC*)CLG_MALLOC("cl.bbcc.nb.1",
-			    sizeof(BBCC) +
-			    (bb->cjmp_count+1) * sizeof(JmpData));
+   cost_offset = VG_ROUNDUP(sizeof(BBCC) +
+			    (bb->cjmp_count+1) * sizeof(JmpData),
+			    sizeof(ULong));
+   bbcc = (BBCC*)alloc_bbcc_space(cost_offset +
+				  bb->cost_count * sizeof(ULong));
    bbcc->bb  = bb;
    bbcc->tid = CLG_(current_tid);
 
    bbcc->ret_counter = 0;
    bbcc->skipped = 0;
-   bbcc->cost = CLG_(get_costarray)(bb->cost_count);
+   bbcc->cost = (ULong*)((UChar*)bbcc + cost_offset);
+   CLG_(costarray_entries) += bb->cost_count;
    for(i=0;i<bb->cost_count;i++)
      bbcc->cost[i] = 0;
    for(i=0; i<=bb->cjmp_count; i++) {
@@ -323,14 +377,18 @@ void insert_bbcc_into_hash(BBCC* bbcc)
     CLG_DEBUG(3,"+ insert_bbcc_into_hash(BB %#lx, fn '%s')\n",
 	     bb_addr(bbcc->bb), bbcc->cxt->fn[0]->name);
 
-    /* check fill degree of hash and resize if needed (>90%) */
+    /* check fill degree of hash and resize if needed (>70%):
+     * with linear probing, probe sequences grow quickly above that */
     current_bbccs.entries++;
-    if (100 * current_bbccs.entries / current_bbccs.size > 90)
+    if (10 * current_bbccs.entries > 7 * current_bbccs.size)
 	resize_bbcc_hash();
 
     idx = bbcc_hash_idx(bbcc->bb, bbcc->cxt, current_bbccs.size);
-    bbcc->next = current_bbccs.table[idx];
-    current_bbccs.table[idx] = bbcc;
+    while (current_bbccs.table[idx].bb)
+	idx = (idx + 1) & (current_bbccs.size - 1);
+    current_bbccs.table[idx].bb   = bbcc->bb;
+    current_bbccs.table[idx].cxt  = bbcc->cxt;
+    current_bbccs.table[idx].bbcc = bbcc;
 
     CLG_DEBUG(3,"- insert_bbcc_into_hash: %u entries\n",
 	     current_bbccs.entries);
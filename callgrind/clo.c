@@ -415,6 +415,8 @@ Bool CLG_(process_cmd_line_option)(const HChar* arg)
    else if VG_BOOL_CLO(arg, "--trace-jump",    CLG_(clo).collect_jumps) {}
 
    else if VG_BOOL_CLO(arg, "--combine-dumps", CLG_(clo).combine_dumps) {}
+   else if VG_BOOL_CLO(arg, "--dump-gzip", CLG_(clo).dump_gzip) {}
+   else if VG_BOOL_CLO(arg, "--dump-background", CLG_(clo).dump_background) {}
 
    else if VG_BOOL_CLO(arg, "--collect-atstart", CLG_(clo).collect_atstart) {}
 
@@ -521,6 +523,10 @@ Bool CLG_(process_cmd_line_option)(const HChar* arg)
    else if VG_BOOL_CLO(arg, "--dump-bb",    CLG_(clo).dump_bb) {}
 
    else if VG_INT_CLO( arg, "--dump-every-bb", CLG_(clo).dump_every_bb) {}
+   else if VG_BINT_CLO(arg, "--sample-interval", CLG_(clo).sample_interval,
+                       0, 1000000) {}
+   else if VG_BINT_CLO(arg, "--sample-window", CLG_(clo).sample_window,
+                       1, 1000000) {}
 
    else if VG_BOOL_CLO(arg, "--collect-alloc",   CLG_(clo).collect_alloc) {}
    else if VG_XACT_CLO(arg, "--collect-systime=no",
@@ -570,6 +576,9 @@ void CLG_(print_usage)(void)
 "    --compress-strings=no|yes Compress strings in profile dump? [yes]\n"
 "    --compress-pos=no|yes     Compress positions in profile dump? [yes]\n"
 "    --combine-dumps=no|yes    Concat all dumps into same file [no]\n"
+"    --dump-gzip=no|yes        Compress dumps with gzip, adding .gz [no]\n"
+"    --dump-background=no|yes  Write intermediate dumps from a forked\n"
+"                              process, without stopping the program [no]\n"
 #if CLG_EXPERIMENTAL
 "    --compress-events=no|yes  Compress events in profile dump? [no]\n"
 "    --dump-bb=no|yes          Dump basic block address of costs? [no]\n"
@@ -589,6 +598,10 @@ void CLG_(print_usage)(void)
 
 "\n   data collection options:\n"
 "    --instr-atstart=no|yes    Do instrumentation at callgrind start [yes]\n"
+"    --sample-interval=<M>     Only instrument a window of code every <M>\n"
+"                              million instructions, and extrapolate [0=off]\n"
+"    --sample-window=<M>       Length of a sampling window, in million\n"
+"                              instructions [10]\n"
 "    --collect-atstart=no|yes  Collect at process/thread start [yes]\n"
 "    --toggle-collect=<func>   Toggle collection on enter/leave function\n"
 "    --collect-jumps=no|yes    Collect jumps? [no]\n"
@@ -649,6 +662,8 @@ void CLG_(set_clo_defaults)(void)
   /* dump options */
   CLG_(clo).out_format       = 0;
   CLG_(clo).combine_dumps    = False;
+  CLG_(clo).dump_gzip        = False;
+  CLG_(clo).dump_background  = False;
   CLG_(clo).compress_strings = True;
   CLG_(clo).compress_mangled = False;
   CLG_(clo).compress_events  = False;
@@ -661,6 +676,9 @@ void CLG_(set_clo_defaults)(void)
 
   CLG_(clo).dump_every_bb    = 0;
 
+  CLG_(clo).sample_interval  = 0;
+  CLG_(clo).sample_window    = 10;
+
   /* Collection */
   CLG_(clo).separate_threads = False;
   CLG_(clo).collect_atstart  = True;
@@ -29,10 +29,16 @@
 
 #include "pub_tool_threadstate.h"
 #include "pub_tool_libcfile.h"
+#include "pub_tool_libcproc.h"
+#include "pub_tool_libcsignal.h"
 
 
 /* Dump Part Counter */
 static Int out_counter = 0;
+static Int out_pid = 0;
+
+/* Process writing a dump in the background, or 0 */
+static Int dump_child = 0;
 
 static HChar* out_file = 0;
 static Bool dumps_initialized = False;
@@ -57,13 +63,16 @@ Int CLG_(get_dump_counter)(void)
 /*--- Output file related stuff                            ---*/
 /*------------------------------------------------------------*/
 
-/* Boolean dumping array */
+/* Boolean dumping array.
+ * It is kept across dumps: when appending to a file, names already
+ * written in an earlier part are not repeated. */
 static Bool* dump_array = 0;
 static Int   dump_array_size = 0;
 static Bool* obj_dumped = 0;
 static Bool* file_dumped = 0;
 static Bool* fn_dumped = 0;
 static Bool* cxt_dumped = 0;
+static Int   dumped_objs = 0, dumped_files = 0, dumped_fns = 0, dumped_cxts = 0;
 
 static
 void reset_dump_array(void)
@@ -76,37 +85,46 @@ void reset_dump_array(void)
 	dump_array[i] = False;
 }
 
+/* Make room for objects, files, functions and contexts created since
+ * the last dump, keeping the state of the existing ones. */
 static
 void init_dump_array(void)
 {
-    dump_array_size = CLG_(stat).distinct_objs +
-      CLG_(stat).distinct_files +
-      CLG_(stat).distinct_fns +
-      CLG_(stat).context_counter;
-    CLG_ASSERT(dump_array == 0);
+    Bool* old = dump_array;
+    Int objs  = CLG_(stat).distinct_objs;
+    Int files = CLG_(stat).distinct_files;
+    Int fns   = CLG_(stat).distinct_fns;
+    Int cxts  = CLG_(stat).context_counter;
+
+    if (old && objs == dumped_objs && files == dumped_files &&
+	fns == dumped_fns && cxts == dumped_cxts)
+	return;
+
+    dump_array_size = objs + files + fns + cxts;
     dump_array = (Bool*) CLG_MALLOC("cl.dump.ida.1",
                                     dump_array_size * sizeof(Bool));
-    obj_dumped  = dump_array;
-    file_dumped = obj_dumped + CLG_(stat).distinct_objs;
-    fn_dumped   = file_dumped + CLG_(stat).distinct_files;
-    cxt_dumped  = fn_dumped + CLG_(stat).distinct_fns;
-
     reset_dump_array();
 
-    CLG_DEBUG(1, "  init_dump_array: size %d\n", dump_array_size);
-}
-
-static __inline__
-void free_dump_array(void)
-{
-    CLG_ASSERT(dump_array != 0);
-    VG_(free)(dump_array);
+    if (old) {
+	VG_(memcpy)(dump_array, obj_dumped, dumped_objs * sizeof(Bool));
+	VG_(memcpy)(dump_array + objs, file_dumped,
+		    dumped_files * sizeof(Bool));
+	VG_(memcpy)(dump_array + objs + files, fn_dumped,
+		    dumped_fns * sizeof(Bool));
+	VG_(memcpy)(dump_array + objs + files + fns, cxt_dumped,
+		    dumped_cxts * sizeof(Bool));
+	VG_(free)(old);
+    }
+    obj_dumped  = dump_array;
+    file_dumped = obj_dumped + objs;
+    fn_dumped   = file_dumped + files;
+    cxt_dumped  = fn_dumped + fns;
+    dumped_objs  = objs;
+    dumped_files = files;
+    dumped_fns   = fns;
+    dumped_cxts  = cxts;
 
-    dump_array = 0;
-    obj_dumped = 0;
-    file_dumped = 0;
-    fn_dumped = 0;
-    cxt_dumped = 0;
+    CLG_DEBUG(1, "  init_dump_array: size %d\n", dump_array_size);
 }
 
 
@@ -525,6 +543,7 @@ void fprint_pos(VgFile *fp, const AddrPos* curr, const AddrPos* last)
 static
 void fprint_cost(VgFile *fp, const EventMapping* es, const ULong* cost)
 {
+  cost = CLG_(sample_scale_cost)(cost);
   HChar *mcost = CLG_(mappingcost_as_string)(es, cost);
   VG_(fprintf)(fp, "%s\n", mcost);
   CLG_FREE(mcost);
@@ -612,12 +631,13 @@ static void fprint_jcc(VgFile *fp, jCC* jcc, AddrPos* curr, AddrPos* last,
 	if (jcc->jmpkind == jk_CondJump) {
 	    /* format: jcnd=<followed>/<executions> <target> */
 	    VG_(fprintf)(fp, "jcnd=%llu/%llu ",
-			 jcc->call_counter, ecounter);
+			 CLG_(sample_scale)(jcc->call_counter),
+			 CLG_(sample_scale)(ecounter));
 	}
 	else {
 	    /* format: jump=<jump count> <target> */
 	    VG_(fprintf)(fp, "jump=%llu ",
-			 jcc->call_counter);
+			 CLG_(sample_scale)(jcc->call_counter));
 	}
 		
 	fprint_pos(fp, &target, last);
@@ -649,7 +669,7 @@ static void fprint_jcc(VgFile *fp, jCC* jcc, AddrPos* curr, AddrPos* last,
 
     if (!CLG_(is_zero_cost)( CLG_(sets).full, jcc->cost)) {
         VG_(fprintf)(fp, "calls=%llu ", 
-		   jcc->call_counter);
+		   CLG_(sample_scale)(jcc->call_counter));
 
 	fprint_pos(fp, &target, last);
         VG_(fprintf)(fp, "\n");
@@ -1143,6 +1163,7 @@ BBCC** prepare_dump(void)
 static void fprint_cost_ln(VgFile *fp, const HChar* prefix,
 			   const EventMapping* em, const ULong* cost)
 {
+    cost = CLG_(sample_scale_cost)(cost);
     HChar *mcost = CLG_(mappingcost_as_string)(em, cost);
     VG_(fprintf)(fp, "%s%s\n", prefix, mcost);
     CLG_FREE(mcost);
@@ -1151,6 +1172,13 @@ static void fprint_cost_ln(VgFile *fp, const HChar* prefix,
 static ULong bbs_done = 0;
 static HChar* filename = 0;
 
+/* With --dump-gzip=yes, the profile is written to <filename> first, and
+ * then compressed into <filename>.gz.  The number of files written by
+ * the current dump, and whether the last one is appended to the
+ * previous ones (--combine-dumps=yes). */
+static Int  dump_parts = 0;
+static Bool dump_appending = False;
+
 static
 void file_err(void)
 {
@@ -1190,12 +1218,19 @@ static VgFile *new_dumpfile(int tid, const HChar* trigger)
 
 	fp = VG_(fopen)(filename, VKI_O_WRONLY|VKI_O_TRUNC, 0);
     }
+    else if (CLG_(clo).dump_gzip) {
+	/* the compressed file is appended to, see close_dumpfile */
+	VG_(sprintf)(filename, "%s", out_file);
+	fp = VG_(fopen)(filename, VKI_O_WRONLY|VKI_O_TRUNC, 0);
+	appending = (out_counter > 1 || dump_parts > 0);
+    }
     else {
 	VG_(sprintf)(filename, "%s", out_file);
         fp = VG_(fopen)(filename, VKI_O_WRONLY|VKI_O_APPEND, 0);
 	if (fp && out_counter>1)
 	    appending = True;
     }
+    dump_appending = appending;
 
     if (fp == NULL) {
 	fp = VG_(fopen)(filename, VKI_O_CREAT|VKI_O_WRONLY,
@@ -1224,7 +1259,7 @@ static VgFile *new_dumpfile(int tid, const HChar* trigger)
 	VG_(fprintf)(fp, "creator: callgrind-" VERSION "\n");
 
 	/* "pid:" line */
-	VG_(fprintf)(fp, "pid: %d\n", VG_(getpid)());
+	VG_(fprintf)(fp, "pid: %d\n", out_pid);
 
 	/* "cmd:" line */
 	VG_(fprintf)(fp, "cmd: %s", cmdbuf);
@@ -1259,6 +1294,8 @@ static VgFile *new_dumpfile(int tid, const HChar* trigger)
 	(*CLG_(cachesim).dump_desc)(fp);
     }
 
+    CLG_(sample_fprint_desc)(fp);
+
     VG_(fprintf)(fp, "\ndesc: Timerange: Basic block %llu - %llu\n",
 		 bbs_done, CLG_(stat).bb_executions);
 
@@ -1329,7 +1366,11 @@ static VgFile *new_dumpfile(int tid, const HChar* trigger)
    /* summary lines */
    sum = CLG_(get_eventset_cost)( CLG_(sets).full );
    CLG_(zero_cost)(CLG_(sets).full, sum);
-   if (CLG_(clo).separate_threads) {
+   if (CLG_(clo).sample_interval > 0) {
+     /* thread costs are zeroed whenever a window starts */
+     CLG_(copy_cost)(CLG_(sets).full, sum, CLG_(sample_cost)());
+   }
+   else if (CLG_(clo).separate_threads) {
      thread_info* ti = CLG_(get_current_thread)();
      CLG_(add_diff_cost)(CLG_(sets).full, sum, ti->lastdump_cost,
 			   ti->states.entry[0]->cost);
@@ -1369,6 +1410,7 @@ static void close_dumpfile(VgFile *fp)
     fprint_cost_ln(fp, "totals: ", CLG_(dumpmap),
 		   dump_total_cost);
     //fprint_fcc_ln(fp, "summary: ", &dump_total_fcc);
+    CLG_(sample_extrapolate)(dump_total_cost);
     CLG_(add_cost_lz)(CLG_(sets).full, 
 		     &CLG_(total_cost), dump_total_cost);
 
@@ -1381,6 +1423,17 @@ static void close_dumpfile(VgFile *fp)
 			 filename, filename);
        }
    }
+
+    dump_parts++;
+    if (CLG_(clo).dump_gzip) {
+	HChar* gzname = CLG_MALLOC("cl.dump.cd.1", VG_(strlen)(filename)+4);
+	VG_(sprintf)(gzname, "%s.gz", filename);
+	if (!CLG_(gzip_file)(filename, gzname,
+			     CLG_(clo).combine_dumps && dump_appending))
+	    VG_(message)(Vg_UserMsg, "Warning: Can not write %s\n", gzname);
+	VG_(unlink)(filename);
+	CLG_FREE(gzname);
+    }
 }
 
 
@@ -1475,6 +1528,7 @@ static void print_bbccs(const HChar* trigger, Bool only_current_thread)
   init_debug_cache();
 
   print_trigger = trigger;
+  dump_parts = 0;
 
   if (!CLG_(clo).separate_threads) {
     /* All BBCC/JCC costs is stored for thread 1 */
@@ -1488,8 +1542,68 @@ static void print_bbccs(const HChar* trigger, Bool only_current_thread)
     print_bbccs_of_thread( CLG_(get_current_thread)() );
   else
     CLG_(forall_threads)(print_bbccs_of_thread);
+}
+
+static void wait_for_dump(void)
+{
+   if (dump_child == 0) return;
+
+   VG_(waitpid_hidden)(dump_child, NULL);
+   dump_child = 0;
+}
+
+/* Write the dump from a forked copy of the process, which is a
+ * copy-on-write snapshot of all costs.  The program only waits for the
+ * fork and for zeroing the costs, as the dump does.  Returns False if
+ * no process could be created. */
+static Bool dump_in_background(const HChar* trigger, Bool only_current_thread)
+{
+   static FullCost sum = 0;
+   vki_sigset_t all;
+   Int pid, t;
+
+   /* Only one dump at a time: parts of combined dumps must not mix */
+   wait_for_dump();
 
-  free_dump_array();
+   /* The client must neither get a SIGCHLD for it nor be able to reap it */
+   pid = VG_(fork_hidden)();
+   if (pid < 0) return False;
+
+   if (pid == 0) {
+      /* Signals are for the program, not for us */
+      VG_(memset)(&all, 0xff, sizeof(all));
+      VG_(sigprocmask)(VKI_SIG_SETMASK, &all, NULL);
+
+      print_bbccs(trigger, only_current_thread);
+      VG_(exit_now)(0);
+   }
+   dump_child = pid;
+
+   /* The child adds its totals to its copy of CLG_(total_cost); use the
+    * sum of the summaries instead */
+   CLG_(init_cost_lz)( CLG_(sets).full, &sum );
+   if (CLG_(clo).sample_interval > 0) {
+      CLG_(copy_cost)( CLG_(sets).full, sum, CLG_(sample_cost)() );
+      CLG_(sample_extrapolate)(sum);
+   }
+   else if (CLG_(clo).separate_threads && only_current_thread) {
+      thread_info* ti = CLG_(get_current_thread)();
+      CLG_(add_diff_cost)( CLG_(sets).full, sum, ti->lastdump_cost,
+			   ti->states.entry[0]->cost );
+   }
+   else {
+      thread_info** thr = CLG_(get_threads)();
+      for(t=1;t<VG_N_THREADS;t++) {
+	 if (!thr[t]) continue;
+	 CLG_(add_diff_cost)( CLG_(sets).full, sum, thr[t]->lastdump_cost,
+			      thr[t]->states.entry[0]->cost );
+      }
+   }
+   CLG_(add_cost_lz)( CLG_(sets).full, &CLG_(total_cost), sum );
+
+   /* the costs just dumped by the child */
+   CLG_(zero_all_cost)( CLG_(clo).separate_threads && only_current_thread );
+   return True;
 }
 
 
@@ -1507,7 +1621,14 @@ void CLG_(dump_profile)(const HChar* trigger, Bool only_current_thread)
 
    out_counter++;
 
-   print_bbccs(trigger, only_current_thread);
+   CLG_(sample_prepare_dump)();
+   /* The dump at program termination has nothing to wait for */
+   if (!CLG_(clo).dump_background || !trigger ||
+       !dump_in_background(trigger, only_current_thread)) {
+      wait_for_dump();
+      print_bbccs(trigger, only_current_thread);
+   }
+   CLG_(sample_reset)();
 
    bbs_done = CLG_(stat).bb_executions++;
 
@@ -1585,14 +1706,15 @@ void CLG_(init_dumps)()
 {
    SysRes res;
 
-   static int thisPID = 0;
    int currentPID = VG_(getpid)();
-   if (currentPID == thisPID) {
+   if (currentPID == out_pid) {
        /* already initialized, and no PID change */
        CLG_ASSERT(out_file != 0);
        return;
    }
-   thisPID = currentPID;
+   out_pid = currentPID;
+   /* a dump process of the parent is not ours */
+   dump_child = 0;
    
    if (!CLG_(clo).out_format)
      CLG_(clo).out_format = DEFAULT_OUTFORMAT;
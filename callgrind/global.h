@@ -84,6 +84,8 @@ struct _CommandLineOptions {
   /* Dump format options */
   const HChar* out_format;  /* Format string for callgrind output file name */
   Bool combine_dumps;       /* Dump trace parts into same file? */
+  Bool dump_gzip;           /* Compress dump files? */
+  Bool dump_background;     /* Write dumps from a forked process? */
   Bool compress_strings;
   Bool compress_events;
   Bool compress_pos;
@@ -96,6 +98,10 @@ struct _CommandLineOptions {
   
   /* Dump generation options */
   ULong dump_every_bb;     /* Dump every xxx BBs. */
+
+  /* Sampling options (in million instructions) */
+  ULong sample_interval;   /* Start a sampling window every xxx, 0 = off */
+  ULong sample_window;     /* Length of a sampling window */
   
   /* Collection options */
   Bool separate_threads; /* Separate threads in dump? */
@@ -173,6 +179,9 @@ struct _Statistics {
   Int  fn_name_debug_BBs;
   Int  no_debug_BBs;
   Int  bbcc_lru_misses;
+  Int  bbcc_hash_probes_max;
+  ULong bbcc_hash_lookups;
+  ULong bbcc_hash_probes;
   Int  jcc_lru_misses;
   Int  cxt_lru_misses;
   Int  bbcc_clones;
@@ -383,7 +392,6 @@ struct _BBCC {
     FullCost skipped;      /* cost for skipped functions called from 
 			    * jmp_addr. Allocated lazy */
     
-    BBCC*    next;         /* entry chain in hash */
     ULong*   cost;         /* start of 64bit costs for this BBCC */
     ULong    ecounter_sum; /* execution counter for first instruction of BB */
     JmpData  jmp[0];
@@ -521,10 +529,19 @@ struct _cxt_hash {
  * There are variables for the current state of each part,
  * on which a thread state is copied at thread switch.
  */
+/* The BBCC hash uses open addressing with linear probing. The key is
+ * copied into the slot, so a probe sequence does not touch the BBCCs. */
+typedef struct _bbcc_slot bbcc_slot;
+struct _bbcc_slot {
+  BB*      bb;       /* 0 for an empty slot */
+  Context* cxt;
+  BBCC*    bbcc;
+};
+
 typedef struct _bbcc_hash bbcc_hash;
 struct _bbcc_hash {
-  UInt size, entries;
-  BBCC** table;
+  UInt size, entries;   /* size is a power of 2 */
+  bbcc_slot* table;
 };
 
 typedef struct _jcc_hash jcc_hash;
@@ -779,6 +796,21 @@ void CLG_(run_post_signal_on_call_stack_bottom)(void);
 /* from dump.c */
 void CLG_(init_dumps)(void);
 
+/* from gzip.c */
+Bool CLG_(gzip_file)(const HChar* src, const HChar* dst, Bool append);
+
+/* from sample.c */
+void CLG_(init_sampling)(void);
+void CLG_(add_sample_counter)(IRSB* sbOut, const IRSB* sbIn);
+void CLG_(sample_check)(void);
+void CLG_(sample_prepare_dump)(void);
+void CLG_(sample_reset)(void);
+ULong CLG_(sample_scale)(ULong count);
+const ULong* CLG_(sample_scale_cost)(const ULong* cost);
+void CLG_(sample_extrapolate)(ULong* cost);
+ULong* CLG_(sample_cost)(void);
+void CLG_(sample_fprint_desc)(VgFile* fp);
+
 /*------------------------------------------------------------*/
 /*--- Exported global variables                            ---*/
 /*------------------------------------------------------------*/
@@ -790,6 +822,7 @@ extern EventMapping* CLG_(dumpmap);
 /* Function active counter array, indexed by function number */
 extern UInt* CLG_(fn_active_array);
 extern Bool CLG_(instrument_state);
+extern ULong CLG_(sample_instrs);
  /* min of L1 and LL cache line sizes */
 extern Int CLG_(min_line_size);
 extern call_stack CLG_(current_call_stack);
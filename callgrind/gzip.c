@@ -0,0 +1,276 @@
+/*--------------------------------------------------------------------*/
+/*--- Callgrind                                                    ---*/
+/*---                                                      gzip.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Callgrind, a Valgrind tool for call tracing.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#include "global.h"
+
+/*------------------------------------------------------------*/
+/*--- gzip output (--dump-gzip)                            ---*/
+/*------------------------------------------------------------*/
+
+/* A small deflate encoder (RFC 1951) writing gzip members (RFC 1952),
+ * as we can not link against zlib.  It uses LZ77 with hash chains and
+ * the fixed Huffman code only, which is good enough for the very
+ * repetitive profile text.  The input is compressed in chunks, and
+ * matches do not cross chunk boundaries.
+ */
+
+#define CHUNK_SIZE   (256 * 1024)
+#define WINDOW_SIZE  32768
+#define HASH_BITS    15
+#define HASH_SIZE    (1 << HASH_BITS)
+#define MAX_CHAIN    32
+#define MIN_MATCH    3
+#define MAX_MATCH    258
+#define OUT_SIZE     65536
+
+static UChar* in_buf = 0;
+static Int*   head = 0;    /* last position with a given hash, or -1 */
+static Int*   prev = 0;    /* previous position with the same hash */
+static UInt   crc_table[256];
+
+static UChar  out_buf[OUT_SIZE];
+static Int    out_used;
+static Int    out_fd;
+static Bool   out_error;
+static UInt   bit_buf;
+static Int    bit_count;
+
+static const UShort len_base[29] = {
+   3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+   35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const UChar len_extra[29] = {
+   0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+   3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const UShort dist_base[30] = {
+   1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+   257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+   8193, 12289, 16385, 24577 };
+static const UChar dist_extra[30] = {
+   0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+   7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static void init_gzip(void)
+{
+   UInt i, j, c;
+
+   if (in_buf) return;
+
+   in_buf = CLG_MALLOC("cl.gzip.ig.1", CHUNK_SIZE);
+   head   = CLG_MALLOC("cl.gzip.ig.2", HASH_SIZE * sizeof(Int));
+   prev   = CLG_MALLOC("cl.gzip.ig.3", CHUNK_SIZE * sizeof(Int));
+
+   for (i = 0; i < 256; i++) {
+      c = i;
+      for (j = 0; j < 8; j++)
+         c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+      crc_table[i] = c;
+   }
+}
+
+static UInt update_crc(UInt crc, const UChar* buf, Int len)
+{
+   Int i;
+
+   crc = ~crc;
+   for (i = 0; i < len; i++)
+      crc = crc_table[(crc ^ buf[i]) & 0xff] ^ (crc >> 8);
+   return ~crc;
+}
+
+static void flush_out(void)
+{
+   if (out_used > 0 && VG_(write)(out_fd, out_buf, out_used) != out_used)
+      out_error = True;
+   out_used = 0;
+}
+
+static __inline__ void put_byte(UChar b)
+{
+   if (out_used == OUT_SIZE) flush_out();
+   out_buf[out_used++] = b;
+}
+
+/* Append the n low bits of value, least significant bit first */
+static __inline__ void put_bits(UInt value, Int n)
+{
+   bit_buf |= value << bit_count;
+   bit_count += n;
+   while (bit_count >= 8) {
+      put_byte(bit_buf & 0xff);
+      bit_buf >>= 8;
+      bit_count -= 8;
+   }
+}
+
+/* Huffman codes are sent most significant bit first */
+static __inline__ void put_code(UInt code, Int len)
+{
+   UInt rev = 0;
+   Int i;
+
+   for (i = 0; i < len; i++) {
+      rev = (rev << 1) | (code & 1);
+      code >>= 1;
+   }
+   put_bits(rev, len);
+}
+
+static void put_literal(UInt sym)
+{
+   if (sym < 144)      put_code(0x30 + sym, 8);
+   else if (sym < 256) put_code(0x190 + sym - 144, 9);
+   else if (sym < 280) put_code(sym - 256, 7);
+   else                put_code(0xc0 + sym - 280, 8);
+}
+
+static void put_match(Int len, Int dist)
+{
+   Int c;
+
+   for (c = 28; len_base[c] > len; c--) ;
+   put_literal(257 + c);
+   put_bits(len - len_base[c], len_extra[c]);
+
+   for (c = 29; dist_base[c] > dist; c--) ;
+   put_code(c, 5);
+   put_bits(dist - dist_base[c], dist_extra[c]);
+}
+
+static __inline__ UInt hash3(const UChar* p)
+{
+   return ((p[0] << 10) ^ (p[1] << 5) ^ p[2]) & (HASH_SIZE - 1);
+}
+
+/* Compress in_buf[0..len) as one fixed Huffman block */
+static void deflate_chunk(Int len)
+{
+   Int pos, i, cand, chain, best_len, best_dist, max, l;
+   UInt h;
+
+   for (i = 0; i < HASH_SIZE; i++) head[i] = -1;
+
+   put_bits(0, 1);  /* not the final block */
+   put_bits(1, 2);  /* fixed Huffman codes */
+
+   pos = 0;
+   while (pos < len) {
+      best_len = 0;
+      best_dist = 0;
+      if (pos + MIN_MATCH <= len) {
+         max = len - pos;
+         if (max > MAX_MATCH) max = MAX_MATCH;
+         h = hash3(in_buf + pos);
+         cand = head[h];
+         for (chain = 0; cand >= 0 && chain < MAX_CHAIN; chain++) {
+            if (pos - cand > WINDOW_SIZE) break;
+            if (in_buf[cand + best_len] == in_buf[pos + best_len]) {
+               for (l = 0; l < max && in_buf[cand + l] == in_buf[pos + l]; l++) ;
+               if (l > best_len) {
+                  best_len = l;
+                  best_dist = pos - cand;
+                  if (l == max) break;
+               }
+            }
+            cand = prev[cand];
+         }
+         prev[pos] = head[h];
+         head[h] = pos;
+      }
+
+      if (best_len >= MIN_MATCH) {
+         put_match(best_len, best_dist);
+         /* insert the skipped positions into the hash chains */
+         for (i = pos + 1; i < pos + best_len && i + MIN_MATCH <= len; i++) {
+            h = hash3(in_buf + i);
+            prev[i] = head[h];
+            head[h] = i;
+         }
+         pos += best_len;
+      }
+      else {
+         put_literal(in_buf[pos]);
+         pos++;
+      }
+   }
+   put_literal(256);  /* end of block */
+}
+
+/* Compress the file <src> into a gzip member written to <dst>, which is
+ * appended to if <append> is set.  Returns False on error. */
+Bool CLG_(gzip_file)(const HChar* src, const HChar* dst, Bool append)
+{
+   static const UChar header[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3 };
+   SysRes res;
+   Int    in_fd, len, i;
+   UInt   crc = 0, size = 0;
+
+   init_gzip();
+
+   res = VG_(open)(src, VKI_O_RDONLY, 0);
+   if (sr_isError(res)) return False;
+   in_fd = sr_Res(res);
+
+   res = VG_(open)(dst, VKI_O_WRONLY | VKI_O_CREAT |
+                   (append ? VKI_O_APPEND : VKI_O_TRUNC),
+                   VKI_S_IRUSR | VKI_S_IWUSR);
+   if (sr_isError(res)) {
+      VG_(close)(in_fd);
+      return False;
+   }
+   out_fd = sr_Res(res);
+   out_used = 0;
+   out_error = False;
+   bit_buf = 0;
+   bit_count = 0;
+
+   for (i = 0; i < 10; i++) put_byte(header[i]);
+
+   while (1) {
+      /* fill the chunk; read() may return less than asked for */
+      len = 0;
+      while (len < CHUNK_SIZE) {
+         i = VG_(read)(in_fd, in_buf + len, CHUNK_SIZE - len);
+         if (i <= 0) break;
+         len += i;
+      }
+      if (len == 0) break;
+      crc = update_crc(crc, in_buf, len);
+      size += len;
+      deflate_chunk(len);
+   }
+
+   /* empty final block, then byte align */
+   put_bits(1, 1);
+   put_bits(1, 2);
+   put_literal(256);
+   if (bit_count > 0) put_bits(0, 8 - bit_count);
+
+   for (i = 0; i < 4; i++) put_byte((crc >> (8 * i)) & 0xff);
+   for (i = 0; i < 4; i++) put_byte((size >> (8 * i)) & 0xff);
+   flush_out();
+
+   VG_(close)(in_fd);
+   VG_(close)(out_fd);
+   return !out_error;
+}
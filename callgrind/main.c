@@ -94,6 +94,9 @@ static void CLG_(init_statistics)(Statistics* s)
   s->fn_name_debug_BBs   = 0;
   s->no_debug_BBs        = 0;
   s->bbcc_lru_misses     = 0;
+  s->bbcc_hash_probes_max = 0;
+  s->bbcc_hash_lookups   = 0;
+  s->bbcc_hash_probes    = 0;
   s->jcc_lru_misses      = 0;
   s->cxt_lru_misses      = 0;
   s->bbcc_clones         = 0;
@@ -972,7 +975,20 @@ IRSB* CLG_(instrument)( VgCallbackClosure* closure,
    if (! CLG_(instrument_state)) {
        CLG_DEBUG(5, "instrument(BB %#lx) [Instrumentation OFF]\n",
 		 (Addr)closure->readdr);
-       return sbIn;
+       if (CLG_(clo).sample_interval == 0)
+	   return sbIn;
+
+       /* Between sampling windows, only count instructions */
+       clgs.sbOut = deepCopyIRSBExceptStmts(sbIn);
+       i = 0;
+       while (i < sbIn->stmts_used && sbIn->stmts[i]->tag != Ist_IMark) {
+	   addStmtToIRSB( clgs.sbOut, sbIn->stmts[i] );
+	   i++;
+       }
+       CLG_(add_sample_counter)(clgs.sbOut, sbIn);
+       for (/*use current i*/; i < sbIn->stmts_used; i++)
+	   addStmtToIRSB( clgs.sbOut, sbIn->stmts[i] );
+       return clgs.sbOut;
    }
 
    CLG_DEBUG(3, "+ instrument(BB %#lx)\n", (Addr)closure->readdr);
@@ -987,6 +1003,9 @@ IRSB* CLG_(instrument)( VgCallbackClosure* closure,
       i++;
    }
 
+   if (CLG_(clo).sample_interval > 0)
+      CLG_(add_sample_counter)(clgs.sbOut, sbIn);
+
    // Get the first statement, and origAddr from it
    CLG_ASSERT(sbIn->stmts_used >0);
    CLG_ASSERT(i < sbIn->stmts_used);
@@ -1421,6 +1440,10 @@ void CLG_(zero_all_cost)(Bool only_current_thread)
   else
     CLG_(forall_threads)(zero_thread_cost);
 
+  /* sampling statistics start again, too */
+  CLG_(sample_prepare_dump)();
+  CLG_(sample_reset)();
+
   if (VG_(clo_verbosity) > 1)
     VG_(message)(Vg_DebugMsg, "  ...done\n");
 }
@@ -1463,7 +1486,9 @@ void CLG_(set_instrument_state)(const HChar* reason, Bool state)
   /* reset internal state: call stacks, simulator */
   CLG_(forall_threads)(unwind_thread);
   CLG_(forall_threads)(zero_state_cost);
-  (*CLG_(cachesim).clear)();
+  /* Keep the simulator state between sampling windows: it is warm */
+  if (CLG_(clo).sample_interval == 0)
+    (*CLG_(cachesim).clear)();
 
   if (VG_(clo_verbosity) > 1)
     VG_(message)(Vg_DebugMsg, "%s: instrumentation switched %s\n",
@@ -1625,6 +1650,8 @@ static Bool handle_gdb_monitor_command (ThreadId tid, const HChar *req)
        VG_(gdb_printf)("instrumentation: %s\n",
 		       CLG_(instrument_state) ? "on":"off");
      }
+     else if (CLG_(clo).sample_interval > 0)
+       VG_(gdb_printf)("instrumentation is controlled by --sample-interval\n");
      else
        CLG_(set_instrument_state)("Command", VG_(strcmp)(arg,"off")!=0);
      return True;
@@ -1672,12 +1699,15 @@ Bool CLG_(handle_client_request)(ThreadId tid, UWord *args, UWord *ret)
      break;
 
    case VG_USERREQ__START_INSTRUMENTATION:
-     CLG_(set_instrument_state)("Client Request", True);
+     /* with --sample-interval, the sampling windows decide */
+     if (CLG_(clo).sample_interval == 0)
+       CLG_(set_instrument_state)("Client Request", True);
      *ret = 0;                 /* meaningless */
      break;
 
    case VG_USERREQ__STOP_INSTRUMENTATION:
-     CLG_(set_instrument_state)("Client Request", False);
+     if (CLG_(clo).sample_interval == 0)
+       CLG_(set_instrument_state)("Client Request", False);
      *ret = 0;                 /* meaningless */
      break;
 
@@ -1911,6 +1941,13 @@ void clg_print_stats(void)
 		CLG_(stat).cxt_lru_misses);
    VG_(message)(Vg_DebugMsg, "LRU BBCC Misses:   %d\n",
 		CLG_(stat).bbcc_lru_misses);
+   if (CLG_(stat).bbcc_hash_lookups > 0)
+      VG_(message)(Vg_DebugMsg, "BBCC hash probes:  %.2f avg, %d max "
+                   "(%llu lookups)\n",
+                   (double)CLG_(stat).bbcc_hash_probes /
+                   (double)CLG_(stat).bbcc_hash_lookups,
+                   CLG_(stat).bbcc_hash_probes_max,
+                   CLG_(stat).bbcc_hash_lookups);
    VG_(message)(Vg_DebugMsg, "LRU JCC Misses:    %d\n",
 		CLG_(stat).jcc_lru_misses);
    VG_(message)(Vg_DebugMsg, "BBs Executed:      %llu\n",
@@ -2008,6 +2045,8 @@ static void clg_start_client_code_callback ( ThreadId tid, ULong blocks_done )
    if (0)
       VG_(printf)("%d R %llu\n", (Int)tid, blocks_done);
 
+   CLG_(sample_check)();
+
    /* throttle calls to CLG_(run_thread) by number of BBs executed */
    if (blocks_done - last_blocks_done < 5000) return;
    last_blocks_done = blocks_done;
@@ -2069,6 +2108,28 @@ void CLG_(post_clo_init)(void)
       VG_(clo_vex_control).guest_chase = False; // cannot be overridden.
    }
    
+   /* VG_(fmsg_bad_option) is not fatal any more after option parsing */
+   if (CLG_(clo).sample_interval > 0) {
+      const HChar* conflict = NULL;
+
+      if (CLG_(clo).separate_threads)
+         conflict = "--separate-threads=yes";
+      else if (!CLG_(clo).instrument_atstart)
+         conflict = "--instr-atstart=no";
+      if (conflict) {
+         VG_(fmsg_bad_option)("--sample-interval",
+            "Sampling can not be used with %s\n", conflict);
+         VG_(exit)(1);
+      }
+      if (CLG_(clo).sample_window >= CLG_(clo).sample_interval) {
+         VG_(fmsg_bad_option)("--sample-interval",
+            "The sampling window (%llu) must be shorter than the sampling"
+            " interval (%llu)\n", CLG_(clo).sample_window,
+            CLG_(clo).sample_interval);
+         VG_(exit)(1);
+      }
+   }
+
    CLG_DEBUG(1, "  dump threads: %s\n", CLG_(clo).separate_threads ? "Yes":"No");
    CLG_DEBUG(1, "  call sep. : %d\n", CLG_(clo).separate_callers);
    CLG_DEBUG(1, "  rec. sep. : %d\n", CLG_(clo).separate_recursions);
@@ -2082,6 +2143,10 @@ void CLG_(post_clo_init)(void)
 
    (*CLG_(cachesim).post_clo_init)();
 
+   /* callgrind only uses cachegrind's default predictors */
+   if (CLG_(clo).simulate_branch)
+      branchpred_init(BP_Simple, BP_BTAC, 64);
+
    CLG_(init_eventsets)();
    CLG_(init_statistics)(& CLG_(stat));
    CLG_(init_cost_lz)( CLG_(sets).full, &CLG_(total_cost) );
@@ -2095,6 +2160,7 @@ void CLG_(post_clo_init)(void)
    CLG_(run_thread)(1);
 
    CLG_(instrument_state) = CLG_(clo).instrument_atstart;
+   CLG_(init_sampling)();
 
    if (VG_(clo_verbosity) > 0) {
       VG_(message)(Vg_UserMsg,
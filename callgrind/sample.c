@@ -0,0 +1,278 @@
+/*--------------------------------------------------------------------*/
+/*--- Callgrind                                                    ---*/
+/*---                                                    sample.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Callgrind, a Valgrind tool for call tracing.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#include "global.h"
+
+/*------------------------------------------------------------*/
+/*--- Sampling mode (--sample-interval)                    ---*/
+/*------------------------------------------------------------*/
+
+/* With --sample-interval=<M>, full instrumentation is switched on for a
+ * window of --sample-window million guest instructions every <M> million
+ * instructions.  Between windows, superblocks only count their guest
+ * instructions.  Windows start and end at the next thread time slice
+ * after the instruction count is reached, so their real length is
+ * measured rather than assumed.
+ *
+ * At dump time, all costs are multiplied by (instructions executed) /
+ * (instructions in windows).  Each window is one observation of the
+ * event rates (events per instruction), which gives the standard error
+ * of the extrapolated totals (a ratio estimator over the windows).
+ */
+
+/* Guest instructions executed, counted at superblock entry. */
+ULong CLG_(sample_instrs) = 0;
+
+static Bool  in_window = False;
+static ULong next_window = 0;   /* start window at this instruction count */
+static ULong window_start = 0;  /* instruction count at window start */
+
+/* Statistics since the last dump */
+static ULong  dump_start = 0;   /* instruction count at last dump */
+static ULong  windows = 0;
+static ULong  sampled = 0;      /* instructions in windows */
+static double sum_n2 = 0.0;     /* sum of squared window lengths */
+static FullCost thread_sum = 0; /* sum of the thread costs */
+static FullCost window_base = 0;/* thread costs already accounted for */
+static FullCost sample_cost = 0;/* sum of window costs */
+static double* sum_e2 = 0;      /* per event: sum of squared window costs */
+static double* sum_en = 0;      /* per event: sum of window cost * length */
+
+static double scale = 1.0;
+
+#if defined(VG_BIGENDIAN)
+# define CLGEndness Iend_BE
+#elif defined(VG_LITTLEENDIAN)
+# define CLGEndness Iend_LE
+#else
+# error "Unknown endianness"
+#endif
+
+void CLG_(init_sampling)(void)
+{
+   Int size = CLG_(sets).full->size;
+
+   if (CLG_(clo).sample_interval == 0) return;
+
+   CLG_(init_cost_lz)( CLG_(sets).full, &thread_sum );
+   CLG_(init_cost_lz)( CLG_(sets).full, &window_base );
+   CLG_(init_cost_lz)( CLG_(sets).full, &sample_cost );
+   sum_e2 = CLG_MALLOC("cl.sample.is.1", size * sizeof(double));
+   sum_en = CLG_MALLOC("cl.sample.is.2", size * sizeof(double));
+   VG_(memset)(sum_e2, 0, size * sizeof(double));
+   VG_(memset)(sum_en, 0, size * sizeof(double));
+
+   /* The first window starts right away. */
+   CLG_(instrument_state) = True;
+   in_window = True;
+}
+
+/* Add the instruction count of sbIn to CLG_(sample_instrs), inline. */
+void CLG_(add_sample_counter)(IRSB* sbOut, const IRSB* sbIn)
+{
+   Int    i, n = 0;
+   IRTemp t1, t2;
+   IRExpr* addr = mkIRExpr_HWord( (HWord)&CLG_(sample_instrs) );
+
+   for (i = 0; i < sbIn->stmts_used; i++)
+      if (sbIn->stmts[i]->tag == Ist_IMark) n++;
+
+   t1 = newIRTemp(sbOut->tyenv, Ity_I64);
+   t2 = newIRTemp(sbOut->tyenv, Ity_I64);
+   addStmtToIRSB(sbOut, IRStmt_WrTmp(t1, IRExpr_Load(CLGEndness, Ity_I64,
+                                                     addr)));
+   addStmtToIRSB(sbOut,
+                 IRStmt_WrTmp(t2, IRExpr_Binop(Iop_Add64, IRExpr_RdTmp(t1),
+                                               IRExpr_Const(IRConst_U64(n)))));
+   addStmtToIRSB(sbOut, IRStmt_Store(CLGEndness, addr, IRExpr_RdTmp(t2)));
+}
+
+static void add_thread_cost(thread_info* t)
+{
+   CLG_(add_cost)( CLG_(sets).full, thread_sum, CLG_(current_state).cost );
+}
+
+/* Account for the part of the current window since the last call.  The
+ * thread costs were zeroed when the window started. */
+static void account_window(void)
+{
+   double n, e;
+   Int    i;
+
+   n = (double)(CLG_(sample_instrs) - window_start);
+   if (n == 0) return;
+
+   CLG_(zero_cost)( CLG_(sets).full, thread_sum );
+   CLG_(forall_threads)(add_thread_cost);
+
+   for (i = 0; i < CLG_(sets).full->size; i++) {
+      e = (double)(thread_sum[i] - window_base[i]);
+      sample_cost[i] += thread_sum[i] - window_base[i];
+      sum_e2[i] += e * e;
+      sum_en[i] += e * n;
+   }
+   CLG_(copy_cost)( CLG_(sets).full, window_base, thread_sum );
+   windows++;
+   sampled += CLG_(sample_instrs) - window_start;
+   sum_n2  += n * n;
+   window_start = CLG_(sample_instrs);
+}
+
+/* Called at every thread time slice. */
+void CLG_(sample_check)(void)
+{
+   if (CLG_(clo).sample_interval == 0) return;
+
+   if (!in_window) {
+      if (CLG_(sample_instrs) < next_window) return;
+      next_window  = CLG_(sample_instrs) + CLG_(clo).sample_interval * 1000000;
+      window_start = CLG_(sample_instrs);
+      in_window    = True;
+      /* switching on zeroes the thread costs */
+      CLG_(zero_cost)( CLG_(sets).full, window_base );
+      CLG_(set_instrument_state)("Sampling", True);
+   }
+   else {
+      if (CLG_(sample_instrs) - window_start
+          < CLG_(clo).sample_window * 1000000) return;
+      account_window();
+      in_window = False;
+      CLG_(set_instrument_state)("Sampling", False);
+   }
+}
+
+/* Called before a dump: account for the current window so far, and
+ * compute the extrapolation factor. */
+void CLG_(sample_prepare_dump)(void)
+{
+   if (CLG_(clo).sample_interval == 0) return;
+
+   if (in_window) account_window();
+   scale = sampled ? (double)(CLG_(sample_instrs) - dump_start) / sampled
+                   : 1.0;
+}
+
+/* Called after a dump: costs are zeroed, so start new statistics. */
+void CLG_(sample_reset)(void)
+{
+   Int i;
+
+   if (CLG_(clo).sample_interval == 0) return;
+
+   dump_start = CLG_(sample_instrs);
+   windows = sampled = 0;
+   sum_n2 = 0.0;
+   CLG_(zero_cost)( CLG_(sets).full, sample_cost );
+   for (i = 0; i < CLG_(sets).full->size; i++)
+      sum_e2[i] = sum_en[i] = 0.0;
+   scale = 1.0;
+}
+
+ULong CLG_(sample_scale)(ULong count)
+{
+   if (scale == 1.0) return count;
+   return (ULong)((double)count * scale + 0.5);
+}
+
+/* Returns cost multiplied by the extrapolation factor, in a buffer that
+ * is overwritten by the next call. */
+const ULong* CLG_(sample_scale_cost)(const ULong* cost)
+{
+   static FullCost buf = 0;
+   Int i;
+
+   if (scale == 1.0 || !cost) return cost;
+   CLG_(init_cost_lz)( CLG_(sets).full, &buf );
+   for (i = 0; i < CLG_(sets).full->size; i++)
+      buf[i] = CLG_(sample_scale)(cost[i]);
+   return buf;
+}
+
+/* Multiplies cost by the extrapolation factor, in place. */
+void CLG_(sample_extrapolate)(ULong* cost)
+{
+   Int i;
+
+   if (scale == 1.0) return;
+   for (i = 0; i < CLG_(sets).full->size; i++)
+      cost[i] = CLG_(sample_scale)(cost[i]);
+}
+
+/* Sum of the window costs since the last dump, unscaled. */
+ULong* CLG_(sample_cost)(void)
+{
+   return sample_cost;
+}
+
+/* Newton's method; there is no libm. */
+static double sqrt_approx(double x)
+{
+   double r = x > 1.0 ? x : 1.0, next;
+   Int i;
+
+   if (x <= 0.0) return 0.0;
+   for (i = 0; i < 100; i++) {
+      next = (r + x / r) / 2;
+      if (next >= r) break;
+      r = next;
+   }
+   return r;
+}
+
+/* Relative standard error of the extrapolated total of event i, in
+ * percent.  With R = sum(e)/sum(n) the estimated events per
+ * instruction, var(R) = sum((e - R*n)^2) / (k*(k-1)*mean(n)^2). */
+static double rel_error(Int i)
+{
+   double k = (double)windows, n = (double)sampled;
+   double e = (double)sample_cost[i], r, ss;
+
+   if (windows < 2 || e == 0.0) return 0.0;
+   r  = e / n;
+   ss = sum_e2[i] - 2 * r * sum_en[i] + r * r * sum_n2;
+   if (ss < 0.0) ss = 0.0;
+   /* relative error is sqrt(ss / (k*(k-1))) / (n/k) / r */
+   ss = ss / (k * (k - 1)) / ((n / k) * (n / k)) / (r * r);
+   return 100.0 * sqrt_approx(ss);
+}
+
+void CLG_(sample_fprint_desc)(VgFile* fp)
+{
+   Int i, off;
+
+   if (CLG_(clo).sample_interval == 0) return;
+
+   VG_(fprintf)(fp, "desc: Sampling: %llu windows, %llu of %llu "
+                "instructions, costs extrapolated by %.3f\n",
+                windows, sampled, CLG_(sample_instrs) - dump_start, scale);
+   VG_(fprintf)(fp, "desc: Sampling error (relative, 1 sigma):");
+   for (i = 0; i < CLG_(dumpmap)->size; i++) {
+      off = CLG_(dumpmap)->entry[i].offset;
+      VG_(fprintf)(fp, " %s %.2f%%",
+                   CLG_(get_event_group)(CLG_(dumpmap)->entry[i].group)
+                      ->name[CLG_(dumpmap)->entry[i].index],
+                   rel_error(off));
+   }
+   VG_(fprintf)(fp, "\n");
+}
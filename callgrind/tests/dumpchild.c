@@ -0,0 +1,36 @@
+// Check that dumps written with --dump-background=yes are not visible
+// to the program: no SIGCHLD is delivered, and wait() finds no child.
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../callgrind.h"
+
+static volatile int sigchld_count = 0;
+
+static void sigchld_handler(int sig)
+{
+   sigchld_count++;
+}
+
+int main(void)
+{
+   int i, status;
+   pid_t pid;
+
+   signal(SIGCHLD, sigchld_handler);
+
+   for (i = 0; i < 3; i++) {
+      CALLGRIND_DUMP_STATS;
+      /* Give the dump some time to finish */
+      usleep(200000);
+   }
+
+   pid = wait(&status);
+   printf("wait: %s\n", pid == -1 && errno == ECHILD ? "ECHILD" : "child");
+   printf("SIGCHLD: %d\n", sigchld_count);
+
+   return 0;
+}
@@ -0,0 +1,22 @@
+// A loop doing one load and one store every four instructions, so that
+// the extrapolated Dr and Dw totals of a sampled profile can be checked
+// against the exact instruction count of the same run.
+
+#define ITERS 10000000
+
+int main(void)
+{
+#if defined(__x86_64__)
+   long buf[2] = { 0, 0 };
+   long n = ITERS;
+
+   __asm__ __volatile__(
+      "1:\n\t"
+      "movq (%1), %%rax\n\t"
+      "movq %%rax, 8(%1)\n\t"
+      "decq %0\n\t"
+      "jnz 1b\n\t"
+      : "+r"(n) : "r"(buf) : "rax", "memory", "cc");
+#endif
+   return 0;
+}
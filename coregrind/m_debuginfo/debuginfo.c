@@ -343,6 +343,7 @@ static void free_DebugInfo ( DebugInfo* di )
    if (di->loctab_fndn_ix) ML_(dinfo_free)(di->loctab_fndn_ix);
    if (di->inltab)       ML_(dinfo_free)(di->inltab);
    if (di->cfsi_base)    ML_(dinfo_free)(di->cfsi_base);
+   if (di->cfsi_base_idx) ML_(dinfo_free)(di->cfsi_base_idx);
    if (di->cfsi_m_ix)    ML_(dinfo_free)(di->cfsi_m_ix);
    if (di->cfsi_rd)      ML_(dinfo_free)(di->cfsi_rd);
    if (di->cfsi_m_pool)  VG_(deleteDedupPA)(di->cfsi_m_pool);
@@ -2920,8 +2921,103 @@ UWord evalCfiExpr ( const XArray* exprs, Int ix,
 }
 
 
+/* To find the DebugInfo whose CFI may pertain to an ip without walking
+   debugInfo_list, a map of the [cfsi_minavma, cfsi_maxavma] ranges of
+   the DebugInfos valid for the current epoch is kept, sorted by
+   address.  It is rebuilt on demand after the set of DebugInfos or
+   the current epoch changed.  If some ranges overlap, which is not
+   expected, the map is not used and debugInfo_list is walked. */
+
+typedef
+   struct { Addr min; Addr max; DebugInfo* di; }
+   CfsiRange;
+
+static CfsiRange* cfsi_ranges = NULL;
+static UWord      cfsi_ranges_used = 0;
+static UWord      cfsi_ranges_size = 0;
+static Bool       cfsi_ranges_valid = False;
+static Bool       cfsi_ranges_overlap = False;
+static DiEpoch    cfsi_ranges_epoch;
+
+/* Stats only. */
+static ULong n_cfsi_queries = 0;
+static ULong n_cfsi_cache_misses = 0;
+static ULong n_cfsi_ranges_builds = 0;
+static ULong n_cfsi_list_searches = 0;
+
+static void cfsi_ranges__invalidate ( void ) {
+   cfsi_ranges_valid = False;
+}
+
+static Int cmp_CfsiRange ( const void* v1, const void* v2 )
+{
+   const CfsiRange* r1 = v1;
+   const CfsiRange* r2 = v2;
+   if (r1->min < r2->min) return -1;
+   if (r1->min > r2->min) return 1;
+   return 0;
+}
+
+static void cfsi_ranges__build ( DiEpoch curr_epoch )
+{
+   DebugInfo* di;
+   UWord      i, n = 0;
+
+   n_cfsi_ranges_builds++;
+   for (di = debugInfo_list; di != NULL; di = di->next) {
+      if (is_DI_valid_for_epoch(di, curr_epoch) && di->cfsi_used > 0)
+         n++;
+   }
+   if (n > cfsi_ranges_size) {
+      if (cfsi_ranges)
+         ML_(dinfo_free)(cfsi_ranges);
+      cfsi_ranges_size = 2 * n;
+      cfsi_ranges = ML_(dinfo_zalloc)("di.debuginfo.cfsi_ranges.1",
+                                      cfsi_ranges_size * sizeof(CfsiRange));
+   }
+   cfsi_ranges_used = 0;
+   for (di = debugInfo_list; di != NULL; di = di->next) {
+      if (is_DI_valid_for_epoch(di, curr_epoch) && di->cfsi_used > 0) {
+         cfsi_ranges[cfsi_ranges_used].min = di->cfsi_minavma;
+         cfsi_ranges[cfsi_ranges_used].max = di->cfsi_maxavma;
+         cfsi_ranges[cfsi_ranges_used].di  = di;
+         cfsi_ranges_used++;
+      }
+   }
+   vg_assert(cfsi_ranges_used == n);
+   VG_(ssort)(cfsi_ranges, cfsi_ranges_used, sizeof(CfsiRange),
+              cmp_CfsiRange);
+
+   cfsi_ranges_overlap = False;
+   for (i = 1; i < cfsi_ranges_used; i++) {
+      if (cfsi_ranges[i].min <= cfsi_ranges[i-1].max)
+         cfsi_ranges_overlap = True;
+   }
+
+   cfsi_ranges_epoch = curr_epoch;
+   cfsi_ranges_valid = True;
+}
+
+/* Return the DebugInfo whose CFI range contains ip, or NULL. */
+static DebugInfo* cfsi_ranges__find ( Addr ip )
+{
+   Word lo = 0,
+        hi = cfsi_ranges_used - 1,
+        mid;
+
+   /* Find the last range starting at or below ip. */
+   while (lo <= hi) {
+      mid = (lo + hi) / 2;
+      if (ip < cfsi_ranges[mid].min) hi = mid-1;
+      else                           lo = mid+1;
+   }
+   if (hi < 0 || ip > cfsi_ranges[hi].max)
+      return NULL;
+   return cfsi_ranges[hi].di;
+}
+
 /* Search all the DebugInfos in the entire system, to find the DiCfSI_m
-   that pertains to 'ip'. 
+   that pertains to 'ip'.
 
    If found, set *diP to the DebugInfo in which it resides, and
    *cfsi_mP to the cfsi_m pointer in that DebugInfo's cfsi_m_pool.
@@ -2932,7 +3028,7 @@ UWord evalCfiExpr ( const XArray* exprs, Int ix,
    DebugInfos that are valid for the current epoch.
 */
 __attribute__((noinline))
-static void find_DiCfSI ( /*OUT*/DebugInfo** diP, 
+static void find_DiCfSI ( /*OUT*/DebugInfo** diP,
                           /*OUT*/DiCfSI_m** cfsi_mP,
                           Addr ip )
 {
@@ -2947,33 +3043,67 @@ static void find_DiCfSI ( /*OUT*/DebugInfo** diP,
 
    DiEpoch curr_epoch = VG_(current_DiEpoch)();
 
-   for (di = debugInfo_list; di != NULL; di = di->next) {
-      Word j;
-      n_steps++;
+   if (!cfsi_ranges_valid || cfsi_ranges_epoch.n != curr_epoch.n)
+      cfsi_ranges__build(curr_epoch);
 
-      if (!is_DI_valid_for_epoch(di, curr_epoch))
-         continue;
+   if (LIKELY(!cfsi_ranges_overlap)) {
 
-      /* Use the per-DebugInfo summary address ranges to skip
-         inapplicable DebugInfos quickly. */
-      if (di->cfsi_used == 0)
-         continue;
-      if (ip < di->cfsi_minavma || ip > di->cfsi_maxavma)
-         continue;
+      di = cfsi_ranges__find(ip);
+      if (di != NULL) {
+         vg_assert(is_DebugInfo_active(di));
+         i = ML_(search_one_cfitab)( di, ip );
+         vg_assert(i >= -1 && i < (Word)di->cfsi_used);
+      }
 
-      // This di must be active (because we have explicitly chosen not to
-      // allow unwinding stacks that pertain to some past epoch).  It can't
-      // be archived or not-yet-active.
-      vg_assert(is_DebugInfo_active(di));
+   } else {
 
-      /* It might be in this DebugInfo.  Search it. */
-      j = ML_(search_one_cfitab)( di, ip );
-      vg_assert(j >= -1 && j < (Word)di->cfsi_used);
+      n_cfsi_list_searches++;
+      for (di = debugInfo_list; di != NULL; di = di->next) {
+         Word j;
+         n_steps++;
 
-      if (j != -1) {
-         i = j;
-         break; /* found it */
+         if (!is_DI_valid_for_epoch(di, curr_epoch))
+            continue;
+
+         /* Use the per-DebugInfo summary address ranges to skip
+            inapplicable DebugInfos quickly. */
+         if (di->cfsi_used == 0)
+            continue;
+         if (ip < di->cfsi_minavma || ip > di->cfsi_maxavma)
+            continue;
+
+         // This di must be active (because we have explicitly chosen not to
+         // allow unwinding stacks that pertain to some past epoch).  It can't
+         // be archived or not-yet-active.
+         vg_assert(is_DebugInfo_active(di));
+
+         /* It might be in this DebugInfo.  Search it. */
+         j = ML_(search_one_cfitab)( di, ip );
+         vg_assert(j >= -1 && j < (Word)di->cfsi_used);
+
+         if (j != -1) {
+            i = j;
+            break; /* found it */
+         }
       }
+
+      /* Start of performance-enhancing hack: once every 64 (chosen
+         hackily after profiling) successful searches, move the found
+         DebugInfo one step closer to the start of the list.  This
+         makes future searches cheaper.  For starting konqueror on
+         amd64, this in fact reduces the total amount of searching
+         done by the above find-the-right-DebugInfo loop by more than
+         a factor of 20. */
+      if (i != -1 && (n_search & 0xF) == 0) {
+         /* Move di one step closer to the start of the list. */
+         move_DebugInfo_one_step_forward( di );
+      }
+      /* End of performance-enhancing hack. */
+
+      if (0 && ((n_search & 0x7FFFF) == 0))
+         VG_(printf)("find_DiCfSI: %lu searches, "
+                     "%lu DebugInfos looked at\n",
+                     n_search, n_steps);
    }
 
    if (i == -1) {
@@ -2992,29 +3122,10 @@ static void find_DiCfSI ( /*OUT*/DebugInfo** diP,
       if (*cfsi_mP == NULL) {
          // This is a cfsi hole. Report no cfi information found.
          *diP = (DebugInfo*)1;
-         // But we will still perform the hack below.
       } else {
          *diP = di;
       }
 
-      /* Start of performance-enhancing hack: once every 64 (chosen
-         hackily after profiling) successful searches, move the found
-         DebugInfo one step closer to the start of the list.  This
-         makes future searches cheaper.  For starting konqueror on
-         amd64, this in fact reduces the total amount of searching
-         done by the above find-the-right-DebugInfo loop by more than
-         a factor of 20. */
-      if ((n_search & 0xF) == 0) {
-         /* Move di one step closer to the start of the list. */
-         move_DebugInfo_one_step_forward( di );
-      }
-      /* End of performance-enhancing hack. */
-
-      if (0 && ((n_search & 0x7FFFF) == 0))
-         VG_(printf)("find_DiCfSI: %lu searches, "
-                     "%lu DebugInfos looked at\n", 
-                     n_search, n_steps);
-
    }
 
 }
@@ -3033,46 +3144,77 @@ static void find_DiCfSI ( /*OUT*/DebugInfo** diP,
    Hence simply zeroing out the entire cache invalidates all
    entries.
 
+   The cache is set associative: an ip can be in any of the
+   CFSI_M_CACHE_WAYS entries of its set, which are kept in most
+   recently used first order.  Its size is given by --cfi-cache-size,
+   rounded up to a power of two, and it is allocated on first use.
+
    We can map an ip value directly to a (di, cfsi_m*) pair as
    once a DebugInfo is read, adding new DiCfSI_m* is not possible
    anymore, as the cfsi_m_pool is frozen once the reading is terminated.
    Also, the cache is invalidated when new debuginfo is read due to
    an mmap or some debuginfo is discarded due to an munmap. */
 
-// Prime number, giving about 6Kbytes cache on 32 bits,
-//                           12Kbytes cache on 64 bits.
-#define N_CFSI_M_CACHE 509
+#define CFSI_M_CACHE_WAYS 4
 
 typedef
    struct { Addr ip; DebugInfo* di; DiCfSI_m* cfsi_m; }
    CFSI_m_CacheEnt;
 
-static CFSI_m_CacheEnt cfsi_m_cache[N_CFSI_M_CACHE];
+static CFSI_m_CacheEnt* cfsi_m_cache = NULL;
+static UWord            cfsi_m_cache_n_sets;
 
 static void cfsi_m_cache__invalidate ( void ) {
-   VG_(memset)(&cfsi_m_cache, 0, sizeof(cfsi_m_cache));
+   if (cfsi_m_cache != NULL)
+      VG_(memset)(cfsi_m_cache, 0, cfsi_m_cache_n_sets * CFSI_M_CACHE_WAYS
+                                   * sizeof(CFSI_m_CacheEnt));
+   cfsi_ranges__invalidate();
+}
+
+static void cfsi_m_cache__init ( void )
+{
+   cfsi_m_cache_n_sets = 1;
+   while (cfsi_m_cache_n_sets * CFSI_M_CACHE_WAYS < VG_(clo_cfi_cache_size))
+      cfsi_m_cache_n_sets *= 2;
+   cfsi_m_cache = ML_(dinfo_zalloc)("di.debuginfo.cfsi_m_cache.1",
+                                    cfsi_m_cache_n_sets * CFSI_M_CACHE_WAYS
+                                    * sizeof(CFSI_m_CacheEnt));
 }
 
 static inline CFSI_m_CacheEnt* cfsi_m_cache__find ( Addr ip )
 {
-   UWord         hash = ip % N_CFSI_M_CACHE;
-   CFSI_m_CacheEnt* ce = &cfsi_m_cache[hash];
-#  ifdef N_Q_M_STATS
-   static UWord  n_q = 0, n_m = 0;
-   n_q++;
-   if (0 == (n_q & 0x1FFFFF))
-      VG_(printf)("QQQ %lu %lu\n", n_q, n_m);
-#  endif
+   UWord            set, w;
+   CFSI_m_CacheEnt* ce;
+   CFSI_m_CacheEnt  tmp;
+
+   if (UNLIKELY(cfsi_m_cache == NULL))
+      cfsi_m_cache__init();
+
+   n_cfsi_queries++;
+   set = (ip ^ (ip >> 12)) & (cfsi_m_cache_n_sets - 1);
+   ce = &cfsi_m_cache[set * CFSI_M_CACHE_WAYS];
 
-   if (LIKELY(ce->ip == ip) && LIKELY(ce->di != NULL)) {
+   if (LIKELY(ce[0].ip == ip) && LIKELY(ce[0].di != NULL)) {
       /* found an entry in the cache .. */
    } else {
-      /* not found in cache.  Search and update. */
-#     ifdef N_Q_M_STATS
-      n_m++;
-#     endif
-      ce->ip = ip;
-      find_DiCfSI( &ce->di, &ce->cfsi_m, ip );
+      /* Look in the other ways, moving the entry found to the front.
+         If not found, evict the least recently used entry. */
+      for (w = 1; w < CFSI_M_CACHE_WAYS; w++) {
+         if (ce[w].ip == ip && ce[w].di != NULL)
+            break;
+      }
+      if (w == CFSI_M_CACHE_WAYS) {
+         /* not found in cache.  Search and update. */
+         n_cfsi_cache_misses++;
+         w = CFSI_M_CACHE_WAYS - 1;
+         tmp.ip = ip;
+         find_DiCfSI( &tmp.di, &tmp.cfsi_m, ip );
+      } else {
+         tmp = ce[w];
+      }
+      for (; w > 0; w--)
+         ce[w] = ce[w-1];
+      ce[0] = tmp;
    }
 
    if (UNLIKELY(ce->di == (DebugInfo*)1)) {
@@ -3084,6 +3226,22 @@ static inline CFSI_m_CacheEnt* cfsi_m_cache__find ( Addr ip )
    }
 }
 
+void VG_(print_CF_info_stats) ( void )
+{
+   VG_(message)(Vg_DebugMsg,
+      "   cfi: %'llu lookups, %'llu cache misses (%'llu per 1000),"
+      " cache of %'lu entries\n",
+      n_cfsi_queries, n_cfsi_cache_misses,
+      n_cfsi_queries == 0
+         ? 0ULL
+         : (n_cfsi_cache_misses * 1000ULL) / n_cfsi_queries,
+      cfsi_m_cache_n_sets * CFSI_M_CACHE_WAYS);
+   VG_(message)(Vg_DebugMsg,
+      "   cfi: %'llu range map builds (%'lu DebugInfos),"
+      " %'llu DebugInfo list searches\n",
+      n_cfsi_ranges_builds, cfsi_ranges_used, n_cfsi_list_searches);
+}
+
 Bool VG_(has_CF_info)(Addr a)
 {
    return cfsi_m_cache__find (a) != NULL;
@@ -3242,13 +3400,23 @@ void VG_(ppUnwindInfo) (Addr from, Addr to)
    CFSI_m_CacheEnt*   ce;
    Addr ce_from;
    CFSI_m_CacheEnt*   next_ce;
+   /* Copies of the entries, as a cache lookup can move entries. */
+   CFSI_m_CacheEnt    ce_copy, next_ce_copy;
 
 
    ce = cfsi_m_cache__find(from);
+   if (ce != NULL) {
+      ce_copy = *ce;
+      ce = &ce_copy;
+   }
    ce_from = from;
    while (from <= to) {
       from++;
       next_ce = cfsi_m_cache__find(from);
+      if (next_ce != NULL) {
+         next_ce_copy = *next_ce;
+         next_ce = &next_ce_copy;
+      }
       if ((ce == NULL && next_ce != NULL)
           || (ce != NULL && next_ce == NULL)
           || (ce != NULL && next_ce != NULL && ce->cfsi_m != next_ce->cfsi_m)
@@ -3261,7 +3429,12 @@ void VG_(ppUnwindInfo) (Addr from, Addr to)
                           ce_from, from - ce_from,
                           ce->cfsi_m);
          }
-         ce = next_ce;
+         if (next_ce != NULL) {
+            ce_copy = next_ce_copy;
+            ce = &ce_copy;
+         } else {
+            ce = NULL;
+         }
          ce_from = from;
       }
    }
@@ -987,6 +987,13 @@ struct _DebugInfo {
    UWord   cfsi_used;
    UWord   cfsi_size;
 
+   /* Every CFSI_BASE_IDX_STRIDE-th element of cfsi_base.  It is small
+      enough to stay in the data cache, and is searched first so that
+      the search of cfsi_base itself only touches a few cache lines.
+      NULL if cfsi_base is small. */
+   Addr*   cfsi_base_idx;
+   UWord   cfsi_base_idx_used;
+
    DedupPoolAlloc *cfsi_m_pool;
    Addr    cfsi_minavma;
    Addr    cfsi_maxavma;
@@ -2307,6 +2307,11 @@ void ML_(canonicaliseCFI) ( struct _DebugInfo* di )
    }
 }
 
+/* Number of cfsi_base entries stood for by an entry of cfsi_base_idx.
+   The entries of cfsi_base searched after the index then fit in a few
+   cache lines. */
+#define CFSI_BASE_IDX_STRIDE 32
+
 void ML_(finish_CFSI_arrays) ( struct _DebugInfo* di )
 {
    UWord n_mergeables, n_holes;
@@ -2392,6 +2397,18 @@ void ML_(finish_CFSI_arrays) ( struct _DebugInfo* di )
    di->cfsi_size = new_used;
    ML_(dinfo_free) (di->cfsi_rd);
    di->cfsi_rd = NULL;
+
+   /* Build the first level index used by ML_(search_one_cfitab). */
+   vg_assert (di->cfsi_base_idx == NULL);
+   if (new_used >= 2 * CFSI_BASE_IDX_STRIDE) {
+      di->cfsi_base_idx_used
+         = (new_used + CFSI_BASE_IDX_STRIDE - 1) / CFSI_BASE_IDX_STRIDE;
+      di->cfsi_base_idx
+         = ML_(dinfo_zalloc)( "di.storage.finCfSI.3",
+                              di->cfsi_base_idx_used * sizeof(Addr) );
+      for (i = 0; i < di->cfsi_base_idx_used; i++)
+         di->cfsi_base_idx[i] = di->cfsi_base[i * CFSI_BASE_IDX_STRIDE];
+   }
 }
 
 
@@ -2479,6 +2496,23 @@ Word ML_(search_one_cfitab) ( const DebugInfo* di, Addr ptr )
         lo = 0, 
         hi = di->cfsi_used-1;
 
+   if (di->cfsi_base_idx != NULL) {
+      /* Find the last index entry <= ptr, and restrict the search of
+         cfsi_base to the entries it stands for. */
+      Word ilo = 0,
+           ihi = di->cfsi_base_idx_used-1;
+      while (ilo <= ihi) {
+         mid = (ilo + ihi) / 2;
+         if (ptr < di->cfsi_base_idx[mid]) ihi = mid-1;
+         else                              ilo = mid+1;
+      }
+      if (ihi < 0)
+         return -1;
+      lo = ihi * CFSI_BASE_IDX_STRIDE;
+      if (ihi + 1 < di->cfsi_base_idx_used)
+         hi = lo + CFSI_BASE_IDX_STRIDE - 1;
+   }
+
    while (lo <= hi) {
       /* Invariants : hi == cfsi_used-1 || ptr < cfsi_base[hi+1]
                       lo == 0           || ptr > cfsi_base[lo-1]
@@ -31,6 +31,7 @@
 #include "pub_core_threadstate.h"      // For VG_N_THREADS
 #include "pub_core_debuginfo.h"
 #include "pub_core_debuglog.h"
+#include "pub_core_deduppoolalloc.h"
 #include "pub_core_errormgr.h"
 #include "pub_core_execontext.h"
 #include "pub_core_gdbserver.h"
@@ -70,10 +71,31 @@
    Initially empty, and grows as errors are detected. */
 static Error* errors = NULL;
 
+/* The errors of the list are also in a hash table, so that finding
+   the errors matching a new one does not scan the whole list.  An
+   error is hashed on its kind and on the part of its ExeContext
+   compared at Vg_LowRes, which is good for errors compared at
+   Vg_MedRes too.  The size of the table is a power of 2, and it is
+   doubled when it holds more errors than it has chains. */
+static Error** errors_htab = NULL;
+static UWord   errors_htab_size = 0;
+static UInt    errors_htab_bits = 0;
+
+/* Number of errors in the list. */
+static UWord n_errors = 0;
+
+/* Incremented each time an error is put at the front of the list.  The
+   errors are in decreasing stamp order in the list. */
+static ULong errors_stamp = 0;
+
 /* The list of suppression directives, as read from the specified
-   suppressions file.  Note that the list gets rearranged as a result
-   of the searches done by is_suppressible_error(). */
+   suppressions file. */
 static Supp* suppressions = NULL;
+
+/* Incremented each time a suppression is loaded or used.  The most
+   recently used suppressions are tried first, and are shown first by
+   show_used_suppressions. */
+static ULong supp_stamp = 0;
 static Bool load_suppressions_called = False;
 
 /* Running count of unsuppressed errors detected. */
@@ -126,6 +148,12 @@ static UWord em_supplist_cmps = 0;
 */
 struct _Error {
    struct _Error* next;
+   struct _Error* prev;
+   // Next error in the same chain of errors_htab, and hash of the error.
+   struct _Error* hash_next;
+   UWord hash;
+   // Value of errors_stamp when put at the front of the errors list.
+   ULong stamp;
    // Unique tag.  This gives the error a unique identity (handle) by
    // which it can be referred to afterwords.  Currently only used for
    // XML printing.
@@ -225,6 +253,13 @@ typedef
    (0..)) for 'skind'. */
 struct _Supp {
    struct _Supp* next;
+   // Links in the list of the SuppBucket holding this suppression,
+   // which is in decreasing stamp order.
+   struct _Supp* bnext;
+   struct _Supp* bprev;
+   struct _SuppBucket* bucket;
+   // Value of supp_stamp when loaded or last used.
+   ULong stamp;
    Int count;     // The number of times this error has been suppressed.
    HChar* sname;  // The name by which the suppression is referred to.
 
@@ -245,6 +280,29 @@ struct _Supp {
    void* extra;      // Anything else -- use is optional.  NULL by default.
 };
 
+/* To avoid trying every suppression on every error, the suppressions
+   are indexed on their first frame.  The suppressions whose first frame
+   is a fun: or obj: line without wildcards are put in the bucket of
+   this name, found in a hash table.  The other ones are put in the
+   fallback bucket.  An error is then only tried against the
+   suppressions of the buckets of the function and object names of its
+   first frame, and of the fallback bucket. */
+typedef
+   struct _SuppBucket {
+      struct _SuppBucket* next;  // hash chain
+      SuppLocTy     ty;          // FunName or ObjName
+      const HChar*  name;
+      Supp*         supps;
+   }
+   SuppBucket;
+
+static SuppBucket** supp_buckets = NULL;
+static UWord        supp_buckets_size = 0;
+static UWord        n_supp_buckets = 0;
+static UWord        n_fun_supp_buckets = 0;
+static UWord        n_obj_supp_buckets = 0;
+static SuppBucket   supp_fallback_bucket = { NULL, NoName, NULL, NULL };
+
 SuppKind VG_(get_supp_kind) ( const Supp* su )
 {
    return su->skind;
@@ -657,6 +715,10 @@ void construct_error ( Error* err, ThreadId tid, ErrorKind ekind, Addr a,
    /* Core-only parts */
    err->unique   = unique_counter++;
    err->next     = NULL;
+   err->prev     = NULL;
+   err->hash_next = NULL;
+   err->hash     = 0;
+   err->stamp    = 0;
    err->supp     = NULL;
    err->count    = 1;
    err->tid      = tid;
@@ -677,6 +739,50 @@ void construct_error ( Error* err, ThreadId tid, ErrorKind ekind, Addr a,
 
 
 
+static UWord hash_Error ( const Error* err )
+{
+   return VG_(hash_ExeContext)(Vg_LowRes, err->where)
+          ^ ((UWord)err->ekind << 7);
+}
+
+static inline UWord errors_htab_chain ( UWord hash )
+{
+   /* Fibonacci hashing: keep the top bits of the product. */
+   return (hash * (UWord)0x9E3779B97F4A7C15ULL)
+          >> (8 * sizeof(UWord) - errors_htab_bits);
+}
+
+static void resize_errors_htab ( void )
+{
+   Error* p;
+   UWord  i;
+
+   errors_htab_bits = errors_htab == NULL ? 8 : errors_htab_bits + 1;
+   errors_htab_size = 1UL << errors_htab_bits;
+   if (errors_htab != NULL)
+      VG_(free)(errors_htab);
+   errors_htab = VG_(malloc)("errormgr.reh.1",
+                             errors_htab_size * sizeof(Error*));
+   for (i = 0; i < errors_htab_size; i++)
+      errors_htab[i] = NULL;
+   for (p = errors; p != NULL; p = p->next) {
+      i = errors_htab_chain(p->hash);
+      p->hash_next = errors_htab[i];
+      errors_htab[i] = p;
+   }
+}
+
+/* Put p, which is not in the errors list, at the front of the list. */
+static void push_front_errors ( Error* p )
+{
+   p->prev = NULL;
+   p->next = errors;
+   if (errors != NULL)
+      errors->prev = p;
+   errors = p;
+   p->stamp = ++errors_stamp;
+}
+
 /* Top-level entry point to the error management subsystem.
    All detected errors are notified here; this routine decides if/when the
    user should see the error. */
@@ -686,7 +792,7 @@ void VG_(maybe_record_error) ( ThreadId tid,
 {
           Error  err;
           Error* p;
-          Error* p_prev;
+          Error* q;
           UInt   extra_size;
           VgRes  exe_res          = Vg_MedRes;
    static Bool   stopping_message = False;
@@ -756,37 +862,44 @@ void VG_(maybe_record_error) ( ThreadId tid,
    /* Build ourselves the error */
    construct_error ( &err, tid, ekind, a, s, extra, NULL );
 
-   /* First, see if we've got an error record matching this one. */
+   /* First, see if we've got an error record matching this one.  If
+      several match, take the first one in the list, as a search of the
+      list would. */
    em_errlist_searches++;
-   p       = errors;
-   p_prev  = NULL;
-   while (p != NULL) {
-      em_errlist_cmps++;
-      if (eq_Error(exe_res, p, &err)) {
-         /* Found it. */
-         p->count++;
-	 if (p->supp != NULL) {
-            /* Deal correctly with suppressed errors. */
-            p->supp->count++;
-            n_errs_suppressed++;	 
-         } else {
-            n_errs_found++;
-         }
+   err.hash = hash_Error(&err);
+   p        = NULL;
+   if (errors_htab != NULL) {
+      for (q = errors_htab[errors_htab_chain(err.hash)]; q != NULL;
+           q = q->hash_next) {
+         if (q->hash != err.hash || (p != NULL && q->stamp < p->stamp))
+            continue;
+         em_errlist_cmps++;
+         if (eq_Error(exe_res, q, &err))
+            p = q;
+      }
+   }
 
-         /* Move p to the front of the list so that future searches
-            for it are faster. It also allows to print the last
-            error (see VG_(show_last_error). */
-         if (p_prev != NULL) {
-            vg_assert(p_prev->next == p);
-            p_prev->next = p->next;
-            p->next      = errors;
-            errors       = p;
-	 }
+   if (p != NULL) {
+      /* Found it. */
+      p->count++;
+      if (p->supp != NULL) {
+         /* Deal correctly with suppressed errors. */
+         p->supp->count++;
+         n_errs_suppressed++;
+      } else {
+         n_errs_found++;
+      }
 
-         return;
+      /* Move p to the front of the list. This allows to print the
+         last error (see VG_(show_last_error). */
+      if (p != errors) {
+         p->prev->next = p->next;
+         if (p->next != NULL)
+            p->next->prev = p->prev;
+         push_front_errors(p);
       }
-      p_prev = p;
-      p      = p->next;
+
+      return;
    }
 
    /* Didn't see it.  Copy and add. */
@@ -838,9 +951,16 @@ void VG_(maybe_record_error) ( ThreadId tid,
       p->extra = new_extra;
    }
 
-   p->next = errors;
+   push_front_errors(p);
    p->supp = is_suppressible_error(&err);
-   errors  = p;
+   n_errors++;
+   if (n_errors > errors_htab_size) {
+      resize_errors_htab();
+   } else {
+      UWord chain = errors_htab_chain(p->hash);
+      p->hash_next = errors_htab[chain];
+      errors_htab[chain] = p;
+   }
    if (p->supp == NULL) {
       /* update stats */
       n_err_contexts++;
@@ -916,20 +1036,43 @@ Bool VG_(unique_error) ( ThreadId tid, ErrorKind ekind, Addr a, const HChar* s,
 /*--- Exported fns                                         ---*/
 /*------------------------------------------------------------*/
 
-/* Show the used suppressions.  Returns False if no suppression
-   got used. */
+static Int cmp_Supp_by_stamp ( const void* v1, const void* v2 )
+{
+   const Supp* su1 = *(const Supp* const*)v1;
+   const Supp* su2 = *(const Supp* const*)v2;
+   if (su1->stamp > su2->stamp) return -1;
+   if (su1->stamp < su2->stamp) return 1;
+   return 0;
+}
+
+/* Show the used suppressions, most recently used first.  Returns False
+   if no suppression got used. */
 static Bool show_used_suppressions ( void )
 {
    Supp  *su;
+   Supp  **used;
+   Int   i, n_used;
    Bool  any_supp;
 
+   n_used = 0;
+   for (su = suppressions; su != NULL; su = su->next) {
+      if (su->count > 0)
+         n_used++;
+   }
+   used = VG_(malloc)("errormgr.sus.2", (n_used + 1) * sizeof(Supp*));
+   n_used = 0;
+   for (su = suppressions; su != NULL; su = su->next) {
+      if (su->count > 0)
+         used[n_used++] = su;
+   }
+   VG_(ssort)(used, n_used, sizeof(Supp*), cmp_Supp_by_stamp);
+
    if (VG_(clo_xml))
       VG_(printf_xml)("<suppcounts>\n");
 
    any_supp = False;
-   for (su = suppressions; su != NULL; su = su->next) {
-      if (su->count <= 0)
-         continue;
+   for (i = 0; i < n_used; i++) {
+      su = used[i];
       if (VG_(clo_xml)) {
          VG_(printf_xml)( "  <pair>\n"
                                  "    <count>%d</count>\n"
@@ -964,6 +1107,7 @@ static Bool show_used_suppressions ( void )
       }
       any_supp = True;
    }
+   VG_(free)(used);
 
    if (VG_(clo_xml))
       VG_(printf_xml)("</suppcounts>\n");
@@ -1270,6 +1414,112 @@ static Bool tool_name_present(const HChar *name, const HChar *names)
    return found;
 }
 
+static UWord supp_bucket_hash ( SuppLocTy ty, const HChar* name )
+{
+   UWord h = ty;
+   while (*name)
+      h = (h << 5) + h + (UChar)*name++;
+   return h;
+}
+
+/* Returns the bucket of the suppressions whose first frame is the
+   function or object name, or NULL if there is none. */
+static SuppBucket* find_supp_bucket ( SuppLocTy ty, const HChar* name )
+{
+   SuppBucket* b;
+
+   if (supp_buckets == NULL)
+      return NULL;
+   b = supp_buckets[supp_bucket_hash(ty, name) % supp_buckets_size];
+   for (; b != NULL; b = b->next) {
+      if (b->ty == ty && VG_(strcmp)(b->name, name) == 0)
+         return b;
+   }
+   return NULL;
+}
+
+static void resize_supp_buckets ( void )
+{
+   UWord        i, h, new_size;
+   SuppBucket** new_buckets;
+   SuppBucket*  b;
+   SuppBucket*  b_next;
+
+   new_size = supp_buckets_size == 0 ? 64 : 2 * supp_buckets_size;
+   new_buckets = VG_(calloc)("errormgr.rsb.1", new_size, sizeof(SuppBucket*));
+   for (i = 0; i < supp_buckets_size; i++) {
+      for (b = supp_buckets[i]; b != NULL; b = b_next) {
+         b_next = b->next;
+         h = supp_bucket_hash(b->ty, b->name) % new_size;
+         b->next = new_buckets[h];
+         new_buckets[h] = b;
+      }
+   }
+   if (supp_buckets != NULL)
+      VG_(free)(supp_buckets);
+   supp_buckets = new_buckets;
+   supp_buckets_size = new_size;
+}
+
+static void push_front_supp_bucket ( SuppBucket* b, Supp* su )
+{
+   su->bucket = b;
+   su->bprev = NULL;
+   su->bnext = b->supps;
+   if (b->supps != NULL)
+      b->supps->bprev = su;
+   b->supps = su;
+}
+
+/* Adds a just loaded suppression to the bucket of its first frame. */
+static void add_to_supp_index ( Supp* su )
+{
+   const SuppLoc* first = &su->callers[0];
+   SuppBucket*    b;
+   UWord          h;
+
+   su->stamp = ++supp_stamp;
+   if ((first->ty != FunName && first->ty != ObjName)
+       || !first->name_is_simple_str) {
+      push_front_supp_bucket(&supp_fallback_bucket, su);
+      return;
+   }
+
+   b = find_supp_bucket(first->ty, first->name);
+   if (b == NULL) {
+      if (n_supp_buckets >= supp_buckets_size)
+         resize_supp_buckets();
+      b = VG_(malloc)("errormgr.atsi.1", sizeof(SuppBucket));
+      b->ty = first->ty;
+      b->name = first->name;
+      b->supps = NULL;
+      h = supp_bucket_hash(b->ty, b->name) % supp_buckets_size;
+      b->next = supp_buckets[h];
+      supp_buckets[h] = b;
+      n_supp_buckets++;
+      if (b->ty == FunName)
+         n_fun_supp_buckets++;
+      else
+         n_obj_supp_buckets++;
+   }
+   push_front_supp_bucket(b, su);
+}
+
+/* Marks su as the most recently used suppression. */
+static void touch_supp ( Supp* su )
+{
+   SuppBucket* b = su->bucket;
+
+   su->stamp = ++supp_stamp;
+   if (b->supps == su)
+      return;
+   vg_assert(su->bprev != NULL);
+   su->bprev->bnext = su->bnext;
+   if (su->bnext != NULL)
+      su->bnext->bprev = su->bprev;
+   push_front_supp_bucket(b, su);
+}
+
 /* Read suppressions from the file specified in 
    VG_(clo_suppressions)[clo_suppressions_i]
    and place them in the suppressions list.  If there's any difficulty
@@ -1460,6 +1710,7 @@ static void load_one_suppressions_file ( Int clo_suppressions_i )
 
       supp->next = suppressions;
       suppressions = supp;
+      add_to_supp_index(supp);
    }
    VG_(free)(buf);
    VG_(close)(fd);
@@ -1661,6 +1912,58 @@ static HChar* grow_names(IPtoFunOrObjCompleter* ip2fo, SizeT needed)
    return ip2fo->names + ip2fo->names_free;
 }
 
+/* The function and object names of the IPs of the errors are cached,
+   so that they are searched only once in the debug info, rather than
+   once per error.  The cache is direct mapped, and is flushed when the
+   debug info changes.  The names are kept in a dedup pool. */
+#define N_IP_NAME_CACHE 4096
+
+typedef
+   struct {
+      Addr         ip;
+      DiEpoch      epoch;
+      const HChar* fun; // NULL if not yet searched
+      const HChar* obj; // NULL if not yet searched
+   }
+   IPNameCacheEnt;
+
+static IPNameCacheEnt* ip_name_cache = NULL;
+static DedupPoolAlloc* ip_name_pool = NULL;
+static UInt            ip_name_cache_generation = 0;
+
+static IPNameCacheEnt* ip_name_cache_find ( DiEpoch ep, Addr ip )
+{
+   IPNameCacheEnt* ce;
+
+   if (ip_name_cache == NULL
+       || ip_name_cache_generation != VG_(debuginfo_generation)()) {
+      if (ip_name_cache == NULL)
+         ip_name_cache = VG_(malloc)("errormgr.incf.1",
+                                     N_IP_NAME_CACHE * sizeof(IPNameCacheEnt));
+      if (ip_name_pool != NULL)
+         VG_(deleteDedupPA)(ip_name_pool);
+      ip_name_pool = VG_(newDedupPA)(16000, 1, VG_(malloc),
+                                     "errormgr.incf.2", VG_(free));
+      VG_(memset)(ip_name_cache, 0, N_IP_NAME_CACHE * sizeof(IPNameCacheEnt));
+      ip_name_cache_generation = VG_(debuginfo_generation)();
+   }
+
+   ce = &ip_name_cache[(ip ^ (ip >> 12)) % N_IP_NAME_CACHE];
+   if (ce->ip != ip || ce->epoch.n != ep.n
+       || (ce->fun == NULL && ce->obj == NULL)) {
+      ce->ip = ip;
+      ce->epoch = ep;
+      ce->fun = NULL;
+      ce->obj = NULL;
+   }
+   return ce;
+}
+
+static const HChar* ip_name_cache_add ( const HChar* name )
+{
+   return VG_(allocEltDedupPA)(ip_name_pool, VG_(strlen)(name) + 1, name);
+}
+
 /* foComplete returns the function name or object name for ixInput.
    If needFun, returns the function name for this input
    else returns the object name for this input.
@@ -1683,26 +1986,33 @@ static HChar* foComplete(IPtoFunOrObjCompleter* ip2fo,
    // Complete Fun name or Obj name for IP if not yet done.
    if ((*offsets)[ixInput] == -1) {
       const HChar* caller;
+      IPNameCacheEnt* ce;
 
       (*offsets)[ixInput] = ip2fo->names_free;
       if (DEBUG_ERRORMGR) VG_(printf)("marking %s ixInput %d offset %d\n", 
                                       needFun ? "fun" : "obj",
                                       ixInput, ip2fo->names_free);
+
       if (needFun) {
          // With inline info, fn names must have been completed already.
          vg_assert (!VG_(clo_read_inline_info));
-         /* Get the function name into 'caller_name', or "???"
-            if unknown. */
-         // Nb: C++-mangled names are used in suppressions.  Do, though,
-         // Z-demangle them, since otherwise it's possible to wind
-         // up comparing "malloc" in the suppression against
-         // "_vgrZU_libcZdsoZa_malloc" in the backtrace, and the
-         // two of them need to be made to match.
-         if (!VG_(get_fnname_no_cxx_demangle)(ip2fo->epoch,
-                                              ip2fo->ips[ixInput],
-                                              &caller,
-                                              NULL))
-            caller = "???";
+         ce = ip_name_cache_find(ip2fo->epoch, ip2fo->ips[ixInput]);
+         if (ce->fun == NULL) {
+            /* Get the function name into 'caller_name', or "???"
+               if unknown. */
+            // Nb: C++-mangled names are used in suppressions.  Do, though,
+            // Z-demangle them, since otherwise it's possible to wind
+            // up comparing "malloc" in the suppression against
+            // "_vgrZU_libcZdsoZa_malloc" in the backtrace, and the
+            // two of them need to be made to match.
+            if (!VG_(get_fnname_no_cxx_demangle)(ip2fo->epoch,
+                                                 ip2fo->ips[ixInput],
+                                                 &caller,
+                                                 NULL))
+               caller = "???";
+            ce->fun = ip_name_cache_add(caller);
+         }
+         caller = ce->fun;
       } else {
          /* Get the object name into 'caller_name', or "???"
             if unknown. */
@@ -1720,8 +2030,13 @@ static HChar* foComplete(IPtoFunOrObjCompleter* ip2fo,
             last_expand_pos_ips is the last offset in fun/obj where
             ips[pos_ips] has been expanded. */
 
-         if (!VG_(get_objname)(ip2fo->epoch, ip2fo->ips[pos_ips], &caller))
-            caller = "???";
+         ce = ip_name_cache_find(ip2fo->epoch, ip2fo->ips[pos_ips]);
+         if (ce->obj == NULL) {
+            if (!VG_(get_objname)(ip2fo->epoch, ip2fo->ips[pos_ips], &caller))
+               caller = "???";
+            ce->obj = ip_name_cache_add(caller);
+         }
+         caller = ce->obj;
 
          // Have all inlined calls pointing at this object name
          for (i = last_expand_pos_ips - ip2fo->n_offsets_per_ip[pos_ips] + 1;
@@ -1960,7 +2275,9 @@ Bool supp_matches_error(const Supp* su, const Error* err)
 static Supp* is_suppressible_error ( const Error* err )
 {
    Supp* su;
-   Supp* su_prev;
+   Supp* cands[3];
+   Int   i, k;
+   SuppBucket* b;
 
    IPtoFunOrObjCompleter ip2fo;
    /* Conceptually, ip2fo contains an array of function names and an array of
@@ -1994,29 +2311,51 @@ static Supp* is_suppressible_error ( const Error* err )
    ip2fo.names_szB = 0;
    ip2fo.names_free = 0;
 
-   /* See if the error context matches any suppression. */
+   /* See if the error context matches any suppression.  Only the
+      suppressions whose first frame can match the first frame of the
+      error are tried: the ones in the buckets of its function and
+      object names, and the ones in the fallback bucket.  They are
+      tried most recently used first, as if they were all in a single
+      list kept in most recently used first order. */
    if (DEBUG_ERRORMGR || VG_(debugLog_getLevel)() >= 4)
      VG_(dmsg)("errormgr matching begin\n");
-   su_prev = NULL;
-   for (su = suppressions; su != NULL; su = su->next) {
+   cands[0] = cands[1] = NULL;
+   cands[2] = supp_fallback_bucket.supps;
+   if (n_supp_buckets > 0 && haveInputInpC(&ip2fo, 0)) {
+      if (n_fun_supp_buckets > 0) {
+         b = find_supp_bucket(FunName, foComplete(&ip2fo, 0, True));
+         if (b != NULL)
+            cands[0] = b->supps;
+      }
+      if (n_obj_supp_buckets > 0) {
+         b = find_supp_bucket(ObjName, foComplete(&ip2fo, 0, False));
+         if (b != NULL)
+            cands[1] = b->supps;
+      }
+   }
+   while (True) {
+      k = -1;
+      for (i = 0; i < 3; i++) {
+         if (cands[i] != NULL
+             && (k == -1 || cands[i]->stamp > cands[k]->stamp))
+            k = i;
+      }
+      if (k == -1)
+         break;
+      su = cands[k];
+      cands[k] = su->bnext;
       em_supplist_cmps++;
       if (supp_matches_error(su, err) 
           && supp_matches_callers(&ip2fo, su)) {
          /* got a match.  */
          /* Inform the tool that err is suppressed by su. */
          (void)VG_TDICT_CALL(tool_update_extra_suppression_use, err, su);
-         /* Move this entry to the head of the list
+         /* Move this entry to the head of its bucket
             in the hope of making future searches cheaper. */
-         if (su_prev) {
-            vg_assert(su_prev->next == su);
-            su_prev->next = su->next;
-            su->next = suppressions;
-            suppressions = su;
-         }
+         touch_supp(su);
          clearIPtoFunOrObjCompleter(su, &ip2fo);
          return su;
       }
-      su_prev = su;
    }
    clearIPtoFunOrObjCompleter(NULL, &ip2fo);
    return NULL;      /* no matches */
@@ -2030,10 +2369,45 @@ void VG_(print_errormgr_stats) ( void )
       " errormgr: %'lu supplist searches, %'lu comparisons during search\n",
       em_supplist_searches, em_supplist_cmps
    );
+   if (suppressions != NULL) {
+      UWord n_supps = 0, n_fallback = 0;
+      Supp* su;
+      for (su = suppressions; su != NULL; su = su->next)
+         n_supps++;
+      for (su = supp_fallback_bucket.supps; su != NULL; su = su->bnext)
+         n_fallback++;
+      VG_(dmsg)(
+         " errormgr: %'lu suppressions in %'lu fun and %'lu obj buckets"
+         " + %'lu unindexed, %'lu.%lu tried per search\n",
+         n_supps, n_fun_supp_buckets, n_obj_supp_buckets, n_fallback,
+         em_supplist_searches == 0
+            ? 0UL : em_supplist_cmps / em_supplist_searches,
+         em_supplist_searches == 0
+            ? 0UL : (em_supplist_cmps * 10 / em_supplist_searches) % 10
+      );
+   }
    VG_(dmsg)(
       " errormgr: %'lu errlist searches, %'lu comparisons during search\n",
       em_errlist_searches, em_errlist_cmps
    );
+   if (errors_htab != NULL) {
+      UWord  i, len, max_len = 0, n_used = 0;
+      Error* p;
+      for (i = 0; i < errors_htab_size; i++) {
+         len = 0;
+         for (p = errors_htab[i]; p != NULL; p = p->hash_next)
+            len++;
+         if (len > 0)
+            n_used++;
+         if (len > max_len)
+            max_len = len;
+      }
+      VG_(dmsg)(
+         " errormgr: %'lu errors in %'lu of %'lu hash chains,"
+         " longest chain %'lu\n",
+         n_errors, n_used, errors_htab_size, max_len
+      );
+   }
 }
 
 /*--------------------------------------------------------------------*/
@@ -46,10 +46,19 @@
    suppression specifications.  If not used in comparison, the rest
    are purely informational (but often important).
 
-   The contexts are stored in a traditional chained hash table, so as
-   to allow quick determination of whether a new context already
-   exists.  The hash table starts small and expands dynamically, so as
-   to keep the load factor below 1.0.
+   The contexts are stored as a trie of frames, rooted at the
+   outermost frame.  Each node holds one IP and a pointer to the node
+   of its caller, and stands for the stack trace made of its IP
+   followed by the IPs of its ancestors.  Traces sharing their
+   outermost frames thus share the nodes for those frames, which
+   matters with a large --num-callers.  A trace is interned one frame
+   at a time from the root, looking up each (parent, ip) pair in a
+   traditional chained hash table.  The hash table starts small and
+   expands dynamically, so as to keep the load factor below 1.0.
+
+   As consecutive traces usually share most of their outer frames,
+   the path of the last interned trace is remembered, and only the
+   frames that differ from it need to be looked up.
 
    The idea is only to ever store any one context once, so as to save
    space and make exact comparisons faster. */
@@ -68,16 +77,22 @@ static SizeT ec_primes[N_EC_PRIMES] = {
 };
 
 
-/* Each element is present in a hash chain, and also contains a
-   variable length array of guest code addresses (the useful part). */
+/* Each element is a node of the trie, and is present in a hash chain
+   keyed by (parent, ip). */
 
 struct _ExeContext {
    struct _ExeContext* chain;
+   /* The context of the caller, or NULL for a depth 1 context. */
+   struct _ExeContext* parent;
+   /* ips[0] of the stack trace, ie. the current IP.  ips[1] is
+      parent->ip, ips[2] is parent->parent->ip, etc. */
+   Addr ip;
    /* A 32-bit unsigned integer that uniquely identifies this
       ExeContext.  Memcheck uses these for origin tracking.  Values
       must be nonzero (else Memcheck's origin tracking is hosed), must
       be a multiple of four, and must be unique.  Hence they start at
-      4. */
+      4.  Nodes which were only ever used as the parent of another
+      node have no ecu yet, and hold zero. */
    UInt ecu;
    /* epoch in which the ExeContext can be symbolised. In other words, epoch
       identifies the set of debug info to use to symbolise the Addr in ips
@@ -92,15 +107,27 @@ struct _ExeContext {
       If an ExeContext with epoch == DiEpoch_INVALID has one or more
       ips Addr corresponding to the just archived debug info, the ExeContext
       epoch is changed to the last epoch identifying the set containing the
-      archived debug info. */
+      archived debug info.  As the descendants of such a node contain
+      the same Addr, they are archived together with it. */
    DiEpoch epoch;
-   /* Variable-length array.  The size is 'n_ips'; at
-      least 1, at most VG_DEEPEST_BACKTRACE.  [0] is the current IP,
-      [1] is its caller, [2] is the caller of [1], etc. */
-   UInt n_ips;
-   Addr ips[0];
 };
 
+/* What is only needed for the nodes which have an ecu, ie. the
+   contexts handed out, is kept out of the nodes, as most nodes of deep
+   traces are never handed out. */
+typedef
+   struct {
+      ExeContext* ec;
+      /* The number of IPs of the stack trace, ie. the depth of the
+         node: at least 1 and at most VG_DEEPEST_BACKTRACE. */
+      UInt n_ips;
+      /* The stack trace as an array of n_ips IPs, or NULL.  It is
+         built the first time VG_(get_ExeContext_StackTrace) is asked
+         for it, and then kept, as callers hold on to it. */
+      Addr* ips;
+   }
+   ECInfo;
+
 
 /* This is the dynamically expanding hash table. */
 static ExeContext** ec_htab; /* array [ec_htab_size] of ExeContext* */
@@ -110,17 +137,32 @@ static SizeT        ec_htab_size_idx; /* 0 .. N_EC_PRIMES-1 */
 /* ECU serial number */
 static UInt ec_next_ecu = 4; /* We must never issue zero */
 
+/* The contexts which have an ecu, indexed by ecu / 4 - 1. */
+static ECInfo* ec_by_ecu;
+static UInt    ec_by_ecu_size;
+
+/* The path of the last interned trace: ec_path_ips[d] is the IP at
+   depth d (0 being the outermost frame), and ec_path_node[d] the node
+   for the trace ending at depth d. */
+static Addr        ec_path_ips[VG_DEEPEST_BACKTRACE];
+static ExeContext* ec_path_node[VG_DEEPEST_BACKTRACE];
+static UInt        ec_path_len;
+
 static ExeContext* null_ExeContext;
 
 /* Stats only: the number of times the system was searched to locate a
    context. */
 static ULong ec_searchreqs;
 
-/* Stats only: the number of full context comparisons done. */
+/* Stats only: the number of node comparisons done. */
 static ULong ec_searchcmps;
 
-/* Stats only: total number of stored contexts. */
+/* Stats only: the number of frames found in the last interned path. */
+static ULong ec_pathhits;
+
+/* Stats only: total number of stored contexts and trie nodes. */
 static ULong ec_totstored;
+static ULong ec_totnodes;
 
 /* Number of 2, 4 and (fast) full cmps done. */
 static ULong ec_cmp2s;
@@ -143,7 +185,9 @@ static void init_ExeContext_storage ( void )
       return;
    ec_searchreqs = 0;
    ec_searchcmps = 0;
+   ec_pathhits = 0;
    ec_totstored = 0;
+   ec_totnodes = 0;
    ec_cmp2s = 0;
    ec_cmp4s = 0;
    ec_cmpAlls = 0;
@@ -155,6 +199,11 @@ static void init_ExeContext_storage ( void )
    for (i = 0; i < ec_htab_size; i++)
       ec_htab[i] = NULL;
 
+   ec_by_ecu_size = 1024;
+   ec_by_ecu = VG_(malloc)("execontext.iEs2",
+                           sizeof(ECInfo) * ec_by_ecu_size);
+   ec_path_len = 0;
+
    {
       Addr ips[1];
       ips[0] = 0;
@@ -166,6 +215,20 @@ static void init_ExeContext_storage ( void )
    init_done = True;
 }
 
+/* The ECInfo of ec, which must have an ecu. */
+static inline ECInfo* get_info ( const ExeContext* ec )
+{
+   return &ec_by_ecu[ec->ecu / 4 - 1];
+}
+
+/* Copy the stack trace of ec in ips[0 .. n_ips-1]. */
+static void get_ips ( const ExeContext* ec, Addr* ips )
+{
+   UInt i;
+   for (i = 0; ec; i++, ec = ec->parent)
+      ips[i] = ec->ip;
+}
+
 DiEpoch VG_(get_ExeContext_epoch)( const ExeContext* e )
 {
    if (is_DiEpoch_INVALID (e->epoch))
@@ -177,7 +240,7 @@ DiEpoch VG_(get_ExeContext_epoch)( const ExeContext* e )
 /* Print stats. */
 void VG_(print_ExeContext_stats) ( Bool with_stacktraces )
 {
-   Int i;
+   UInt i;
    ULong total_n_ips;
    ExeContext* ec;
 
@@ -185,56 +248,63 @@ void VG_(print_ExeContext_stats) ( Bool with_stacktraces )
 
    if (with_stacktraces) {
       VG_(message)(Vg_DebugMsg, "   exectx: Printing contexts stacktraces\n");
-      for (i = 0; i < ec_htab_size; i++) {
-         for (ec = ec_htab[i]; ec; ec = ec->chain) {
-            VG_(message)(Vg_DebugMsg,
-                         "   exectx: stacktrace ecu %u epoch %u n_ips %u\n",
-                         ec->ecu, ec->epoch.n, ec->n_ips);
-            VG_(pp_StackTrace)( VG_(get_ExeContext_epoch)(ec),
-                                ec->ips, ec->n_ips );
-         }
+      for (i = 0; i < ec_totstored; i++) {
+         ec = ec_by_ecu[i].ec;
+         VG_(message)(Vg_DebugMsg,
+                      "   exectx: stacktrace ecu %u epoch %u n_ips %u\n",
+                      ec->ecu, ec->epoch.n, ec_by_ecu[i].n_ips);
+         VG_(pp_ExeContext)(ec);
       }
-      VG_(message)(Vg_DebugMsg, 
+      VG_(message)(Vg_DebugMsg,
                    "   exectx: Printed %'llu contexts stacktraces\n",
                    ec_totstored);
    }
-   
+
    total_n_ips = 0;
-   for (i = 0; i < ec_htab_size; i++) {
-      for (ec = ec_htab[i]; ec; ec = ec->chain)
-         total_n_ips += ec->n_ips;
-   }
-   VG_(message)(Vg_DebugMsg, 
-      "   exectx: %'lu lists, %'llu contexts (avg %3.2f per list)"
-      " (avg %3.2f IP per context)\n",
-      ec_htab_size, ec_totstored, (Double)ec_totstored / (Double)ec_htab_size,
-      (Double)total_n_ips / (Double)ec_totstored
+   for (i = 0; i < ec_totstored; i++)
+      total_n_ips += ec_by_ecu[i].n_ips;
+   VG_(message)(Vg_DebugMsg,
+      "   exectx: %'lu lists, %'llu nodes (avg %3.2f per list)\n",
+      ec_htab_size, ec_totnodes, (Double)ec_totnodes / (Double)ec_htab_size
+   );
+   VG_(message)(Vg_DebugMsg,
+      "   exectx: %'llu contexts (avg %3.2f IP per context,"
+      " %3.2f nodes per context)\n",
+      ec_totstored, (Double)total_n_ips / (Double)ec_totstored,
+      (Double)ec_totnodes / (Double)ec_totstored
    );
-   VG_(message)(Vg_DebugMsg, 
-      "   exectx: %'llu searches, %'llu full compares (%'llu per 1000)\n",
-      ec_searchreqs, ec_searchcmps, 
-      ec_searchreqs == 0 
-         ? 0ULL 
-         : ( (ec_searchcmps * 1000ULL) / ec_searchreqs ) 
+   VG_(message)(Vg_DebugMsg,
+      "   exectx: %'llu searches, %'llu frames reused,"
+      " %'llu node compares (%'llu per 1000)\n",
+      ec_searchreqs, ec_pathhits, ec_searchcmps,
+      ec_searchreqs == 0
+         ? 0ULL
+         : ( (ec_searchcmps * 1000ULL) / ec_searchreqs )
    );
-   VG_(message)(Vg_DebugMsg, 
+   VG_(message)(Vg_DebugMsg,
       "   exectx: %'llu cmp2, %'llu cmp4, %'llu cmpAll\n",
-      ec_cmp2s, ec_cmp4s, ec_cmpAlls 
+      ec_cmp2s, ec_cmp4s, ec_cmpAlls
    );
 }
 
 /* Print an ExeContext. */
 void VG_(pp_ExeContext) ( ExeContext* ec )
 {
-   VG_(pp_StackTrace)( VG_(get_ExeContext_epoch)(ec), ec->ips, ec->n_ips );
+   UInt n_ips = get_info(ec)->n_ips;
+   Addr ips[n_ips];
+   get_ips(ec, ips);
+   VG_(pp_StackTrace)( VG_(get_ExeContext_epoch)(ec), ips, n_ips );
 }
 
 void VG_(apply_ExeContext)(
    void(*action)(UInt n, DiEpoch ep, Addr ip, void* opaque),
    void* opaque, ExeContext* ec)
 {
+   UInt n_ips = get_info(ec)->n_ips;
+   Addr ips[n_ips];
+   get_ips(ec, ips);
    VG_(apply_StackTrace)(action, opaque, VG_(get_ExeContext_epoch)(ec),
-                         ec->ips, ec->n_ips);
+                         ips, n_ips);
 }
 
 void VG_(archive_ExeContext_in_range) (DiEpoch last_epoch,
@@ -242,28 +312,37 @@ void VG_(archive_ExeContext_in_range) (DiEpoch last_epoch,
 {
    Int i;
    ExeContext* ec;
+   ExeContext* anc;
    ULong n_archived = 0;
    const Addr text_avma_end = text_avma + length - 1;
 
    if (VG_(clo_verbosity) > 1)
       VG_(message)(Vg_DebugMsg, "Scanning and archiving ExeContexts ...\n");
+   /* A node is archived if one of its IPs is in the range, ie. if it
+      or one of its ancestors has its ip in the range.  An ancestor
+      which is already archived can only have been archived by this
+      scan: nodes are never created below an archived node. */
    for (i = 0; i < ec_htab_size; i++) {
       for (ec = ec_htab[i]; ec; ec = ec->chain) {
-         if (is_DiEpoch_INVALID (ec->epoch))
-            for (UInt j = 0; j < ec->n_ips; j++) {
-               if (UNLIKELY(ec->ips[j] >= text_avma
-                            && ec->ips[j] <= text_avma_end)) {
-                  ec->epoch = last_epoch;
-                  n_archived++;
-                  break;
-               }
+         if (!is_DiEpoch_INVALID (ec->epoch))
+            continue;
+         for (anc = ec; anc; anc = anc->parent) {
+            if (UNLIKELY(!is_DiEpoch_INVALID (anc->epoch)
+                         || (anc->ip >= text_avma
+                             && anc->ip <= text_avma_end))) {
+               ec->epoch = last_epoch;
+               n_archived++;
+               break;
             }
+         }
       }
    }
+   /* The remembered path may go through archived nodes. */
+   ec_path_len = 0;
    if (VG_(clo_verbosity) > 1)
       VG_(message)(Vg_DebugMsg,
                    "Scanned %'llu ExeContexts, archived %'llu ExeContexts\n",
-                   ec_totstored, n_archived);
+                   ec_totnodes, n_archived);
 }
 
 /* Compare two ExeContexts.  Number of callers considered depends on res. */
@@ -271,13 +350,11 @@ Bool VG_(eq_ExeContext) ( VgRes res, const ExeContext* e1,
                           const ExeContext* e2 )
 {
    Int i;
+   const ExeContext *f1, *f2;
 
-   if (e1 == NULL || e2 == NULL) 
+   if (e1 == NULL || e2 == NULL)
       return False;
 
-   // Must be at least one address in each trace.
-   vg_assert(e1->n_ips >= 1 && e2->n_ips >= 1);
-
    // Note: we compare the epoch in the case below, and not here
    // to have the ec_cmp* stats correct.
 
@@ -285,22 +362,22 @@ Bool VG_(eq_ExeContext) ( VgRes res, const ExeContext* e1,
    case Vg_LowRes:
       /* Just compare the top two callers. */
       ec_cmp2s++;
-      for (i = 0; i < 2; i++) {
-         if ( (e1->n_ips <= i) &&  (e2->n_ips <= i)) return True;
-         if ( (e1->n_ips <= i) && !(e2->n_ips <= i)) return False;
-         if (!(e1->n_ips <= i) &&  (e2->n_ips <= i)) return False;
-         if (e1->ips[i] != e2->ips[i])               return False;
+      for (i = 0, f1 = e1, f2 = e2; i < 2;
+           i++, f1 = f1->parent, f2 = f2->parent) {
+         if (f1 == NULL && f2 == NULL) return True;
+         if (f1 == NULL || f2 == NULL) return False;
+         if (f1->ip != f2->ip)         return False;
       }
       return e1->epoch.n == e2->epoch.n;
 
    case Vg_MedRes:
       /* Just compare the top four callers. */
       ec_cmp4s++;
-      for (i = 0; i < 4; i++) {
-         if ( (e1->n_ips <= i) &&  (e2->n_ips <= i)) return True;
-         if ( (e1->n_ips <= i) && !(e2->n_ips <= i)) return False;
-         if (!(e1->n_ips <= i) &&  (e2->n_ips <= i)) return False;
-         if (e1->ips[i] != e2->ips[i])               return False;
+      for (i = 0, f1 = e1, f2 = e2; i < 4;
+           i++, f1 = f1->parent, f2 = f2->parent) {
+         if (f1 == NULL && f2 == NULL) return True;
+         if (f1 == NULL || f2 == NULL) return False;
+         if (f1->ip != f2->ip)         return False;
       }
       return e1->epoch.n == e2->epoch.n;
 
@@ -334,16 +411,34 @@ static inline UWord ROLW ( UWord w, Int n )
    return w;
 }
 
-static UWord calc_hash ( const Addr* ips, UInt n_ips, UWord htab_sz )
+static UWord calc_hash ( const ExeContext* parent, Addr ip, UWord htab_sz )
 {
-   UInt  i;
-   UWord hash = 0;
+   UWord hash;
    vg_assert(htab_sz > 0);
-   for (i = 0; i < n_ips; i++) {
-      hash ^= ips[i];
+   hash = ROLW((UWord)parent, 19) ^ ip;
+   return hash % htab_sz;
+}
+
+UWord VG_(hash_ExeContext) ( VgRes res, const ExeContext* e )
+{
+   Int   i, n;
+   UWord hash = 0;
+
+   switch (res) {
+   case Vg_LowRes:  n = 2; break;
+   case Vg_MedRes:  n = 4; break;
+   case Vg_HighRes: return (UWord)e;
+   default:
+      VG_(core_panic)("VG_(hash_ExeContext): unrecognised VgRes");
+   }
+
+   /* As for VG_(eq_ExeContext), the epoch is not hashed: contexts of
+      less than n IPs are equal whatever their epoch. */
+   for (i = 0; i < n && e != NULL; i++, e = e->parent) {
+      hash ^= e->ip;
       hash = ROLW(hash, 19);
    }
-   return hash % htab_sz;
+   return hash ^ i;
 }
 
 static void resize_ec_htab ( void )
@@ -362,8 +457,8 @@ static void resize_ec_htab ( void )
 
    VG_(debugLog)(
       1, "execontext",
-         "resizing htab from size %lu to %lu (idx %lu)  Total#ECs=%llu\n",
-         ec_htab_size, new_size, ec_htab_size_idx + 1, ec_totstored);
+         "resizing htab from size %lu to %lu (idx %lu)  Total#nodes=%llu\n",
+         ec_htab_size, new_size, ec_htab_size_idx + 1, ec_totnodes);
 
    for (i = 0; i < new_size; i++)
       new_ec_htab[i] = NULL;
@@ -372,7 +467,7 @@ static void resize_ec_htab ( void )
       ExeContext* cur = ec_htab[i];
       while (cur) {
          ExeContext* next = cur->chain;
-         UWord hash = calc_hash(cur->ips, cur->n_ips, new_size);
+         UWord hash = calc_hash(cur->parent, cur->ip, new_size);
          vg_assert(hash < new_size);
          cur->chain = new_ec_htab[hash];
          new_ec_htab[hash] = cur;
@@ -453,85 +548,84 @@ static ExeContext* record_ExeContext_wrk ( ThreadId tid, Word first_ip_delta,
    return record_ExeContext_wrk2 ( ips, n_ips );
 }
 
+
+/* Find the (non archived) child of parent for ip, allocating a new
+   node if there is none. */
+static ExeContext* intern_frame ( ExeContext* parent, Addr ip )
+{
+   UWord       hash;
+   ExeContext* node;
+
+   hash = calc_hash( parent, ip, ec_htab_size );
+   for (node = ec_htab[hash]; node; node = node->chain) {
+      ec_searchcmps++;
+      if (node->parent == parent && node->ip == ip
+          && is_DiEpoch_INVALID (node->epoch))
+         return node;
+   }
+
+   /* Bummer.  We have to allocate a new node. */
+   ec_totnodes++;
+
+   node = VG_(perm_malloc)( sizeof(struct _ExeContext),
+                            vg_alignof(struct _ExeContext));
+   node->parent = parent;
+   node->ip     = ip;
+   node->ecu    = 0;
+   node->epoch  = DiEpoch_INVALID();
+   node->chain  = ec_htab[hash];
+   ec_htab[hash] = node;
+
+   /* Resize the hash table, maybe? */
+   if ( ((ULong)ec_totnodes) > ((ULong)ec_htab_size) ) {
+      vg_assert(ec_htab_size_idx >= 0 && ec_htab_size_idx < N_EC_PRIMES);
+      if (ec_htab_size_idx < N_EC_PRIMES-1)
+         resize_ec_htab();
+   }
+
+   return node;
+}
+
 /* Do the second part of getting a stack trace: ips[0 .. n_ips-1]
    holds a proposed trace.  Find or allocate a suitable ExeContext.
    Note that callers must have done init_ExeContext_storage() before
    getting to this point. */
 static ExeContext* record_ExeContext_wrk2 ( const Addr* ips, UInt n_ips )
 {
-   Int         i;
-   Bool        same;
-   UWord       hash;
-   ExeContext* new_ec;
-   ExeContext* list;
-   ExeContext  *prev2, *prev;
-
-   static UInt ctr = 0;
+   UInt        d;
+   Addr        ip;
+   ExeContext* ec;
 
    vg_assert(n_ips >= 1 && n_ips <= VG_(clo_backtrace_size));
 
-   /* Now figure out if we've seen this one before.  First hash it so
-      as to determine the list number. */
-   hash = calc_hash( ips, n_ips, ec_htab_size );
-
-   /* And (the expensive bit) look a for matching entry in the list. */
-
    ec_searchreqs++;
 
-   prev2 = NULL;
-   prev  = NULL;
-   list  = ec_htab[hash];
-
-   while (True) {
-      if (list == NULL) break;
-      ec_searchcmps++;
-      same = list->n_ips == n_ips && is_DiEpoch_INVALID (list->epoch);
-      for (i = 0; i < n_ips && same ; i++) {
-         same = list->ips[i] == ips[i];
-      }
-      if (same) break;
-      prev2 = prev;
-      prev  = list;
-      list  = list->chain;
+   /* Skip the outer frames shared with the last interned trace, and
+      intern the remaining ones from there. */
+   for (d = 0; d < n_ips && d < ec_path_len; d++) {
+      if (ec_path_ips[d] != ips[n_ips - 1 - d])
+         break;
    }
-
-   if (list != NULL) {
-      /* Yay!  We found it.  Once every 8 searches, move it one step
-         closer to the start of the list to make future searches
-         cheaper. */
-      if (0 == ((ctr++) & 7)) {
-         if (prev2 != NULL && prev != NULL) {
-            /* Found at 3rd or later position in the chain. */
-            vg_assert(prev2->chain == prev);
-            vg_assert(prev->chain  == list);
-            prev2->chain = list;
-            prev->chain  = list->chain;
-            list->chain  = prev;
-         }
-         else if (prev2 == NULL && prev != NULL) {
-            /* Found at 2nd position in the chain. */
-            vg_assert(ec_htab[hash] == prev);
-            vg_assert(prev->chain == list);
-            prev->chain = list->chain;
-            list->chain = prev;
-            ec_htab[hash] = list;
-         }
+   ec_pathhits += d;
+   ec = d == 0 ? NULL : ec_path_node[d - 1];
+   if (d < n_ips) {
+      for (; d < n_ips; d++) {
+         ip = ips[n_ips - 1 - d];
+         ec = intern_frame(ec, ip);
+         ec_path_ips[d]  = ip;
+         ec_path_node[d] = ec;
       }
-      return list;
+      ec_path_len = n_ips;
    }
 
-   /* Bummer.  We have to allocate a new context record. */
-   ec_totstored++;
-
-   new_ec = VG_(perm_malloc)( sizeof(struct _ExeContext) 
-                              + n_ips * sizeof(Addr),
-                              vg_alignof(struct _ExeContext));
+   if (ec->ecu != 0)
+      return ec;
 
-   for (i = 0; i < n_ips; i++)
-      new_ec->ips[i] = ips[i];
+   /* First time this node is asked for: give it an ecu. */
+   ec_totstored++;
 
    vg_assert(VG_(is_plausible_ECU)(ec_next_ecu));
-   new_ec->ecu = ec_next_ecu;
+   ec->ecu = ec_next_ecu;
    ec_next_ecu += 4;
    if (ec_next_ecu == 0) {
       /* Urr.  Now we're hosed; we emitted 2^30 ExeContexts already
@@ -539,19 +633,17 @@ static ExeContext* record_ExeContext_wrk2 ( const Addr* ips, UInt n_ips )
       VG_(core_panic)("m_execontext: more than 2^30 ExeContexts created");
    }
 
-   new_ec->n_ips = n_ips;
-   new_ec->chain = ec_htab[hash];
-   new_ec->epoch = DiEpoch_INVALID();
-   ec_htab[hash] = new_ec;
-
-   /* Resize the hash table, maybe? */
-   if ( ((ULong)ec_totstored) > ((ULong)ec_htab_size) ) {
-      vg_assert(ec_htab_size_idx >= 0 && ec_htab_size_idx < N_EC_PRIMES);
-      if (ec_htab_size_idx < N_EC_PRIMES-1)
-         resize_ec_htab();
+   if (ec_totstored > ec_by_ecu_size) {
+      ec_by_ecu_size *= 2;
+      ec_by_ecu = VG_(realloc)("execontext.rEw2.1", ec_by_ecu,
+                               sizeof(ECInfo) * ec_by_ecu_size);
    }
+   ec_by_ecu[ec_totstored - 1].ec    = ec;
+   ec_by_ecu[ec_totstored - 1].n_ips = n_ips;
+   ec_by_ecu[ec_totstored - 1].ips   = NULL;
+   vg_assert(ec->ecu / 4 == ec_totstored);
 
-   return new_ec;
+   return ec;
 }
 
 ExeContext* VG_(record_ExeContext)( ThreadId tid, Word first_ip_delta ) {
@@ -571,8 +663,14 @@ ExeContext* VG_(make_depth_1_ExeContext_from_Addr)( Addr a ) {
 }
 
 StackTrace VG_(get_ExeContext_StackTrace) ( ExeContext* e ) {
-   return e->ips;
-}  
+   ECInfo* info = get_info(e);
+   if (UNLIKELY(info->ips == NULL)) {
+      info->ips = VG_(perm_malloc)( info->n_ips * sizeof(Addr),
+                                    vg_alignof(Addr) );
+      get_ips(e, info->ips);
+   }
+   return info->ips;
+}
 
 UInt VG_(get_ECU_from_ExeContext)( const ExeContext* e ) {
    vg_assert(VG_(is_plausible_ECU)(e->ecu));
@@ -580,23 +678,16 @@ UInt VG_(get_ECU_from_ExeContext)( const ExeContext* e ) {
 }
 
 Int VG_(get_ExeContext_n_ips)( const ExeContext* e ) {
-   vg_assert(e->n_ips >= 1);
-   return e->n_ips;
+   return get_info(e)->n_ips;
 }
 
 ExeContext* VG_(get_ExeContext_from_ECU)( UInt ecu )
 {
-   UWord i;
-   ExeContext* ec;
    vg_assert(VG_(is_plausible_ECU)(ecu));
    vg_assert(ec_htab_size > 0);
-   for (i = 0; i < ec_htab_size; i++) {
-      for (ec = ec_htab[i]; ec; ec = ec->chain) {
-         if (ec->ecu == ecu)
-            return ec;
-      }
-   }
-   return NULL;
+   if (ecu / 4 > ec_totstored)
+      return NULL;
+   return ec_by_ecu[ecu / 4 - 1].ec;
 }
 
 ExeContext* VG_(make_ExeContext_from_StackTrace)( const Addr* ips, UInt n_ips )
@@ -32,6 +32,7 @@
 #include "pub_core_scheduler.h"
 #include "pub_core_transtab.h"
 #include "pub_core_debuginfo.h"
+#include "pub_core_stacktrace.h"
 #include "pub_core_addrinfo.h"
 #include "pub_core_aspacemgr.h"
 
@@ -171,6 +172,9 @@ void VG_(print_all_stats) (Bool memory_stats, Bool tool_stats)
    VG_(print_tt_tc_stats)();
    VG_(print_scheduler_stats)();
    VG_(print_ExeContext_stats)( False /* with_stacktraces */ );
+   VG_(print_CF_info_stats)();
+   if (VG_(clo_shadow_stack))
+      VG_(print_shadow_stack_stats)();
    VG_(print_errormgr_stats)();
    if (tool_stats && VG_(needs).print_stats) {
       VG_TDICT_CALL(tool_print_stats);
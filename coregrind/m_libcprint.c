@@ -833,6 +833,7 @@ struct _VgFile {
    HChar buf[VGFILE_BUFSIZE];
    UInt  num_chars;   // number of characters in buf
    Int   fd;          // file descriptor to write to
+   ULong num_written; // number of characters written to fd
 };
 
 
@@ -844,6 +845,7 @@ static void add_to__vgfile ( HChar c, void *p )
 
    if (fp->num_chars == VGFILE_BUFSIZE) {
       VG_(write)(fp->fd, fp->buf, fp->num_chars);
+      fp->num_written += fp->num_chars;
       fp->num_chars = 0;
    }
 }
@@ -859,6 +861,7 @@ VgFile *VG_(fopen)(const HChar *name, Int flags, Int mode)
 
    fp->fd = sr_Res(res);
    fp->num_chars = 0;
+   fp->num_written = 0;
 
    return fp;
 }
@@ -879,6 +882,20 @@ UInt VG_(fprintf) ( VgFile *fp, const HChar *format, ... )
    return ret;
 }
 
+void VG_(fflush)( VgFile *fp )
+{
+   if (fp->num_chars) {
+      VG_(write)(fp->fd, fp->buf, fp->num_chars);
+      fp->num_written += fp->num_chars;
+      fp->num_chars = 0;
+   }
+}
+
+ULong VG_(ftell)( const VgFile *fp )
+{
+   return fp->num_written + fp->num_chars;
+}
+
 void VG_(fclose)( VgFile *fp )
 {
    // Flush the buffer.
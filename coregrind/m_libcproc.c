@@ -673,6 +673,18 @@ Int VG_(prctl) (Int option,
    return sr_isError(res) ? -1 : sr_Res(res);
 }
 
+/* Support for mincore. */
+Int VG_(mincore) ( Addr start, SizeT len, UChar* vec )
+{
+   SysRes res = VG_(mk_SysRes_Error)(VKI_ENOSYS);
+#  if defined(VGO_linux)
+   /* res = mincore( start, len, vec ); */
+   res = VG_(do_syscall3)(__NR_mincore, start, len, (UWord)vec);
+#  endif
+
+   return sr_isError(res) ? -1 : sr_Res(res);
+}
+
 /* ---------------------------------------------------------------------
    pids, etc
    ------------------------------------------------------------------ */
@@ -999,6 +1011,35 @@ Int VG_(fork) ( void )
 #  endif
 }
 
+/* Like VG_(fork), but on Linux the child is created without an exit
+   signal.  The client then gets no SIGCHLD for it, and wait() or
+   waitpid(-1) only return it when __WALL or __WCLONE is given, so the
+   child is not visible as a child of the client.  Reap it with
+   VG_(waitpid_hidden).  Returns -1 if no such process can be created,
+   which is always the case on other OSes. */
+Int VG_(fork_hidden) ( void )
+{
+#  if defined(VGO_linux)
+   /* With all arguments zero the child gets no exit signal and a copy of
+      the current stack, whatever the argument order of clone is. */
+   SysRes res = VG_(do_syscall5)(__NR_clone, 0, 0, 0, 0, 0);
+   if (sr_isError(res))
+      return -1;
+   return sr_Res(res);
+#  else
+   return -1;
+#  endif
+}
+
+Int VG_(waitpid_hidden) ( Int pid, Int *status )
+{
+#  if defined(VGO_linux)
+   return VG_(waitpid)(pid, status, __VKI_WCLONE);
+#  else
+   return VG_(waitpid)(pid, status, 0);
+#  endif
+}
+
 /* ---------------------------------------------------------------------
    Timing stuff
    ------------------------------------------------------------------ */
@@ -206,6 +206,10 @@ static void usage_NORETURN ( int need_help )
 "           android-gpu-sgx5xx android-gpu-adreno3xx none\n"
 "    --merge-recursive-frames=<number>  merge frames between identical\n"
 "           program counters in max <number> frames) [0]\n"
+"    --shadow-stack=no|yes     track calls and returns to take stack traces\n"
+"                              without unwinding the stack? [no]\n"
+"    --cfi-cache-size=<number> number of entries of the cache of CFI\n"
+"                              lookups used when unwinding [8192]\n"
 "    --num-transtab-sectors=<number> size of translated code cache [%d]\n"
 "           more sectors may increase performance, but use more memory.\n"
 "    --avg-transtab-entry-size=<number> avg size in bytes of a translated\n"
@@ -677,6 +681,9 @@ static void process_option (Clo_Mode mode,
    else if VG_BINT_CLOM(cloPD, arg, "--merge-recursive-frames",
                         VG_(clo_merge_recursive_frames), 0,
                         VG_DEEPEST_BACKTRACE) {}
+   else if VG_BOOL_CLO(arg, "--shadow-stack",     VG_(clo_shadow_stack)) {}
+   else if VG_BINT_CLO(arg, "--cfi-cache-size",   VG_(clo_cfi_cache_size),
+                       4, 16*1024*1024) {}
 
    else if VG_XACT_CLO(arg, "--smc-check=none",
                        VG_(clo_smc_check), Vg_SmcNone) {}
@@ -1035,6 +1042,11 @@ void main_process_cmd_line_options( void )
    }
 #  endif
 
+   /* Chasing into the target of a call would hide the call inside a
+      superblock, where the shadow stack instrumentation can't see it. */
+   if (VG_(clo_shadow_stack))
+      VG_(clo_vex_control).guest_chase = False;
+
    /* If XML output is requested, check that the tool actually
       supports it. */
    if (VG_(clo_xml) && !VG_(needs).xml_output) {
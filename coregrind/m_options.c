@@ -165,6 +165,8 @@ Bool VG_(clo_xtree_compress_strings) = True;
 Int    VG_(clo_dump_error)     = 0;
 Int    VG_(clo_backtrace_size) = 12;
 Int    VG_(clo_merge_recursive_frames) = 0; // default value: no merge
+Bool   VG_(clo_shadow_stack) = False;
+UInt   VG_(clo_cfi_cache_size) = 8192;
 UInt   VG_(clo_sim_hints)      = 0;
 Bool   VG_(clo_sym_offsets)    = False;
 Bool   VG_(clo_read_inline_info) = False; // Or should be put it to True by default ???
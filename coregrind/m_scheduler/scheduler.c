@@ -621,6 +621,10 @@ void mostly_clear_thread_record ( ThreadId tid )
    VG_(clear_out_queued_signals)(tid, &savedmask);
 
    VG_(threads)[tid].sched_jmpbuf_valid = False;
+
+   /* keep the shadow stack array for the next use of the slot */
+   VG_(threads)[tid].shadow_stack_used = 0;
+   VG_(threads)[tid].shadow_stack_lost = 0;
 }
 
 /*                                                                             
@@ -913,6 +917,22 @@ void VG_(force_vgdb_poll) ( void )
    vgdb_next_poll = VGDB_POLL_ASAP;
 }
 
+/* Tell the tool that thread tid is about to run client code.  No
+   translation is executing, so the tool may discard some, e.g. to
+   change its instrumentation.  Returns True if translations were
+   discarded, in which case host code addresses looked up before are
+   stale.  Tools which do not discard anything only pay for the
+   comparison. */
+static Bool start_client_code ( ThreadId tid )
+{
+   UInt n_discarded = VG_(get_bbs_discarded_or_dumped)();
+
+   VG_(ok_to_discard_translations) = True;
+   VG_TRACK( start_client_code, tid, bbs_done );
+   VG_(ok_to_discard_translations) = False;
+   return VG_(get_bbs_discarded_or_dumped)() != n_discarded;
+}
+
 /* Run the thread tid for a while, and return a VG_TRC_* value
    indicating why VG_(disp_run_translations) stopped, and possibly an
    auxiliary word.  Also, only allow the thread to run for at most
@@ -1025,8 +1045,14 @@ void run_thread_for_a_while ( /*OUT*/HWord* two_words,
 
    /* Set up return-value area. */
 
-   // Tell the tool this thread is about to run client code
-   VG_TRACK( start_client_code, tid, bbs_done );
+   // Tell the tool this thread is about to run client code.  If it
+   // discarded translations, look the translation up again.  A no-redir
+   // translation has to run now, so handle_noredir_jump tells the tool
+   // before looking it up.
+   if (!use_alt_host_addr && start_client_code(tid)) {
+      two_words[0] = VG_TRC_INNER_FASTMISS;
+      return;
+   }
 
    vg_assert(VG_(in_generated_code) == False);
    VG_(in_generated_code) = True;
@@ -1242,6 +1268,8 @@ void handle_noredir_jump ( /*OUT*/HWord* two_words,
    Addr  hcode = 0;
    Addr  ip    = VG_(get_IP)(tid);
 
+   start_client_code(tid);
+
    Bool  found = VG_(search_unredir_transtab)( &hcode, ip );
    if (!found) {
       /* Not found; we need to request a translation. */
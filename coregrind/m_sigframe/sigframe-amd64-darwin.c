@@ -43,6 +43,7 @@
 #include "pub_core_tooliface.h"
 #include "pub_core_trampoline.h"
 #include "pub_core_sigframe.h"      /* self */
+#include "pub_core_stacktrace.h"   // VG_(shadow_stack_signal_returned)
 #include "priv_sigframe.h"
 
 
@@ -271,6 +272,8 @@ void VG_(sigframe_destroy)( ThreadId tid, Bool isRT )
              (Addr)frame - VG_STACK_REDZONE_SZB, 
              sizeof(struct hacky_sigframe) );
 
+   VG_(shadow_stack_signal_returned)(tid);
+
    /* tell the tools */
    VG_TRACK( post_deliver_signal, tid, sigNo );
 }
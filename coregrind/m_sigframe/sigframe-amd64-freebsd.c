@@ -44,6 +44,7 @@
 #include "pub_core_tooliface.h"
 #include "pub_core_trampoline.h"
 #include "pub_core_sigframe.h"   /* self */
+#include "pub_core_stacktrace.h"   // VG_(shadow_stack_signal_returned)
 
 /* This module creates and removes signal frames for signal deliveries
    on amd64-freebsd.
@@ -421,6 +422,8 @@ void VG_(sigframe_destroy)( ThreadId tid )
          "VG_(signal_return) (thread %u): valid magic; RIP=%#llx\n",
          tid, tst->arch.vex.guest_RIP);
 
+   VG_(shadow_stack_signal_returned)(tid);
+
    /* tell the tools */
    VG_TRACK( post_deliver_signal, tid, sigNo );
 }
@@ -42,6 +42,7 @@
 #include "pub_core_tooliface.h"
 #include "pub_core_trampoline.h"
 #include "pub_core_sigframe.h"   /* self */
+#include "pub_core_stacktrace.h"   // VG_(shadow_stack_signal_returned)
 #include "priv_sigframe.h"
 
 /* This module creates and removes signal frames for signal deliveries
@@ -595,6 +596,8 @@ void VG_(sigframe_destroy)( ThreadId tid, Bool isRT )
          "VG_(signal_return) (thread %u): isRT=%d valid magic; RIP=%#llx\n",
          tid, isRT, tst->arch.vex.guest_RIP);
 
+   VG_(shadow_stack_signal_returned)(tid);
+
    /* tell the tools */
    VG_TRACK( post_deliver_signal, tid, sigNo );
 }
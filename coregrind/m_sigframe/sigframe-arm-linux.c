@@ -47,6 +47,7 @@
 #include "pub_core_signals.h"
 #include "pub_core_tooliface.h"
 #include "pub_core_trampoline.h"
+#include "pub_core_stacktrace.h"   // VG_(shadow_stack_signal_returned)
 #include "priv_sigframe.h"
 
 
@@ -314,6 +315,8 @@ void VG_(sigframe_destroy)( ThreadId tid, Bool isRT )
                    "isRT=%d valid magic; PC=%#x\n",
                    tid, has_siginfo, tst->arch.vex.guest_R15T);
 
+   VG_(shadow_stack_signal_returned)(tid);
+
    /* tell the tools */
    VG_TRACK( post_deliver_signal, tid, sigNo );
 }
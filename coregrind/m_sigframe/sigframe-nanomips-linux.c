@@ -42,6 +42,7 @@
 #include "pub_core_signals.h"
 #include "pub_core_tooliface.h"
 #include "pub_core_trampoline.h"
+#include "pub_core_stacktrace.h"   // VG_(shadow_stack_signal_returned)
 #include "priv_sigframe.h"
 
 struct vg_sig_private {
@@ -241,6 +242,7 @@ void VG_(sigframe_destroy)( ThreadId tid, Bool isRT ) {
                     "VG_(signal_return) (thread %u): isRT=%d valid magic; EIP=%#x\n",
                     tid, isRT, tst->arch.vex.guest_PC);
 
+   VG_(shadow_stack_signal_returned)(tid);
    VG_TRACK(post_deliver_signal, tid, priv1->sigNo_private);
 }
 
@@ -42,6 +42,7 @@
 #include "pub_core_signals.h"
 #include "pub_core_tooliface.h"
 #include "pub_core_trampoline.h"
+#include "pub_core_stacktrace.h"   // VG_(shadow_stack_signal_returned)
 #include "priv_sigframe.h"
 
 #if defined(VGA_s390x)
@@ -516,6 +517,8 @@ void VG_(sigframe_destroy)( ThreadId tid, Bool isRT )
          "VG_(sigframe_destroy) (thread %u): isRT=%d valid magic; IP=%#llx\n",
          tid, isRT, tst->arch.vex.guest_IA);
 
+   VG_(shadow_stack_signal_returned)(tid);
+
    /* tell the tools */
    VG_TRACK( post_deliver_signal, tid, sigNo );
 }
@@ -42,6 +42,7 @@
 #include "pub_core_tooliface.h"
 #include "pub_core_sigframe.h"      /* Self */
 #include "pub_core_syswrap.h"
+#include "pub_core_stacktrace.h"   // VG_(shadow_stack_signal_returned)
 #include "priv_sigframe.h"
 
 /* This module creates and removes signal frames for signal deliveries
@@ -257,6 +258,8 @@ void VG_(sigframe_return)(ThreadId tid, const vki_ucontext_t *uc)
                    "sigframe_return (thread %u): IP=%#lx\n",
                    tid, VG_(get_IP)(tid));
 
+   VG_(shadow_stack_signal_returned)(tid);
+
    /* Tell the tool. */
    VG_TRACK(post_deliver_signal, tid, signo);
 }
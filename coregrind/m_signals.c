@@ -1537,6 +1537,8 @@ void push_signal_frame ( ThreadId tid, const vki_siginfo_t *siginfo,
    /* Signal delivery to tools */
    VG_TRACK( pre_deliver_signal, tid, sigNo, on_altstack );
 
+   VG_(shadow_stack_signal_delivered)(tid, on_altstack);
+
    vg_assert(scss.scss_per_sig[sigNo].scss_handler != VKI_SIG_IGN);
    vg_assert(scss.scss_per_sig[sigNo].scss_handler != VKI_SIG_DFL);
 
@@ -35,6 +35,7 @@
 #include "pub_core_libcassert.h"
 #include "pub_core_libcprint.h"
 #include "pub_core_machine.h"
+#include "pub_core_mallocfree.h"    // VG_(realloc), for the shadow stack
 #include "pub_core_options.h"
 #include "pub_core_stacks.h"        // VG_(stack_limits)
 #include "pub_core_stacktrace.h"
@@ -1508,6 +1509,208 @@ UInt VG_(get_StackTrace_wrk) ( ThreadId tid_if_known,
 /*---                                                      ---*/
 /*------------------------------------------------------------*/
 
+/*------------------------------------------------------------*/
+/*--- Shadow call stack                                    ---*/
+/*------------------------------------------------------------*/
+
+/* With --shadow-stack=yes, m_translate.c instruments every call to
+   push (return address, SP after the call) on a per-thread shadow
+   stack, and every return to pop it.  A stack trace is then just the
+   current IP followed by the return addresses on the shadow stack,
+   which avoids a CFI/FP unwind for each trace.  This matters for the
+   tools recording a stack trace on every malloc and free.
+
+   The shadow stack is not always in sync with the real stack:
+   longjmp, exceptions and coroutines pop frames without returns,
+   "call next insn" sequences are not calls, and a function may return
+   to somewhere else than its return address.  We deal with this the
+   way callgrind's callstack.c does, using the stack pointer:
+   - on a return, the top entry is popped if its SP is not above the
+     new SP, and all entries whose SP is now below the SP are dropped
+     as stale (their frames have gone);
+   - on a call, stale entries are dropped too before the push.
+   The stack grows down on all our platforms, so an entry is stale when
+   its SP is strictly below the current one.  Equality is live, as
+   calls on arm, ppc, mips and s390x do not change SP.
+
+   Signal delivery pushes a marker, which is removed at sigreturn.
+   If the handler runs on the alternate stack, SP values on both sides
+   of the marker cannot be compared, so nothing below an alternate
+   stack marker is ever dropped as stale.
+
+   A trace is taken from the shadow stack only if it looks trustworthy:
+   SP is within the thread's stack (not on an alternate signal stack or
+   a coroutine stack), no marker is in the frames used, no push was
+   lost, and on x86/amd64 the return address of each used entry is
+   still at the place the call pushed it.  Otherwise we fall back to
+   unwinding. */
+
+#define SS_MARKER      ((Addr)0)   /* signal frame on the same stack */
+#define SS_ALT_MARKER  ((Addr)1)   /* signal frame on the alt stack */
+#define SS_IS_MARKER(_ret) ((_ret) <= SS_ALT_MARKER)
+
+#define SS_INIT_SIZE   256
+#define SS_MAX_SIZE    (1 << 20)
+
+/* Return address to IP, as done by the unwinders below. */
+#if defined(VGA_mips32) || defined(VGA_mips64)
+#  define SS_RA_TO_IP(_ra) ((_ra) - 8)   /* skip the delay slot */
+#elif defined(VGA_arm)
+#  define SS_RA_TO_IP(_ra) (((_ra) & ~(Addr)1) - 1)
+#else
+#  define SS_RA_TO_IP(_ra) ((_ra) - 1)
+#endif
+
+static ULong stats__ss_traces    = 0;  // traces taken from the shadow stack
+static ULong stats__ss_fallbacks = 0;  // traces unwound instead
+static ULong stats__ss_mismatch  = 0;  // .. of which failed verification
+static UInt  stats__ss_max_used  = 0;  // deepest shadow stack
+
+static void ss_drop_stale ( ThreadState* tst, Addr sp )
+{
+   UInt n = tst->shadow_stack_used;
+
+   while (n > 0 && tst->shadow_stack[n-1].sp < sp
+          && tst->shadow_stack[n-1].ret != SS_ALT_MARKER)
+      n--;
+   tst->shadow_stack_used = n;
+}
+
+static void ss_push ( ThreadState* tst, Addr ret, Addr sp )
+{
+   if (UNLIKELY(tst->shadow_stack_used == tst->shadow_stack_size)) {
+      UInt new_size = tst->shadow_stack_size == 0
+                         ? SS_INIT_SIZE : 2 * tst->shadow_stack_size;
+      if (new_size > SS_MAX_SIZE) {
+         tst->shadow_stack_lost++;
+         return;
+      }
+      tst->shadow_stack = VG_(realloc)("stacktrace.ss_push.1",
+                                       tst->shadow_stack,
+                                       new_size * sizeof(ShadowFrame));
+      tst->shadow_stack_size = new_size;
+   }
+   tst->shadow_stack[tst->shadow_stack_used].ret = ret;
+   tst->shadow_stack[tst->shadow_stack_used].sp  = sp;
+   tst->shadow_stack_used++;
+   if (UNLIKELY(tst->shadow_stack_used > stats__ss_max_used))
+      stats__ss_max_used = tst->shadow_stack_used;
+}
+
+VG_REGPARM(2) void VG_(shadow_stack_push) ( Addr ret, Addr sp )
+{
+   ThreadState* tst = &VG_(threads)[VG_(running_tid)];
+
+#  if defined(VGA_x86) || defined(VGA_amd64)
+   /* The call pushed the return address at sp, so an entry with the
+      same SP is stale too (e.g. the first call made after a longjmp
+      back into the caller of a function which called longjmp). */
+   ss_drop_stale(tst, sp + 1);
+#  else
+   ss_drop_stale(tst, sp);
+#  endif
+   ss_push(tst, ret, sp);
+}
+
+VG_REGPARM(1) void VG_(shadow_stack_pop) ( Addr sp )
+{
+   ThreadState* tst = &VG_(threads)[VG_(running_tid)];
+   UInt n = tst->shadow_stack_used;
+
+   if (UNLIKELY(tst->shadow_stack_lost > 0)) {
+      tst->shadow_stack_lost--;
+      return;
+   }
+   if (n > 0 && !SS_IS_MARKER(tst->shadow_stack[n-1].ret)
+       && tst->shadow_stack[n-1].sp <= sp)
+      tst->shadow_stack_used = n - 1;
+   ss_drop_stale(tst, sp);
+}
+
+void VG_(shadow_stack_signal_delivered) ( ThreadId tid, Bool on_altstack )
+{
+   ThreadState* tst = VG_(get_ThreadState)(tid);
+
+   if (!VG_(clo_shadow_stack))
+      return;
+
+   if (on_altstack) {
+      ss_push(tst, SS_ALT_MARKER, 0);
+   } else {
+      Addr sp = VG_(get_SP)(tid);
+      ss_drop_stale(tst, sp);
+      ss_push(tst, SS_MARKER, sp);
+   }
+}
+
+void VG_(shadow_stack_signal_returned) ( ThreadId tid )
+{
+   ThreadState* tst = VG_(get_ThreadState)(tid);
+   UInt n = tst->shadow_stack_used;
+
+   if (!VG_(clo_shadow_stack))
+      return;
+
+   /* If the handler longjmp-ed out, the marker may already be gone,
+      in which case we leave the stack alone. */
+   while (n > 0) {
+      n--;
+      if (SS_IS_MARKER(tst->shadow_stack[n].ret)) {
+         tst->shadow_stack_used = n;
+         return;
+      }
+   }
+}
+
+/* Fill ips[] from the shadow stack of tid, whose current IP and SP are
+   given.  Returns 0 if the shadow stack can not be trusted. */
+static UInt shadow_stack_trace ( ThreadId tid,
+                                 /*OUT*/Addr* ips, UInt max_n_ips,
+                                 Addr ip, Addr sp )
+{
+   const Int    cmrf = VG_(clo_merge_recursive_frames);
+   ThreadState* tst  = &VG_(threads)[tid];
+   Addr         hi   = tst->client_stack_highest_byte;
+   Int          n    = tst->shadow_stack_used;
+   UInt         i;
+
+   if (tst->shadow_stack_lost > 0 || tst->client_stack_szB == 0
+       || sp > hi || sp < hi - tst->client_stack_szB + 1)
+      return 0;
+
+   /* Skip the stale entries not yet dropped by a call or return. */
+   while (n > 0 && tst->shadow_stack[n-1].sp < sp
+          && tst->shadow_stack[n-1].ret != SS_ALT_MARKER)
+      n--;
+
+   ips[0] = ip;
+   i = 1;
+   while (i < max_n_ips && n > 0) {
+      const ShadowFrame* f = &tst->shadow_stack[--n];
+      if (SS_IS_MARKER(f->ret) || f->sp > hi)
+         return 0;
+#     if defined(VGA_x86) || defined(VGA_amd64)
+      if (*(Addr*)f->sp != f->ret) {
+         stats__ss_mismatch++;
+         return 0;
+      }
+#     endif
+      ips[i++] = SS_RA_TO_IP(f->ret);
+      RECURSIVE_MERGE(cmrf,ips,i);
+   }
+   return i;
+}
+
+void VG_(print_shadow_stack_stats) ( void )
+{
+   VG_(message)(Vg_DebugMsg,
+      "shadowstk: %'llu traces from shadow stacks, %'llu unwound "
+      "(%'llu mismatches)\n",
+      stats__ss_traces, stats__ss_fallbacks, stats__ss_mismatch);
+   VG_(message)(Vg_DebugMsg,
+      "shadowstk: largest shadow stack: %'u frames\n", stats__ss_max_used);
+}
+
 /*------------------------------------------------------------*/
 /*--- Exported functions.                                  ---*/
 /*------------------------------------------------------------*/
@@ -1571,6 +1774,19 @@ UInt VG_(get_StackTrace_with_deltas)(
                   tid, stack_highest_byte,
                   startRegs.r_pc, startRegs.r_sp);
 
+   /* The shadow stack only gives IPs. */
+   if (VG_(clo_shadow_stack) && n_ips > 0 && sps == NULL && fps == NULL
+       && first_sp_delta == 0) {
+      UInt n_found = shadow_stack_trace(tid, ips, n_ips,
+                                        (Addr)startRegs.r_pc,
+                                        (Addr)startRegs.r_sp);
+      if (n_found > 0) {
+         stats__ss_traces++;
+         return n_found;
+      }
+      stats__ss_fallbacks++;
+   }
+
    return VG_(get_StackTrace_wrk)(tid, ips, n_ips, 
                                        sps, fps,
                                        &startRegs,
@@ -43,6 +43,7 @@
 #include "pub_core_redir.h"      // VG_(redir_do_lookup)
 
 #include "pub_core_signals.h"    // VG_(synth_fault_{perms,mapping}
+#include "pub_core_stacktrace.h" // VG_(shadow_stack_push/pop)
 #include "pub_core_stacks.h"     // VG_(unknown_SP_update*)()
 #include "pub_core_tooliface.h"  // VG_(tdict)
 
@@ -685,6 +686,96 @@ IRSB* vg_SP_update_pass ( void*             closureV,
 #undef DO_DIE
 }
 
+/* With --shadow-stack=yes, calls and returns are instrumented to
+   maintain the shadow call stacks of m_stacktrace.c.  This is a second
+   instrumentation pass, after the SP update pass, so that the helpers
+   see SP after the call or return.  The return address of a call is
+   the address following its guest instruction, which is the last one
+   of the block, or the one of the side exit for a conditional call.
+   Ijk_NoRedir is only used by the "call-noredir" sequences with which
+   function wrappers call the original, so it is a call too.  A call
+   to the next instruction (the PIC idiom "call 1f; 1: pop") does not
+   return, and is left alone.  Chasing is disabled by the
+   option, as it would hide calls inside superblocks. */
+static void add_shadow_stack_call ( IRSB* bb, const VexGuestLayout* layout,
+                                    IRJumpKind jk, Addr ret,
+                                    const IRExpr* dst, IRExpr* guard )
+{
+   IRType   typeof_SP = layout->sizeof_SP == 4 ? Ity_I32 : Ity_I64;
+   IRTemp   sp        = newIRTemp(bb->tyenv, typeof_SP);
+   IRDirty* dcall;
+
+   if (jk == Ijk_NoRedir)
+      jk = Ijk_Call;
+   if (jk == Ijk_Call && dst->tag == Iex_Const
+       && (dst->Iex.Const.con->tag == Ico_U32
+              ? (Addr)dst->Iex.Const.con->Ico.U32
+              : (Addr)dst->Iex.Const.con->Ico.U64) == ret)
+      return;
+
+   addStmtToIRSB( bb, IRStmt_WrTmp( sp, IRExpr_Get(layout->offset_SP,
+                                                   typeof_SP) ) );
+   if (jk == Ijk_Call)
+      dcall = unsafeIRDirty_0_N(
+                 2/*regparms*/,
+                 "VG_(shadow_stack_push)",
+                 VG_(fnptr_to_fnentry)( &VG_(shadow_stack_push) ),
+                 mkIRExprVec_2( mkIRExpr_HWord(ret), IRExpr_RdTmp(sp) ) );
+   else
+      dcall = unsafeIRDirty_0_N(
+                 1/*regparms*/,
+                 "VG_(shadow_stack_pop)",
+                 VG_(fnptr_to_fnentry)( &VG_(shadow_stack_pop) ),
+                 mkIRExprVec_1( IRExpr_RdTmp(sp) ) );
+   if (guard)
+      dcall->guard = deepCopyIRExpr(guard);
+   addStmtToIRSB( bb, IRStmt_Dirty(dcall) );
+}
+
+static
+IRSB* vg_shadow_stack_pass ( void*             closureV,
+                             IRSB*             sb_in, 
+                             const VexGuestLayout*   layout, 
+                             const VexGuestExtents*  vge,
+                             const VexArchInfo*      vai,
+                             IRType            gWordTy, 
+                             IRType            hWordTy )
+{
+   Int    i;
+   Addr   next_ip = 0;
+   IRSB*  bb;
+
+   if (need_to_handle_SP_assignment())
+      sb_in = vg_SP_update_pass(closureV, sb_in, layout, vge, vai,
+                                gWordTy, hWordTy);
+
+   bb = deepCopyIRSBExceptStmts(sb_in);
+
+   for (i = 0; i < sb_in->stmts_used; i++) {
+      IRStmt* st = sb_in->stmts[i];
+
+      if (st->tag == Ist_IMark) {
+         next_ip = (Addr)st->Ist.IMark.addr + st->Ist.IMark.len
+                   + st->Ist.IMark.delta;
+      }
+      else if (st->tag == Ist_Exit
+               && (st->Ist.Exit.jk == Ijk_Call
+                   || st->Ist.Exit.jk == Ijk_Ret)) {
+         add_shadow_stack_call(bb, layout, st->Ist.Exit.jk, next_ip,
+                               IRExpr_Const(st->Ist.Exit.dst),
+                               st->Ist.Exit.guard);
+      }
+      addStmtToIRSB( bb, st );
+   }
+
+   if (sb_in->jumpkind == Ijk_Call || sb_in->jumpkind == Ijk_NoRedir
+       || sb_in->jumpkind == Ijk_Ret)
+      add_shadow_stack_call(bb, layout, sb_in->jumpkind, next_ip,
+                            sb_in->next, NULL);
+
+   return bb;
+}
+
 /*------------------------------------------------------------*/
 /*--- Main entry point for the JITter.                     ---*/
 /*------------------------------------------------------------*/
@@ -1787,7 +1878,9 @@ Bool VG_(translate) ( ThreadId tid,
      vta.instrument1     = g;
    }
    /* No need for type kludgery here. */
-   vta.instrument2       = need_to_handle_SP_assignment()
+   vta.instrument2       = VG_(clo_shadow_stack)
+                              ? vg_shadow_stack_pass
+                              : need_to_handle_SP_assignment()
                               ? vg_SP_update_pass
                               : NULL;
    vta.finaltidy         = VG_(needs).final_IR_tidy_pass
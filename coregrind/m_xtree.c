@@ -895,6 +895,12 @@ void VG_(XT_massif_close)(MsFile* fp)
    VG_(fclose)(fp);
 }
 
+ULong VG_(XT_massif_flush)(MsFile* fp)
+{
+   VG_(fflush)(fp);
+   return VG_(ftell)(fp);
+}
+
 void VG_(XT_massif_print) 
      (MsFile* fp,
       XTree* xt,
@@ -139,12 +139,8 @@ extern Bool VG_(use_CF_info) ( /*MOD*/D3UnwindRegs* uregs,
                                Addr min_accessible,
                                Addr max_accessible );
 
-/* returns the "generation" of the debug info.
-   Each time some debuginfo is changed (e.g. loaded or unloaded),
-   the VG_(debuginfo_generation)() value returned will be increased.
-   This can be used to flush cached information derived from debug
-   info (e.g. CFI info or FPO info or ...). */
-extern UInt VG_(debuginfo_generation) (void);
+/* Print the stats of the CFI lookups done by VG_(use_CF_info). */
+extern void VG_(print_CF_info_stats) ( void );
 
 
 
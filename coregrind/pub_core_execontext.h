@@ -51,6 +51,10 @@ extern void VG_(print_ExeContext_stats) ( Bool with_stacktraces );
 extern void VG_(archive_ExeContext_in_range) (DiEpoch last_epoch,
                                               Addr text_avma, SizeT length );
 
+// Hash of the part of an ExeContext compared by VG_(eq_ExeContext)(res, ...):
+// ExeContexts that are equal at resolution res have the same hash.
+extern UWord VG_(hash_ExeContext) ( VgRes res, const ExeContext* e );
+
 // Extract the StackTrace from an ExeContext.
 // (Minor hack: we use Addr* as the return type instead of StackTrace so
 // that modules #including this file don't also have to #include
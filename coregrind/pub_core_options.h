@@ -323,6 +323,13 @@ extern UInt VG_(clo_max_threads);
    Note that the value is changeable by a gdbsrv command. */
 extern Int VG_(clo_merge_recursive_frames);
 
+/* Maintain a shadow call stack by instrumenting calls and returns, and
+   use it to capture stack traces instead of unwinding the stack. */
+extern Bool VG_(clo_shadow_stack);
+
+/* Number of entries of the cache of CFI lookups done when unwinding. */
+extern UInt VG_(clo_cfi_cache_size);
+
 /* Max number of sectors that will be used by the translation code cache. */
 extern UInt VG_(clo_num_transtab_sectors);
 
@@ -55,6 +55,19 @@ UInt VG_(get_StackTrace_wrk) ( ThreadId tid_if_known,
                                const UnwindStartRegs* startRegs,
                                Addr fp_max_orig );
 
+// Shadow call stack (--shadow-stack=yes).  The push and pop helpers
+// are called from the code generated for calls and returns, with the
+// stack pointer just after the call or return.  The signal functions
+// are called when a signal frame is built and when it is removed; they
+// do nothing if the option is off.
+VG_REGPARM(2) void VG_(shadow_stack_push) ( Addr ret, Addr sp );
+VG_REGPARM(1) void VG_(shadow_stack_pop)  ( Addr sp );
+void VG_(shadow_stack_signal_delivered) ( ThreadId tid, Bool on_altstack );
+void VG_(shadow_stack_signal_returned)  ( ThreadId tid );
+
+// Print the shadow stack statistics (for -v -v -v or --stats=yes).
+void VG_(print_shadow_stack_stats) ( void );
+
 #endif   // __PUB_CORE_STACKTRACE_H
 
 /*--------------------------------------------------------------------*/
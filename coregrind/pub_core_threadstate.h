@@ -321,6 +321,17 @@ typedef
    ThreadOSstate;
 
 
+/* An entry of a thread's shadow call stack: the return address pushed
+   by a call, and the stack pointer just after the call.  Signal
+   delivery pushes a marker entry, see m_stacktrace.c. */
+typedef
+   struct {
+      Addr ret;
+      Addr sp;
+   }
+   ShadowFrame;
+
+
 /* Overall thread state */
 typedef struct {
    /* ThreadId == 0 (and hence vg_threads[0]) is NEVER USED.
@@ -406,6 +417,14 @@ typedef struct {
    /* This thread's name. NULL, if no name. */
    HChar *thread_name;
    UInt ptrace;
+
+   /* Shadow call stack, maintained when --shadow-stack=yes.  See
+      m_stacktrace.c.  The array is kept when the slot is reused;
+      only the counters are reset. */
+   ShadowFrame* shadow_stack;
+   UInt shadow_stack_used;
+   UInt shadow_stack_size;
+   UInt shadow_stack_lost;   // pushes dropped as the stack was full
 }
 ThreadState;
 
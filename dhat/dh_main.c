@@ -30,6 +30,7 @@
 #include "pub_tool_basics.h"
 #include "pub_tool_clientstate.h"
 #include "pub_tool_clreq.h"
+#include "pub_tool_hashtable.h"
 #include "pub_tool_libcbase.h"
 #include "pub_tool_libcassert.h"
 #include "pub_tool_libcfile.h"
@@ -39,6 +40,7 @@
 #include "pub_tool_mallocfree.h"
 #include "pub_tool_options.h"
 #include "pub_tool_replacemalloc.h"
+#include "pub_tool_threadstate.h"
 #include "pub_tool_tooliface.h"
 #include "pub_tool_wordfm.h"
 
@@ -73,6 +75,13 @@ static ULong g_tgmax_instrs = 0;
 static ULong g_reads_bytes = 0;
 static ULong g_writes_bytes = 0;
 
+// With --sample-accesses=N, the number of heap accesses left before the
+// next sampled one (decremented from generated code), and the number of
+// accesses the next sampled one stands for.
+static ULong g_sample_countdown = 0;
+static ULong g_sample_weight = 0;
+static UInt  g_sample_seed = 0;
+
 //------------------------------------------------------------//
 //--- Command line args                                    ---//
 //------------------------------------------------------------//
@@ -83,10 +92,17 @@ static ProfileKind clo_mode = Heap;
 
 static const HChar* clo_dhat_out_file = "dhat.out.%p";
 
+// Only every Nth heap access (on average) is recorded, and stands for N
+// accesses.  1 means record all accesses.
+static Long clo_sample_accesses = 1;
+
 static Bool dh_process_cmd_line_option(const HChar* arg)
 {
    if VG_STR_CLO(arg, "--dhat-out-file", clo_dhat_out_file) {
 
+   } else if VG_BINT_CLO(arg, "--sample-accesses", clo_sample_accesses,
+                         1, 1000000) {
+
    } else if (VG_XACT_CLO(arg, "--mode=heap",   clo_mode, Heap)) {
    } else if (VG_XACT_CLO(arg, "--mode=copy",   clo_mode, Copy)) {
    } else if (VG_XACT_CLO(arg, "--mode=ad-hoc", clo_mode, AdHoc)) {
@@ -103,6 +119,8 @@ static void dh_print_usage(void)
    VG_(printf)(
 "    --dhat-out-file=<file>    output file name [dhat.out.%%p]\n"
 "    --mode=heap|copy|ad-hoc   profiling mode\n"
+"    --sample-accesses=<N>     with --mode=heap, record only 1 in N heap\n"
+"                              accesses, and extrapolate reads/writes [1]\n"
    );
 }
 
@@ -151,55 +169,263 @@ static Word interval_tree_Cmp ( UWord k1, UWord k2 )
    return 0;
 }
 
-// 2-entry cache for find_Block_containing
-static Block* fbc_cache0 = NULL;
-static Block* fbc_cache1 = NULL;
+/* The interval tree holds all the live blocks, but looking an address up
+   in it costs a dozen or more cache misses once there are many blocks.
+   So, to find the block containing an address on each memory access,
+   blocks are also indexed by page:
+
+   - A block spanning at most BI_MAX_PAGES pages is entered in the
+     BlockPage of each page it overlaps.  A BlockPage holds the bounds of
+     the blocks overlapping its page, sorted by address, so that the one
+     containing an address can be binary searched without touching the
+     Blocks themselves.
+
+   - Bigger blocks, of which there are normally few, are instead kept in
+     large_tree, with the same ordering as interval_tree.
+
+   The interval tree remains the authoritative set of live blocks. */
+
+#define BI_PAGE_SHIFT 12
+#define BI_MAX_PAGES  16
+
+typedef
+   struct {
+      Addr   start;   /* == bk->payload */
+      Addr   end;     /* == bk->payload + bk->req_szB */
+      Block* bk;
+   }
+   BlockEnt;
+
+typedef
+   struct _BlockPage {
+      struct _BlockPage* next;
+      UWord    key;      /* page number, i.e. address >> BI_PAGE_SHIFT */
+      UInt     n_ents;
+      UInt     sz_ents;
+      BlockEnt ents[0];  /* [0 .. n_ents-1], sorted by start */
+   }
+   BlockPage;
+
+static VgHashTable* block_pages = NULL;  /* of BlockPage */
+static WordFM*      large_tree = NULL;   /* WordFM* Block* void */
+static UWord        n_large_blocks = 0;
 
-static UWord stats__n_fBc_cached = 0;
+static UWord stats__n_bi_pages = 0;
+static UWord stats__n_bi_pages_found = 0;
+static UWord stats__n_bi_large_found = 0;
+
+/* In front of the index, find_Block_containing has a per-thread MRU
+   cache, so that threads working on different blocks don't keep evicting
+   each other's entries.  A cache is only valid if its gen matches
+   fbc_gen, which is bumped whenever a block leaves the index or changes
+   size.  (Adding a block can't invalidate anything, since blocks don't
+   overlap.) */
+#define FBC_WAYS 4
+
+typedef
+   struct {
+      BlockEnt   ents[FBC_WAYS];  /* most recently used first */
+      UWord      gen;
+      BlockPage* bp;              /* the last BlockPage looked up */
+      UWord      bp_gen;
+   }
+   FbcCache;
+
+static FbcCache* fbc_caches = NULL; /* [0 .. VG_N_THREADS-1] */
+static UWord     fbc_gen = 1;
+static UWord     bp_gen = 1;      /* bumped when a BlockPage moves or dies */
+
+static UWord stats__n_fBc_cached[FBC_WAYS];
 static UWord stats__n_fBc_uncached = 0;
 static UWord stats__n_fBc_notfound = 0;
 
+static inline UWord first_page_of_Block ( const Block* bk ) {
+   return bk->payload >> BI_PAGE_SHIFT;
+}
+static inline UWord last_page_of_Block ( const Block* bk ) {
+   return (bk->payload + bk->req_szB - 1) >> BI_PAGE_SHIFT;
+}
+static inline Bool is_large_Block ( const Block* bk ) {
+   return last_page_of_Block(bk) - first_page_of_Block(bk) >= BI_MAX_PAGES;
+}
+
+/* Returns the index of the last block in bp starting at or below a,
+   or -1 if there is none. */
+static inline Int find_in_BlockPage ( const BlockPage* bp, Addr a )
+{
+   Int lo = 0, hi = bp->n_ents - 1;
+   while (lo <= hi) {
+      Int mid = (lo + hi) / 2;
+      if (a < bp->ents[mid].start) hi = mid - 1;
+      else                         lo = mid + 1;
+   }
+   return hi;
+}
+
+static void index_Block ( Block* bk )
+{
+   if (is_large_Block(bk)) {
+      Bool present = VG_(addToFM)( large_tree, (UWord)bk, (UWord)0 );
+      tl_assert(!present);
+      n_large_blocks++;
+      return;
+   }
+
+   for (UWord pg = first_page_of_Block(bk); pg <= last_page_of_Block(bk);
+        pg++) {
+      BlockPage* bp = VG_(HT_lookup)( block_pages, pg );
+      if (bp == NULL) {
+         bp = VG_(malloc)( "dh.index_Block.1",
+                           sizeof(BlockPage) + 4 * sizeof(BlockEnt) );
+         bp->key     = pg;
+         bp->n_ents  = 0;
+         bp->sz_ents = 4;
+         VG_(HT_add_node)( block_pages, bp );
+         stats__n_bi_pages++;
+      } else if (bp->n_ents == bp->sz_ents) {
+         // The entries are inline, so the node moves when grown.
+         VG_(HT_remove)( block_pages, pg );
+         bp_gen++;
+         bp->sz_ents *= 2;
+         bp = VG_(realloc)( "dh.index_Block.2", bp,
+                            sizeof(BlockPage)
+                            + bp->sz_ents * sizeof(BlockEnt) );
+         VG_(HT_add_node)( block_pages, bp );
+      }
+      Int i = find_in_BlockPage( bp, bk->payload ) + 1;
+      tl_assert(i == 0 || bp->ents[i-1].end <= bk->payload);
+      VG_(memmove)( &bp->ents[i+1], &bp->ents[i],
+                    (bp->n_ents - i) * sizeof(BlockEnt) );
+      bp->ents[i].start = bk->payload;
+      bp->ents[i].end   = bk->payload + bk->req_szB;
+      bp->ents[i].bk    = bk;
+      bp->n_ents++;
+   }
+}
+
+static void unindex_Block ( Block* bk )
+{
+   // The caches may hold the bounds of bk.
+   fbc_gen++;
+
+   if (is_large_Block(bk)) {
+      Bool found = VG_(delFromFM)( large_tree, NULL, NULL, (UWord)bk );
+      tl_assert(found);
+      n_large_blocks--;
+      return;
+   }
+
+   for (UWord pg = first_page_of_Block(bk); pg <= last_page_of_Block(bk);
+        pg++) {
+      BlockPage* bp = VG_(HT_lookup)( block_pages, pg );
+      tl_assert(bp);
+      Int i = find_in_BlockPage( bp, bk->payload );
+      tl_assert(i >= 0 && bp->ents[i].bk == bk);
+      bp->n_ents--;
+      VG_(memmove)( &bp->ents[i], &bp->ents[i+1],
+                    (bp->n_ents - i) * sizeof(BlockEnt) );
+      if (bp->n_ents == 0) {
+         VG_(HT_remove)( block_pages, pg );
+         bp_gen++;
+         VG_(free)( bp );
+         stats__n_bi_pages--;
+      }
+   }
+}
+
+static Bool lookup_Block_index ( FbcCache* fbc, Addr a,
+                                 /*OUT*/BlockEnt* ent )
+{
+   UWord      pg = a >> BI_PAGE_SHIFT;
+   BlockPage* bp;
+   if (fbc->bp_gen == bp_gen && fbc->bp && fbc->bp->key == pg) {
+      bp = fbc->bp;
+   } else {
+      bp = VG_(HT_lookup)( block_pages, pg );
+      fbc->bp     = bp;
+      fbc->bp_gen = bp_gen;
+   }
+   if (bp) {
+      Int i = find_in_BlockPage( bp, a );
+      if (i >= 0 && a < bp->ents[i].end) {
+         stats__n_bi_pages_found++;
+         *ent = bp->ents[i];
+         return True;
+      }
+   }
+
+   if (n_large_blocks > 0) {
+      Block fake;
+      fake.payload = a;
+      fake.req_szB = 1;
+      UWord foundkey = 1;
+      UWord foundval = 1;
+      if (VG_(lookupFM)( large_tree, &foundkey, &foundval, (UWord)&fake )) {
+         tl_assert(foundval == 0);
+         tl_assert(foundkey != 1 && foundkey != (UWord)&fake);
+         Block* bk = (Block*)foundkey;
+         stats__n_bi_large_found++;
+         ent->start = bk->payload;
+         ent->end   = bk->payload + bk->req_szB;
+         ent->bk    = bk;
+         return True;
+      }
+   }
+
+   return False;
+}
+
+// Add a block to the interval tree and the index.
+static void add_Block ( Block* bk )
+{
+   tl_assert(clo_mode == Heap);
+
+   Bool present = VG_(addToFM)( interval_tree, (UWord)bk, (UWord)0/*no val*/);
+   tl_assert(!present);
+   index_Block(bk);
+}
+
 static Block* find_Block_containing ( Addr a )
 {
    tl_assert(clo_mode == Heap);
 
-   if (LIKELY(fbc_cache0
-              && fbc_cache0->payload <= a
-              && a < fbc_cache0->payload + fbc_cache0->req_szB)) {
+   ThreadId tid = VG_(get_running_tid)();
+   tl_assert(tid < VG_N_THREADS);
+   FbcCache* fbc = &fbc_caches[tid];
+   BlockEnt  ent;
+   UInt      w;
+
+   if (UNLIKELY(fbc->gen != fbc_gen)) {
+      VG_(memset)(fbc->ents, 0, sizeof(fbc->ents));
+      fbc->gen = fbc_gen;
+   }
+
+   if (LIKELY(fbc->ents[0].start <= a && a < fbc->ents[0].end)) {
       // found at 0
-      stats__n_fBc_cached++;
-      return fbc_cache0;
-   }
-   if (LIKELY(fbc_cache1
-              && fbc_cache1->payload <= a
-              && a < fbc_cache1->payload + fbc_cache1->req_szB)) {
-      // found at 1; swap 0 and 1
-      Block* tmp = fbc_cache0;
-      fbc_cache0 = fbc_cache1;
-      fbc_cache1 = tmp;
-      stats__n_fBc_cached++;
-      return fbc_cache0;
+      stats__n_fBc_cached[0]++;
+      return fbc->ents[0].bk;
    }
-   Block fake;
-   fake.payload = a;
-   fake.req_szB = 1;
-   UWord foundkey = 1;
-   UWord foundval = 1;
-   Bool found = VG_(lookupFM)( interval_tree,
-                               &foundkey, &foundval, (UWord)&fake );
-   if (!found) {
-      stats__n_fBc_notfound++;
-      return NULL;
+   for (w = 1; w < FBC_WAYS; w++) {
+      if (fbc->ents[w].start <= a && a < fbc->ents[w].end) {
+         stats__n_fBc_cached[w]++;
+         break;
+      }
    }
-   tl_assert(foundval == 0); // we don't store vals in the interval tree
-   tl_assert(foundkey != 1);
-   Block* res = (Block*)foundkey;
-   tl_assert(res != &fake);
-   // put at the top position
-   fbc_cache1 = fbc_cache0;
-   fbc_cache0 = res;
-   stats__n_fBc_uncached++;
-   return res;
+   if (w < FBC_WAYS) {
+      ent = fbc->ents[w];
+   } else {
+      if (!lookup_Block_index(fbc, a, &ent)) {
+         stats__n_fBc_notfound++;
+         return NULL;
+      }
+      stats__n_fBc_uncached++;
+      w = FBC_WAYS - 1;
+   }
+   // move to the top position
+   for (; w > 0; w--)
+      fbc->ents[w] = fbc->ents[w-1];
+   fbc->ents[0] = ent;
+   return ent.bk;
 }
 
 // delete a block; asserts if not found.  (viz, 'a' must be
@@ -211,10 +437,11 @@ static void delete_Block_starting_at ( Addr a )
    Block fake;
    fake.payload = a;
    fake.req_szB = 1;
+   UWord foundkey = 0;
    Bool found = VG_(delFromFM)( interval_tree,
-                                NULL, NULL, (Addr)&fake );
+                                &foundkey, NULL, (Addr)&fake );
    tl_assert(found);
-   fbc_cache0 = fbc_cache1 = NULL;
+   unindex_Block((Block*)foundkey);
 }
 
 //------------------------------------------------------------//
@@ -583,7 +810,7 @@ void* new_block ( ThreadId tid, void* p, SizeT req_szB, SizeT req_alignB,
       return p;
    }
 
-   // Make new Block, add to interval_tree.
+   // Make new Block, add to interval_tree and the index.
    Block* bk = VG_(malloc)("dh.new_block.1", sizeof(Block));
    bk->payload      = (Addr)p;
    bk->req_szB      = req_szB;
@@ -598,9 +825,7 @@ void* new_block ( ThreadId tid, void* p, SizeT req_szB, SizeT req_alignB,
       VG_(memset)(bk->histoW, 0, req_szB * sizeof(UShort));
    }
 
-   Bool present = VG_(addToFM)( interval_tree, (UWord)bk, (UWord)0/*no val*/);
-   tl_assert(!present);
-   fbc_cache0 = fbc_cache1 = NULL;
+   add_Block(bk);
 
    intro_Block(bk);
 
@@ -683,8 +908,12 @@ void* renew_block ( ThreadId tid, void* p_old, SizeT new_req_szB )
    // Actually do the allocation, if necessary.
    if (new_req_szB <= bk->req_szB) {
       // New size is smaller or same; block not moved.
+      // The interval tree ordering is unaffected, but the index has to
+      // be updated for the new size.
       resize_Block(bk->ec, bk->req_szB, new_req_szB);
+      unindex_Block(bk);
       bk->req_szB = new_req_szB;
+      index_Block(bk);
 
       // Update reads/writes for the implicit copy. Even though we didn't
       // actually do a copy, we act like we did, to match up with the fact
@@ -724,10 +953,7 @@ void* renew_block ( ThreadId tid, void* p_old, SizeT new_req_szB )
       bk->req_szB = new_req_szB;
 
       // And re-add it to the interval tree.
-      Bool present
-         = VG_(addToFM)( interval_tree, (UWord)bk, (UWord)0/*no val*/);
-      tl_assert(!present);
-      fbc_cache0 = fbc_cache1 = NULL;
+      add_Block(bk);
    }
 
    return p_new;
@@ -824,7 +1050,7 @@ static SizeT dh_malloc_usable_size ( ThreadId tid, void* p )
 //------------------------------------------------------------//
 
 static
-void inc_histo_for_block ( Block* bk, Addr addr, UWord szB )
+void inc_histo_for_block ( Block* bk, Addr addr, UWord szB, UWord weight )
 {
    UWord i, offMin, offMax1;
    offMin = addr - bk->payload;
@@ -834,8 +1060,8 @@ void inc_histo_for_block ( Block* bk, Addr addr, UWord szB )
       offMax1 = bk->req_szB;
    //VG_(printf)("%lu %lu   (size of block %lu)\n", offMin, offMax1, bk->req_szB);
    for (i = offMin; i < offMax1; i++) {
-      UShort n = bk->histoW[i];
-      if (n < 0xFFFF) n++;
+      UWord n = bk->histoW[i];
+      n = weight < 0xFFFF - n ? n + weight : 0xFFFF;
       bk->histoW[i] = n;
    }
 }
@@ -849,7 +1075,7 @@ void dh_handle_write ( Addr addr, UWord szB )
    if (bk) {
       bk->writes_bytes += szB;
       if (bk->histoW)
-         inc_histo_for_block(bk, addr, szB);
+         inc_histo_for_block(bk, addr, szB, 1);
    }
 }
 
@@ -862,7 +1088,53 @@ void dh_handle_read ( Addr addr, UWord szB )
    if (bk) {
       bk->reads_bytes += szB;
       if (bk->histoW)
-         inc_histo_for_block(bk, addr, szB);
+         inc_histo_for_block(bk, addr, szB, 1);
+   }
+}
+
+// With --sample-accesses=N, the generated code only calls the helpers
+// below when g_sample_countdown reaches zero.  The countdown is then reset
+// to a random value in [1, 2N-1], rather than to N, so that sampling
+// doesn't lock onto loops whose access pattern has a period dividing N.
+// A sampled access stands for all the accesses of the countdown that
+// selected it.
+
+static UWord stats__n_samples = 0;
+
+static void reset_sample_countdown ( void )
+{
+   g_sample_weight
+      = 1 + VG_(random)(&g_sample_seed) % (2 * clo_sample_accesses - 1);
+   g_sample_countdown = g_sample_weight;
+}
+
+static VG_REGPARM(2)
+void dh_handle_sampled_write ( Addr addr, UWord szB )
+{
+   UWord weight = g_sample_weight;
+   reset_sample_countdown();
+   stats__n_samples++;
+
+   Block* bk = find_Block_containing(addr);
+   if (bk) {
+      bk->writes_bytes += szB * weight;
+      if (bk->histoW)
+         inc_histo_for_block(bk, addr, szB, weight);
+   }
+}
+
+static VG_REGPARM(2)
+void dh_handle_sampled_read ( Addr addr, UWord szB )
+{
+   UWord weight = g_sample_weight;
+   reset_sample_countdown();
+   stats__n_samples++;
+
+   Block* bk = find_Block_containing(addr);
+   if (bk) {
+      bk->reads_bytes += szB * weight;
+      if (bk->histoW)
+         inc_histo_for_block(bk, addr, szB, weight);
    }
 }
 
@@ -975,7 +1247,15 @@ void addMemEvent(IRSB* sbOut, Bool isWrite, Int szB, IRExpr* addr,
    tyAddr = typeOfIRExpr( sbOut->tyenv, addr );
    tl_assert(tyAddr == Ity_I32 || tyAddr == Ity_I64);
 
-   if (isWrite) {
+   if (clo_sample_accesses > 1) {
+      if (isWrite) {
+         hName = "dh_handle_sampled_write";
+         hAddr = &dh_handle_sampled_write;
+      } else {
+         hName = "dh_handle_sampled_read";
+         hAddr = &dh_handle_sampled_read;
+      }
+   } else if (isWrite) {
       hName = "dh_handle_write";
       hAddr = &dh_handle_write;
    } else {
@@ -1027,6 +1307,34 @@ void addMemEvent(IRSB* sbOut, Bool isWrite, Int szB, IRExpr* addr,
                 ? binop(Iop_CmpLT32U, mkU32(THRESH), mkexpr(diff))
                 : binop(Iop_CmpLT64U, mkU64(THRESH), mkexpr(diff)))
    );
+
+   if (clo_sample_accesses > 1) {
+      /* Count down the accesses that passed the guard above, and only
+         call the helper when the countdown reaches zero:
+
+            cnt = g_sample_countdown - (guard ? 1 : 0)
+            g_sample_countdown = cnt
+            if (cnt == 0) call helper
+
+         The helper resets the countdown to a non-zero value, so a
+         non-guarded access can't see it at zero. */
+      IRExpr* cnt_addr = mkIRExpr_HWord( (HWord)&g_sample_countdown );
+      IRTemp  dec      = newIRTemp(sbOut->tyenv, Ity_I64);
+      IRTemp  cnt0     = newIRTemp(sbOut->tyenv, Ity_I64);
+      IRTemp  cnt1     = newIRTemp(sbOut->tyenv, Ity_I64);
+      IRTemp  sguard   = newIRTemp(sbOut->tyenv, Ity_I1);
+      addStmtToIRSB(
+         sbOut, assign(dec, IRExpr_Unop(Iop_1Uto64, mkexpr(guard))));
+      addStmtToIRSB( sbOut, assign(cnt0, IRExpr_Load(END, Ity_I64, cnt_addr)));
+      addStmtToIRSB(
+         sbOut, assign(cnt1, binop(Iop_Sub64, mkexpr(cnt0), mkexpr(dec))));
+      addStmtToIRSB( sbOut, IRStmt_Store(END, cnt_addr, mkexpr(cnt1)));
+      addStmtToIRSB(
+         sbOut,
+         assign(sguard, binop(Iop_CmpEQ64, mkexpr(cnt1), mkU64(0)))
+      );
+      guard = sguard;
+   }
    di->guard = mkexpr(guard);
 
    addStmtToIRSB( sbOut, IRStmt_Dirty(di) );
@@ -1279,6 +1587,14 @@ static Bool dh_handle_client_request(ThreadId tid, UWord* arg, UWord* ret)
 //   // present. A mandatory boolean.
 //   "bkacc": true,
 //
+//   // The access sampling rate, i.e. only 1 in "accsmp" accesses was
+//   // recorded, and the "rb", "wb" and "acc" values are extrapolated from
+//   // these samples.
+//   // - bkacc=true: an optional integer, omitted if all accesses were
+//   //   recorded.
+//   // - bkacc=false: omitted.
+//   "accsmp": 100,
+//
 //   // Byte/bytes/blocks-position units. Optional strings. "byte", "bytes",
 //   // and "blocks" are the values used if these fields are omitted.
 //   "bu": "byte", "bsu": "bytes", "bksu": "blocks",
@@ -1608,12 +1924,29 @@ static void dh_fini(Int exit_status)
 
       // Stats.
       if (VG_(clo_stats)) {
+         UWord n_cached = 0;
+         for (UInt w = 0; w < FBC_WAYS; w++)
+            n_cached += stats__n_fBc_cached[w];
+         UWord n_lookups
+            = n_cached + stats__n_fBc_uncached + stats__n_fBc_notfound;
          VG_(dmsg)(" dhat: find_Block_containing:\n");
          VG_(dmsg)("             found: %'lu (%'lu cached + %'lu uncached)\n",
-                   stats__n_fBc_cached + stats__n_fBc_uncached,
-                   stats__n_fBc_cached,
+                   n_cached + stats__n_fBc_uncached,
+                   n_cached,
                    stats__n_fBc_uncached);
          VG_(dmsg)("          notfound: %'lu\n", stats__n_fBc_notfound);
+         VG_(dmsg)("    cache hits/1k: %lu (%'lu in the MRU entry)\n",
+                   n_lookups == 0 ? 0UL : n_cached * 1000 / n_lookups,
+                   stats__n_fBc_cached[0]);
+         VG_(dmsg)("    index lookups: %'lu found in pages,"
+                   " %'lu found in large blocks\n",
+                   stats__n_bi_pages_found, stats__n_bi_large_found);
+         VG_(dmsg)("        index now: %'lu pages, %'lu large blocks\n",
+                   stats__n_bi_pages, n_large_blocks);
+         if (clo_sample_accesses > 1) {
+            VG_(dmsg)("           samples: %'lu (1 in %'lld accesses)\n",
+                      stats__n_samples, clo_sample_accesses);
+         }
          VG_(dmsg)("\n");
       }
    }
@@ -1651,6 +1984,9 @@ static void dh_fini(Int exit_status)
    if (clo_mode == Heap) {
       FP(",\"mode\":\"heap\",\"verb\":\"Allocated\"\n");
       FP(",\"bklt\":true,\"bkacc\":true\n");
+      if (clo_sample_accesses > 1) {
+         FP(",\"accsmp\":%lld\n", clo_sample_accesses);
+      }
    } else if (clo_mode == Copy) {
       FP(",\"mode\":\"copy\",\"verb\":\"Copied\"\n");
       FP(",\"bklt\":false,\"bkacc\":false\n");
@@ -1734,6 +2070,10 @@ static void dh_fini(Int exit_status)
                 g_curr_bytes, g_curr_blocks);
       VG_(umsg)("Reads:     %'llu bytes\n", g_reads_bytes);
       VG_(umsg)("Writes:    %'llu bytes\n", g_writes_bytes);
+      if (clo_sample_accesses > 1) {
+         VG_(umsg)("(Reads and writes are extrapolated from "
+                   "1 in %'lld accesses.)\n", clo_sample_accesses);
+      }
    } else {
       tl_assert(g_max_bytes == 0);
       tl_assert(g_max_blocks == 0);
@@ -1766,6 +2106,18 @@ static void dh_post_clo_init(void)
       VG_(track_pre_mem_read)        ( dh_handle_noninsn_read );
       VG_(track_pre_mem_read_asciiz) ( dh_handle_noninsn_read_asciiz );
       VG_(track_post_mem_write)      ( dh_handle_noninsn_write );
+
+      fbc_caches = VG_(calloc)("dh.fbc_caches.1",
+                               VG_N_THREADS, sizeof(FbcCache));
+
+      if (clo_sample_accesses > 1) {
+         reset_sample_countdown();
+      }
+   } else if (clo_sample_accesses > 1) {
+      VG_(fmsg_bad_option)("--sample-accesses",
+                           "Only meaningful with --mode=heap.\n");
+      // Not fatal by itself once the command line has been processed.
+      VG_(exit)(1);
    }
 }
 
@@ -1809,13 +2161,16 @@ static void dh_pre_clo_init(void)
                                  0 );
 
    tl_assert(!interval_tree);
-   tl_assert(!fbc_cache0);
-   tl_assert(!fbc_cache1);
 
    interval_tree = VG_(newFM)( VG_(malloc),
                                "dh.interval_tree.1",
                                VG_(free),
                                interval_tree_Cmp );
+   large_tree = VG_(newFM)( VG_(malloc),
+                            "dh.large_tree.1",
+                            VG_(free),
+                            interval_tree_Cmp );
+   block_pages = VG_(HT_construct)( "dh.block_pages.1" );
 
    ppinfo = VG_(newFM)( VG_(malloc),
                         "dh.ppinfo.1",
@@ -877,6 +877,10 @@ function appendInvocationAndTimes(aP) {
   v += `  Mode:    ${gData.mode}\n`;
   v += `  Command: ${gData.cmd}\n`;
   v += `  PID:     ${gData.pid}\n`;
+  if (gData.accsmp) {
+    v += `  Accesses sampled 1 in ${gData.accsmp}; reads and writes are ` +
+         `extrapolated\n`;
+  }
   v += "}\n\n";
 
   appendElementWithText(aP, "span", v, "invocation");
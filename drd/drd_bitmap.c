@@ -45,6 +45,10 @@ static OSet* s_bm2_set_template;
 static ULong s_bitmap_creation_count;
 static ULong s_bitmap_merge_count;
 static ULong s_bitmap2_merge_count;
+static ULong s_summary_reject_count;
+/* Updated by the inline functions in drd_bitmap.h, hence not static. */
+ULong DRD_(g_bitmap2_live_count);
+ULong DRD_(g_max_bitmap2_live_count);
 
 
 /* Function definitions. */
@@ -103,6 +107,8 @@ void DRD_(bm_init)(struct bitmap* const bm)
       bm->cache[i].bm2 = 0;
    }
    bm->oset = VG_(OSetGen_EmptyClone)(s_bm2_set_template);
+   for (i = 0; i < DRD_BITMAP_SUMMARY_UWORDS; i++)
+      bm->summary[i] = 0;
 
    s_bitmap_creation_count++;
 }
@@ -110,6 +116,7 @@ void DRD_(bm_init)(struct bitmap* const bm)
 /** Free the memory allocated by DRD_(bm_init)(). */
 void DRD_(bm_cleanup)(struct bitmap* const bm)
 {
+   DRD_(g_bitmap2_live_count) -= VG_(OSetGen_Size)(bm->oset);
    VG_(OSetGen_Destroy)(bm->oset);
 }
 
@@ -801,6 +808,32 @@ Bool DRD_(bm_test_and_clear)(struct bitmap* const bm,
    return result;
 }
 
+/**
+ * Return a nonzero value if any bit corresponding to the addresses with
+ * address_lsb() in the range [ b0 .. b1 ] (both inclusive) is set in bm0.
+ * The words covered entirely by the range are tested a word at a time.
+ */
+static __inline__
+UWord bm0_is_any_set_in_range(const UWord* bm0, const UWord b0, const UWord b1)
+{
+   const UWord k0 = uword_msb(b0);
+   const UWord k1 = uword_msb(b1);
+   const UWord first_mask = ~(UWord)0 << uword_lsb(b0);
+   const UWord last_mask = ~(UWord)0 >> (BITS_PER_UWORD - 1 - uword_lsb(b1));
+   UWord k;
+
+   if (k0 == k1)
+      return bm0[k0] & first_mask & last_mask;
+   if (bm0[k0] & first_mask)
+      return 1;
+   for (k = k0 + 1; k < k1; k++)
+   {
+      if (bm0[k])
+         return 1;
+   }
+   return bm0[k1] & last_mask;
+}
+
 Bool DRD_(bm_has_conflict_with)(struct bitmap* const bm,
                                 const Addr a1, const Addr a2,
                                 const BmAccessTypeT access_type)
@@ -843,25 +876,14 @@ Bool DRD_(bm_has_conflict_with)(struct bitmap* const bm,
          tl_assert(b_start < b_end);
          tl_assert(address_lsb(b_start) <= address_lsb(b_end - 1));
 
-         for (b0 = address_lsb(b_start); b0 <= address_lsb(b_end - 1); b0++)
-         {
-            if (access_type == eLoad)
-            {
-               if (bm0_is_set(p1->bm0_w, b0))
-               {
-                  return True;
-               }
-            }
-            else
-            {
-               tl_assert(access_type == eStore);
-               if (bm0_is_set(p1->bm0_r, b0)
-                   | bm0_is_set(p1->bm0_w, b0))
-               {
-                  return True;
-               }
-            }
-         }
+         b0 = address_lsb(b_start);
+         if (bm0_is_any_set_in_range(p1->bm0_w, b0, address_lsb(b_end - 1)))
+            return True;
+         if (access_type == eStore
+             && bm0_is_any_set_in_range(p1->bm0_r, b0,
+                                        address_lsb(b_end - 1)))
+            return True;
+         tl_assert(access_type == eLoad || access_type == eStore);
       }
    }
    return False;
@@ -1008,8 +1030,16 @@ Bool DRD_(bm_equal)(struct bitmap* const lhs, struct bitmap* const rhs)
 void DRD_(bm_swap)(struct bitmap* const bm1, struct bitmap* const bm2)
 {
    OSet* const tmp = bm1->oset;
+   unsigned k;
+
    bm1->oset = bm2->oset;
    bm2->oset = tmp;
+   for (k = 0; k < DRD_BITMAP_SUMMARY_UWORDS; k++)
+   {
+      const UWord t = bm1->summary[k];
+      bm1->summary[k] = bm2->summary[k];
+      bm2->summary[k] = t;
+   }
 }
 
 /** Merge bitmaps *lhs and *rhs into *lhs. */
@@ -1030,7 +1060,8 @@ void DRD_(bm_merge2)(struct bitmap* const lhs, struct bitmap* const rhs)
 
    for ( ; (bm2r = VG_(OSetGen_Next)(rhs->oset)) != 0; )
    {
-      bm2l = VG_(OSetGen_Lookup)(lhs->oset, &bm2r->addr);
+      bm2l = bm_summary_may_have(lhs, bm2r->addr)
+         ? VG_(OSetGen_Lookup)(lhs->oset, &bm2r->addr) : NULL;
       if (bm2l)
       {
          tl_assert(bm2l != bm2r);
@@ -1117,10 +1148,19 @@ void DRD_(bm_merge2_marked)(struct bitmap* const lhs, struct bitmap* const rhs)
 
    s_bitmap_merge_count++;
 
+   /* Only second level bitmaps present in lhs can be marked. */
+   if (! bm_summaries_overlap(lhs, rhs))
+   {
+      s_summary_reject_count++;
+      return;
+   }
+
    VG_(OSetGen_ResetIter)(rhs->oset);
 
    for ( ; (bm2r = VG_(OSetGen_Next)(rhs->oset)) != 0; )
    {
+      if (! bm_summary_may_have(lhs, bm2r->addr))
+         continue;
       bm2l = VG_(OSetGen_Lookup)(lhs->oset, &bm2r->addr);
       if (bm2l && bm2l->recalc)
       {
@@ -1157,6 +1197,12 @@ void DRD_(bm_remove_cleared_marked)(struct bitmap* bm)
  */
 int DRD_(bm_has_races)(struct bitmap* const lhs, struct bitmap* const rhs)
 {
+   if (! bm_summaries_overlap(lhs, rhs))
+   {
+      s_summary_reject_count++;
+      return 0;
+   }
+
    VG_(OSetGen_ResetIter)(lhs->oset);
    VG_(OSetGen_ResetIter)(rhs->oset);
 
@@ -1185,16 +1231,18 @@ int DRD_(bm_has_races)(struct bitmap* const lhs, struct bitmap* const rhs)
 
       for (k = 0; k < BITMAP1_UWORD_COUNT; k++)
       {
+         /* Bit b of 'races' is set iff HAS_RACE() holds for bit b. */
+         UWord const races
+            = (bm1l->bm0_w[k] & (bm1r->bm0_r[k] | bm1r->bm0_w[k]))
+            | (bm1r->bm0_w[k] & bm1l->bm0_r[k]);
          unsigned b;
+
+         if (races == 0)
+            continue;
          for (b = 0; b < BITS_PER_UWORD; b++)
          {
-            UWord const access_mask
-               = ((bm1l->bm0_r[k] & bm0_mask(b)) ? LHS_R : 0)
-               | ((bm1l->bm0_w[k] & bm0_mask(b)) ? LHS_W : 0)
-               | ((bm1r->bm0_r[k] & bm0_mask(b)) ? RHS_R : 0)
-               | ((bm1r->bm0_w[k] & bm0_mask(b)) ? RHS_W : 0);
             Addr const a = make_address(bm2l->addr, k * BITS_PER_UWORD | b);
-            if (HAS_RACE(access_mask) && ! DRD_(is_suppressed)(a, a + 1))
+            if ((races & bm0_mask(b)) && ! DRD_(is_suppressed)(a, a + 1))
             {
                return 1;
             }
@@ -1250,11 +1298,32 @@ ULong DRD_(bm_get_bitmap2_creation_count)(void)
    return s_bitmap2_creation_count;
 }
 
+/** Return the number of bytes currently allocated for second level bitmaps. */
+ULong DRD_(bm_get_bitmap2_memory)(void)
+{
+   return DRD_(g_bitmap2_live_count) * sizeof(struct bitmap2);
+}
+
+/** Return the peak value of DRD_(bm_get_bitmap2_memory)(). */
+ULong DRD_(bm_get_max_bitmap2_memory)(void)
+{
+   return DRD_(g_max_bitmap2_live_count) * sizeof(struct bitmap2);
+}
+
 ULong DRD_(bm_get_bitmap2_merge_count)(void)
 {
    return s_bitmap2_merge_count;
 }
 
+/**
+ * Return how many times the summaries of two bitmaps allowed to skip a
+ * comparison or merge of these bitmaps.
+ */
+ULong DRD_(bm_get_summary_reject_count)(void)
+{
+   return s_summary_reject_count;
+}
+
 /** Compute *bm2l |= *bm2r. */
 static
 void bm2_merge(struct bitmap2* const bm2l, const struct bitmap2* const bm2r)
@@ -1267,12 +1336,10 @@ void bm2_merge(struct bitmap2* const bm2l, const struct bitmap2* const bm2r)
 
    s_bitmap2_merge_count++;
 
+   /* A single loop without early exits, which the compiler vectorizes. */
    for (k = 0; k < BITMAP1_UWORD_COUNT; k++)
    {
       bm2l->bm1.bm0_r[k] |= bm2r->bm1.bm0_r[k];
-   }
-   for (k = 0; k < BITMAP1_UWORD_COUNT; k++)
-   {
       bm2l->bm1.bm0_w[k] |= bm2r->bm1.bm0_w[k];
    }
 }
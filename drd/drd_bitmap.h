@@ -214,6 +214,12 @@ Addr first_address_with_higher_uword_msb(const Addr a)
 static ULong s_bitmap2_creation_count;
 
 
+/* Variables defined in drd_bitmap.c. */
+
+extern ULong DRD_(g_bitmap2_live_count);
+extern ULong DRD_(g_max_bitmap2_live_count);
+
+
 
 /*********************************************************************/
 /*           Functions for manipulating a struct bitmap1.            */
@@ -344,6 +350,56 @@ struct bitmap2* bm2_insert(struct bitmap* const bm, const UWord a1);
 
 
 
+/*********************************************************************/
+/*           Functions for manipulating a bitmap summary.            */
+/*********************************************************************/
+
+
+/** Number of bits in the summary of a struct bitmap. */
+#define BM_SUMMARY_BITS (DRD_BITMAP_SUMMARY_UWORDS * BITS_PER_UWORD)
+
+/**
+ * Summary bit for the second level bitmap with address a1. Consecutive
+ * second level bitmaps map onto consecutive summary bits.
+ *
+ * @param a1 client address shifted right by ADDR_LSB_BITS.
+ */
+static __inline__
+void bm_summary_set(struct bitmap* const bm, const UWord a1)
+{
+   const UWord b = a1 % BM_SUMMARY_BITS;
+   bm->summary[b / BITS_PER_UWORD] |= (UWord)1 << (b % BITS_PER_UWORD);
+}
+
+/**
+ * Return zero if bitmap bm certainly does not contain a second level bitmap
+ * with address a1.
+ */
+static __inline__
+UWord bm_summary_may_have(const struct bitmap* const bm, const UWord a1)
+{
+   const UWord b = a1 % BM_SUMMARY_BITS;
+   return bm->summary[b / BITS_PER_UWORD] & ((UWord)1 << (b % BITS_PER_UWORD));
+}
+
+/**
+ * Return zero if bitmaps bm1 and bm2 certainly do not contain any second
+ * level bitmaps with the same address.
+ */
+static __inline__
+UWord bm_summaries_overlap(const struct bitmap* const bm1,
+                           const struct bitmap* const bm2)
+{
+   UWord overlap = 0;
+   unsigned k;
+
+   for (k = 0; k < DRD_BITMAP_SUMMARY_UWORDS; k++)
+      overlap |= bm1->summary[k] & bm2->summary[k];
+   return overlap;
+}
+
+
+
 /**
  * Rotate elements cache[0..n-1] such that the element at position n-1 is
  * moved to position 0. This allows to speed up future cache lookups.
@@ -509,7 +565,8 @@ const struct bitmap2* bm2_lookup(struct bitmap* const bm, const UWord a1)
 
    if (! bm_cache_lookup(bm, a1, &bm2))
    {
-      bm2 = VG_(OSetGen_Lookup)(bm->oset, &a1);
+      if (bm_summary_may_have(bm, a1))
+         bm2 = VG_(OSetGen_Lookup)(bm->oset, &a1);
       bm_update_cache(bm, a1, bm2);
    }
    return bm2;
@@ -532,7 +589,7 @@ bm2_lookup_exclusive(struct bitmap* const bm, const UWord a1)
    tl_assert(bm);
 #endif
 
-   if (! bm_cache_lookup(bm, a1, &bm2))
+   if (! bm_cache_lookup(bm, a1, &bm2) && bm_summary_may_have(bm, a1))
    {
       bm2 = VG_(OSetGen_Lookup)(bm->oset, &a1);
    }
@@ -568,10 +625,13 @@ struct bitmap2* bm2_insert(struct bitmap* const bm, const UWord a1)
 #endif
 
    s_bitmap2_creation_count++;
+   if (++DRD_(g_bitmap2_live_count) > DRD_(g_max_bitmap2_live_count))
+      DRD_(g_max_bitmap2_live_count) = DRD_(g_bitmap2_live_count);
 
    bm2 = VG_(OSetGen_AllocNode)(bm->oset, sizeof(*bm2));
    bm2->addr = a1;
    VG_(OSetGen_Insert)(bm->oset, bm2);
+   bm_summary_set(bm, a1);
 
    bm_update_cache(bm, a1, bm2);
 
@@ -615,7 +675,8 @@ struct bitmap2* bm2_lookup_or_insert(struct bitmap* const bm, const UWord a1)
    }
    else
    {
-      bm2 = VG_(OSetGen_Lookup)(bm->oset, &a1);
+      bm2 = bm_summary_may_have(bm, a1)
+         ? VG_(OSetGen_Lookup)(bm->oset, &a1) : NULL;
       if (! bm2)
       {
          bm2 = bm2_insert(bm, a1);
@@ -651,6 +712,7 @@ void bm2_remove(struct bitmap* const bm, const UWord a1)
 
    bm2 = VG_(OSetGen_Remove)(bm->oset, &a1);
    VG_(OSetGen_FreeNode)(bm->oset, bm2);
+   DRD_(g_bitmap2_live_count)--;
 
    bm_update_cache(bm, a1, NULL);
 }
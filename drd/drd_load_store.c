@@ -29,6 +29,7 @@
 #include "drd_bitmap.c"
 #include "drd_load_store.h"
 #include "drd_segment.c"
+#include "drd_shadow.c"
 #include "drd_thread.c"
 #include "drd_vc.c"
 #include "libvex_guest_offsets.h"
@@ -138,6 +139,20 @@ static VG_REGPARM(3) void drd_trace_mem_store(const Addr addr,const SizeT size,
                                  stored_value_lo);
 }
 
+/**
+ * Record an access of the running thread in its segment bitmap, such that
+ * the conflicting segments can be reported, and check the access against
+ * shadow memory.
+ */
+static __inline__
+Bool shadow_access_triggers_conflict(const Addr a1, const Addr a2,
+                                     const BmAccessTypeT access_type)
+{
+   DRD_(bm_access_range)(DRD_(sg_bm)(DRD_(running_thread_get_segment)()),
+                         a1, a2, access_type);
+   return DRD_(shadow_access_triggers_conflict)(a1, a2, access_type);
+}
+
 static void drd_report_race(const Addr addr, const SizeT size,
                             const BmAccessTypeT access_type)
 {
@@ -182,7 +197,9 @@ VG_REGPARM(2) void DRD_(trace_load)(Addr addr, SizeT size)
    if (DRD_(running_thread_is_recording_loads)()
        && (s_check_stack_accesses
            || ! DRD_(thread_address_on_stack)(addr))
-       && bm_access_load_triggers_conflict(addr, addr + size)
+       && (DRD_(g_race_backend) == eRaceBackendShadow
+           ? shadow_access_triggers_conflict(addr, addr + size, eLoad)
+           : bm_access_load_triggers_conflict(addr, addr + size))
        && ! DRD_(is_suppressed)(addr, addr + size))
    {
       drd_report_race(addr, size, eLoad);
@@ -194,7 +211,9 @@ static VG_REGPARM(1) void drd_trace_load_1(Addr addr)
    if (DRD_(running_thread_is_recording_loads)()
        && (s_check_stack_accesses
            || ! DRD_(thread_address_on_stack)(addr))
-       && bm_access_load_1_triggers_conflict(addr)
+       && (DRD_(g_race_backend) == eRaceBackendShadow
+           ? shadow_access_triggers_conflict(addr, addr + 1, eLoad)
+           : bm_access_load_1_triggers_conflict(addr))
        && ! DRD_(is_suppressed)(addr, addr + 1))
    {
       drd_report_race(addr, 1, eLoad);
@@ -206,7 +225,9 @@ static VG_REGPARM(1) void drd_trace_load_2(Addr addr)
    if (DRD_(running_thread_is_recording_loads)()
        && (s_check_stack_accesses
            || ! DRD_(thread_address_on_stack)(addr))
-       && bm_access_load_2_triggers_conflict(addr)
+       && (DRD_(g_race_backend) == eRaceBackendShadow
+           ? shadow_access_triggers_conflict(addr, addr + 2, eLoad)
+           : bm_access_load_2_triggers_conflict(addr))
        && ! DRD_(is_suppressed)(addr, addr + 2))
    {
       drd_report_race(addr, 2, eLoad);
@@ -218,7 +239,9 @@ static VG_REGPARM(1) void drd_trace_load_4(Addr addr)
    if (DRD_(running_thread_is_recording_loads)()
        && (s_check_stack_accesses
            || ! DRD_(thread_address_on_stack)(addr))
-       && bm_access_load_4_triggers_conflict(addr)
+       && (DRD_(g_race_backend) == eRaceBackendShadow
+           ? shadow_access_triggers_conflict(addr, addr + 4, eLoad)
+           : bm_access_load_4_triggers_conflict(addr))
        && ! DRD_(is_suppressed)(addr, addr + 4))
    {
       drd_report_race(addr, 4, eLoad);
@@ -230,7 +253,9 @@ static VG_REGPARM(1) void drd_trace_load_8(Addr addr)
    if (DRD_(running_thread_is_recording_loads)()
        && (s_check_stack_accesses
            || ! DRD_(thread_address_on_stack)(addr))
-       && bm_access_load_8_triggers_conflict(addr)
+       && (DRD_(g_race_backend) == eRaceBackendShadow
+           ? shadow_access_triggers_conflict(addr, addr + 8, eLoad)
+           : bm_access_load_8_triggers_conflict(addr))
        && ! DRD_(is_suppressed)(addr, addr + 8))
    {
       drd_report_race(addr, 8, eLoad);
@@ -248,7 +273,9 @@ VG_REGPARM(2) void DRD_(trace_store)(Addr addr, SizeT size)
    if (DRD_(running_thread_is_recording_stores)()
        && (s_check_stack_accesses
            || ! DRD_(thread_address_on_stack)(addr))
-       && bm_access_store_triggers_conflict(addr, addr + size)
+       && (DRD_(g_race_backend) == eRaceBackendShadow
+           ? shadow_access_triggers_conflict(addr, addr + size, eStore)
+           : bm_access_store_triggers_conflict(addr, addr + size))
        && ! DRD_(is_suppressed)(addr, addr + size))
    {
       drd_report_race(addr, size, eStore);
@@ -260,7 +287,9 @@ static VG_REGPARM(1) void drd_trace_store_1(Addr addr)
    if (DRD_(running_thread_is_recording_stores)()
        && (s_check_stack_accesses
            || ! DRD_(thread_address_on_stack)(addr))
-       && bm_access_store_1_triggers_conflict(addr)
+       && (DRD_(g_race_backend) == eRaceBackendShadow
+           ? shadow_access_triggers_conflict(addr, addr + 1, eStore)
+           : bm_access_store_1_triggers_conflict(addr))
        && ! DRD_(is_suppressed)(addr, addr + 1))
    {
       drd_report_race(addr, 1, eStore);
@@ -272,7 +301,9 @@ static VG_REGPARM(1) void drd_trace_store_2(Addr addr)
    if (DRD_(running_thread_is_recording_stores)()
        && (s_check_stack_accesses
            || ! DRD_(thread_address_on_stack)(addr))
-       && bm_access_store_2_triggers_conflict(addr)
+       && (DRD_(g_race_backend) == eRaceBackendShadow
+           ? shadow_access_triggers_conflict(addr, addr + 2, eStore)
+           : bm_access_store_2_triggers_conflict(addr))
        && ! DRD_(is_suppressed)(addr, addr + 2))
    {
       drd_report_race(addr, 2, eStore);
@@ -284,7 +315,9 @@ static VG_REGPARM(1) void drd_trace_store_4(Addr addr)
    if (DRD_(running_thread_is_recording_stores)()
        && (s_check_stack_accesses
            || !DRD_(thread_address_on_stack)(addr))
-       && bm_access_store_4_triggers_conflict(addr)
+       && (DRD_(g_race_backend) == eRaceBackendShadow
+           ? shadow_access_triggers_conflict(addr, addr + 4, eStore)
+           : bm_access_store_4_triggers_conflict(addr))
        && !DRD_(is_suppressed)(addr, addr + 4))
    {
       drd_report_race(addr, 4, eStore);
@@ -296,7 +329,9 @@ static VG_REGPARM(1) void drd_trace_store_8(Addr addr)
    if (DRD_(running_thread_is_recording_stores)()
        && (s_check_stack_accesses
            || ! DRD_(thread_address_on_stack)(addr))
-       && bm_access_store_8_triggers_conflict(addr)
+       && (DRD_(g_race_backend) == eRaceBackendShadow
+           ? shadow_access_triggers_conflict(addr, addr + 8, eStore)
+           : bm_access_store_8_triggers_conflict(addr))
        && ! DRD_(is_suppressed)(addr, addr + 8))
    {
       drd_report_race(addr, 8, eStore);
@@ -32,6 +32,7 @@
 #include "drd_rwlock.h"
 #include "drd_segment.h"
 #include "drd_semaphore.h"
+#include "drd_shadow.h"
 #include "drd_suppression.h"
 #include "drd_thread.h"
 #include "libvex_guest_offsets.h"
@@ -72,6 +73,7 @@ static Bool DRD_(process_cmd_line_option)(const HChar* arg)
    int report_signal_unlocked = -1;
    int segment_merging        = -1;
    int segment_merge_interval = -1;
+   int segment_memory_limit   = -1;
    int shared_threshold_ms    = -1;
    int show_confl_seg         = -1;
    int trace_barrier          = -1;
@@ -97,9 +99,15 @@ static Bool DRD_(process_cmd_line_option)(const HChar* arg)
    else if VG_BOOL_CLO(arg, "--free-is-write",       DRD_(g_free_is_write)) {}
    else if VG_BOOL_CLO(arg,"--report-signal-unlocked",report_signal_unlocked)
    {}
+   else if VG_XACT_CLO(arg, "--race-backend=bitmap",
+                       DRD_(g_race_backend), eRaceBackendBitmap) {}
+   else if VG_XACT_CLO(arg, "--race-backend=shadow",
+                       DRD_(g_race_backend), eRaceBackendShadow) {}
    else if VG_BOOL_CLO(arg, "--segment-merging",     segment_merging) {}
    else if VG_INT_CLO (arg, "--segment-merging-interval", segment_merge_interval)
    {}
+   else if VG_BINT_CLO(arg, "--segment-memory-limit", segment_memory_limit,
+                       0, 1 << 20) {}
    else if VG_BOOL_CLO(arg, "--show-confl-seg",      show_confl_seg) {}
    else if VG_BOOL_CLO(arg, "--show-stack-usage",    s_show_stack_usage) {}
    else if VG_BOOL_CLO(arg, "--ignore-thread-creation",
@@ -154,6 +162,8 @@ static Bool DRD_(process_cmd_line_option)(const HChar* arg)
       DRD_(thread_set_segment_merging)(segment_merging);
    if (segment_merge_interval != -1)
       DRD_(thread_set_segment_merge_interval)(segment_merge_interval);
+   if (segment_memory_limit != -1)
+      DRD_(thread_set_segment_memory_limit)((ULong)segment_memory_limit << 20);
    if (show_confl_seg != -1)
       DRD_(set_show_conflicting_segments)(show_confl_seg);
    if (trace_address) {
@@ -212,6 +222,9 @@ static void DRD_(print_usage)(void)
 "    --free-is-write=yes|no    Whether to report races between freeing memory\n"
 "                              and subsequent accesses of that memory[no].\n"
 "    --join-list-vol=<n>       Number of threads to delay cleanup for [10].\n"
+"    --race-backend=bitmap|shadow Detect races by intersecting segment\n"
+"                              bitmaps or via per-address access epochs kept\n"
+"                              in shadow memory [bitmap].\n"
 "    --report-signal-unlocked=yes|no Whether to report calls to\n"
 "                              pthread_cond_signal() where the mutex associated\n"
 "                              with the signal via pthread_cond_wait() is not\n"
@@ -223,6 +236,8 @@ static void DRD_(print_usage)(void)
 "        in race reports but can also trigger an out of memory error.\n"
 "    --segment-merging-interval=<n> Perform segment merging every time n new\n"
 "        segments have been created. Default: %d.\n"
+"    --segment-memory-limit=<n> Discard old segments when the segment bitmaps\n"
+"        use more than n MB of memory. Reduces accuracy. 0 means no limit [0].\n"
 "    --shared-threshold=<n>    Print an error message if a reader lock\n"
 "                              is held longer than the specified time (in\n"
 "                              milliseconds) [off]\n"
@@ -754,6 +769,9 @@ static void DRD_(post_clo_init)(void)
    {
       VG_(needs_var_info)();
    }
+
+   if (DRD_(g_race_backend) == eRaceBackendShadow)
+      DRD_(shadow_init)();
 }
 
 static void drd_start_client_code(const ThreadId tid, const ULong bbs_done)
@@ -801,6 +819,11 @@ static void DRD_(fini)(Int exitcode)
                    "           %llu discard points and %llu merges.\n",
                    DRD_(thread_get_discard_ordered_segments_count)(),
                    DRD_(sg_get_segment_merge_count)());
+      if (DRD_(thread_get_memory_limit_discard_count)())
+         VG_(message)(Vg_UserMsg,
+                      "           %llu segments discarded because of the"
+                      " memory limit.\n",
+                      DRD_(thread_get_memory_limit_discard_count)());
       VG_(message)(Vg_UserMsg,
                    "segmnt cr: %llu mutex, %llu rwlock, %llu semaphore and"
                    " %llu barrier.\n",
@@ -813,6 +836,15 @@ static void DRD_(fini)(Int exitcode)
                    " and %llu level two bitmaps were allocated.\n",
                    DRD_(bm_get_bitmap_creation_count)(),
                    DRD_(bm_get_bitmap2_creation_count)());
+      VG_(message)(Vg_UserMsg,
+                   "           peak level two bitmap memory: %llu KB.\n",
+                   DRD_(bm_get_max_bitmap2_memory)() >> 10);
+      VG_(message)(Vg_UserMsg,
+                   "           %llu bitmap comparisons skipped because of"
+                   " disjoint summaries.\n",
+                   DRD_(bm_get_summary_reject_count)());
+      if (DRD_(g_race_backend) == eRaceBackendShadow)
+         DRD_(shadow_print_stats)();
       VG_(message)(Vg_UserMsg,
                    "    mutex: %llu non-recursive lock/unlock events.\n",
                    DRD_(get_mutex_lock_count)());
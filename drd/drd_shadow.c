@@ -0,0 +1,450 @@
+/*
+  This file is part of drd, a thread error detector.
+
+  Copyright (C) 2006-2020 Bart Van Assche <bvanassche@acm.org>.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+  The GNU General Public License is contained in the file COPYING.
+*/
+
+
+/*
+ * Shadow memory based data race detection.
+ *
+ * Instead of intersecting the bitmap of the running segment with the
+ * conflict set, for every aligned eight-byte granule of client memory a few
+ * shadow cells are kept. Each shadow cell holds the epoch of a recent access
+ * -- the ID of the thread that performed the access together with the value
+ * of that thread's own component of its vector clock -- the bytes of the
+ * granule that were accessed and whether or not the access was a store.
+ * Since every segment of a thread increments the thread's own vector clock
+ * component, and since the segment of a releasing thread is always ended by
+ * the release operation, an access with epoch (t, c) happens before the
+ * running thread u if and only if c <= VC(u)[t]. This allows to check each
+ * access in constant time. See also Cormac Flanagan and Stephen N. Freund,
+ * FastTrack: Efficient and Precise Dynamic Race Detection, PLDI 2009.
+ *
+ * When all cells of a granule are in use, a cell of another thread that is
+ * ordered before the current access is overwritten, or the current access is
+ * folded into an older cell of the same thread, or one of the cells is
+ * overwritten round-robin. Hence this algorithm may miss races that the
+ * bitmap algorithm would have reported, but it never reports a race that the
+ * bitmap algorithm would not report.
+ *
+ * Shadow cells are allocated in chunks covering 2**SHADOW_CHUNK_BITS bytes of
+ * client memory. A chunk is freed when the client stops using all of the
+ * memory it covers, e.g. when that memory is unmapped or freed.
+ */
+
+
+#include "drd_shadow.h"
+#include "drd_thread.h"
+#include "drd_vc.h"
+#include "pub_tool_basics.h"      // Addr, SizeT
+#include "pub_tool_libcassert.h"  // tl_assert()
+#include "pub_tool_libcbase.h"    // VG_(memset)()
+#include "pub_tool_libcprint.h"   // VG_(message)()
+#include "pub_tool_mallocfree.h"  // VG_(malloc), VG_(free)
+#include "pub_tool_oset.h"
+
+
+/* Local constants. */
+
+#define SHADOW_GRANULE_BITS      3
+#define SHADOW_GRANULE_SIZE      (1UL << SHADOW_GRANULE_BITS)
+#define SHADOW_GRANULE_MASK      (SHADOW_GRANULE_SIZE - 1)
+#define SHADOW_CELLS             4
+#define SHADOW_CHUNK_BITS        12
+#define SHADOW_CHUNK_GRANULES \
+   (1U << (SHADOW_CHUNK_BITS - SHADOW_GRANULE_BITS))
+#define SHADOW_CACHE_BITS        10
+#define SHADOW_CACHE_SIZE        (1U << SHADOW_CACHE_BITS)
+
+
+/* Local type definitions. */
+
+/** Information about one access. A cell with clock zero is unused. */
+typedef struct {
+   UInt   clock;    /**< Vector clock component of thread tid. */
+   UShort tid;      /**< DRD thread ID of the accessing thread. */
+   UChar  mask;     /**< Bytes of the granule that have been accessed. */
+   UChar  is_store; /**< Whether the access was a store. */
+} ShadowCell;
+
+/** Shadow memory for 2**SHADOW_CHUNK_BITS bytes of client memory. */
+struct shadow_chunk {
+   UWord      addr;  /**< Client address >> SHADOW_CHUNK_BITS. Must be first. */
+   ShadowCell cell[SHADOW_CHUNK_GRANULES][SHADOW_CELLS];
+};
+
+
+/* Local variables. */
+
+RaceBackendT DRD_(g_race_backend) = eRaceBackendBitmap;
+
+static OSet*                s_chunks;
+static struct shadow_chunk* s_chunk_cache[SHADOW_CACHE_SIZE];
+/* Vector clock of the running thread in dense form. */
+static UInt*                s_vc;
+/* Minimum of the vector clocks of all threads in dense form. */
+static UInt*                s_vc_min;
+static const VectorClock*   s_vc_cached;
+static ULong                s_vc_cached_sum;
+static unsigned             s_vc_cached_size;
+static DrdThreadId          s_vc_cached_tid = DRD_INVALID_THREADID;
+static unsigned             s_evict_next;
+static ULong                s_access_count;
+static ULong                s_same_epoch_count;
+static ULong                s_fold_count;
+static ULong                s_eviction_count;
+static ULong                s_vc_refresh_count;
+static ULong                s_chunk_count;
+static ULong                s_chunk_free_count;
+static ULong                s_chunk_live_count;
+static ULong                s_chunk_max_live_count;
+
+
+/* Function definitions. */
+
+void DRD_(shadow_init)(void)
+{
+   tl_assert(!s_chunks);
+   tl_assert(DRD_N_THREADS <= 0xffff);
+
+   s_chunks = VG_(OSetGen_Create)(0, 0, VG_(malloc), "drd.shadow.chunks",
+                                  VG_(free));
+   s_vc = VG_(malloc)("drd.shadow.vc", DRD_N_THREADS * sizeof(s_vc[0]));
+   VG_(memset)(s_vc, 0, DRD_N_THREADS * sizeof(s_vc[0]));
+   s_vc_min = VG_(malloc)("drd.shadow.vc_min",
+                          DRD_N_THREADS * sizeof(s_vc_min[0]));
+   VG_(memset)(s_vc_min, 0, DRD_N_THREADS * sizeof(s_vc_min[0]));
+}
+
+/**
+ * Called with the minimum of the vector clocks of all threads each time
+ * ordered segments are discarded. Shadow cells with an epoch that is ordered
+ * before this vector clock are released when they are encountered next.
+ */
+void DRD_(shadow_set_min_vc)(const VectorClock* const vc_min)
+{
+   unsigned i;
+
+   VG_(memset)(s_vc_min, 0, DRD_N_THREADS * sizeof(s_vc_min[0]));
+   for (i = 0; i < vc_min->size; i++)
+      s_vc_min[vc_min->vc[i].threadid] = vc_min->vc[i].count;
+}
+
+/**
+ * Force the dense copy of the vector clock of the running thread to be
+ * recomputed before it is used again. Must be called after a context switch
+ * and whenever the vector clock of the running thread changes.
+ */
+void DRD_(shadow_invalidate_vc_cache)(void)
+{
+   s_vc_cached = NULL;
+}
+
+/**
+ * Make sure that s_vc[] holds the vector clock of the running thread. The
+ * counter sum and the size of that vector clock serve as a cheap check
+ * whether the vector clock changed in place since the last call.
+ */
+static __inline__
+void shadow_refresh_vc(void)
+{
+   const DrdThreadId tid = DRD_(thread_get_running_tid)();
+   const VectorClock* const vc = DRD_(thread_get_vc)(tid);
+   unsigned i;
+
+   if (LIKELY(vc == s_vc_cached && tid == s_vc_cached_tid
+              && vc->sum == s_vc_cached_sum && vc->size == s_vc_cached_size))
+      return;
+
+   s_vc_refresh_count++;
+   VG_(memset)(s_vc, 0, DRD_N_THREADS * sizeof(s_vc[0]));
+   for (i = 0; i < vc->size; i++)
+      s_vc[vc->vc[i].threadid] = vc->vc[i].count;
+   s_vc_cached      = vc;
+   s_vc_cached_sum  = vc->sum;
+   s_vc_cached_size = vc->size;
+   s_vc_cached_tid  = tid;
+   tl_assert(s_vc[tid] > 0);
+}
+
+/** Look up or create the shadow memory chunk for client address a. */
+static __inline__
+struct shadow_chunk* shadow_chunk_lookup_or_insert(const Addr a)
+{
+   const UWord key = a >> SHADOW_CHUNK_BITS;
+   struct shadow_chunk** const cache
+      = &s_chunk_cache[key & (SHADOW_CACHE_SIZE - 1)];
+   struct shadow_chunk* chunk;
+
+   if (LIKELY(*cache && (*cache)->addr == key))
+      return *cache;
+
+   chunk = VG_(OSetGen_Lookup)(s_chunks, &key);
+   if (!chunk)
+   {
+      chunk = VG_(OSetGen_AllocNode)(s_chunks, sizeof(*chunk));
+      VG_(memset)(chunk, 0, sizeof(*chunk));
+      chunk->addr = key;
+      VG_(OSetGen_Insert)(s_chunks, chunk);
+      s_chunk_count++;
+      if (++s_chunk_live_count > s_chunk_max_live_count)
+         s_chunk_max_live_count = s_chunk_live_count;
+   }
+   *cache = chunk;
+   return chunk;
+}
+
+/**
+ * Check an access of the bytes 'mask' of one granule by the running thread
+ * against the shadow cells of that granule and record the access.
+ */
+static __inline__
+Bool shadow_granule_access(ShadowCell* const cells, const UChar mask,
+                           const Bool is_store)
+{
+   const DrdThreadId tid = s_vc_cached_tid;
+   const UInt clock = s_vc[tid];
+   Bool conflict = False;
+   int free_cell = -1;
+   int merge_cell = -1;
+   int own_cell = -1;
+   int ordered_cell = -1;
+   Bool covered = False;
+   int i;
+
+   for (i = 0; i < SHADOW_CELLS; i++)
+   {
+      ShadowCell* const c = &cells[i];
+
+      /* Accesses that are ordered before all threads can no longer race. */
+      if (c->clock != 0 && c->clock <= s_vc_min[c->tid])
+         c->clock = 0;
+
+      if (c->clock == 0)
+      {
+         if (free_cell < 0)
+            free_cell = i;
+      }
+      else if (c->tid == tid || c->clock <= s_vc[c->tid])
+      {
+         /*
+          * The access in c happens before the current access. If c was
+          * performed in the same epoch and covers the current access, there
+          * is no need to record the current access. Otherwise, for the bytes
+          * accessed now, any future access that races with c also races with
+          * the current access, so these bytes can be removed from c.
+          */
+         if (c->clock == clock && c->tid == tid && (mask & ~c->mask) == 0
+             && c->is_store >= is_store)
+         {
+            covered = True;
+         }
+         else if (c->clock == clock && c->tid == tid
+                  && c->is_store == is_store)
+         {
+            merge_cell = i;
+         }
+         else if (is_store || !c->is_store)
+         {
+            c->mask &= ~mask;
+            if (c->mask == 0)
+            {
+               c->clock = 0;
+               if (free_cell < 0)
+                  free_cell = i;
+            }
+            else if (c->tid == tid && c->is_store == is_store)
+            {
+               own_cell = i;
+            }
+            else if (c->tid != tid)
+            {
+               ordered_cell = i;
+            }
+         }
+         else if (c->tid != tid)
+         {
+            ordered_cell = i;
+         }
+      }
+      else if ((c->mask & mask) && (is_store || c->is_store))
+      {
+         conflict = True;
+      }
+   }
+
+   if (covered)
+   {
+      s_same_epoch_count++;
+      return conflict;
+   }
+
+   /*
+    * Accesses of the same type by the same thread in the same epoch are
+    * recorded in a single cell, such that accessing adjacent bytes does not
+    * evict the accesses of other threads.
+    */
+   if (merge_cell >= 0)
+   {
+      cells[merge_cell].mask |= mask;
+      return conflict;
+   }
+
+   /*
+    * If all cells are in use, first evict an access of another thread that
+    * is ordered before the current access, since that access has most
+    * likely been observed by the other threads too. Otherwise fold the
+    * current access into an older cell of the same thread. Keeping the older
+    * epoch may hide races on the bytes accessed now but cannot cause false
+    * positives.
+    */
+   if (free_cell < 0 && ordered_cell >= 0)
+   {
+      free_cell = ordered_cell;
+      s_eviction_count++;
+   }
+   else if (free_cell < 0 && own_cell >= 0)
+   {
+      cells[own_cell].mask |= mask;
+      s_fold_count++;
+      return conflict;
+   }
+
+   if (free_cell < 0)
+   {
+      free_cell = s_evict_next++ % SHADOW_CELLS;
+      s_eviction_count++;
+   }
+   cells[free_cell].clock    = clock;
+   cells[free_cell].tid      = tid;
+   cells[free_cell].mask     = mask;
+   cells[free_cell].is_store = is_store;
+
+   return conflict;
+}
+
+/**
+ * Record an access of the running thread to the address range [ a1, a2 [
+ * and return whether it races with a previously recorded access.
+ */
+Bool DRD_(shadow_access_triggers_conflict)(const Addr a1, const Addr a2,
+                                           const BmAccessTypeT access_type)
+{
+   const Bool is_store = access_type == eStore;
+   Bool conflict = False;
+   Addr a;
+
+   tl_assert(access_type == eLoad || access_type == eStore);
+
+   s_access_count++;
+   shadow_refresh_vc();
+
+   for (a = a1; a < a2; )
+   {
+      struct shadow_chunk* const chunk = shadow_chunk_lookup_or_insert(a);
+      const unsigned g = (a >> SHADOW_GRANULE_BITS)
+         & (SHADOW_CHUNK_GRANULES - 1);
+      const UWord offset = a & SHADOW_GRANULE_MASK;
+      const UWord len = a2 - a < SHADOW_GRANULE_SIZE - offset
+         ? a2 - a : SHADOW_GRANULE_SIZE - offset;
+      const UChar mask = ((1U << len) - 1) << offset;
+
+      conflict |= shadow_granule_access(chunk->cell[g], mask, is_store);
+      a += len;
+   }
+
+   return conflict;
+}
+
+/**
+ * Forget all accesses recorded for the address range [ a1, a2 [. Chunks that
+ * lie entirely inside that range are freed.
+ */
+void DRD_(shadow_clear)(const Addr a1, const Addr a2)
+{
+   UWord key = a1 >> SHADOW_CHUNK_BITS;
+   struct shadow_chunk* chunk;
+
+   if (!s_chunks || a1 >= a2)
+      return;
+
+   VG_(OSetGen_ResetIterAt)(s_chunks, &key);
+   while ((chunk = VG_(OSetGen_Next)(s_chunks)) != NULL)
+   {
+      const Addr chunk_start = chunk->addr << SHADOW_CHUNK_BITS;
+      const Addr chunk_end = chunk_start + (1UL << SHADOW_CHUNK_BITS);
+      const Addr c1 = a1 > chunk_start ? a1 : chunk_start;
+      Addr a;
+
+      if (chunk_start >= a2)
+         break;
+
+      if (a1 <= chunk_start && chunk_end <= a2)
+      {
+         struct shadow_chunk** const cache
+            = &s_chunk_cache[chunk->addr & (SHADOW_CACHE_SIZE - 1)];
+
+         /* Removing a node invalidates the iterator, so restart after it. */
+         key = chunk->addr + 1;
+         if (*cache == chunk)
+            *cache = NULL;
+         VG_(OSetGen_Remove)(s_chunks, &chunk->addr);
+         VG_(OSetGen_FreeNode)(s_chunks, chunk);
+         s_chunk_live_count--;
+         s_chunk_free_count++;
+         if (chunk_end == 0 || chunk_end >= a2)
+            break;
+         VG_(OSetGen_ResetIterAt)(s_chunks, &key);
+         continue;
+      }
+
+      for (a = c1; a < a2 && (a >> SHADOW_CHUNK_BITS) == chunk->addr; )
+      {
+         ShadowCell* const cells
+            = chunk->cell[(a >> SHADOW_GRANULE_BITS)
+                          & (SHADOW_CHUNK_GRANULES - 1)];
+         const UWord offset = a & SHADOW_GRANULE_MASK;
+         const UWord len = a2 - a < SHADOW_GRANULE_SIZE - offset
+            ? a2 - a : SHADOW_GRANULE_SIZE - offset;
+         const UChar mask = ((1U << len) - 1) << offset;
+         int i;
+
+         for (i = 0; i < SHADOW_CELLS; i++)
+         {
+            cells[i].mask &= ~mask;
+            if (cells[i].mask == 0)
+               cells[i].clock = 0;
+         }
+         a += len;
+      }
+   }
+}
+
+void DRD_(shadow_print_stats)(void)
+{
+   VG_(message)(Vg_UserMsg,
+                "   shadow: %llu accesses, %llu in the same epoch,"
+                " %llu folded and %llu evictions,\n", s_access_count,
+                s_same_epoch_count, s_fold_count, s_eviction_count);
+   VG_(message)(Vg_UserMsg,
+                "           %llu vector clock refreshes, %llu chunks allocated"
+                " and %llu freed (peak %llu KB).\n", s_vc_refresh_count,
+                s_chunk_count, s_chunk_free_count,
+                s_chunk_max_live_count * sizeof(struct shadow_chunk) >> 10);
+}
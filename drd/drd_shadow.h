@@ -0,0 +1,54 @@
+/*
+  This file is part of drd, a thread error detector.
+
+  Copyright (C) 2006-2020 Bart Van Assche <bvanassche@acm.org>.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 2 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+  The GNU General Public License is contained in the file COPYING.
+*/
+
+
+#ifndef __DRD_SHADOW_H
+#define __DRD_SHADOW_H
+
+
+#include "drd_basics.h"      /* DRD_() */
+#include "drd_vc.h"          /* VectorClock */
+#include "pub_drd_bitmap.h"  /* BmAccessTypeT */
+#include "pub_tool_basics.h" /* Addr */
+
+
+/* Algorithm used for deciding whether a memory access triggers a race. */
+typedef enum {
+   /* Intersect the segment bitmaps with the conflict set. */
+   eRaceBackendBitmap,
+   /* Compare per-address access epochs kept in shadow memory. */
+   eRaceBackendShadow,
+} RaceBackendT;
+
+
+extern RaceBackendT DRD_(g_race_backend);
+
+
+void DRD_(shadow_init)(void);
+void DRD_(shadow_invalidate_vc_cache)(void);
+void DRD_(shadow_set_min_vc)(const VectorClock* const vc_min);
+Bool DRD_(shadow_access_triggers_conflict)(const Addr a1, const Addr a2,
+                                           const BmAccessTypeT access_type);
+void DRD_(shadow_clear)(const Addr a1, const Addr a2);
+void DRD_(shadow_print_stats)(void);
+
+
+#endif /* __DRD_SHADOW_H */
@@ -27,6 +27,7 @@
 #include "drd_mutex.h"
 #include "drd_segment.h"
 #include "drd_semaphore.h"
+#include "drd_shadow.h"
 #include "drd_suppression.h"
 #include "drd_thread.h"
 #include "pub_tool_vki.h"
@@ -48,12 +49,14 @@ static void thread_discard_segment(const DrdThreadId tid, Segment* const sg);
 static void thread_compute_conflict_set(struct bitmap** conflict_set,
                                         const DrdThreadId tid);
 static Bool thread_conflict_set_up_to_date(const DrdThreadId tid);
+static void thread_enforce_segment_memory_limit(void);
 
 
 /* Local variables. */
 
 static ULong    s_context_switch_count;
 static ULong    s_discard_ordered_segments_count;
+static ULong    s_memory_limit_discard_count;
 static ULong    s_compute_conflict_set_count;
 static ULong    s_update_conflict_set_count;
 static ULong    s_update_conflict_set_new_sg_count;
@@ -73,6 +76,8 @@ static Bool     s_trace_fork_join = False;
 static Bool     s_segment_merging = True;
 static Bool     s_new_segments_since_last_merge;
 static int      s_segment_merge_interval = 10;
+static ULong    s_segment_memory_limit;
+static Bool     s_segment_memory_limit_reached;
 static unsigned s_join_list_vol = 10;
 static unsigned s_deletion_head;
 static unsigned s_deletion_tail;
@@ -138,6 +143,15 @@ void DRD_(thread_set_segment_merge_interval)(const int i)
    s_segment_merge_interval = i;
 }
 
+/**
+ * Set the maximum number of bytes that may be allocated for segment bitmaps
+ * before old segments are discarded. Zero means that there is no limit.
+ */
+void DRD_(thread_set_segment_memory_limit)(const ULong bytes)
+{
+   s_segment_memory_limit = bytes;
+}
+
 void DRD_(thread_set_join_list_vol)(const int jlv)
 {
    s_join_list_vol = jlv;
@@ -998,6 +1012,9 @@ static void thread_discard_ordered_segments(void)
       DRD_(vc_cleanup)(&thread_vc_max);
    }
 
+   if (DRD_(g_race_backend) == eRaceBackendShadow)
+      DRD_(shadow_set_min_vc)(&thread_vc_min);
+
    for (i = 0; i < DRD_N_THREADS; i++) {
       Segment* sg;
       Segment* sg_next;
@@ -1130,6 +1147,64 @@ static void thread_merge_segments(void)
    }
 }
 
+/**
+ * Keep the memory allocated for segment bitmaps below the limit specified
+ * via --segment-memory-limit. First discard ordered segments and merge
+ * equivalent segments. If that is not sufficient, discard the oldest segment
+ * of every thread except its latest segment until the memory usage drops
+ * below the limit. Discarding a segment can make DRD miss data races but
+ * cannot cause false positives, provided that the conflict set is recomputed
+ * afterwards.
+ */
+static void thread_enforce_segment_memory_limit(void)
+{
+   unsigned i;
+   Bool discarded = False;
+
+   if (s_segment_memory_limit == 0
+       || DRD_(bm_get_bitmap2_memory)() <= s_segment_memory_limit)
+      return;
+
+   thread_discard_ordered_segments();
+   thread_merge_segments();
+
+   while (DRD_(bm_get_bitmap2_memory)() > s_segment_memory_limit)
+   {
+      Bool progress = False;
+
+      for (i = 0; i < DRD_N_THREADS; i++)
+      {
+         Segment* const sg = DRD_(g_threadinfo)[i].sg_first;
+
+         if (sg && sg->thr_next)
+         {
+            thread_discard_segment(i, sg);
+            s_memory_limit_discard_count++;
+            progress = True;
+         }
+      }
+      if (!progress)
+         break;
+      discarded = True;
+   }
+
+   if (!discarded)
+      return;
+
+   if (!s_segment_memory_limit_reached)
+   {
+      s_segment_memory_limit_reached = True;
+      VG_(message)(Vg_UserMsg,
+                   "Segment memory limit of %llu MB reached -- discarding old"
+                   " segments. Some data races may not be reported.\n",
+                   s_segment_memory_limit >> 20);
+   }
+
+   if (DRD_(g_drd_running_tid) != DRD_INVALID_THREADID)
+      thread_compute_conflict_set(&DRD_(g_conflict_set),
+                                  DRD_(g_drd_running_tid));
+}
+
 /**
  * Create a new segment for the specified thread, and discard any segments
  * that cannot cause races anymore.
@@ -1160,6 +1235,7 @@ void DRD_(thread_new_segment)(const DrdThreadId tid)
       thread_discard_ordered_segments();
       thread_merge_segments();
    }
+   thread_enforce_segment_memory_limit();
 }
 
 /** Call this function after thread 'joiner' joined thread 'joinee'. */
@@ -1273,6 +1349,7 @@ void DRD_(thread_new_segment_and_combine_vc)(DrdThreadId tid, const Segment* sg)
       thread_discard_ordered_segments();
       thread_merge_segments();
    }
+   thread_enforce_segment_memory_limit();
 }
 
 /**
@@ -1288,6 +1365,9 @@ void DRD_(thread_stop_using_mem)(const Addr a1, const Addr a2)
       DRD_(bm_clear)(DRD_(sg_bm)(p), a1, a2);
 
    DRD_(bm_clear)(DRD_(g_conflict_set), a1, a2);
+
+   if (DRD_(g_race_backend) == eRaceBackendShadow)
+      DRD_(shadow_clear)(a1, a2);
 }
 
 /** Specify whether memory loads should be recorded. */
@@ -1472,6 +1552,14 @@ static void thread_compute_conflict_set(struct bitmap** conflict_set,
              && tid != DRD_INVALID_THREADID);
    tl_assert(tid == DRD_(g_drd_running_tid));
 
+   if (DRD_(g_race_backend) == eRaceBackendShadow) {
+      /* The shadow memory backend does not need a conflict set. */
+      DRD_(shadow_invalidate_vc_cache)();
+      if (!*conflict_set)
+         *conflict_set = DRD_(bm_new)();
+      return;
+   }
+
    s_compute_conflict_set_count++;
    s_conflict_set_bitmap_creation_count
       -= DRD_(bm_get_bitmap_creation_count)();
@@ -1571,6 +1659,11 @@ void DRD_(thread_update_conflict_set)(const DrdThreadId tid,
    tl_assert(tid == DRD_(g_drd_running_tid));
    tl_assert(DRD_(g_conflict_set));
 
+   if (DRD_(g_race_backend) == eRaceBackendShadow) {
+      DRD_(shadow_invalidate_vc_cache)();
+      return;
+   }
+
    if (s_trace_conflict_set) {
       HChar* str;
 
@@ -1680,6 +1773,15 @@ ULong DRD_(thread_get_discard_ordered_segments_count)(void)
    return s_discard_ordered_segments_count;
 }
 
+/**
+ * Report the number of segments that have been discarded because the
+ * segment memory limit was exceeded.
+ */
+ULong DRD_(thread_get_memory_limit_discard_count)(void)
+{
+   return s_memory_limit_discard_count;
+}
+
 /** Return how many times the conflict set has been updated entirely. */
 ULong DRD_(thread_get_compute_conflict_set_count)()
 {
@@ -138,6 +138,7 @@ void DRD_(thread_set_trace_fork_join)(const Bool t);
 void DRD_(thread_set_segment_merging)(const Bool m);
 int DRD_(thread_get_segment_merge_interval)(void);
 void DRD_(thread_set_segment_merge_interval)(const int i);
+void DRD_(thread_set_segment_memory_limit)(const ULong bytes);
 void DRD_(thread_set_join_list_vol)(const int jlv);
 
 void DRD_(thread_init)(void);
@@ -206,6 +207,7 @@ void DRD_(thread_report_conflicting_segments)(const DrdThreadId tid,
 ULong DRD_(thread_get_context_switch_count)(void);
 ULong DRD_(thread_get_report_races_count)(void);
 ULong DRD_(thread_get_discard_ordered_segments_count)(void);
+ULong DRD_(thread_get_memory_limit_discard_count)(void);
 ULong DRD_(thread_get_compute_conflict_set_count)(void);
 ULong DRD_(thread_get_update_conflict_set_count)(void);
 ULong DRD_(thread_get_update_conflict_set_new_sg_count)(void);
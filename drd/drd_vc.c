@@ -32,6 +32,7 @@
 
 static
 void DRD_(vc_reserve)(VectorClock* const vc, const unsigned new_capacity);
+static ULong DRD_(vc_sum)(const VectorClock* const vc);
 
 
 /* Function definitions. */
@@ -47,6 +48,7 @@ void DRD_(vc_init)(VectorClock* const vc,
 {
    tl_assert(vc);
    vc->size = 0;
+   vc->sum = 0;
    vc->capacity = 0;
    vc->vc = 0;
    DRD_(vc_reserve)(vc, size);
@@ -55,6 +57,7 @@ void DRD_(vc_init)(VectorClock* const vc,
    {
       VG_(memcpy)(vc->vc, vcelem, size * sizeof(vcelem[0]));
       vc->size = size;
+      vc->sum = DRD_(vc_sum)(vc);
    }
 #ifdef ENABLE_DRD_CONSISTENCY_CHECKS
    DRD_(vc_check)(vc);
@@ -65,6 +68,8 @@ void DRD_(vc_init)(VectorClock* const vc,
 void DRD_(vc_cleanup)(VectorClock* const vc)
 {
    DRD_(vc_reserve)(vc, 0);
+   vc->size = 0;
+   vc->sum = 0;
 }
 
 /** Copy constructor -- initializes *new. */
@@ -92,6 +97,7 @@ void DRD_(vc_increment)(VectorClock* const vc, DrdThreadId const tid)
          vc->vc[i].count++;
          // Check for integer overflow.
          tl_assert(oldcount < vc->vc[i].count);
+         vc->sum++;
          return;
       }
    }
@@ -155,6 +161,7 @@ void DRD_(vc_min)(VectorClock* const result, const VectorClock* const rhs)
          }
       }
    }
+   result->sum = DRD_(vc_sum)(result);
    DRD_(vc_check)(result);
 }
 
@@ -207,6 +214,7 @@ void DRD_(vc_combine)(VectorClock* const result, const VectorClock* const rhs)
       {
          result->size++;
          result->vc[i] = rhs->vc[j];
+         result->sum += rhs->vc[j].count;
       }
       /* If clock rhs->vc[j] is not in *result, insert it. */
       else if (result->vc[i].threadid > rhs->vc[j].threadid)
@@ -218,6 +226,7 @@ void DRD_(vc_combine)(VectorClock* const result, const VectorClock* const rhs)
          }
          result->size++;
          result->vc[i] = rhs->vc[j];
+         result->sum += rhs->vc[j].count;
       }
       /* Otherwise, both *result and *rhs have a clock for thread            */
       /* result->vc[i].threadid == rhs->vc[j].threadid. Compute the maximum. */
@@ -226,6 +235,7 @@ void DRD_(vc_combine)(VectorClock* const result, const VectorClock* const rhs)
          tl_assert(result->vc[i].threadid == rhs->vc[j].threadid);
          if (rhs->vc[j].count > result->vc[i].count)
          {
+            result->sum += rhs->vc[j].count - result->vc[i].count;
             result->vc[i].count = rhs->vc[j].count;
          }
       }
@@ -290,6 +300,7 @@ HChar* DRD_(vc_aprint)(const VectorClock* const vc)
  * satisfied:
  * - size <= capacity.
  * - Vector clock elements are stored in thread ID order.
+ * - sum equals the sum of all counters.
  *
  * If one of these conditions is not met, an assertion failure is triggered.
  */
@@ -301,6 +312,20 @@ void DRD_(vc_check)(const VectorClock* const vc)
 
    for (i = 1; i < vc->size; i++)
       tl_assert(vc->vc[i-1].threadid < vc->vc[i].threadid);
+#ifdef ENABLE_DRD_CONSISTENCY_CHECKS
+   tl_assert(vc->sum == DRD_(vc_sum)(vc));
+#endif
+}
+
+/** Compute the sum of all counters of vector clock 'vc'. */
+static ULong DRD_(vc_sum)(const VectorClock* const vc)
+{
+   unsigned i;
+   ULong sum = 0;
+
+   for (i = 0; i < vc->size; i++)
+      sum += vc->vc[i].count;
+   return sum;
 }
 
 /**
@@ -29,6 +29,8 @@
  * - One counter per thread.
  * - A vector clock is implemented as multiple pairs of (thread id, counter).
  * - Pairs are stored in an array sorted by thread id.
+ * - The sum of all counters is cached such that most vc_lte() calls that
+ *   return False can do so without looking at the individual counters.
  *
  * Semantics:
  * - Each time a thread performs an action that implies an ordering between
@@ -63,6 +65,7 @@ typedef struct
 {
    unsigned capacity; /**< number of elements allocated for array vc. */
    unsigned size;     /**< number of elements used of array vc. */
+   ULong    sum;      /**< sum of the counters in array vc. */
    VCElem*  vc;       /**< vector clock elements. */
    VCElem   preallocated[VC_PREALLOCATED];
 } VectorClock;
@@ -102,6 +105,18 @@ Bool DRD_(vc_lte)(const VectorClock* const vc1, const VectorClock* const vc2)
    unsigned i;
    unsigned j = 0;
 
+   /*
+    * If vc1 <= vc2 then every thread id in vc1 also occurs in vc2 and the
+    * counters in vc1 are not larger than the corresponding counters in vc2.
+    * Hence vc1 can only be less than or equal to vc2 if neither its size nor
+    * the sum of its counters exceeds that of vc2.
+    */
+   if (vc1->size > vc2->size || vc1->sum > vc2->sum)
+      return False;
+   if (vc1->size > 0
+       && vc1->vc[vc1->size - 1].threadid > vc2->vc[vc2->size - 1].threadid)
+      return False;
+
    for (i = 0; i < vc1->size; i++)
    {
       while (j < vc2->size && vc2->vc[j].threadid < vc1->vc[i].threadid)
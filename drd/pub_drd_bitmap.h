@@ -63,11 +63,21 @@ struct bm_cache_elem
 
 #define DRD_BITMAP_N_CACHE_ELEM 4
 
+/* Number of UWords in the summary of a bitmap. */
+#define DRD_BITMAP_SUMMARY_UWORDS 4
+
 /* Complete bitmap. */
 struct bitmap
 {
    struct bm_cache_elem cache[DRD_BITMAP_N_CACHE_ELEM];
    OSet*                oset;
+   /*
+    * One bit per hash bucket of second level bitmap addresses. A bit is set
+    * when a second level bitmap is inserted into oset and is only cleared
+    * again by bm_init(), so if two bitmaps have disjoint summaries they can't
+    * have any address in common.
+    */
+   UWord                summary[DRD_BITMAP_SUMMARY_UWORDS];
 };
 
 
@@ -146,6 +156,9 @@ void DRD_(bm_report_races)(ThreadId const tid1, ThreadId const tid2,
 void DRD_(bm_print)(struct bitmap* bm);
 ULong DRD_(bm_get_bitmap_creation_count)(void);
 ULong DRD_(bm_get_bitmap2_creation_count)(void);
+ULong DRD_(bm_get_bitmap2_memory)(void);
+ULong DRD_(bm_get_max_bitmap2_memory)(void);
 ULong DRD_(bm_get_bitmap2_merge_count)(void);
+ULong DRD_(bm_get_summary_reject_count)(void);
 
 #endif /* __PUB_DRD_BITMAP_H */
@@ -59,7 +59,7 @@ UInt VG_(printf)(const HChar *format, ...)
 UInt VG_(message)(VgMsgKind kind, const HChar* format, ...)
 { UInt ret; va_list vargs; va_start(vargs, format); ret = vprintf(format, vargs); va_end(vargs); printf("\n"); return ret; }
 Bool DRD_(is_suppressed)(const Addr a1, const Addr a2)
-{ assert(0); }
+{ return False; }
 void VG_(vcbprintf)(void(*char_sink)(HChar, void* opaque),
                     void* opaque,
                     const HChar* format, va_list vargs)
@@ -319,6 +319,65 @@ void bm_test3(const int outer_loop_step, const int inner_loop_step)
   DRD_(bm_delete)(bm1);
 }
 
+/**
+ * Test whether the word-at-a-time conflict and race detection functions
+ * agree with a bit-by-bit evaluation, including for bitmaps whose summaries
+ * do not overlap.
+ */
+void bm_test4(void)
+{
+  struct bitmap* bm1;
+  struct bitmap* bm2;
+  const Addr lb = make_address(3, 0) - 2 * BITS_PER_UWORD;
+  const Addr ub = make_address(3, 0) + 2 * BITS_PER_UWORD;
+  Addr a, b;
+
+  bm1 = DRD_(bm_new)();
+  bm2 = DRD_(bm_new)();
+
+  assert(! DRD_(bm_has_races)(bm1, bm2));
+
+  DRD_(bm_access_range_load)(bm1, lb + 3, lb + 5);
+  DRD_(bm_access_range_store)(bm1, ub - 7, ub - 6);
+  for (a = lb; a < ub; a += ADDR_GRANULARITY)
+  {
+    for (b = a + ADDR_GRANULARITY; b <= ub; b += ADDR_GRANULARITY)
+    {
+      Bool has_r = False, has_w = False;
+      Addr c;
+
+      for (c = a; c < b; c++)
+      {
+        has_r |= DRD_(bm_has_1)(bm1, c, eLoad);
+        has_w |= DRD_(bm_has_1)(bm1, c, eStore);
+      }
+      assert(DRD_(bm_load_has_conflict_with)(bm1, a, b) == has_w);
+      assert(DRD_(bm_store_has_conflict_with)(bm1, a, b) == (has_r | has_w));
+    }
+  }
+
+  /* Reads only: no race. */
+  DRD_(bm_access_range_load)(bm2, lb + 3, lb + 5);
+  assert(! DRD_(bm_has_races)(bm1, bm2));
+  /* Write by bm2 to an address read by bm1. */
+  DRD_(bm_access_store_1)(bm2, lb + 4);
+  assert(DRD_(bm_has_races)(bm1, bm2));
+  assert(DRD_(bm_has_races)(bm2, bm1));
+  DRD_(bm_delete)(bm2);
+
+  /* Bitmaps with disjoint summaries. */
+  bm2 = DRD_(bm_new)();
+  DRD_(bm_access_store_1)(bm2, make_address(1000, 0));
+  assert(! DRD_(bm_has_races)(bm1, bm2));
+  assert(! DRD_(bm_store_has_conflict_with)(bm1, make_address(1000, 0),
+                                            make_address(1000, 1)));
+  DRD_(bm_merge2)(bm2, bm1);
+  assert(DRD_(bm_has_races)(bm1, bm2));
+
+  DRD_(bm_delete)(bm2);
+  DRD_(bm_delete)(bm1);
+}
+
 int main(int argc, char** argv)
 {
   int outer_loop_step = ADDR_GRANULARITY;
@@ -352,6 +411,7 @@ int main(int argc, char** argv)
   bm_test1();
   bm_test2();
   bm_test3(outer_loop_step, inner_loop_step);
+  bm_test4();
   DRD_(bm_module_cleanup)();
 
   fprintf(stderr, "End of DRD BM unit test.\n");
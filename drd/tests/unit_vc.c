@@ -51,6 +51,72 @@ Bool DRD_(is_suppressed)(const Addr a1, const Addr a2)
 
 /* Actual unit test */
 
+/**
+ * Reference implementation of vc_lte() that does not use the cached counter
+ * sum.
+ */
+static Bool vc_lte_ref(const VectorClock* const vc1,
+                       const VectorClock* const vc2)
+{
+  unsigned i, j;
+
+  for (i = 0; i < vc1->size; i++) {
+    for (j = 0; j < vc2->size; j++)
+      if (vc2->vc[j].threadid == vc1->vc[i].threadid)
+        break;
+    if (j == vc2->size || vc1->vc[i].count > vc2->vc[j].count)
+      return False;
+  }
+  return True;
+}
+
+/** Fill vc with random counters for a random subset of four threads. */
+static void vc_random(VectorClock* const vc)
+{
+  VectorClock tmp;
+  VCElem elem;
+  DrdThreadId tid;
+
+  DRD_(vc_init)(vc, 0, 0);
+  for (tid = 1; tid <= 4; tid++) {
+    if (random() % 3 == 0)
+      continue;
+    elem.threadid = tid;
+    elem.count = random() % 4;
+    DRD_(vc_init)(&tmp, &elem, 1);
+    DRD_(vc_combine)(vc, &tmp);
+    DRD_(vc_cleanup)(&tmp);
+    if (random() % 2)
+      DRD_(vc_increment)(vc, tid);
+  }
+  DRD_(vc_check)(vc);
+  assert(vc->sum == DRD_(vc_sum)(vc));
+}
+
+/** Verify that the cached counter sum does not change the vc_lte() result. */
+static void vc_lte_test(void)
+{
+  int i;
+  VectorClock vc1, vc2, vc3;
+
+  srandom(1);
+  for (i = 0; i < 100000; i++) {
+    vc_random(&vc1);
+    vc_random(&vc2);
+    assert(DRD_(vc_lte)(&vc1, &vc2) == vc_lte_ref(&vc1, &vc2));
+    assert(DRD_(vc_lte)(&vc2, &vc1) == vc_lte_ref(&vc2, &vc1));
+    DRD_(vc_copy)(&vc3, &vc1);
+    DRD_(vc_combine)(&vc3, &vc2);
+    assert(vc3.sum == DRD_(vc_sum)(&vc3));
+    assert(DRD_(vc_lte)(&vc1, &vc3) && DRD_(vc_lte)(&vc2, &vc3));
+    DRD_(vc_min)(&vc3, &vc1);
+    assert(vc3.sum == DRD_(vc_sum)(&vc3));
+    DRD_(vc_cleanup)(&vc1);
+    DRD_(vc_cleanup)(&vc2);
+    DRD_(vc_cleanup)(&vc3);
+  }
+}
+
 static void vc_unittest(void)
 {
   int i;
@@ -106,5 +172,6 @@ static void vc_unittest(void)
 int main(int argc, char** argv)
 {
   vc_unittest();
+  vc_lte_test();
   return 0;
 }
@@ -3505,10 +3505,7 @@ void evh__HG_RTLD_BIND_CLEAR(ThreadId tid, Int flags)
 /*--- Lock acquisition order monitoring                      ---*/
 /*--------------------------------------------------------------*/
 
-/* FIXME: here are some optimisations still to do in
-          laog__pre_thread_acquires_lock.
-
-   The graph is structured so that if L1 --*--> L2 then L1 must be
+/* The graph is structured so that if L1 --*--> L2 then L1 must be
    acquired before L2.
 
    The common case is that some thread T holds (eg) L1 L2 and L3 and
@@ -3529,6 +3526,13 @@ void evh__HG_RTLD_BIND_CLEAR(ThreadId tid, Int flags)
    (2) Cache these add-edge requests and ignore them if said edges
        have already been added to laog.  Invalidate the cache any time
        any edges are deleted from laog.
+
+   Both are done by the laog_memo below.  Rather than clearing the
+   memo when the graph changes, each entry is tagged with the value
+   of laog_gen at the time it was made, and laog_gen is bumped each
+   time an edge is really added to or deleted from laog (re-adding an
+   edge which is already present does not change the graph, and so
+   does not bump it).
 */
 
 typedef
@@ -3567,6 +3571,44 @@ static Word cmp_LAOGLinkExposition ( UWord llx1W, UWord llx2W ) {
 static WordFM* laog_exposition = NULL; /* WordFM LAOGLinkExposition* NULL */
 /* end EXPOSITION ONLY */
 
+/* Memo of lock order reachability queries, see the comment at the
+   start of this section.  An entry records that, in graph generation
+   'gen', the dfs from 'src' to the lockset 'dsts' (in univ_lsets)
+   gave 'res', and whether the edges dsts --> src are known to be in
+   the graph.  univ_lsets is never garbage collected, so a 'dsts'
+   WordSetID always denotes the same lockset. */
+typedef
+   struct {
+      Lock*     src;
+      WordSetID dsts;  /* in univ_lsets */
+      Lock*     res;
+      UWord     gen;   /* 0 means unused entry */
+      Bool      edges_present;
+   }
+   LAOGMemoEnt;
+
+#define N_LAOG_MEMO 1021 /* prime */
+static LAOGMemoEnt laog_memo[N_LAOG_MEMO];
+static UWord laog_gen = 1;
+
+static UWord stats__laog_queries = 0;
+static UWord stats__laog_memo_hits = 0;
+static UWord stats__laog_edges_skipped = 0;
+static UWord stats__laog_gen_changes = 0;
+
+static inline LAOGMemoEnt* laog__memo_ent ( Lock* src, WordSetID dsts )
+{
+   UWord h = ((UWord)src >> 4) ^ ((UWord)dsts * 0x9E3779B1U);
+   return &laog_memo[h % N_LAOG_MEMO];
+}
+
+/* Called each time the set of edges in laog changes. */
+static inline void laog__graph_changed ( void )
+{
+   laog_gen++;
+   stats__laog_gen_changes++;
+}
+
 
 __attribute__((noinline))
 static void laog__init ( void )
@@ -3735,6 +3777,9 @@ static void laog__add_edge ( Lock* src, Lock* dst ) {
 
    tl_assert( (presentF && presentR) || (!presentF && !presentR) );
 
+   if (!presentF)
+      laog__graph_changed();
+
    if (!presentF && src->acquired_at && dst->acquired_at) {
       LAOGLinkExposition expo;
       /* If this edge is entering the graph, and we have acquired_at
@@ -3775,9 +3820,13 @@ static void laog__del_edge ( Lock* src, Lock* dst ) {
    keyW  = 0;
    links = NULL;
    if (VG_(lookupFM)( laog, &keyW, (UWord*)&links, (UWord)src )) {
+      WordSetID outs_new;
       tl_assert(links);
       tl_assert(keyW == (UWord)src);
-      links->outs = HG_(delFromWS)( univ_laog, links->outs, (UWord)dst );
+      outs_new = HG_(delFromWS)( univ_laog, links->outs, (UWord)dst );
+      if (outs_new != links->outs)
+         laog__graph_changed();
+      links->outs = outs_new;
    }
    /* Update the in edges for dst */
    keyW  = 0;
@@ -3950,6 +3999,7 @@ static void laog__pre_thread_acquires_lock (
    UWord*   ls_words;
    UWord    ls_size, i;
    Lock*    other;
+   LAOGMemoEnt* memo;
 
    /* It may be that 'thr' already holds 'lk' and is recursively
       relocking in.  In this case we just ignore the call. */
@@ -3963,7 +4013,20 @@ static void laog__pre_thread_acquires_lock (
       (rather than after, as we are doing here) at least one of those
       locks.
    */
-   other = laog__do_dfs_from_to(lk, thr->locksetA);
+   stats__laog_queries++;
+   memo = laog__memo_ent(lk, thr->locksetA);
+   if (memo->gen == laog_gen
+       && memo->src == lk && memo->dsts == thr->locksetA) {
+      stats__laog_memo_hits++;
+      other = memo->res;
+   } else {
+      other = laog__do_dfs_from_to(lk, thr->locksetA);
+      memo->src  = lk;
+      memo->dsts = thr->locksetA;
+      memo->res  = other;
+      memo->gen  = laog_gen;
+      memo->edges_present = False;
+   }
    if (other) {
       LAOGLinkExposition key, *found;
       /* So we managed to find a path lk --*--> other in the graph,
@@ -4048,10 +4111,24 @@ static void laog__pre_thread_acquires_lock (
    */
    tl_assert(lk->acquired_at);
    HG_(getPayloadWS)( &ls_words, &ls_size, univ_lsets, thr->locksetA );
-   for (i = 0; i < ls_size; i++) {
-      Lock* old = (Lock*)ls_words[i];
-      tl_assert(old->acquired_at);
-      laog__add_edge( old, lk );
+   if (memo->edges_present && memo->gen == laog_gen) {
+      /* Nothing changed in the graph since these edges were added. */
+      stats__laog_edges_skipped += ls_size;
+   } else {
+      for (i = 0; i < ls_size; i++) {
+         Lock* old = (Lock*)ls_words[i];
+         tl_assert(old->acquired_at);
+         laog__add_edge( old, lk );
+      }
+      /* The new edges all lead into lk from a lock of thr->locksetA.
+         As the dfs stops at the first lock of thr->locksetA it finds,
+         these edges cannot change the dfs result: the memo entry can
+         be carried over to the (maybe) new graph generation. */
+      memo->src  = lk;
+      memo->dsts = thr->locksetA;
+      memo->res  = other;
+      memo->gen  = laog_gen;
+      memo->edges_present = True;
    }
 
    /* Why "except_Locks" ?  We're here because a lock is being
@@ -4088,6 +4165,10 @@ static void laog__handle_one_lock_deletion ( Lock* lk )
    UWord preds_size, succs_size, i, j;
    UWord *preds_words, *succs_words;
 
+   /* lk might have no edges, but the memo can still refer to it, and
+      its address can be re-used for a new lock. */
+   laog__graph_changed();
+
    preds = laog__preds( lk );
    succs = laog__succs( lk );
 
@@ -5899,6 +5980,14 @@ static void hg_print_stats (void)
                   (Int)(laog ? VG_(sizeFM)( laog ) : 0));
       VG_(printf)(" LAOG exposition: %'8d map size\n",
                   (Int)(laog_exposition ? VG_(sizeFM)( laog_exposition ) : 0));
+      VG_(printf)("      LAOG check: %'8lu queries, %'lu memo hits (%lu%%), "
+                  "%'lu graph changes\n",
+                  stats__laog_queries, stats__laog_memo_hits,
+                  stats__laog_queries == 0 ? 0UL
+                  : (100 * stats__laog_memo_hits) / stats__laog_queries,
+                  stats__laog_gen_changes);
+      VG_(printf)("       LAOG edge: %'8lu add requests skipped\n",
+                  stats__laog_edges_skipped);
    }
 
    VG_(printf)("           locks: %'8lu acquires, "
@@ -37,7 +37,7 @@
 #include "pub_tool_libcbase.h"
 #include "pub_tool_libcprint.h"
 #include "pub_tool_threadstate.h"
-#include "pub_tool_wordfm.h"
+#include "pub_tool_hashtable.h"
 
 #include "hg_basics.h"
 #include "hg_wordset.h"     /* self */
@@ -124,23 +124,85 @@ typedef
    } while (0)
 
 
+//------------------------------------------------------------------//
+//--- Hashed Word Cache                                          ---//
+//------------------------------------------------------------------//
+
+/* A WCache is searched linearly, so it has to stay small, which makes
+   it a poor fit for operations whose argument pairs are spread over
+   many different sets (typically union and minus on a program with
+   thousands of locks).  An HCache is a larger direct-mapped cache
+   indexed by a hash of the argument pair, so a lookup costs the same
+   whatever its size.  Each entry is tagged with the epoch of its
+   WordSetU: HG_(dieWS) bumps the epoch, which invalidates the whole
+   cache in O(1). */
+#define N_HCACHE_BITS 10
+#define N_HCACHE      (1 << N_HCACHE_BITS)
+typedef
+   struct { UWord arg1; UWord arg2; UWord res; UWord epoch; }
+   HCacheEnt;
+
+typedef
+   struct {
+      HCacheEnt ent[N_HCACHE];
+   }
+   HCache;
+
+static inline HCacheEnt* HCache_ent ( HCache* cache, UWord arg1, UWord arg2 )
+{
+   UWord h = (arg1 << 7) ^ (arg1 >> 3) ^ arg2;
+   h ^= h >> N_HCACHE_BITS;
+   return &cache->ent[h & (N_HCACHE-1)];
+}
+
+#define HCache_LOOKUP_AND_RETURN(_retty,_zzcache,_zzepoch,_zzarg1,_zzarg2) \
+   do {                                                              \
+      HCacheEnt* _e = HCache_ent((_zzcache), (UWord)(_zzarg1),       \
+                                 (UWord)(_zzarg2));                  \
+      if (_e->epoch == (_zzepoch)                                    \
+          && _e->arg1 == (UWord)(_zzarg1)                            \
+          && _e->arg2 == (UWord)(_zzarg2))                           \
+         return (_retty)_e->res;                                     \
+   } while (0)
+
+#define HCache_UPDATE(_zzcache,_zzepoch,_zzarg1,_zzarg2,_zzresult)   \
+   do {                                                              \
+      HCacheEnt* _e = HCache_ent((_zzcache), (UWord)(_zzarg1),       \
+                                 (UWord)(_zzarg2));                  \
+      _e->arg1  = (UWord)(_zzarg1);                                  \
+      _e->arg2  = (UWord)(_zzarg2);                                  \
+      _e->res   = (UWord)(_zzresult);                                \
+      _e->epoch = (_zzepoch);                                        \
+   } while (0)
+
+
 //------------------------------------------------------------------//
 //---                          WordSet                           ---//
 //---                       Implementation                       ---//
 //------------------------------------------------------------------//
 
+/* The first two fields are those of a VgHashNode, so that WordVecs
+   can be chained directly in the vec2ix hash table.  'hash' is only
+   valid once the words have been filled in and the vec has been
+   given to add_or_dealloc_WordVec. */
 typedef
-   struct {
+   struct _WordVec {
+      struct _WordVec* next; /* vec2ix hash chain */
+      UWord     hash;  /* hash of words[0 .. size-1] */
       WordSetU* owner; /* for sanity checking */
       UWord*    words;
       UWord     size; /* Really this should be SizeT */
+      WordSet   ix;   /* index in ix2vec, once interned */
    }
    WordVec;
 
 /* ix2vec[0 .. ix2vec_used-1] are pointers to the lock sets (WordVecs)
    really.  vec2ix is the inverse mapping, mapping WordVec* to the
    corresponding ix2vec entry number.  The two mappings are mutually
-   redundant. 
+   redundant.  vec2ix is a hash table keyed on the hash of the
+   WordVec content, so that interning a set costs one hash of its
+   words plus (usually) a single full comparison, rather than a
+   comparison at each level of a tree.
 
    If a WordVec WV is marked as dead by HG(dieWS), WV is removed from
    vec2ix. The entry of the dead WVs in ix2vec are used to maintain a
@@ -149,7 +211,7 @@ struct _WordSetU {
       void*     (*alloc)(const HChar*,SizeT);
       const HChar* cc;
       void      (*dealloc)(void*);
-      WordFM*   vec2ix; /* WordVec-to-WordSet mapping tree */
+      VgHashTable* vec2ix; /* WordVec-to-WordSet mapping hash table */
       WordVec** ix2vec; /* WordSet-to-WordVec mapping array */
       UWord     ix2vec_size;
       UWord     ix2vec_used;
@@ -159,7 +221,9 @@ struct _WordSetU {
       WCache    cache_addTo;
       WCache    cache_delFrom;
       WCache    cache_intersect;
-      WCache    cache_minus;
+      HCache    cache_union;
+      HCache    cache_minus;
+      UWord     epoch; /* validity tag of the HCache entries */
       /* Stats */
       UWord     n_add;
       UWord     n_add_uncached;
@@ -167,6 +231,7 @@ struct _WordSetU {
       UWord     n_del_uncached;
       UWord     n_die;
       UWord     n_union;
+      UWord     n_union_uncached;
       UWord     n_intersect;
       UWord     n_intersect_uncached;
       UWord     n_minus;
@@ -177,6 +242,8 @@ struct _WordSetU {
       UWord     n_isSingleton;
       UWord     n_anyElementOf;
       UWord     n_isSubsetOf;
+      UWord     n_intern;
+      UWord     n_intern_new;
    };
 
 /* Create a new WordVec of the given size. */
@@ -186,9 +253,12 @@ static WordVec* new_WV_of_size ( WordSetU* wsu, UWord sz )
    WordVec* wv;
    tl_assert(sz >= 0);
    wv = wsu->alloc( wsu->cc, sizeof(WordVec) );
+   wv->next = NULL;
+   wv->hash = 0;
    wv->owner = wsu;
    wv->words = NULL;
    wv->size = sz;
+   wv->ix = (WordSet)(-1);
    if (sz > 0) {
      wv->words = wsu->alloc( wsu->cc, (SizeT)sz * sizeof(UWord) );
    }
@@ -203,15 +273,29 @@ static void delete_WV ( WordVec* wv )
    }
    dealloc(wv);
 }
-static void delete_WV_for_FM ( UWord wv ) {
+static void delete_WV_for_HT ( void* wv ) {
    delete_WV( (WordVec*)wv );
 }
 
-static Word cmp_WordVecs_for_FM ( UWord wv1W, UWord wv2W )
+static UWord hash_WordVec ( const WordVec* wv )
+{
+   UWord i;
+   UWord h = wv->size;
+   for (i = 0; i < wv->size; i++) {
+      /* The words are mostly aligned pointers: fold the low zero
+         bits away before mixing. */
+      UWord w = wv->words[i];
+      h = ((h << 5) | (h >> (8 * sizeof(UWord) - 5))) ^ w ^ (w >> 4);
+   }
+   return h;
+}
+
+/* Only called by the hash table for WordVecs having the same hash. */
+static Word cmp_WordVecs_for_HT ( const void* wv1V, const void* wv2V )
 {
    UWord    i;
-   WordVec* wv1    = (WordVec*)wv1W;
-   WordVec* wv2    = (WordVec*)wv2W;
+   const WordVec* wv1 = wv1V;
+   const WordVec* wv2 = wv2V;
 
    // WordVecs with smaller size are smaller.
    if (wv1->size < wv2->size) {
@@ -309,32 +393,29 @@ static WordVec* do_ix2vec_with_dead ( WordSetU* wsu, WordSet ws )
 */
 static WordSet add_or_dealloc_WordVec( WordSetU* wsu, WordVec* wv_new )
 {
-   Bool     have;
    WordVec* wv_old;
-   UWord/*Set*/ ix_old = -1;
-   /* Really WordSet, but need something that can safely be casted to
-      a Word* in the lookupFM.  Making it WordSet (which is 32 bits)
-      causes failures on a 64-bit platform. */
    tl_assert(wv_new->owner == wsu);
-   have = VG_(lookupFM)( wsu->vec2ix, 
-                         (UWord*)&wv_old, (UWord*)&ix_old,
-                         (UWord)wv_new );
-   if (have) {
+   wsu->n_intern++;
+   wv_new->hash = hash_WordVec( wv_new );
+   wv_old = VG_(HT_gen_lookup)( wsu->vec2ix, wv_new, cmp_WordVecs_for_HT );
+   if (wv_old) {
       tl_assert(wv_old != wv_new);
-      tl_assert(wv_old);
       tl_assert(wv_old->owner == wsu);
-      tl_assert(ix_old < wsu->ix2vec_used);
-      tl_assert(wsu->ix2vec[ix_old] == wv_old);
+      tl_assert(wv_old->ix < wsu->ix2vec_used);
+      tl_assert(wsu->ix2vec[wv_old->ix] == wv_old);
       delete_WV( wv_new );
-      return (WordSet)ix_old;
-   } else if (wsu->ix2vec_free) {
+      return wv_old->ix;
+   }
+   wsu->n_intern_new++;
+   if (wsu->ix2vec_free) {
       WordSet ws;
       tl_assert(is_dead(wsu,(WordVec*)wsu->ix2vec_free));
       ws = wsu->ix2vec_free - &(wsu->ix2vec[0]);
       tl_assert(wsu->ix2vec[ws] == NULL || is_dead(wsu,wsu->ix2vec[ws]));
       wsu->ix2vec_free = (WordVec **) wsu->ix2vec[ws];
       wsu->ix2vec[ws] = wv_new;
-      VG_(addToFM)( wsu->vec2ix, (UWord)wv_new, ws );
+      wv_new->ix = ws;
+      VG_(HT_add_node)( wsu->vec2ix, wv_new );
       if (HG_DEBUG) VG_(printf)("aodW %s re-use free %d %p\n", wsu->cc, (Int)ws, wv_new );
       return ws;
    } else {
@@ -342,7 +423,8 @@ static WordSet add_or_dealloc_WordVec( WordSetU* wsu, WordVec* wv_new )
       tl_assert(wsu->ix2vec);
       tl_assert(wsu->ix2vec_used < wsu->ix2vec_size);
       wsu->ix2vec[wsu->ix2vec_used] = wv_new;
-      VG_(addToFM)( wsu->vec2ix, (Word)wv_new, (Word)wsu->ix2vec_used );
+      wv_new->ix = (WordSet)wsu->ix2vec_used;
+      VG_(HT_add_node)( wsu->vec2ix, wv_new );
       if (HG_DEBUG) VG_(printf)("aodW %s %d %p\n", wsu->cc, (Int)wsu->ix2vec_used, wv_new  );
       wsu->ix2vec_used++;
       tl_assert(wsu->ix2vec_used <= wsu->ix2vec_size);
@@ -364,8 +446,7 @@ WordSetU* HG_(newWordSetU) ( void* (*alloc_nofail)( const HChar*, SizeT ),
    wsu->alloc   = alloc_nofail;
    wsu->cc      = cc;
    wsu->dealloc = dealloc;
-   wsu->vec2ix  = VG_(newFM)( alloc_nofail, cc,
-                              dealloc, cmp_WordVecs_for_FM );
+   wsu->vec2ix  = VG_(HT_construct)( cc );
    wsu->ix2vec_used = 0;
    wsu->ix2vec_size = 0;
    wsu->ix2vec      = NULL;
@@ -373,7 +454,9 @@ WordSetU* HG_(newWordSetU) ( void* (*alloc_nofail)( const HChar*, SizeT ),
    WCache_INIT(wsu->cache_addTo,     cacheSize);
    WCache_INIT(wsu->cache_delFrom,   cacheSize);
    WCache_INIT(wsu->cache_intersect, cacheSize);
-   WCache_INIT(wsu->cache_minus,     cacheSize);
+   /* cache_union and cache_minus are zeroed by the memset above,
+      which makes all their entries stale for epoch 1. */
+   wsu->epoch   = 1;
    empty = new_WV_of_size( wsu, 0 );
    wsu->empty = add_or_dealloc_WordVec( wsu, empty );
 
@@ -384,7 +467,7 @@ void HG_(deleteWordSetU) ( WordSetU* wsu )
 {
    void (*dealloc)(void*) = wsu->dealloc;
    tl_assert(wsu->vec2ix);
-   VG_(deleteFM)( wsu->vec2ix, delete_WV_for_FM, NULL/*val-finalizer*/ );
+   VG_(HT_destruct)( wsu->vec2ix, delete_WV_for_HT );
    if (wsu->ix2vec)
       dealloc(wsu->ix2vec);
    dealloc(wsu);
@@ -458,7 +541,6 @@ void HG_(dieWS) ( WordSetU* wsu, WordSet ws )
 {
    WordVec* wv = do_ix2vec_with_dead( wsu, ws );
    WordVec* wv_in_vec2ix;
-   UWord/*Set*/ wv_ix = -1;
 
    if (HG_DEBUG) VG_(printf)("dieWS %s %d %p\n", wsu->cc, (Int)ws, wv);
 
@@ -474,20 +556,19 @@ void HG_(dieWS) ( WordSetU* wsu, WordSet ws )
    wsu->ix2vec[ws] = (WordVec*) wsu->ix2vec_free;
    wsu->ix2vec_free = &wsu->ix2vec[ws];
 
-   VG_(delFromFM) ( wsu->vec2ix, 
-                    (UWord*)&wv_in_vec2ix, (UWord*)&wv_ix,
-                    (UWord)wv );
+   wv_in_vec2ix = VG_(HT_gen_remove) ( wsu->vec2ix, wv, cmp_WordVecs_for_HT );
 
-   if (HG_DEBUG) VG_(printf)("dieWS wv_ix %d\n", (Int)wv_ix);
-   tl_assert (wv_ix);
-   tl_assert (wv_ix == ws);
+   if (HG_DEBUG) VG_(printf)("dieWS wv_ix %d\n", (Int)wv->ix);
+   tl_assert (wv_in_vec2ix == wv);
+   tl_assert (wv->ix);
+   tl_assert (wv->ix == ws);
 
    delete_WV( wv );
 
    wsu->cache_addTo.inUse = 0;
    wsu->cache_delFrom.inUse = 0;
    wsu->cache_intersect.inUse = 0;
-   wsu->cache_minus.inUse = 0;
+   wsu->epoch++;
 }
 
 Bool HG_(plausibleWS) ( WordSetU* wsu, WordSet ws )
@@ -585,7 +666,8 @@ void HG_(ppWSUstats) ( WordSetU* wsu, const HChar* name )
                wsu->n_add, wsu->n_add_uncached);
    VG_(printf)("      delFrom      %10lu (%lu uncached)\n", 
                wsu->n_del, wsu->n_del_uncached);
-   VG_(printf)("      union        %10lu\n", wsu->n_union);
+   VG_(printf)("      union        %10lu (%lu uncached)\n",
+               wsu->n_union, wsu->n_union_uncached);
    VG_(printf)("      intersect    %10lu (%lu uncached) "
                "[nb. incl isSubsetOf]\n", 
                wsu->n_intersect, wsu->n_intersect_uncached);
@@ -598,6 +680,8 @@ void HG_(ppWSUstats) ( WordSetU* wsu, const HChar* name )
    VG_(printf)("      anyElementOf %10lu\n",   wsu->n_anyElementOf);
    VG_(printf)("      isSubsetOf   %10lu\n",   wsu->n_isSubsetOf);
    VG_(printf)("      dieWS        %10lu\n",   wsu->n_die);
+   VG_(printf)("      intern       %10lu (%lu new)\n",
+               wsu->n_intern, wsu->n_intern_new);
 }
 
 WordSet HG_(addToWS) ( WordSetU* wsu, WordSet ws, UWord w )
@@ -695,10 +779,29 @@ WordSet HG_(delFromWS) ( WordSetU* wsu, WordSet ws, UWord w )
 WordSet HG_(unionWS) ( WordSetU* wsu, WordSet ws1, WordSet ws2 )
 {
    UWord    i1, i2, k, sz;
+   WordSet  ws_new;
    WordVec* wv_new;
-   WordVec* wv1 = do_ix2vec( wsu, ws1 );
-   WordVec* wv2 = do_ix2vec( wsu, ws2 );
+   WordVec* wv1;
+   WordVec* wv2;
+
    wsu->n_union++;
+
+   /* Deal with the obvious cases fast. */
+   if (ws1 == ws2 || ws2 == wsu->empty)
+      return ws1;
+   if (ws1 == wsu->empty)
+      return ws2;
+
+   /* union is commutative: canonicalise the query, as for intersect. */
+   if (ws1 > ws2) {
+      WordSet wst = ws1; ws1 = ws2; ws2 = wst;
+   }
+
+   HCache_LOOKUP_AND_RETURN(WordSet, &wsu->cache_union, wsu->epoch, ws1, ws2);
+   wsu->n_union_uncached++;
+
+   wv1 = do_ix2vec( wsu, ws1 );
+   wv2 = do_ix2vec( wsu, ws2 );
    sz = 0;
    i1 = i2 = 0;
    while (1) {
@@ -759,7 +862,10 @@ WordSet HG_(unionWS) ( WordSetU* wsu, WordSet ws1, WordSet ws2 )
 
    tl_assert(k == sz);
 
-   return add_or_dealloc_WordVec( wsu, wv_new );
+   ws_new = add_or_dealloc_WordVec( wsu, wv_new );
+   HCache_UPDATE(&wsu->cache_union, wsu->epoch, ws1, ws2, ws_new);
+
+   return ws_new;
 }
 
 WordSet HG_(intersectWS) ( WordSetU* wsu, WordSet ws1, WordSet ws2 )
@@ -852,7 +958,7 @@ WordSet HG_(minusWS) ( WordSetU* wsu, WordSet ws1, WordSet ws2 )
    WordVec* wv2;
    
    wsu->n_minus++;
-   WCache_LOOKUP_AND_RETURN(WordSet, wsu->cache_minus, ws1, ws2);
+   HCache_LOOKUP_AND_RETURN(WordSet, &wsu->cache_minus, wsu->epoch, ws1, ws2);
    wsu->n_minus_uncached++;
 
    wv1 = do_ix2vec( wsu, ws1 );
@@ -914,7 +1020,7 @@ WordSet HG_(minusWS) ( WordSetU* wsu, WordSet ws1, WordSet ws2 )
    }
 
    tl_assert(ws_new != (WordSet)(-1));
-   WCache_UPDATE(wsu->cache_minus, ws1, ws2, ws_new);
+   HCache_UPDATE(&wsu->cache_minus, wsu->epoch, ws1, ws2, ws_new);
 
    return ws_new;
 }
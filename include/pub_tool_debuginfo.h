@@ -280,6 +280,13 @@ const HChar*  VG_(DebugInfo_get_soname)      ( const DebugInfo *di );
 const HChar*  VG_(DebugInfo_get_filename)    ( const DebugInfo *di );
 PtrdiffT      VG_(DebugInfo_get_text_bias)   ( const DebugInfo *di );
 
+/* returns the "generation" of the debug info.
+   Each time some debuginfo is changed (e.g. loaded or unloaded),
+   the VG_(debuginfo_generation)() value returned will be increased.
+   This can be used to flush cached information derived from debug
+   info (e.g. CFI info or FPO info or ...). */
+extern UInt VG_(debuginfo_generation) (void);
+
 /* Function for traversing the DebugInfo list.  When called with NULL
    it returns the first element; otherwise it returns the given
    element's successor.  Note that the order of elements in the list
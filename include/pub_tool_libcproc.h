@@ -69,6 +69,10 @@ extern Int  VG_(waitpid)( Int pid, Int *status, Int options );
 extern Int  VG_(system) ( const HChar* cmd );
 extern Int  VG_(spawn)  ( const HChar *filename, const HChar **argv );
 extern Int  VG_(fork)   ( void);
+/* Fork a helper process that the client cannot see or reap, see
+   m_libcproc.c.  Returns -1 where this is not supported. */
+extern Int  VG_(fork_hidden)   ( void );
+extern Int  VG_(waitpid_hidden)( Int pid, Int *status );
 extern void VG_(execv)  ( const HChar* filename, const HChar** argv );
 extern Int  VG_(sysctl) ( Int *name, UInt namelen, void *oldp, SizeT *oldlenp, const void *newp, SizeT newlen );
 
@@ -81,6 +85,11 @@ extern Int VG_(setrlimit) ( Int resource, const struct vki_rlimit *rlim );
 extern Int VG_(prctl) (Int option, 
                        ULong arg2, ULong arg3, ULong arg4, ULong arg5);
 
+/* Sets the low bit of vec[i] if the i-th page of [start, start+len) is
+   resident in memory.  start must be page aligned.  Returns -1 if this
+   fails, or is not supported on this platform. */
+extern Int VG_(mincore) ( Addr start, SizeT len, UChar* vec );
+
 /* ---------------------------------------------------------------------
    pids, etc
    ------------------------------------------------------------------ */
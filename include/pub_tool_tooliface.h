@@ -660,7 +660,8 @@ void VG_(track_copy_reg_to_mem)(void(*f)(CorePart part, ThreadId tid,
    client blocks.  Obviously though, a thread must hold the lock in
    order to run client code blocks, so the times bracketed by
    'start_client_code'..'stop_client_code' are a subset of the times
-   when thread 'tid' holds the cpu lock.
+   when thread 'tid' holds the cpu lock.  'start_client_code' may call
+   VG_(discard_translations_safely).
 */
 void VG_(track_start_client_code)(
         void(*f)(ThreadId tid, ULong blocks_dispatched)
@@ -203,6 +203,10 @@ extern MsFile* VG_(XT_massif_open)(const HChar* outfilename,
 
 extern void VG_(XT_massif_close)(MsFile* fp);
 
+/* Writes out what was printed in fp so far, and returns the size
+   of the file. */
+extern ULong VG_(XT_massif_flush)(MsFile* fp);
+
 typedef 
    struct {
       int snapshot_n; // starting at 0.
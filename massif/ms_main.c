@@ -162,6 +162,7 @@ Number of snapshots: 50
 #include "pub_tool_mallocfree.h"
 #include "pub_tool_options.h"
 #include "pub_tool_poolalloc.h"
+#include "pub_tool_rangemap.h"
 #include "pub_tool_replacemalloc.h"
 #include "pub_tool_stacktrace.h"
 #include "pub_tool_threadstate.h"
@@ -364,6 +365,7 @@ static Bool   clo_heap            = True;
    // word-sized type -- it ended up with a value of 4.2 billion.  Sigh.
 static SSizeT clo_heap_admin      = 8;
 static Bool   clo_pages_as_heap   = False;
+static Bool   clo_pages_resident  = False;
 static Bool   clo_stacks          = False;
 static Int    clo_depth           = 30;
 static double clo_threshold       = 1.0;  // percentage
@@ -372,6 +374,9 @@ static Int    clo_time_unit       = TimeI;
 static Int    clo_detailed_freq   = 10;
 static Int    clo_max_snapshots   = 100;
 static const HChar* clo_massif_out_file = "massif.out.%p";
+static Bool   clo_stream_snapshots = False;
+static Long   clo_stream_interval  = 0;   // 0 means default_stream_interval()
+static Long   clo_stream_rotate_size = 0; // in MB, 0 means no rotation
 
 static XArray* args_for_massif;
 
@@ -388,6 +393,7 @@ static Bool ms_process_cmd_line_option(const HChar* arg)
    else if VG_BOOL_CLO(arg, "--stacks",         clo_stacks) {}
 
    else if VG_BOOL_CLO(arg, "--pages-as-heap",  clo_pages_as_heap) {}
+   else if VG_BOOL_CLO(arg, "--pages-resident", clo_pages_resident) {}
 
    else if VG_BINT_CLO(arg, "--depth",          clo_depth, 1, MAX_DEPTH) {}
 
@@ -417,6 +423,12 @@ static Bool ms_process_cmd_line_option(const HChar* arg)
 
    else if VG_STR_CLO(arg, "--massif-out-file", clo_massif_out_file) {}
 
+   else if VG_BOOL_CLO(arg, "--stream-snapshots", clo_stream_snapshots) {}
+   else if VG_BINT_CLO(arg, "--stream-interval",  clo_stream_interval,
+                       0, 1LL << 60) {}
+   else if VG_BINT_CLO(arg, "--stream-rotate-size", clo_stream_rotate_size,
+                       0, 1LL << 30) {}
+
    else
       return VG_(replacement_malloc_process_cmd_line_option)(arg);
 
@@ -431,6 +443,9 @@ static void ms_print_usage(void)
 "                               ignored if --heap=no [8]\n"
 "    --stacks=no|yes           profile stack(s) [no]\n"
 "    --pages-as-heap=no|yes    profile memory at the page level [no]\n"
+"    --pages-resident=no|yes   with --pages-as-heap=yes, report the resident\n"
+"                              pages as useful heap, and the mapped but\n"
+"                              not resident ones as extra heap [no]\n"
 "    --depth=<number>          depth of contexts [30]\n"
 "    --alloc-fn=<name>         specify <name> as an alloc function [empty]\n"
 "    --ignore-fn=<name>        ignore heap allocations within <name> [empty]\n"
@@ -441,6 +456,13 @@ static void ms_print_usage(void)
 "    --detailed-freq=<N>       every Nth snapshot should be detailed [10]\n"
 "    --max-snapshots=<N>       maximum number of snapshots recorded [100]\n"
 "    --massif-out-file=<file>  output file name [massif.out.%%p]\n"
+"    --stream-snapshots=no|yes append each snapshot to the output file when\n"
+"                              it is taken, instead of culling them [no]\n"
+"    --stream-interval=<n>     time between streamed snapshots, in units\n"
+"                              of --time-unit; 0 means 100M instructions,\n"
+"                              1000 ms or 100MB alloc'd/dealloc'd [0]\n"
+"    --stream-rotate-size=<MB> start a new output file when it exceeds\n"
+"                              this size; 0 means never [0]\n"
    );
 }
 
@@ -931,6 +953,62 @@ static Time get_time(void)
    }
 }
 
+// With --pages-as-heap=yes, the mapped memory is tracked as ranges of
+// pages rather than as one block per page, so that mapping or unmapping
+// N pages costs one stack trace and one XTree update rather than N.
+// page_map maps each address to 0 if it is not mapped, or to 1 + the
+// heap_xt Xecu of the place where it was mapped.  Adjacent ranges
+// mapped at the same place are merged.
+static RangeMap* page_map = NULL;
+
+// With --pages-resident=yes, the residency of the mapped pages is sampled
+// when a snapshot is taken, using mincore.  Returns the number of bytes
+// resident in the mapped pages that are not ignored.  If nonres_xa is not
+// NULL, the non resident bytes are subtracted from heap_xt, and each
+// (Xecu, bytes) subtracted is added to nonres_xa, so that the caller can
+// snapshot heap_xt with resident bytes only, and restore it after.
+typedef struct { Xecu where; SizeT szB; } NonResident;
+
+static SizeT measure_resident_pages(XArray* nonres_xa)
+{
+#  define MINCORE_PAGES 4096
+   static UChar vec[MINCORE_PAGES];
+   UInt   i, n_ranges = VG_(sizeRangeMap)(page_map);
+   UWord  key_min, key_max, val;
+   SizeT  resident_szB = 0;
+
+   for (i = 0; i < n_ranges; i++) {
+      Addr  a;
+      SizeT range_res_szB = 0;
+      VG_(indexRangeMap)(&key_min, &key_max, &val, page_map, i);
+      if (val == 0 || VG_(XT_n_ips_sel)(heap_xt, val - 1) == 0)
+         continue;
+      for (a = key_min; a < key_max; a += MINCORE_PAGES * VKI_PAGE_SIZE) {
+         SizeT len = key_max - a + 1;
+         UInt  n_pages, j;
+         if (len > MINCORE_PAGES * VKI_PAGE_SIZE)
+            len = MINCORE_PAGES * VKI_PAGE_SIZE;
+         n_pages = len / VKI_PAGE_SIZE;
+         // Pages that cannot be queried count as not resident.
+         if (VG_(mincore)(a, len, vec) != 0)
+            continue;
+         for (j = 0; j < n_pages; j++)
+            if (vec[j] & 1)
+               range_res_szB += VKI_PAGE_SIZE;
+      }
+      resident_szB += range_res_szB;
+      if (nonres_xa != NULL && range_res_szB < key_max - key_min + 1) {
+         NonResident nr;
+         nr.where = val - 1;
+         nr.szB = key_max - key_min + 1 - range_res_szB;
+         VG_(XT_sub_from_xecu)(heap_xt, nr.where, &nr.szB);
+         VG_(addToXA)(nonres_xa, &nr);
+      }
+   }
+   return resident_szB;
+#  undef MINCORE_PAGES
+}
+
 // Take a snapshot, and only that -- decisions on whether to take a
 // snapshot, or what kind of snapshot, are made elsewhere.
 // Nb: we call the arg "my_time" because "time" shadows a global declaration
@@ -945,7 +1023,27 @@ take_snapshot(Snapshot* snapshot, SnapshotKind kind, Time my_time,
    }
 
    // Heap and heap admin.
-   if (clo_heap) {
+   if (clo_pages_resident) {
+      // Resident pages, and mapped but not resident pages.
+      XArray* nonres_xa = NULL;
+      SizeT   resident_szB;
+      Word    i;
+      if (is_detailed)
+         nonres_xa = VG_(newXA)(VG_(malloc), "ms.main.ts.1", VG_(free),
+                                sizeof(NonResident));
+      resident_szB = measure_resident_pages(nonres_xa);
+      tl_assert(resident_szB <= heap_szB);
+      snapshot->heap_szB = resident_szB;
+      snapshot->heap_extra_szB = heap_extra_szB + heap_szB - resident_szB;
+      if (is_detailed) {
+         snapshot->xt = VG_(XT_snapshot)(heap_xt);
+         for (i = 0; i < VG_(sizeXA)(nonres_xa); i++) {
+            NonResident* nr = VG_(indexXA)(nonres_xa, i);
+            VG_(XT_add_to_xecu)(heap_xt, nr->where, &nr->szB);
+         }
+         VG_(deleteXA)(nonres_xa);
+      }
+   } else if (clo_heap) {
       snapshot->heap_szB = heap_szB;
       if (is_detailed) {
          snapshot->xt = VG_(XT_snapshot)(heap_xt);
@@ -970,6 +1068,18 @@ take_snapshot(Snapshot* snapshot, SnapshotKind kind, Time my_time,
 }
 
 
+static void stream_snapshot(Snapshot* snapshot);
+
+static Time default_stream_interval(void)
+{
+   switch (clo_time_unit) {
+   case TimeI:  return 100*1000*1000;
+   case TimeMS: return 1000;
+   case TimeB:  return 100*1024*1024;
+   default:     tl_assert2(0, "bad --time-unit value");
+   }
+}
+
 // Take a snapshot, if it's time, or if we've hit a peak.
 static void
 maybe_take_snapshot(SnapshotKind kind, const HChar* what)
@@ -986,6 +1096,7 @@ maybe_take_snapshot(SnapshotKind kind, const HChar* what)
    static Int  n_skipped_snapshots_since_last_snapshot = 0;
 
    Snapshot* snapshot;
+   Snapshot  streamed_snapshot;
    Bool      is_detailed;
    // Nb: we call this variable "my_time" because "time" shadows a global
    // declaration in /usr/include/time.h on Darwin.
@@ -1022,8 +1133,14 @@ maybe_take_snapshot(SnapshotKind kind, const HChar* what)
       tl_assert2(0, "maybe_take_snapshot: unrecognised snapshot kind");
    }
 
-   // Take the snapshot.
-   snapshot = & snapshots[next_snapshot_i];
+   // Take the snapshot.  When streaming, it is written out straight away
+   // rather than being kept in the snapshots array.
+   if (clo_stream_snapshots) {
+      snapshot = &streamed_snapshot;
+      clear_snapshot(snapshot, /*do_sanity_check*/False);
+   } else {
+      snapshot = & snapshots[next_snapshot_i];
+   }
    take_snapshot(snapshot, kind, my_time, is_detailed);
 
    // Record if it was detailed.
@@ -1045,6 +1162,8 @@ maybe_take_snapshot(SnapshotKind kind, const HChar* what)
       peak_snapshot_total_szB = snapshot_total_szB;
 
       // Find the old peak snapshot, if it exists, and mark it as normal.
+      // (A streamed peak snapshot is already written out:  ms_print
+      // takes the last one of the file as the peak.)
       for (i = 0; i < next_snapshot_i; i++) {
          if (Peak == snapshots[i].kind) {
             snapshots[i].kind = Normal;
@@ -1060,9 +1179,19 @@ maybe_take_snapshot(SnapshotKind kind, const HChar* what)
          n_skipped_snapshots_since_last_snapshot,
          ( 1 == n_skipped_snapshots_since_last_snapshot ? "" : "s") );
    }
-   VERB_snapshot(2, what, next_snapshot_i);
    n_skipped_snapshots_since_last_snapshot = 0;
 
+   if (clo_stream_snapshots) {
+      VERB(2, "%s streamed snapshot (t:%lld)\n", what, my_time);
+      stream_snapshot(snapshot);
+      delete_snapshot(snapshot);
+      earliest_possible_time_of_next_snapshot = my_time
+         + (clo_stream_interval > 0 ? clo_stream_interval
+                                    : default_stream_interval());
+      return;
+   }
+   VERB_snapshot(2, what, next_snapshot_i);
+
    // Cull the entries, if our snapshot table is full.
    next_snapshot_i++;
    if (clo_max_snapshots == next_snapshot_i) {
@@ -1123,7 +1252,8 @@ static void update_alloc_stats(SSizeT szB_delta)
    total_allocs_deallocs_szB += szB_delta;
 }
 
-static void update_heap_stats(SSizeT heap_szB_delta, Int heap_extra_szB_delta)
+static void update_heap_stats(SSizeT heap_szB_delta,
+                              SSizeT heap_extra_szB_delta)
 {
    if (heap_szB_delta < 0)
       tl_assert(heap_szB >= -heap_szB_delta);
@@ -1464,38 +1594,89 @@ static SizeT ms_malloc_usable_size ( ThreadId tid, void* p )
 //--- Page handling                                        ---//
 //------------------------------------------------------------//
 
+static SizeT page_admin_szB(SizeT len)
+{
+   return clo_heap_admin * (len / VKI_PAGE_SIZE);
+}
+
+static
+void unrecord_page_range( Addr a, SizeT len, Bool maybe_snapshot )
+{
+   UWord key_min, key_max, val;
+   Addr  last = a + len - 1;
+   Addr  cur  = a;
+   Bool  any  = False;
+
+   while (True) {
+      VG_(lookupRangeMap)(&key_min, &key_max, &val, page_map, cur);
+      if (val != 0) {
+         Xecu  where = val - 1;
+         SizeT szB   = (key_max < last ? key_max : last) - cur + 1;
+         VERB(3, "<<< unrecord_page_range (%#lx, %lu)\n", cur, szB);
+         if (VG_(XT_n_ips_sel)(heap_xt, where) > 0) {
+            n_heap_frees++;
+            // This might be the peak, so maybe do a snapshot first.
+            if (maybe_snapshot && !any) {
+               maybe_take_snapshot(Peak, "de-PEAK");
+            }
+            any = True;
+            update_heap_stats(-szB, -page_admin_szB(szB));
+            sub_heap_xt(where, szB, /*exclude_first_entry*/False);
+         } else {
+            n_ignored_heap_frees++;
+            VERB(3, "(ignored)\n");
+         }
+         VERB(3, ">>>\n");
+      }
+      if (key_max >= last)
+         break;
+      cur = key_max + 1;
+   }
+   VG_(bindRangeMap)(page_map, a, last, 0);
+
+   if (maybe_snapshot && any) {
+      maybe_take_snapshot(Normal, "dealloc");
+   }
+}
+
 static
 void ms_record_page_mem ( Addr a, SizeT len )
 {
    ThreadId tid = VG_(get_running_tid)();
-   Addr end;
+   Xecu where;
    tl_assert(VG_IS_PAGE_ALIGNED(len));
    tl_assert(len >= VKI_PAGE_SIZE);
-   // Record the first N-1 pages as blocks, but don't do any snapshots.
-   for (end = a + len - VKI_PAGE_SIZE; a < end; a += VKI_PAGE_SIZE) {
-      record_block( tid, (void*)a, VKI_PAGE_SIZE, /*slop_szB*/0,
-                    /*exclude_first_entry*/False, /*maybe_snapshot*/False );
+
+   // Some startup segments do not start on a page boundary: track the
+   // whole pages.
+   len = VG_PGROUNDUP(a + len) - VG_PGROUNDDN(a);
+   a = VG_PGROUNDDN(a);
+
+   // The range can replace existing mappings (e.g. MAP_FIXED).
+   unrecord_page_range(a, len, /*maybe_snapshot*/False);
+
+   VERB(3, "<<< record_page_mem (%#lx, %lu)\n", a, len);
+   where = add_heap_xt(tid, len, /*exclude_first_entry*/False);
+   VG_(bindRangeMap)(page_map, a, a + len - 1, 1 + (UWord)where);
+   if (VG_(XT_n_ips_sel)(heap_xt, where) > 0) {
+      n_heap_allocs++;
+      update_heap_stats(len, page_admin_szB(len));
+      maybe_take_snapshot(Normal, "  alloc");
+   } else {
+      n_ignored_heap_allocs++;
+      VERB(3, "(ignored)\n");
    }
-   // Record the last page as a block, and maybe do a snapshot afterwards.
-   record_block( tid, (void*)a, VKI_PAGE_SIZE, /*slop_szB*/0,
-                 /*exclude_first_entry*/False, /*maybe_snapshot*/True );
+   VERB(3, ">>>\n");
 }
 
 static
 void ms_unrecord_page_mem( Addr a, SizeT len )
 {
-   Addr end;
    tl_assert(VG_IS_PAGE_ALIGNED(len));
    tl_assert(len >= VKI_PAGE_SIZE);
-   // Unrecord the first page. This might be the peak, so do a snapshot.
-   unrecord_block((void*)a, /*maybe_snapshot*/True,
-                  /*exclude_first_entry*/False);
-   a += VKI_PAGE_SIZE;
-   // Then unrecord the remaining pages, but without snapshots.
-   for (end = a + len - VKI_PAGE_SIZE; a < end; a += VKI_PAGE_SIZE) {
-      unrecord_block((void*)a, /*maybe_snapshot*/False,
-                     /*exclude_first_entry*/False);
-   }
+   len = VG_PGROUNDUP(a + len) - VG_PGROUNDDN(a);
+   a = VG_PGROUNDDN(a);
+   unrecord_page_range(a, len, /*maybe_snapshot*/True);
 }
 
 //------------------------------------------------------------//
@@ -1825,6 +2006,78 @@ static void write_snapshots_to_file(const HChar* massif_out_file,
    VG_(XT_massif_close) (fp);
 }
 
+// Streamed snapshots are written to the output file as they are taken,
+// and the file is flushed after each one, so that it is usable while the
+// program runs or if it dies.  The snapshots are numbered from 0 in each
+// file.  With --stream-rotate-size, once the file grows above the given
+// size, the next snapshots go to a new file, named after the output file
+// with a ".1", ".2", ... suffix.
+static MsFile* stream_fp            = NULL;
+static HChar*  stream_file_name     = NULL;   // Expanded --massif-out-file.
+static UInt    stream_file_n        = 0;      // Number of rotations.
+static Int     stream_snapshot_n    = 0;      // Next snapshot number.
+static Bool    stream_open_failed   = False;
+
+static void stream_open(void)
+{
+   HChar* filename;
+
+   // See write_snapshots_array_to_file about expanding the name late.
+   if (stream_file_name == NULL)
+      stream_file_name =
+         VG_(expand_file_name)("--massif-out-file", clo_massif_out_file);
+   if (stream_file_n == 0) {
+      filename = stream_file_name;
+   } else {
+      filename = VG_(malloc)("ms.main.so.1",
+                             VG_(strlen)(stream_file_name) + 12);
+      VG_(sprintf)(filename, "%s.%u", stream_file_name, stream_file_n);
+   }
+   stream_fp = VG_(XT_massif_open)(filename,
+                                   NULL,
+                                   args_for_massif,
+                                   TimeUnit_to_string(clo_time_unit));
+   if (stream_fp == NULL)
+      stream_open_failed = True; // Error reported by VG_(XT_massif_open)
+   if (filename != stream_file_name)
+      VG_(free)(filename);
+   stream_snapshot_n = 0;
+}
+
+static void stream_snapshot(Snapshot* snapshot)
+{
+   ULong size;
+
+   if (stream_fp == NULL && !stream_open_failed)
+      stream_open();
+   if (stream_fp == NULL)
+      return;
+
+   pp_snapshot(stream_fp, snapshot, stream_snapshot_n++);
+   size = VG_(XT_massif_flush)(stream_fp);
+   if (clo_stream_rotate_size > 0
+       && size >= (ULong)clo_stream_rotate_size * 1024 * 1024) {
+      VG_(XT_massif_close)(stream_fp);
+      stream_fp = NULL;
+      stream_file_n++;
+   }
+}
+
+// The child of a fork must not append to the file of its parent:  it
+// starts its own file, named with its own pid if --massif-out-file
+// contains %p.
+static void stream_atfork_child(ThreadId tid)
+{
+   if (stream_fp != NULL)
+      VG_(XT_massif_close)(stream_fp);  // Nothing buffered, see above.
+   stream_fp = NULL;
+   if (stream_file_name != NULL)
+      VG_(free)(stream_file_name);
+   stream_file_name = NULL;
+   stream_file_n = 0;
+   stream_open_failed = False;
+}
+
 static void write_snapshots_array_to_file(void)
 {
    // Setup output filename.  Nb: it's important to do this now, ie. as late
@@ -1867,14 +2120,39 @@ static void handle_all_snapshots_monitor_command (const HChar *filename)
          ("error: cannot take snapshot before execution has started\n");
       return;
    }
+   if (clo_stream_snapshots) {
+      VG_(gdb_printf)
+         ("error: snapshots are streamed to the output file"
+          " with --stream-snapshots=yes\n");
+      return;
+   }
 
    write_snapshots_to_file ((filename == NULL) ? 
                             "massif.vgdb.out" : filename,
                             snapshots, next_snapshot_i);
 }
 
+// Index of the next page_map range reported, with --pages-as-heap=yes.
+static UInt xtmemory_page_range_i;
+
 static void xtmemory_report_next_block(XT_Allocs* xta, ExeContext** ec_alloc)
 {
+   if (clo_pages_as_heap) {
+      UWord key_min, key_max, val;
+      while (xtmemory_page_range_i < VG_(sizeRangeMap)(page_map)) {
+         VG_(indexRangeMap)(&key_min, &key_max, &val, page_map,
+                            xtmemory_page_range_i++);
+         if (val != 0) {
+            xta->nbytes = key_max - key_min + 1;
+            xta->nblocks = 1;
+            *ec_alloc = VG_(XT_get_ec_from_xecu)(heap_xt, val - 1);
+            return;
+         }
+      }
+      xta->nblocks = 0;
+      return;
+   }
+
    const HP_Chunk* hc = VG_(HT_Next)(malloc_list);
    if (hc) {
       xta->nbytes = hc->req_szB;
@@ -1887,6 +2165,7 @@ static void ms_xtmemory_report ( const HChar* filename, Bool fini )
 { 
    // Make xtmemory_report_next_block ready to be called.
    VG_(HT_ResetIter)(malloc_list);
+   xtmemory_page_range_i = 0;
    VG_(XTMemory_report)(filename, fini, xtmemory_report_next_block,
                         VG_(XT_filter_maybe_below_main));
    /* As massif already filters one top function, use as filter
@@ -1959,6 +2238,8 @@ static void ms_print_stats (void)
    STATS("detailed snapshots:    %u\n", n_detailed_snapshots);
    STATS("peak snapshots:        %u\n", n_peak_snapshots);
    STATS("cullings:              %u\n", n_cullings);
+   if (clo_stream_snapshots)
+      STATS("streamed files:        %u\n", stream_file_n + 1);
 #undef STATS
 }
 
@@ -1972,7 +2253,13 @@ static void ms_fini(Int exit_status)
    ms_xtmemory_report(VG_(clo_xtree_memory_file), True);
 
    // Output.
-   write_snapshots_array_to_file();
+   if (clo_stream_snapshots) {
+      if (stream_fp != NULL)
+         VG_(XT_massif_close)(stream_fp);
+      stream_fp = NULL;
+   } else {
+      write_snapshots_array_to_file();
+   }
 
    if (VG_(clo_stats))
       ms_print_stats();
@@ -2004,6 +2291,19 @@ static void ms_post_clo_init(void)
    if (!clo_heap) {
       clo_pages_as_heap = False;
    }
+   if (clo_pages_resident) {
+      UChar vec;
+      if (!clo_pages_as_heap) {
+         VG_(fmsg_bad_option)("--pages-resident=yes",
+            "Can only be used together with --pages-as-heap=yes");
+         VG_(exit)(1);
+      }
+      if (VG_(mincore)(VG_PGROUNDDN((Addr)&vec), VKI_PAGE_SIZE, &vec) != 0) {
+         VG_(fmsg_bad_option)("--pages-resident=yes",
+            "Not supported on this platform");
+         VG_(exit)(1);
+      }
+   }
 
    // If --pages-as-heap=yes we don't want malloc replacement to occur.  So we
    // disable vgpreload_massif-$PLATFORM.so by removing it from LD_PRELOAD (or
@@ -2072,6 +2372,8 @@ static void ms_post_clo_init(void)
    }
 
    if (clo_pages_as_heap) {
+      page_map = VG_(newRangeMap)(VG_(malloc), "ms.main.mpoci.2",
+                                  VG_(free), 0);
       VG_(track_new_mem_startup) ( ms_new_mem_startup );
       VG_(track_new_mem_brk)     ( ms_new_mem_brk     );
       VG_(track_new_mem_mmap)    ( ms_new_mem_mmap    );
@@ -2092,6 +2394,9 @@ static void ms_post_clo_init(void)
    }
    sanity_check_snapshots_array();
 
+   if (clo_stream_snapshots)
+      VG_(atfork)(NULL/*pre*/, NULL/*parent*/, stream_atfork_child);
+
    if (VG_(clo_xtree_memory) == Vg_XTMemory_Full)
       // Activate full xtree memory profiling.
       // As massif already filters one top function, use as filter
@@ -0,0 +1,41 @@
+// Stack traces taken with --shadow-stack=yes must be the same as the
+// unwound ones, also after a longjmp out of a recursion, and in a signal
+// handler.
+
+#include <setjmp.h>
+#include <signal.h>
+#include <stdlib.h>
+
+static jmp_buf jb;
+static volatile int do_jump = 1;
+
+__attribute__((noinline)) void a3(int n) { malloc(n); }
+__attribute__((noinline)) void a2(int n) { a3(n); }
+__attribute__((noinline)) void a1(int n) { a2(n); }
+
+__attribute__((noinline)) void recurse(int depth)
+{
+   if (depth > 0)
+      recurse(depth - 1);
+   else if (do_jump)
+      longjmp(jb, 1);
+   a3(16);   // not reached
+}
+
+static void handler(int sig)
+{
+   a1(800);
+}
+
+int main(void)
+{
+   a1(400);
+   if (setjmp(jb) == 0)
+      recurse(100);
+   a1(1200);
+   a2(1600);
+   signal(SIGUSR1, handler);
+   raise(SIGUSR1);
+   a2(2000);
+   return 0;
+}
@@ -0,0 +1,78 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// segments simulates a pool of worker threads that synchronise very often
+// on a set of mutexes, each critical section touching a small part of a
+// shared array.  Every lock/unlock pair ends a segment, so under DRD this
+// measures the cost of creating segments and of the conflict set updates
+// that go with them (segments per second = nr_thr * nr_iter * 2 / time).
+//
+// usage: segments [-t nr_thr default 4] [-i nr_iter default 20000]
+//                 [-m nr_mutex default 16] [-s stride default 64]
+
+#define MAX_THR 64
+#define ARRAY_SIZE (1024 * 1024)
+
+static int nr_thr = 4;
+static int nr_iter = 20000;
+static int nr_mutex = 16;
+static int stride = 64;
+
+static pthread_mutex_t* mutex;
+static unsigned char* shared;
+
+static void* worker(void* arg)
+{
+   const int me = (int)(long)arg;
+   unsigned int seed = me;
+   int i;
+
+   for (i = 0; i < nr_iter; i++) {
+      const int m = (i + me) % nr_mutex;
+      const int chunk = ARRAY_SIZE / nr_mutex;
+      int j;
+
+      seed = seed * 1103515245 + 12345;
+      pthread_mutex_lock(&mutex[m]);
+      for (j = (seed >> 8) % stride; j < chunk; j += chunk / 8)
+         shared[m * chunk + j]++;
+      pthread_mutex_unlock(&mutex[m]);
+   }
+   return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+   pthread_t thr[MAX_THR];
+   int a, i;
+
+   for (a = 1; a + 1 < argc; a += 2) {
+      if      (strcmp(argv[a], "-t") == 0) nr_thr   = atoi(argv[a+1]);
+      else if (strcmp(argv[a], "-i") == 0) nr_iter  = atoi(argv[a+1]);
+      else if (strcmp(argv[a], "-m") == 0) nr_mutex = atoi(argv[a+1]);
+      else if (strcmp(argv[a], "-s") == 0) stride   = atoi(argv[a+1]);
+      else printf("unknown arg %s\n", argv[a]);
+   }
+   if (nr_thr < 1) nr_thr = 1;
+   if (nr_thr > MAX_THR) nr_thr = MAX_THR;
+   if (nr_mutex < 1) nr_mutex = 1;
+   if (stride < 1) stride = 1;
+
+   mutex = malloc(nr_mutex * sizeof(*mutex));
+   shared = calloc(ARRAY_SIZE, 1);
+   for (i = 0; i < nr_mutex; i++)
+      pthread_mutex_init(&mutex[i], NULL);
+
+   for (i = 0; i < nr_thr; i++)
+      pthread_create(&thr[i], NULL, worker, (void*)(long)i);
+   for (i = 0; i < nr_thr; i++)
+      pthread_join(thr[i], NULL);
+
+   for (i = 0; i < nr_mutex; i++)
+      pthread_mutex_destroy(&mutex[i]);
+   free(shared);
+   free(mutex);
+   return 0;
+}